@@ -0,0 +1,48 @@
+/**
+ * @file batch.h
+ * @brief Batch processing of many session directories
+ *
+ * This header file contains the definition of the batch scheduler. A batch is given as a
+ * root directory whose subdirectories are sessions or as a text file listing one session
+ * path per line. Sessions run concurrently in child processes, so a failing session does
+ * not abort the others. A session is only started while the estimated memory of all
+ * running sessions stays within the global budget and its device has a free I/O slot.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "processing.h"
+
+typedef struct {
+    unsigned int maxSessions;       // Sessions processed at the same time
+    size_t memoryBudgetMB;          // Estimated memory all running sessions may use together
+    unsigned int sessionsPerDevice; // Sessions reading from and writing to one device at the same time
+} BatchOptions;
+
+/**
+ * Estimate the memory a session needs with the given options
+ *
+ * Covers the output buffer pool and the input blocks, which dominate the memory use of a
+ * session.
+ *
+ * @param options_p Processing options of the session
+ * @return Estimated memory in megabytes
+ */
+size_t batch_session_memory_mb(const SplitOptions *options_p);
+
+/**
+ * Process all sessions of a batch and print a per-session and an aggregate summary
+ *
+ * @param options_p Processing options used for every session
+ * @param batchOptions_p Scheduling limits
+ * @param batchPath_p Root directory of the sessions or text file listing the session paths
+ * @return Number of sessions that failed
+ */
+unsigned int run_batch(const SplitOptions *options_p, const BatchOptions *batchOptions_p, const char *batchPath_p);
+
+#endif // BATCH_H
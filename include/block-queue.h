@@ -0,0 +1,70 @@
+/**
+ * @file block-queue.h
+ * @brief Bounded blocking queue used to connect the pipeline stages
+ *
+ * This header file contains the definition of a fixed capacity FIFO of pointers that is
+ * shared between threads. Producers block while the queue is full, consumers block while
+ * it is empty. Closing the queue wakes all waiters and lets consumers drain what is left.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef BLOCK_QUEUE_H
+#define BLOCK_QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct {
+    void **items_pp;          // Ring of queued items
+    size_t capacity;          // Maximum number of queued items
+    size_t head;              // Index of the oldest item
+    size_t count;             // Number of queued items
+    bool closed;              // No more items will be pushed
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} BlockQueue;
+
+/**
+ * Initialize an empty queue
+ *
+ * @param queue_p Queue to initialize
+ * @param capacity Maximum number of items the queue can hold
+ * @return 0 on success, -1 if memory allocation failed
+ */
+int block_queue_init(BlockQueue *queue_p, size_t capacity);
+
+/**
+ * Release the memory held by a queue (does not free the queued items)
+ *
+ * @param queue_p Queue to destroy
+ */
+void block_queue_destroy(BlockQueue *queue_p);
+
+/**
+ * Append an item, blocking while the queue is full
+ *
+ * @param queue_p Queue to push to
+ * @param item_p Item to append (must not be NULL)
+ */
+void block_queue_push(BlockQueue *queue_p, void *item_p);
+
+/**
+ * Remove the oldest item, blocking while the queue is empty
+ *
+ * @param queue_p Queue to pop from
+ * @return Oldest item, or NULL once the queue is closed and drained
+ */
+void *block_queue_pop(BlockQueue *queue_p);
+
+/**
+ * Mark the queue as closed and wake all waiting threads
+ *
+ * @param queue_p Queue to close
+ */
+void block_queue_close(BlockQueue *queue_p);
+
+#endif // BLOCK_QUEUE_H
@@ -0,0 +1,80 @@
+/**
+ * @file channel-selection.h
+ * @brief Selection and grouping of the input channels that are extracted
+ *
+ * This header file contains the definition of the channel selection. Every output consists
+ * of one or more input channels: the -c option selects mono outputs (e.g. "1-4,17,31"),
+ * a channel map file groups channels into named stereo pairs or multichannel stems.
+ * Channels that are not selected are skipped by the deinterleave engine and never buffered
+ * or written.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef CHANNEL_SELECTION_H
+#define CHANNEL_SELECTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Longest output name accepted in a channel map
+#define CHANNEL_MAP_MAX_NAME_LENGTH 64
+
+// Longest message describing why a selection cannot be used
+#define CHANNEL_SELECTION_MESSAGE_LENGTH 256
+
+typedef struct {
+    uint16_t count;           // Number of outputs (0 until resolved when all channels are extracted)
+    uint16_t *channels_p;     // Zero-based input channels of all outputs, stored output after output
+    uint16_t *groupSizes_p;   // Number of interleaved channels of every output
+    uint32_t *firstSlots_p;   // Index of the first channel of every output in channels_p
+    char **names_p;           // File name of every output without extension (NULL for ch_<channel>)
+} ChannelSelection;
+
+/**
+ * Parse a list of one-based channel numbers and ranges into mono outputs
+ *
+ * @param spec_p Comma separated channels and ranges, e.g. "1-4,17,31"
+ * @param selection_p Pointer to store the selection (channels in ascending order, duplicates removed)
+ * @return 0 on success, -1 if the list is malformed
+ */
+int channel_selection_parse(const char *spec_p, ChannelSelection *selection_p);
+
+/**
+ * Load a channel map file describing named, possibly multichannel outputs
+ *
+ * Every non-empty line that does not start with '#' defines one output as a name followed
+ * by a comma separated list of one-based channels and ranges in output channel order, e.g.
+ * "overheads 7,8" or "keys 12,11". The output is written to <name>.wav.
+ *
+ * @param path_p Path of the channel map file
+ * @param selection_p Pointer to store the selection
+ * @param message_p Buffer to store the reason of a failure (nothing is printed)
+ * @param messageSize Size of the buffer at message_p
+ * @return 0 on success, -1 if the file cannot be read or is malformed
+ */
+int channel_selection_load_map(const char *path_p, ChannelSelection *selection_p, char *message_p, size_t messageSize);
+
+/**
+ * Complete the selection once the channel count of the session is known
+ *
+ * An empty selection is expanded to one mono output per channel.
+ *
+ * @param selection_p Selection to resolve
+ * @param numChannels Number of interleaved channels of the input
+ * @param message_p Buffer to store the reason of a failure (nothing is printed)
+ * @param messageSize Size of the buffer at message_p
+ * @return 0 on success, -1 if a selected channel does not exist
+ */
+int channel_selection_resolve(ChannelSelection *selection_p, uint16_t numChannels, char *message_p,
+                              size_t messageSize);
+
+/**
+ * Free all memory held by a selection
+ *
+ * @param selection_p Selection to free
+ */
+void channel_selection_free(ChannelSelection *selection_p);
+
+#endif // CHANNEL_SELECTION_H
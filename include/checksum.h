@@ -0,0 +1,118 @@
+/**
+ * @file checksum.h
+ * @brief CRC32C checksums of the input chunks and outputs of a session
+ *
+ * This header file contains the definition of the checksums computed while a session is
+ * split. The audio data of every input chunk is hashed as it is read and the audio data of
+ * every output right after it was deinterleaved (and converted), while the samples are still
+ * in the cache, so proving the outputs bit-exact needs no second read of the files. The
+ * checksums are CRC32C (Castagnoli), computed with the SSE4.2 crc32 instruction on three
+ * independent lanes where available and with slicing-by-8 tables otherwise.
+ *
+ * The checksums of a run are written to a manifest in the output directory, one line per
+ * input chunk and per output with the number of audio bytes and the CRC32C in hex.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "channel-selection.h"
+
+// File name of the manifest in the output directory
+#define CHECKSUM_MANIFEST_NAME "manifest.csv"
+
+typedef enum {
+    CHECKSUM_OFF = 0, // no checksums
+    CHECKSUM_CRC32C   // CRC32C of every input chunk and output
+} ChecksumMode;
+
+typedef struct {
+    uint32_t crc;   // CRC32C of the bytes so far
+    uint64_t bytes; // Number of bytes covered
+} Checksum;
+
+typedef struct {
+    uint64_t firstChunk;     // First chunk of the run
+    uint64_t chunkCount;     // Number of chunks from firstChunk on
+    Checksum *inputs_p;      // Checksum of the audio data of every chunk
+    Checksum *currentInput_p;// Checksum of the chunk being read (NULL before the first one)
+    uint16_t outputCount;    // Number of outputs
+    Checksum *outputs_p;     // Checksum of the audio data of every output (owned by its deinterleaving thread)
+} SessionChecksums;
+
+/**
+ * Parse a checksum mode as given on the command line
+ *
+ * @param name_p Mode name ("crc32c")
+ * @param mode_p Pointer to store the parsed mode
+ * @return 0 on success, -1 if the name is unknown
+ */
+int checksum_mode_parse(const char *name_p, ChecksumMode *mode_p);
+
+/**
+ * Name of the CRC32C kernel selected for this CPU
+ *
+ * @return Static string like "sse4.2x3" or "slice8"
+ */
+const char *checksum_kernel_name(void);
+
+/**
+ * Add bytes to a checksum
+ *
+ * @param checksum_p Checksum to extend (NULL is ignored)
+ * @param data_p Bytes following the ones covered so far
+ * @param length Number of bytes
+ */
+void checksum_update(Checksum *checksum_p, const uint8_t *data_p, size_t length);
+
+/**
+ * Prepare the checksums of a run
+ *
+ * @param checksums_p Checksums to initialize
+ * @param firstChunk First chunk of the run
+ * @param lastChunk Last chunk of the run
+ * @param outputCount Number of outputs
+ */
+void session_checksums_init(SessionChecksums *checksums_p, uint64_t firstChunk, uint64_t lastChunk,
+                            uint16_t outputCount);
+
+/**
+ * Direct the input checksum to the chunk that is read next
+ *
+ * @param checksums_p Checksums (NULL is ignored)
+ * @param chunkIndex Chunk that is read next
+ */
+void session_checksums_begin_input(SessionChecksums *checksums_p, uint64_t chunkIndex);
+
+/**
+ * Checksum of the chunk being read
+ *
+ * @param checksums_p Checksums (may be NULL)
+ * @return Checksum of the current chunk, NULL without checksums
+ */
+Checksum *session_checksums_current_input(SessionChecksums *checksums_p);
+
+/**
+ * Write the manifest of a run into the output directory
+ *
+ * @param checksums_p Checksums of the run
+ * @param channels_p Channel selection naming the outputs
+ * @param outputPath_p Output directory (with trailing separator)
+ * @return 0 on success, -1 if the manifest cannot be written (errors printed)
+ */
+int session_checksums_write(const SessionChecksums *checksums_p, const ChannelSelection *channels_p,
+                            const char *outputPath_p);
+
+/**
+ * Free the checksums of a run
+ *
+ * @param checksums_p Checksums
+ */
+void session_checksums_free(SessionChecksums *checksums_p);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,199 @@
+/**
+ * @file deinterleave.h
+ * @brief Block-based deinterleave engine
+ *
+ * This header file contains the definition of the deinterleave engine used to split
+ * blocks of interleaved multi-channel frames into one contiguous sample stream per channel.
+ * Kernels are specialized for 16, 24 and 32 bit samples and common channel counts, with
+ * SSE/AVX2 shuffle paths selected at runtime where the CPU supports them. Gather and
+ * regroup kernels extract arbitrary channel sets and build interleaved multichannel stems.
+ * The interleave kernels run the same transposes the other way round, merging mono sample
+ * streams back into interleaved frames.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef DEINTERLEAVE_H
+#define DEINTERLEAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Deinterleave kernel signature
+ *
+ * Splits frameCount interleaved frames from src_p so that dst_pp[c] receives
+ * frameCount contiguous samples of channel c. Frames are frameStride bytes apart,
+ * which allows processing a contiguous range of channels out of wider frames.
+ *
+ * @param src_p First sample of the channel range in the first frame
+ * @param frameCount Number of frames to process
+ * @param frameStride Distance between two frames in bytes
+ * @param numChannels Number of channels to extract per frame
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param dst_pp Array of destination pointers (one per channel)
+ */
+typedef void (*DeinterleaveKernel)(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                   uint16_t numChannels, uint16_t bytesPerSample,
+                                   uint8_t *const *dst_pp);
+
+/**
+ * Gather kernel signature
+ *
+ * Like DeinterleaveKernel, but extracts an arbitrary list of channels. Output i receives
+ * groupSizes_p[i] interleaved channels taken from channels_p in order, so dst_pp[i] gets
+ * frameCount frames of groupSizes_p[i] samples each. Gather kernels for mono outputs
+ * ignore groupSizes_p. Only the selected samples of every frame are touched.
+ *
+ * @param src_p First frame
+ * @param frameCount Number of frames to process
+ * @param frameStride Distance between two frames in bytes
+ * @param channels_p Zero-based channels to extract, output after output
+ * @param groupSizes_p Number of channels of every output
+ * @param outputCount Number of outputs
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param dst_pp Array of destination pointers (one per output)
+ */
+typedef void (*GatherKernel)(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                             const uint16_t *channels_p, const uint16_t *groupSizes_p,
+                             uint16_t outputCount, uint16_t bytesPerSample, uint8_t *const *dst_pp);
+
+typedef struct {
+    uint16_t numChannels;        // Number of channels extracted (number of outputs for the gather kernels)
+    uint16_t firstChannel;       // First extracted channel within a frame (contiguous range)
+    const uint16_t *channels_p;  // Extracted channels for the gather kernel (NULL for a contiguous range)
+    const uint16_t *groupSizes_p;// Channels per output for the regroup kernel (NULL for mono outputs)
+    uint16_t bytesPerSample;     // Bytes per sample of a single channel
+    uint16_t blockAlign;         // Bytes per frame (all channels)
+    DeinterleaveKernel kernel_p; // Selected kernel
+    GatherKernel gather_p;       // Selected gather kernel (used when channels_p is set)
+    const char *kernelName_p;    // Human readable name of the selected kernel
+} Deinterleaver;
+
+/**
+ * Select the fastest kernel for the given frame layout
+ *
+ * @param deinterleaver_p Deinterleaver to initialize
+ * @param numChannels Number of interleaved channels
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param allowSimd Whether SSE/AVX2 kernels may be selected (false forces the scalar path)
+ */
+void deinterleaver_init(Deinterleaver *deinterleaver_p, uint16_t numChannels,
+                        uint16_t bytesPerSample, bool allowSimd);
+
+/**
+ * Select the fastest kernel for extracting a contiguous range of channels
+ *
+ * Used by pipeline workers that each own a slice of the channels. dst_pp passed to
+ * deinterleaver_run is then indexed relative to firstChannel.
+ *
+ * @param deinterleaver_p Deinterleaver to initialize
+ * @param frameChannels Number of interleaved channels per frame
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param firstChannel First channel of the range
+ * @param channelCount Number of channels in the range
+ * @param allowSimd Whether SSE/AVX2 kernels may be selected (false forces the scalar path)
+ */
+void deinterleaver_init_range(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                              uint16_t bytesPerSample, uint16_t firstChannel,
+                              uint16_t channelCount, bool allowSimd);
+
+/**
+ * Select the fastest kernel for extracting an arbitrary set of channels
+ *
+ * A set that forms a contiguous range is handled like deinterleaver_init_range, any other
+ * set uses a gather kernel that reads only the selected samples of each frame. dst_pp
+ * passed to deinterleaver_run is indexed like channels_p, which must outlive the
+ * deinterleaver.
+ *
+ * @param deinterleaver_p Deinterleaver to initialize
+ * @param frameChannels Number of interleaved channels per frame
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param channels_p Zero-based channels to extract
+ * @param channelCount Number of channels to extract
+ * @param allowSimd Whether SSE/AVX2 kernels may be selected (false forces the scalar path)
+ */
+void deinterleaver_init_gather(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                               uint16_t bytesPerSample, const uint16_t *channels_p,
+                               uint16_t channelCount, bool allowSimd);
+
+/**
+ * Select the fastest kernel for extracting channel groups into interleaved outputs
+ *
+ * Output i is built from groupSizes_p[i] channels of channels_p, in that order. If every
+ * output is mono this is deinterleaver_init_gather, otherwise a regroup kernel copies the
+ * samples of each group into consecutive positions of its output frame. channels_p and
+ * groupSizes_p must outlive the deinterleaver.
+ *
+ * @param deinterleaver_p Deinterleaver to initialize
+ * @param frameChannels Number of interleaved channels per frame
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param channels_p Zero-based channels to extract, output after output
+ * @param groupSizes_p Number of channels of every output
+ * @param outputCount Number of outputs
+ * @param allowSimd Whether SSE/AVX2 kernels may be selected (false forces the scalar path)
+ */
+void deinterleaver_init_regroup(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                                uint16_t bytesPerSample, const uint16_t *channels_p,
+                                const uint16_t *groupSizes_p, uint16_t outputCount, bool allowSimd);
+
+/**
+ * Deinterleave a block of frames with the selected kernel
+ *
+ * @param deinterleaver_p Initialized deinterleaver
+ * @param src_p Interleaved input frames (start of the first frame)
+ * @param frameCount Number of frames to process
+ * @param dst_pp Array of destination pointers (one per extracted channel or output)
+ */
+void deinterleaver_run(const Deinterleaver *deinterleaver_p, const uint8_t *src_p,
+                       size_t frameCount, uint8_t *const *dst_pp);
+
+/**
+ * Interleave kernel signature
+ *
+ * The inverse of DeinterleaveKernel: src_pp[c] provides frameCount contiguous samples of
+ * channel c, which are merged into frameCount interleaved frames frameStride bytes apart.
+ *
+ * @param src_pp Array of source pointers (one per channel)
+ * @param frameCount Number of frames to process
+ * @param frameStride Distance between two frames in bytes
+ * @param numChannels Number of channels per frame
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param dst_p First frame of the interleaved output
+ */
+typedef void (*InterleaveKernel)(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                 uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p);
+
+typedef struct {
+    uint16_t numChannels;        // Number of interleaved channels
+    uint16_t bytesPerSample;     // Bytes per sample of a single channel
+    uint16_t blockAlign;         // Bytes per frame (all channels)
+    InterleaveKernel kernel_p;   // Selected kernel
+    const char *kernelName_p;    // Human readable name of the selected kernel
+} Interleaver;
+
+/**
+ * Select the fastest kernel for merging mono sample streams into interleaved frames
+ *
+ * @param interleaver_p Interleaver to initialize
+ * @param numChannels Number of interleaved channels
+ * @param bytesPerSample Bytes per sample of a single channel
+ * @param allowSimd Whether SSE/AVX2 kernels may be selected (false forces the scalar path)
+ */
+void interleaver_init(Interleaver *interleaver_p, uint16_t numChannels, uint16_t bytesPerSample,
+                      bool allowSimd);
+
+/**
+ * Interleave a block of frames with the selected kernel
+ *
+ * @param interleaver_p Initialized interleaver
+ * @param src_pp Array of source pointers (one per channel)
+ * @param frameCount Number of frames to process
+ * @param dst_p Interleaved output frames (start of the first frame)
+ */
+void interleaver_run(const Interleaver *interleaver_p, const uint8_t *const *src_pp, size_t frameCount,
+                     uint8_t *dst_p);
+
+#endif // DEINTERLEAVE_H
@@ -0,0 +1,100 @@
+/**
+ * @file flac-encoder.h
+ * @brief Lossless FLAC encoding of the outputs
+ *
+ * This header file contains the definition of the built-in FLAC encoder. Every output gets
+ * its own encoder that takes the deinterleaved buffers in place of the raw fwrite, cuts them
+ * into blocks of FLAC_BLOCK_SIZE frames and codes every channel of a block as a constant,
+ * verbatim, fixed or LPC subframe, whichever is smallest, with a partitioned Rice coded
+ * residual. Buffers of one output are always handed to the same writer thread, so with
+ * several jobs the writer threads form the encoder pool without any locking.
+ *
+ * The stream starts with a STREAMINFO block sized for the planned session that is completed
+ * with the frame sizes, the sample count and the MD5 of the audio once the encoder finishes.
+ * No external library is needed.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef FLAC_ENCODER_H
+#define FLAC_ENCODER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "wav-header.h"
+
+// Frames per FLAC block (all blocks but the last one of a stream)
+#define FLAC_BLOCK_SIZE 4096
+
+// Most channels a FLAC stream can carry
+#define FLAC_MAX_CHANNELS 8
+
+// Highest LPC order that is tried
+#define FLAC_MAX_LPC_ORDER 8
+
+typedef struct FlacEncoder FlacEncoder;
+
+typedef struct {
+    uint64_t inputBytes;  // PCM bytes handed to the encoder
+    uint64_t outputBytes; // Bytes of the FLAC stream including its header
+    double encodeSeconds; // Time spent encoding
+} FlacEncoderStats;
+
+/**
+ * Check whether outputs of a format can be written as FLAC
+ *
+ * @param format_p Sample format of the outputs
+ * @param maxChannels Largest number of channels of an output
+ * @return 0 if supported, -1 otherwise (error printed)
+ */
+int flac_check_format(const WavHeader *format_p, uint16_t maxChannels);
+
+/**
+ * Create an encoder and write the stream header
+ *
+ * @param file_p Empty output file, written by the encoder only
+ * @param format_p Sample format of the output (sample rate and bits per sample)
+ * @param channels Number of channels of the output
+ * @param plannedFrames Expected number of frames (corrected when the encoder finishes)
+ * @return New encoder, exits on failure
+ */
+FlacEncoder *flac_encoder_create(FILE *file_p, const WavHeader *format_p, uint16_t channels,
+                                 uint64_t plannedFrames);
+
+/**
+ * Encode interleaved samples
+ *
+ * Only whole blocks are written, the remaining frames are kept for the next call.
+ *
+ * @param encoder_p Encoder
+ * @param samples_p Interleaved little-endian samples in the format of the output
+ * @param bytes Number of bytes, a multiple of the frame size
+ */
+void flac_encoder_write(FlacEncoder *encoder_p, const uint8_t *samples_p, size_t bytes);
+
+/**
+ * Encode the remaining frames and complete the STREAMINFO block
+ *
+ * @param encoder_p Encoder
+ * @return 0 on success, -1 if the stream could not be completed (error printed)
+ */
+int flac_encoder_finish(FlacEncoder *encoder_p);
+
+/**
+ * Sizes and encode time of a stream
+ *
+ * @param encoder_p Encoder
+ * @param stats_p Pointer to store the statistics
+ */
+void flac_encoder_stats(const FlacEncoder *encoder_p, FlacEncoderStats *stats_p);
+
+/**
+ * Free the encoder (does not close the output file)
+ *
+ * @param encoder_p Encoder
+ */
+void flac_encoder_destroy(FlacEncoder *encoder_p);
+
+#endif // FLAC_ENCODER_H
@@ -0,0 +1,36 @@
+/**
+ * @file follow.h
+ * @brief Live splitting of a session that is still being recorded
+ *
+ * This header file contains the definition of the follow mode. Instead of planning the
+ * whole session up front, the session directory is watched (with inotify where available,
+ * by polling otherwise) and every chunk is split as soon as it is complete: the recorder
+ * closed it, the next chunk appeared or its size stopped changing. After every chunk the
+ * output headers are brought up to date, so the outputs are valid WAV files at all times.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "processing.h"
+
+/**
+ * Split a session while it is being recorded
+ *
+ * Waits for the first chunk, then appends every completed chunk to the outputs. The
+ * session ends once no further chunk appears within settleSeconds after the last one was
+ * complete. Follow mode requires a buffered output backend (stdio or uring) and processes
+ * chunks on a single thread. A restarted run continues behind the last checkpoint recorded
+ * in the journal of the output directory.
+ *
+ * @param options_p Processing options
+ * @param sessionPath_p Path to the session directory
+ * @param settleSeconds Seconds without any change after which a chunk counts as complete
+ *                      and the session as finished
+ */
+void follow_session(const SplitOptions *options_p, const char *sessionPath_p, unsigned int settleSeconds);
+
+#endif // FOLLOW_H
@@ -0,0 +1,103 @@
+/**
+ * @file input-source.h
+ * @brief Input backends for reading the audio data of a chunk file
+ *
+ * This header file contains the definition of the input source abstraction. The stdio
+ * backend copies frames through fread into a caller supplied buffer, the mmap backend maps
+ * the data region of the chunk and hands out pointers straight into the page cache.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef INPUT_SOURCE_H
+#define INPUT_SOURCE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "wav-header.h"
+#include "page-cache.h"
+#include "checksum.h"
+
+typedef enum {
+    INPUT_BACKEND_STDIO = 0,  // fread into a private buffer
+    INPUT_BACKEND_MMAP        // zero-copy view of the mapped data region
+} InputBackend;
+
+typedef struct {
+    InputBackend backend;     // Backend used for this source
+    FILE *file_p;             // Chunk file (owned by the caller)
+    size_t blockAlign;        // Bytes per frame
+    uint64_t remainingFrames; // Frames left in the data region
+    void *mapBase_p;          // Start of the mapping (page aligned)
+    size_t mapLength;         // Length of the mapping in bytes
+    const uint8_t *cursor_p;  // Next frame inside the mapping
+    PageCache *cache_p;       // Page cache policy (NULL to leave the cache alone)
+    uint64_t dropOffset;      // File offset up to which the chunk was dropped from the cache
+    Checksum *checksum_p;     // Checksum extended by every returned frame (NULL for none)
+} InputSource;
+
+/**
+ * Parse an input backend name as given on the command line
+ *
+ * @param name_p Backend name ("stdio" or "mmap")
+ * @param backend_p Pointer to store the parsed backend
+ * @return 0 on success, -1 if the name is unknown or the backend is not available
+ */
+int input_backend_parse(const char *name_p, InputBackend *backend_p);
+
+/**
+ * Name of an input backend as given on the command line
+ *
+ * @param backend Input backend
+ * @return Backend name
+ */
+const char *input_backend_name(InputBackend backend);
+
+/**
+ * Open the data region of a chunk
+ *
+ * @param source_p Source to initialize
+ * @param inputFile_p Chunk file, positioned at the start of the audio data (after read_header)
+ * @param inputHeader WAV header of the chunk
+ * @param backend Backend to use
+ * @param cache_p Page cache policy dropping consumed data from the cache (NULL to keep it)
+ * @return 0 on success, -1 on failure
+ */
+int input_source_open(InputSource *source_p, FILE *inputFile_p, const WavHeader *inputHeader,
+                      InputBackend backend, PageCache *cache_p);
+
+/**
+ * Get the next frames of the data region
+ *
+ * The stdio backend reads into scratch_p, the mmap backend ignores scratch_p and returns a
+ * pointer into the mapping that stays valid until input_source_close.
+ *
+ * @param source_p Opened source
+ * @param scratch_p Buffer of at least maxFrames frames (stdio backend only)
+ * @param maxFrames Maximum number of frames to return
+ * @param frames_pp Pointer to store the address of the returned frames
+ * @return Number of frames returned, 0 at the end of the data region
+ */
+size_t input_source_next(InputSource *source_p, uint8_t *scratch_p, size_t maxFrames,
+                         const uint8_t **frames_pp);
+
+/**
+ * Hash every frame returned from now on
+ *
+ * @param source_p Opened source
+ * @param checksum_p Checksum to extend (NULL to stop hashing)
+ */
+void input_source_set_checksum(InputSource *source_p, Checksum *checksum_p);
+
+/**
+ * Release the mapping of a source (does not close the chunk file)
+ *
+ * With a page cache policy the whole chunk is dropped from the cache.
+ *
+ * @param source_p Source to close
+ */
+void input_source_close(InputSource *source_p);
+
+#endif // INPUT_SOURCE_H
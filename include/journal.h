@@ -0,0 +1,109 @@
+/**
+ * @file journal.h
+ * @brief Checkpoint journal for resuming and extending a split session
+ *
+ * This header file contains the definition of the session journal. The journal is a small
+ * text file in the output directory that records the format, the outputs and the number of
+ * audio bytes every output safely holds. It is replaced atomically at every checkpoint, so
+ * after a crash a rerun truncates the outputs to the journaled sizes and continues from
+ * there, and chunks added to a session later are appended without reprocessing the
+ * earlier ones.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "wav-header.h"
+#include "output-writer.h"
+#include "processing.h"
+
+// Name of the journal inside the output directory
+#define JOURNAL_FILE_NAME ".wav-splitter-journal"
+
+typedef struct {
+    char *path_p;                    // Journal file
+    char *directoryPath_p;           // Output directory holding the journal
+    const SplitOptions *options_p;   // Processing options with resolved channel selection
+    const WavHeader *format_p;       // Format of the session
+    const WavHeader *outputFormat_p; // Sample format of the outputs
+    uint64_t *durableBytes_p;        // Scratch space for the byte counts of a checkpoint
+    bool active;                     // Outputs can be resumed (not for encoded outputs or ranges)
+} SessionJournal;
+
+/**
+ * Whether an output directory holds a journal
+ *
+ * @param outputPath_p Output directory (with trailing separator)
+ * @return true if a journal exists
+ */
+bool journal_exists(const char *outputPath_p);
+
+/**
+ * Prepare the journal of a session
+ *
+ * @param journal_p Journal to initialize
+ * @param outputPath_p Output directory (with trailing separator)
+ * @param options_p Processing options, the channel selection must already be resolved
+ * @param format_p Format of the session
+ * @param outputFormat_p Sample format of the outputs
+ */
+void journal_init(SessionJournal *journal_p, const char *outputPath_p, const SplitOptions *options_p,
+                  const WavHeader *format_p, const WavHeader *outputFormat_p);
+
+/**
+ * Read the byte counts of a journal
+ *
+ * Fails if the journal was written for a different format, different outputs, a different
+ * output sample format or a different output data offset than the current run uses.
+ *
+ * @param journal_p Journal
+ * @param bytesWritten_p Array to store the journaled bytes of every output
+ * @return 0 on success, -1 if the journal is unreadable or does not match (error printed)
+ */
+int journal_load(const SessionJournal *journal_p, uint64_t *bytesWritten_p);
+
+/**
+ * Record a checkpoint from the byte counts of a running writer
+ *
+ * The outputs are flushed to stable storage before the journal is replaced, so it never
+ * claims audio an OS crash or power loss could still lose. If they cannot be synced the
+ * previous journal stays in place.
+ *
+ * @param journal_p Journal
+ * @param writer_p Output writer of the session
+ * @param chunkIndex Last chunk read so far (informational)
+ */
+void journal_checkpoint(SessionJournal *journal_p, OutputWriter *writer_p, uint64_t chunkIndex);
+
+/**
+ * Record the final state once every write completed
+ *
+ * @param journal_p Journal
+ * @param outputFiles_pp Array of output file handles (synced to stable storage before the journal is written)
+ * @param bytesWritten_p Array containing bytes written per output
+ * @param chunkIndex Last chunk of the session
+ */
+void journal_commit(SessionJournal *journal_p, FILE **outputFiles_pp, const uint64_t *bytesWritten_p,
+                    uint64_t chunkIndex);
+
+/**
+ * Remove the journal, the outputs can no longer be resumed or extended
+ *
+ * @param journal_p Journal
+ */
+void journal_discard(SessionJournal *journal_p);
+
+/**
+ * Free the journal state (the journal file stays)
+ *
+ * @param journal_p Journal
+ */
+void journal_free(SessionJournal *journal_p);
+
+#endif // JOURNAL_H
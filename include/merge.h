@@ -0,0 +1,41 @@
+/**
+ * @file merge.h
+ * @brief Merging of mono tracks back into a recorder session
+ *
+ * This header file contains the definition of the merge mode, the inverse of splitting.
+ * The ch_<channel>.wav tracks of a directory are read in large blocks, interleaved with
+ * the transpose kernels of the deinterleave engine and written as numbered multichannel
+ * chunks (00000001.WAV, 00000002.WAV, ...) that the recorder plays back, each one capped
+ * at the file size limit of the recorder's card.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stdint.h>
+#include "processing.h"
+
+// Largest chunk file the recorder writes, the FAT32 limit of its card (4 GiB - 1)
+#define MERGE_CHUNK_LIMIT_BYTES UINT32_MAX
+
+/**
+ * Merge the mono tracks of a directory into a new session
+ *
+ * Channel N of the session is taken from ch_N.wav, channels without a track are silent and
+ * tracks shorter than the longest one are padded with silence. All tracks must be mono PCM
+ * with 16, 24 or 32 bit samples and share sample rate and word length. Of the options only
+ * the buffer size applies, half of it holds a block of every track and half the
+ * interleaved block.
+ *
+ * @param options_p Processing options
+ * @param tracksPath_p Directory holding the ch_<channel>.wav tracks
+ * @param sessionPath_p Session directory to create for the chunks
+ * @param chunkLimitBytes Largest size of a chunk file in bytes
+ */
+void merge_tracks(const SplitOptions *options_p, const char *tracksPath_p, const char *sessionPath_p,
+                  uint64_t chunkLimitBytes);
+
+#endif // MERGE_H
@@ -0,0 +1,248 @@
+/**
+ * @file output-writer.h
+ * @brief Pluggable writer backends for the per-channel output files
+ *
+ * This header file contains the definition of the output writer. The writer owns a single
+ * arena of fixed-size, page-aligned blocks that are recycled through a free list, so memory
+ * use is bounded by the buffer budget regardless of session length. Producers acquire a buffer, fill it with deinterleaved samples
+ * and submit it; the backend appends it to the channel's output file and returns the buffer
+ * to the pool once the write completed. The stdio backend writes synchronously with fwrite,
+ * the io_uring backends keep many writes in flight so producers only wait when every buffer
+ * of the pool is being written.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "flac-encoder.h"
+#include "page-cache.h"
+
+// Alignment of file offsets, lengths and buffers for O_DIRECT writes
+#define OUTPUT_DIRECT_ALIGNMENT 4096
+
+typedef enum {
+    OUTPUT_BACKEND_STDIO = 0,  // blocking fwrite on the output FILE
+    OUTPUT_BACKEND_URING,      // asynchronous io_uring writes through the page cache
+    OUTPUT_BACKEND_DIRECT      // asynchronous io_uring writes with O_DIRECT
+} OutputBackend;
+
+typedef enum {
+    OUTPUT_CODEC_WAV = 0,      // PCM samples written as they are
+    OUTPUT_CODEC_FLAC          // FLAC frames encoded when a buffer is submitted
+} OutputCodec;
+
+typedef struct {
+    uint8_t *data_p;           // Sample storage (aligned to OUTPUT_DIRECT_ALIGNMENT)
+    size_t fillBytes;          // Number of valid bytes in data_p
+    uint16_t channel;          // Output the buffer belongs to
+    uint64_t fileOffset;       // Write position (set on submit)
+    size_t submittedBytes;     // Bytes handed to the kernel (set on submit)
+    size_t completedBytes;     // Bytes the kernel reported as written
+    uint64_t chunkIndex;       // Chunk whose frames completed the buffer (run statistics)
+    bool sparse;               // Only zeros that need not be written, the file position still advances
+} OutputBuffer;
+
+typedef struct OutputWriter OutputWriter;
+
+/**
+ * Parse an output backend name as given on the command line
+ *
+ * @param name_p Backend name ("stdio", "uring" or "direct")
+ * @param backend_p Pointer to store the parsed backend
+ * @return 0 on success, -1 if the name is unknown or the backend is not available
+ */
+int output_backend_parse(const char *name_p, OutputBackend *backend_p);
+
+/**
+ * Name of an output backend as given on the command line
+ *
+ * @param backend Output backend
+ * @return Backend name
+ */
+const char *output_backend_name(OutputBackend backend);
+
+/**
+ * Offset of the audio data in output files written by a backend
+ *
+ * The buffered backends start the data right behind a header with reserved ds64 space
+ * (wav_output_header_size). O_DIRECT requires aligned file offsets, so the direct
+ * backend pads the header with a JUNK chunk up to OUTPUT_DIRECT_ALIGNMENT.
+ *
+ * @param backend Output backend
+ * @param audioFormat Audio format of the outputs (float headers are larger)
+ * @return Offset of the first audio byte in the output files
+ */
+uint32_t output_backend_data_offset(OutputBackend backend, uint16_t audioFormat);
+
+/**
+ * Parse an output codec name as given on the command line
+ *
+ * @param name_p Codec name ("wav" or "flac")
+ * @param codec_p Pointer to store the parsed codec
+ * @return 0 on success, -1 if the name is unknown
+ */
+int output_codec_parse(const char *name_p, OutputCodec *codec_p);
+
+/**
+ * File name extension of outputs written with a codec
+ *
+ * @param codec Output codec
+ * @return Extension including the dot
+ */
+const char *output_codec_extension(OutputCodec codec);
+
+/**
+ * Whether submitting a buffer returns before the data is written
+ *
+ * @param backend Output backend
+ * @return true for the io_uring backends
+ */
+bool output_backend_is_async(OutputBackend backend);
+
+/**
+ * Create a writer for a set of opened output files
+ *
+ * The headers must already be written to the output files. Outputs that already hold audio
+ * (bytesWritten_p not zero) are continued behind it. totalBufferBytes is split into
+ * fixed-size blocks (about four per output, between 64 KiB and 4 MiB each). The pool never
+ * holds fewer than two blocks per output, so one can be filled while the other one is written.
+ *
+ * @param backend Output backend
+ * @param outputFiles_pp Array of output file handles (one per output)
+ * @param bytesWritten_p Array tracking bytes written per output (updated on submit)
+ * @param outputCount Number of outputs
+ * @param frameBytes_p Bytes per frame of every output, buffers always hold whole frames
+ * @param totalBufferBytes Total size of the buffer pool in bytes
+ * @param dataOffset Offset of the first audio byte in the output files (output_backend_data_offset)
+ * @return New writer, exits on failure
+ */
+OutputWriter *output_writer_create(OutputBackend backend, FILE **outputFiles_pp, uint64_t *bytesWritten_p,
+                                   uint16_t outputCount, const size_t *frameBytes_p, size_t totalBufferBytes,
+                                   uint32_t dataOffset);
+
+/**
+ * Encode the outputs as FLAC instead of writing the samples
+ *
+ * Submitted buffers are handed to the encoder of their output in place of the raw write,
+ * sparse buffers are encoded as well. Only valid for the stdio backend.
+ *
+ * @param writer_p Writer
+ * @param encoders_pp Array of encoders (one per output), must outlive the writer
+ */
+void output_writer_set_encoders(OutputWriter *writer_p, FlacEncoder **encoders_pp);
+
+/**
+ * Write the outputs back behind the writers to cap their dirty data
+ *
+ * After every submitted buffer the output is handed to page_cache_write_behind. The direct
+ * backend bypasses the page cache and ignores the policy.
+ *
+ * @param writer_p Writer
+ * @param cache_p Page cache policy, must outlive the writer
+ */
+void output_writer_set_page_cache(OutputWriter *writer_p, PageCache *cache_p);
+
+/**
+ * Size of every buffer of the pool in bytes
+ *
+ * @param writer_p Writer
+ * @return Buffer capacity in bytes
+ */
+size_t output_writer_buffer_size(const OutputWriter *writer_p);
+
+/**
+ * Number of bytes an output may fill into a buffer before submitting it
+ *
+ * Always a whole number of the output's frames and, for the direct backend, a multiple of
+ * OUTPUT_DIRECT_ALIGNMENT. Only the last buffer of an output may be submitted with less.
+ *
+ * @param writer_p Writer
+ * @param output Output the buffer is filled for
+ * @return Usable buffer capacity in bytes
+ */
+size_t output_writer_buffer_capacity(const OutputWriter *writer_p, uint16_t output);
+
+/**
+ * Number of buffers in the pool
+ *
+ * @param writer_p Writer
+ * @return Buffer count
+ */
+size_t output_writer_buffer_count(const OutputWriter *writer_p);
+
+/**
+ * Take an empty buffer from the pool, waiting for in-flight writes if the pool is empty
+ *
+ * @param writer_p Writer
+ * @param channel Output the buffer will be filled for
+ * @return Empty buffer
+ */
+OutputBuffer *output_writer_acquire(OutputWriter *writer_p, uint16_t channel);
+
+/**
+ * Append a filled buffer to its output
+ *
+ * Buffers of one output must be submitted in order. With the direct backend only the last
+ * buffer of an output may be partially filled. Sparse buffers are accounted but not
+ * written.
+ *
+ * @param writer_p Writer
+ * @param buffer_p Filled buffer, returns to the pool once written
+ */
+void output_writer_submit(OutputWriter *writer_p, OutputBuffer *buffer_p);
+
+/**
+ * Return a buffer to the pool without writing it
+ *
+ * @param writer_p Writer
+ * @param buffer_p Unused buffer
+ */
+void output_writer_release(OutputWriter *writer_p, OutputBuffer *buffer_p);
+
+/**
+ * Report how much audio of every output is safely written
+ *
+ * Reaps the writes in flight, then copies the number of bytes per output whose writes
+ * completed without a gap from the start of the audio data and flushes every output to
+ * stable storage (fdatasync, FlushFileBuffers on Windows), so the copied counts survive
+ * an OS crash or power loss. Can be called while other threads keep submitting, the
+ * counts are then a lower bound.
+ *
+ * @param writer_p Writer
+ * @param durableBytes_p Array to store the byte count of every output
+ * @return 0 on success, -1 if an output could not be synced (the counts are then not durable)
+ */
+int output_writer_sync_point(OutputWriter *writer_p, uint64_t *durableBytes_p);
+
+/**
+ * Wait for all in-flight writes, the writer stays usable
+ *
+ * Used at checkpoints where the outputs must hold everything submitted so far. Only valid
+ * for the buffered backends, a partial direct write would leave the next offset unaligned.
+ *
+ * @param writer_p Writer
+ */
+void output_writer_drain(OutputWriter *writer_p);
+
+/**
+ * Wait for all in-flight writes and restore exact file sizes after padded direct writes
+ *
+ * @param writer_p Writer
+ */
+void output_writer_finish(OutputWriter *writer_p);
+
+/**
+ * Free the writer and its buffer pool (does not close the output files)
+ *
+ * @param writer_p Writer
+ */
+void output_writer_destroy(OutputWriter *writer_p);
+
+#endif // OUTPUT_WRITER_H
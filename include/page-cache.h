@@ -0,0 +1,110 @@
+/**
+ * @file page-cache.h
+ * @brief Page cache policy for sessions larger than the memory of the machine
+ *
+ * This header file contains the definition of the page cache policy. Every byte of a session
+ * is read once and every output byte is written once, so keeping either in the page cache
+ * only pushes out the data of other programs. With the drop policy the input ranges that
+ * were consumed are dropped from the cache, and the outputs are written back behind the
+ * writers: once an output collected half of its dirty limit, writeback of that range is
+ * started, and the range before it is waited for and dropped. At most the dirty limit of
+ * every output is dirty or under writeback at any time, instead of everything piling up
+ * until the files are closed.
+ *
+ * The policy relies on posix_fadvise and sync_file_range and is only available on Linux.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "run-stats.h"
+
+// Dirty bytes per output allowed by default with the drop policy
+#define PAGE_CACHE_DEFAULT_DIRTY_MB 16
+
+// Consumed input bytes collected before they are dropped from the cache
+#define PAGE_CACHE_INPUT_DROP_BYTES (8 * 1024 * 1024)
+
+typedef enum {
+    CACHE_POLICY_KEEP = 0,  // leave caching to the kernel
+    CACHE_POLICY_DROP       // drop consumed input and write outputs back early
+} CachePolicy;
+
+typedef struct {
+    uint64_t startedEnd;    // Writeback was started for all bytes in front of this offset
+    uint64_t droppedEnd;    // All bytes in front of this offset are written and dropped from the cache
+} PageCacheOutput;
+
+typedef struct {
+    uint64_t dirtyLimitBytes;              // Bytes per output that may be dirty or under writeback
+    uint16_t outputCount;                  // Number of outputs
+    PageCacheOutput *outputs_p;            // Write-behind state of every output (owned by its writing thread)
+    atomic_uint_fast64_t inputDroppedBytes;   // Input bytes dropped from the cache
+    atomic_uint_fast64_t writtenBackBytes;    // Output bytes written back and dropped before the files were closed
+    atomic_uint_fast64_t writebackWaitNanos;  // Time the writers waited for writeback
+} PageCache;
+
+/**
+ * Parse a cache policy as given on the command line
+ *
+ * @param name_p Policy name ("keep" or "drop")
+ * @param policy_p Pointer to store the parsed policy
+ * @return 0 on success, -1 if the name is unknown or the policy is not available
+ */
+int cache_policy_parse(const char *name_p, CachePolicy *policy_p);
+
+/**
+ * Prepare the write-behind state of all outputs
+ *
+ * @param cache_p Page cache state to initialize
+ * @param dirtyLimitMB Megabytes per output that may be dirty or under writeback
+ * @param outputCount Number of outputs
+ */
+void page_cache_init(PageCache *cache_p, size_t dirtyLimitMB, uint16_t outputCount);
+
+/**
+ * Drop a consumed range of an input file from the cache
+ *
+ * @param cache_p Page cache state (NULL keeps the cache)
+ * @param fd Descriptor of the input file
+ * @param offset First byte of the range
+ * @param length Bytes in the range
+ */
+void page_cache_drop_input(PageCache *cache_p, int fd, uint64_t offset, uint64_t length);
+
+/**
+ * Start writeback of what an output received since the last call and cap its dirty data
+ *
+ * Only the thread writing the output may call this. Whenever half of the dirty limit was
+ * written since writeback was last started, writeback of that range is started, and the
+ * range started before is waited for and dropped from the cache.
+ *
+ * @param cache_p Page cache state (NULL keeps the cache)
+ * @param output Output the file belongs to
+ * @param fd Descriptor of the output file, all data in front of writtenEnd reached the kernel
+ * @param writtenEnd Offset behind the last byte written
+ */
+void page_cache_write_behind(PageCache *cache_p, uint16_t output, int fd, uint64_t writtenEnd);
+
+/**
+ * Print what the policy did and add it to the run statistics
+ *
+ * @param cache_p Page cache state
+ * @param stats_p Statistics (may be NULL)
+ */
+void page_cache_report(PageCache *cache_p, RunStats *stats_p);
+
+/**
+ * Free the write-behind state
+ *
+ * @param cache_p Page cache state
+ */
+void page_cache_free(PageCache *cache_p);
+
+#endif // PAGE_CACHE_H
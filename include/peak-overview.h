@@ -0,0 +1,155 @@
+/**
+ * @file peak-overview.h
+ * @brief Multi-resolution min/max peak overviews built during the split
+ *
+ * This header file contains the definition of the peak overview. Right after a block of
+ * frames was deinterleaved, the samples every output received are reduced to the minimum
+ * and maximum of every bin of a fixed number of frames, so waveform viewers can draw an
+ * output without reading it. Coarser levels are folded from the bins of the finest level,
+ * every level holds a whole number of bins of the level below.
+ *
+ * Every output gets a sidecar file <name>.peaks next to it. All values are little endian:
+ *
+ *   offset  size  field
+ *        0     8  magic "WSPEAKS1"
+ *        8     2  channels of the output
+ *       10     2  bits per sample of the session the peaks were taken from
+ *       12     4  sample rate
+ *       16     8  frames of the output
+ *       24     2  number of levels
+ *       26     6  reserved (zero)
+ *       32  24*n  level table, per level from fine to coarse:
+ *                   4  frames per bin
+ *                   4  reserved (zero)
+ *                   8  number of bins
+ *                   8  offset of the first bin in the file
+ *
+ * A bin holds an int16 minimum followed by an int16 maximum for every channel of the
+ * output, in channel order. Integer samples keep their upper 16 bits, float samples are
+ * scaled by 32767 and clamped. The last bin of a level may cover fewer frames.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef PEAK_OVERVIEW_H
+#define PEAK_OVERVIEW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "channel-selection.h"
+#include "wav-header.h"
+
+// Extension of the sidecar file of every output
+#define PEAK_FILE_EXTENSION ".peaks"
+
+// Magic at the start of every sidecar file
+#define PEAK_FILE_MAGIC "WSPEAKS1"
+
+// Size of the fixed header and of one entry of the level table
+#define PEAK_HEADER_SIZE 32
+#define PEAK_LEVEL_ENTRY_SIZE 24
+
+// Most levels a sidecar file holds
+#define PEAK_MAX_LEVELS 8
+
+// Bins of the finest level collected per output before they are written
+#define PEAK_WRITE_BINS 1024
+
+typedef struct {
+    uint16_t count;                           // Number of levels (0 when disabled)
+    uint32_t framesPerBin[PEAK_MAX_LEVELS];   // Frames per bin of every level, each a multiple of the one before
+} PeakLevels;
+
+/**
+ * Peak kernel signature
+ *
+ * Finds the smallest and largest of count samples of one channel that are stride samples
+ * apart, scaled to 16 bit.
+ *
+ * @param samples_p First sample
+ * @param count Number of samples (at least 1)
+ * @param stride Distance between two samples in samples (1 for mono outputs)
+ * @param minimum_p Pointer to store the smallest sample
+ * @param maximum_p Pointer to store the largest sample
+ */
+typedef void (*PeakKernel)(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,
+                           int16_t *maximum_p);
+
+typedef struct {
+    FILE *file_p;                        // Sidecar file
+    uint16_t channels;                   // Channels of the output
+    int16_t *bins_p;                     // Bin being built per level, minimum and maximum per channel
+    uint64_t fill[PEAK_MAX_LEVELS];      // Frames (finest level) or bins of the level below in the bin being built
+    uint64_t binCount[PEAK_MAX_LEVELS];  // Completed bins per level
+    int16_t *pending_p;                  // Bins of the finest level not written yet
+    size_t pendingBins;                  // Number of bins at pending_p
+    int16_t *coarse_p[PEAK_MAX_LEVELS];  // Bins of the coarser levels, written when the overview finishes
+    uint64_t coarseCapacity[PEAK_MAX_LEVELS]; // Bins allocated at coarse_p
+    uint64_t frames;                     // Frames reduced so far
+    bool failed;                         // Writing the sidecar failed, reported when the overview finishes
+} PeakOutput;
+
+typedef struct {
+    PeakLevels levels;                   // Bin sizes of all levels
+    const ChannelSelection *channels_p;  // Resolved channel selection
+    const WavHeader *format_p;           // Format of the session
+    size_t bytesPerSample;               // Bytes per sample of the session
+    PeakOutput *outputs_p;               // State of every output
+    PeakKernel strideKernel_p;           // Reduction for outputs with interleaved channels
+    PeakKernel monoKernel_p;             // Reduction for outputs with a single channel
+    const char *kernelName_p;            // Name of the mono reduction (for logging)
+} PeakOverview;
+
+/**
+ * Parse the bin sizes of the levels as given on the command line
+ *
+ * @param text_p Comma separated frames per bin from fine to coarse, e.g. 256,4096,65536
+ * @param levels_p Pointer to store the levels
+ * @return 0 on success, -1 if a size is invalid or not a multiple of the one before
+ */
+int peak_levels_parse(const char *text_p, PeakLevels *levels_p);
+
+/**
+ * Prepare the overviews of all outputs and create their sidecar files
+ *
+ * @param overview_p Overview to initialize
+ * @param levels_p Bin sizes of the levels
+ * @param channels_p Resolved channel selection, must outlive the overview
+ * @param format_p Format of the session, must outlive the overview
+ * @param outputPath_p Output directory (with trailing separator)
+ */
+void peak_overview_init(PeakOverview *overview_p, const PeakLevels *levels_p, const ChannelSelection *channels_p,
+                        const WavHeader *format_p, const char *outputPath_p);
+
+/**
+ * Add samples deinterleaved into an output to its overview
+ *
+ * Outputs are owned by exactly one thread, so different outputs may be reduced at the
+ * same time without locking.
+ *
+ * @param overview_p Overview
+ * @param output Output the samples belong to
+ * @param samples_p Interleaved samples of the output's channels in the session format
+ * @param frameCount Number of frames at samples_p
+ */
+void peak_overview_run(PeakOverview *overview_p, uint16_t output, const uint8_t *samples_p, size_t frameCount);
+
+/**
+ * Complete the last bins, write the coarser levels and the headers and close the sidecars
+ *
+ * @param overview_p Overview
+ * @return 0 on success, -1 if a sidecar could not be written (error printed)
+ */
+int peak_overview_finish(PeakOverview *overview_p);
+
+/**
+ * Free the overview state
+ *
+ * @param overview_p Overview
+ */
+void peak_overview_free(PeakOverview *overview_p);
+
+#endif // PEAK_OVERVIEW_H
@@ -0,0 +1,49 @@
+/**
+ * @file pipeline.h
+ * @brief Multi-threaded read -> deinterleave -> write pipeline
+ *
+ * This header file contains the definition of the pipelined processing mode. A reader thread
+ * reads blocks of interleaved frames, a pool of deinterleave workers each own a contiguous
+ * range of channels, and writer threads write the filled per-channel blocks to the output
+ * files. The stages are connected by bounded queues of reusable buffers so disk reads,
+ * shuffling and writes overlap.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "wav-header.h"
+#include "processing.h"
+#include "output-writer.h"
+#include "journal.h"
+
+/**
+ * Process all chunks of a session with the multi-threaded pipeline
+ *
+ * Takes over the already opened first chunk (as returned by read_chunk_header) and opens
+ * the remaining chunks itself. A journal checkpoint is recorded after every chunk read. All input files are closed on return; the output files stay
+ * open for finalize_output_files. Writes may still be in flight on return, they are
+ * completed by flush_remaining_buffers.
+ *
+ * @param options_p Processing options (buffer size, jobs, input backend)
+ * @param firstInputFile_p Input file handle of the first chunk, positioned at the first frame to process
+ * @param inputHeader WAV header of the first chunk (data size counted from that frame)
+ * @param firstChunkIndex Index of the first chunk to process
+ * @param maxChunkIndex Highest chunk index of the session
+ * @param sessionPath_p Path to the session directory
+ * @param writer_p Output writer providing the per-channel buffers
+ * @param outputFiles_pp Pointer to array of output file handles
+ * @param bytesWritten_p Pointer to array tracking bytes written per channel
+ * @param journal_p Journal of the session
+ */
+void run_pipeline(const SplitOptions *options_p, FILE *firstInputFile_p, const WavHeader *inputHeader,
+                  uint64_t firstChunkIndex, uint64_t maxChunkIndex, const char *sessionPath_p,
+                  OutputWriter *writer_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p,
+                  SessionJournal *journal_p);
+
+#endif // PIPELINE_H
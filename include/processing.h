@@ -5,81 +5,261 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "wav-header.h"
+#include "input-source.h"
+#include "output-writer.h"
+#include "channel-selection.h"
+#include "run-stats.h"
+#include "signal-analysis.h"
+#include "peak-overview.h"
+#include "sample-convert.h"
+#include "session-index.h"
+#include "page-cache.h"
+#include "checksum.h"
+
+typedef struct {
+    size_t totalBufferSizeMB;     // Total size of the per-channel write buffers in megabytes
+    unsigned int jobs;            // Number of deinterleave workers and writer threads
+    InputBackend inputBackend;    // How the audio data of a chunk is read
+    OutputBackend outputBackend;  // How the per-channel outputs are written
+    WavContainer largeContainer;  // Container for outputs beyond the 4 GiB RIFF limit
+    ChannelSelection channels;    // Input channels that become outputs (resolved after planning)
+    RunStats *stats_p;            // Stage timing of the run (NULL when disabled)
+    AnalysisMode analysisMode;    // Per-channel level analysis and handling of silent outputs
+    SignalAnalysis *analysis_p;   // Levels of the session being split (NULL when disabled)
+    PeakLevels peakLevels;        // Bin sizes of the peak overviews (no levels when disabled)
+    PeakOverview *peaks_p;        // Peak overviews of the session being split (NULL when disabled)
+    SampleFormat sampleFormat;    // Sample format of the outputs
+    SampleConverter *converter_p; // Conversion of the session being split (NULL when samples are copied)
+    OutputCodec outputCodec;      // Codec of the output files
+    FlacEncoder **encoders_pp;    // FLAC encoder per output of the session being split (NULL for WAV)
+    SessionPosition start;        // First position to split (--start)
+    SessionPosition end;          // Position to stop at (--end)
+    const SessionRange *range_p;  // Frames of the session being split (NULL for the whole session)
+    CachePolicy cachePolicy;      // Whether consumed input and written outputs are dropped from the page cache
+    size_t dirtyLimitMB;          // Dirty megabytes per output with CACHE_POLICY_DROP
+    PageCache *cache_p;           // Page cache state of the session being split (NULL with CACHE_POLICY_KEEP)
+    ChecksumMode checksumMode;    // Whether inputs and outputs are hashed into a manifest
+    SessionChecksums *checksums_p;// Checksums of the session being split (NULL when disabled)
+} SplitOptions;
+
+typedef struct {
+    WavHeader format;          // Header of the first chunk (format of all chunks)
+    WavHeader outputFormat;    // Sample format of the outputs (see plan_output_format)
+    uint64_t totalFrames;      // Whole frames in the data chunks of all chunks
+    uint64_t channelDataBytes; // Final size of the data chunk of every output
+} SessionPlan;
 
 /**
- * Initialize the session by finding the maximum chunk index and creating output directory
+ * Initialize the session by creating its output directory
+ *
+ * An existing output directory is only accepted if it holds a journal to resume from.
  * 
  * @param sessionPath_p Path to the session directory
- * @param maxChunkIndex Pointer to store the maximum chunk index found
  * @param outputPath_p Pointer to store the allocated output path string
+ * @param resume_p Pointer to store whether a journal was found (NULL to always start a new output directory)
+ */
+void initialize_session(const char *sessionPath_p, char **outputPath_p, bool *resume_p);
+
+/**
+ * Add a chunk to a session plan
+ *
+ * Reads the header of the chunk, takes the format from the first chunk and checks that
+ * every later chunk shares it, then adds the whole frames available in its data chunk. A
+ * chunk holding less audio than its header announces is reported with a warning.
+ *
+ * @param sessionPath_p Path to the session directory
+ * @param chunkIndex Index of the chunk to add
+ * @param plan_p Session plan to extend (zeroed before the first chunk)
+ */
+void plan_chunk(const char *sessionPath_p, uint64_t chunkIndex, SessionPlan *plan_p);
+
+/**
+ * Work out the final size of every output before any audio is processed
+ *
+ * Takes the format of the first chunk and the whole frames of all chunks from the session
+ * index, whose chunks are already checked to share that format.
+ *
+ * @param index_p Index of the session
+ * @param range_p Range of the session to split (NULL for the whole session)
+ * @param plan_p Pointer to store the session plan
+ */
+void plan_session(const SessionIndex *index_p, const SessionRange *range_p, SessionPlan *plan_p);
+
+/**
+ * Apply the requested sample format of the outputs to a session plan
+ *
+ * Exits if the session cannot be converted to it or, for FLAC outputs, cannot be
+ * encoded with the resolved channel selection.
+ *
+ * @param options_p Processing options (sample format, output codec and resolved channels)
+ * @param plan_p Session plan holding the format of the first chunk
  */
-void initialize_session(const char *sessionPath_p, uint64_t *maxChunkIndex, char **outputPath_p);
+void plan_output_format(const SplitOptions *options_p, SessionPlan *plan_p);
 
 /**
- * Initialize write buffers for all channels
+ * Create the output files with their final headers and preallocate them to their final size
+ *
+ * @param options_p Processing options (output backend and large container determine the header layout)
+ * @param plan_p Session plan providing format and final sizes
+ * @param outputPath_p Path to output directory
+ * @param outputFiles_pp Pointer to array of output file handles (allocated by this function)
+ * @param bytesWritten_p Pointer to array tracking bytes written per channel (allocated by this function)
+ */
+void initialize_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, const char *outputPath_p,
+                             FILE ***outputFiles_pp, uint64_t **bytesWritten_p);
+
+/**
+ * Create FLAC output files and an encoder for every output
+ *
+ * The stream headers are sized for the planned session and completed by
+ * finalize_output_files. The format was checked by plan_output_format.
+ *
+ * @param options_p Processing options (selected channels)
+ * @param plan_p Session plan providing the output format and the planned frames
+ * @param outputPath_p Path to output directory
+ * @param outputFiles_pp Pointer to array of output file handles (allocated by this function)
+ * @param bytesWritten_p Pointer to array tracking PCM bytes per output (allocated by this function)
+ * @return Array of encoders, one per output
+ */
+FlacEncoder **initialize_flac_outputs(const SplitOptions *options_p, const SessionPlan *plan_p,
+                                      const char *outputPath_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p);
+
+/**
+ * Reopen the outputs of a journaled session and find where to continue
+ *
+ * Every output is cut back to the frames all outputs hold according to the journal (for
+ * the direct backend rounded down so writes stay aligned), gets a header for the planned
+ * session size and is preallocated again.
+ *
+ * @param options_p Processing options (output backend and large container determine the header layout)
+ * @param plan_p Session plan of all chunks present now
+ * @param journaledBytes_p Bytes of every output recorded in the journal (see journal_load)
+ * @param index_p Index of the session, locates the chunk to continue with
+ * @param outputPath_p Path to output directory
+ * @param outputFiles_pp Pointer to array of output file handles (allocated by this function)
+ * @param bytesWritten_p Pointer to array tracking bytes written per channel (allocated by this function)
+ * @param firstChunkIndex_p Pointer to store the chunk to continue with
+ * @param skipFrames_p Pointer to store the frames of that chunk that are already split
+ * @return true if audio is left to split, false if the outputs already hold the whole session
+ */
+bool resume_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, const uint64_t *journaledBytes_p,
+                         const SessionIndex *index_p, const char *outputPath_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p,
+                         uint64_t *firstChunkIndex_p, uint64_t *skipFrames_p);
+
+/**
+ * Create the output writer and its buffer pool for all channels
  * 
- * @param inputHeader WAV header containing channel information
- * @param totalBufferSizeMB Total buffer size in megabytes to allocate across all channels
- * @param writeBuffers_pp Pointer to array of write buffers (one per channel)
- * @param bufferFillBytes_p Pointer to array tracking bytes filled in each buffer
- * @param bufferSizeBytes Pointer to store the calculated buffer size per channel in bytes
+ * @param options_p Processing options (buffer size, output backend and selected channels)
+ * @param outputFormat_p Sample format of the outputs
+ * @param outputFiles_pp Array of output file handles
+ * @param bytesWritten_p Array tracking bytes written per channel
+ * @return Output writer, released by flush_remaining_buffers
  */
-void initialize_buffers(const WavHeader *inputHeader, size_t totalBufferSizeMB, 
-                       uint8_t ***writeBuffers_pp, size_t **bufferFillBytes_p, 
-                       size_t *bufferSizeBytes);
+OutputWriter *initialize_output_writer(const SplitOptions *options_p, const WavHeader *outputFormat_p,
+                                       FILE **outputFiles_pp, uint64_t *bytesWritten_p);
 
 /**
- * Read chunk header and initialize output files on first chunk
+ * Acquire one write buffer per channel from the output writer
  * 
+ * @param options_p Processing options (selected channels)
+ * @param writer_p Output writer providing the buffers
+ * @param writeBuffers_pp Pointer to array of write buffers (one per output)
+ */
+void initialize_buffers(const SplitOptions *options_p, OutputWriter *writer_p, OutputBuffer ***writeBuffers_pp);
+
+/**
+ * Open a chunk and read its header
+ *
+ * The data of the last chunk of a range is cut at the end of the range.
+ * 
+ * @param options_p Processing options (selected channels, needed for cleanup on failure)
  * @param chunkIndex Current chunk index being processed
  * @param sessionPath_p Path to the session directory
  * @param inputHeader Pointer to WAV header structure to populate
  * @param outputFiles_pp Pointer to array of output file handles
  * @param bytesWritten_p Pointer to array tracking bytes written per channel
- * @param outputPath_p Path to output directory
  * @return Opened input file handle (caller must close after processing)
  */
-FILE* read_chunk_header(uint64_t chunkIndex, const char *sessionPath_p, 
-                        WavHeader *inputHeader, FILE ***outputFiles_pp, 
-                        uint32_t **bytesWritten_p, const char *outputPath_p);
+FILE* read_chunk_header(const SplitOptions *options_p, uint64_t chunkIndex, const char *sessionPath_p, WavHeader *inputHeader,
+                        FILE ***outputFiles_pp, uint64_t **bytesWritten_p);
+
+/**
+ * Skip frames at the start of a chunk that an earlier run already split
+ *
+ * @param inputFile_p Input file positioned at the start of the audio data
+ * @param inputHeader WAV header of the chunk, its data size is reduced accordingly
+ * @param skipFrames Number of frames to skip
+ */
+void skip_chunk_frames(FILE *inputFile_p, WavHeader *inputHeader, uint64_t skipFrames);
 
 /**
  * Extract audio data from current chunk and distribute to channel buffers
+ *
+ * Reads the data chunk in blocks of whole frames and splits each block with the
+ * width-specialized deinterleave engine (see deinterleave.h). Only the selected channels
+ * are gathered from each frame.
  * 
+ * @param options_p Processing options (input backend and selected channels)
  * @param inputFile_p Input WAV file handle
  * @param inputHeader WAV header containing format information
- * @param writeBuffers_pp Array of write buffers (one per channel)
- * @param bufferFillBytes_p Array tracking bytes filled in each buffer
- * @param bufferSizeBytes Size of each buffer in bytes
- * @param outputFiles_pp Array of output file handles
- * @param bytesWritten_p Array tracking bytes written per channel
+ * @param writer_p Output writer full buffers are submitted to
+ * @param writeBuffers_pp Array of write buffers (one per output)
  */
-void extract_audio_from_chunk(FILE *inputFile_p, const WavHeader *inputHeader,
-                             uint8_t **writeBuffers_pp, size_t *bufferFillBytes_p,
-                             size_t bufferSizeBytes, FILE **outputFiles_pp,
-                             uint32_t *bytesWritten_p);
+void extract_audio_from_chunk(const SplitOptions *options_p, FILE *inputFile_p, const WavHeader *inputHeader,
+                             OutputWriter *writer_p, OutputBuffer **writeBuffers_pp);
 
 /**
- * Flush any remaining buffered data to output files
+ * Flush any remaining buffered data and wait until all writes completed
  * 
- * @param inputHeader WAV header containing channel information
- * @param writeBuffers_pp Array of write buffers (one per channel)
- * @param bufferFillBytes_p Array tracking bytes filled in each buffer
+ * @param options_p Processing options (selected channels)
+ * @param writer_p Output writer, destroyed by this function
+ * @param writeBuffers_pp Array of write buffers (one per output), NULL if the pipeline already submitted them
+ */
+void flush_remaining_buffers(const SplitOptions *options_p, OutputWriter *writer_p,
+                            OutputBuffer **writeBuffers_pp);
+
+/**
+ * Make the outputs valid WAV files for everything processed so far
+ *
+ * Submits partially filled buffers, waits until all writes completed and rewrites the
+ * headers with the current sizes. Processing continues afterwards with the same buffers.
+ *
+ * @param options_p Processing options (buffered output backend, selected channels)
+ * @param plan_p Session plan providing the format
+ * @param writer_p Output writer
+ * @param writeBuffers_pp Array of write buffers (one per output), refilled with empty buffers
  * @param outputFiles_pp Array of output file handles
- * @param bytesWritten_p Array tracking bytes written per channel
+ * @param bytesWritten_p Array tracking bytes written per output
  */
-void flush_remaining_buffers(const WavHeader *inputHeader, uint8_t **writeBuffers_pp,
-                            size_t *bufferFillBytes_p, FILE **outputFiles_pp,
-                            uint32_t *bytesWritten_p);
+void checkpoint_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, OutputWriter *writer_p,
+                             OutputBuffer **writeBuffers_pp, FILE **outputFiles_pp, uint64_t *bytesWritten_p);
 
 /**
- * Finalize output files by rewriting headers with correct sizes and cleanup
+ * Finalize output files and cleanup
+ *
+ * The final headers are already in place, so this only closes the files. Outputs that did
+ * not receive the planned amount of audio (a chunk changed while processing) get their
+ * header rewritten and are trimmed to their actual size. FLAC outputs encode their last
+ * block and get their stream header completed, the compression is printed.
  * 
- * @param inputHeader WAV header containing format information
+ * @param options_p Processing options (output backend and large container determine the header layout)
+ * @param plan_p Session plan the output files were created from
  * @param bytesWritten_p Pointer to array tracking bytes written per channel
  * @param outputFiles_pp Pointer to array of output file handles
  */
-void finalize_output_files(const WavHeader *inputHeader, uint32_t **bytesWritten_p,
-                          FILE ***outputFiles_pp);
+void finalize_output_files(const SplitOptions *options_p, const SessionPlan *plan_p,
+                          uint64_t **bytesWritten_p, FILE ***outputFiles_pp);
+
+/**
+ * Split one session directory into its outputs
+ *
+ * Runs all steps from planning to finalizing for the session and reports progress on
+ * stdout. An empty channel selection in options_p selects all channels of this session,
+ * so the same options can be used for sessions with different channel counts.
+ *
+ * @param options_p Processing options
+ * @param sessionPath_p Path to the session directory
+ */
+void split_session(const SplitOptions *options_p, const char *sessionPath_p);
 
 #endif // PROCESSING_H
@@ -0,0 +1,167 @@
+/**
+ * @file run-stats.h
+ * @brief Per-stage timing of a split run
+ *
+ * This header file contains the definition of the run statistics. When enabled, every
+ * stage of the split (header parsing, input reads, deinterleaving, output writes and the
+ * waits between them) reports how long it took and how many bytes it moved, both per
+ * chunk and in total. The statistics feed a periodic progress line with ETA on stderr
+ * and a JSON report written at the end of the run. All functions accept NULL and then
+ * do nothing, so disabled statistics cost a single branch per block.
+ *
+ * Stage times are summed over all threads working on a stage, so with several jobs they
+ * can exceed the wall time of the run.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wav-header.h"
+
+typedef enum {
+    RUN_STAGE_HEADER = 0,   // Planning, opening chunks and parsing their headers
+    RUN_STAGE_READ,         // Reading interleaved audio from the chunks
+    RUN_STAGE_DEINTERLEAVE, // Deinterleaving into the output buffers
+    RUN_STAGE_WRITE,        // Handing filled buffers to the output backend
+    RUN_STAGE_WRITE_WAIT,   // Waiting for free output buffers or in-flight writes
+    RUN_STAGE_READ_WAIT,    // Deinterleave workers waiting for input blocks
+    RUN_STAGE_COUNT
+} RunStage;
+
+typedef struct RunStats RunStats;
+
+/**
+ * Create the statistics of a run, the clock of the run starts now
+ *
+ * @param progressInterval Seconds between progress lines on stderr (0 disables them)
+ * @return New statistics, exits on failure
+ */
+RunStats *run_stats_create(double progressInterval);
+
+/**
+ * Record the configuration of the run for the report
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param bufferSizeMB Total buffer size
+ * @param jobs Number of jobs
+ * @param inputBackend_p Name of the input backend
+ * @param outputBackend_p Name of the output backend
+ */
+void run_stats_set_config(RunStats *stats_p, size_t bufferSizeMB, unsigned int jobs, const char *inputBackend_p,
+                          const char *outputBackend_p);
+
+/**
+ * Record the session that is split
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param sessionPath_p Session directory
+ * @param format_p Format of the session
+ * @param outputCount Number of outputs
+ * @param expectedInputBytes Audio bytes left to read, 0 if unknown (no ETA then)
+ */
+void run_stats_begin_session(RunStats *stats_p, const char *sessionPath_p, const WavHeader *format_p,
+                             uint16_t outputCount, uint64_t expectedInputBytes);
+
+/**
+ * Record the number of threads per stage, used to turn stage times into utilization
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param readers Threads reading the chunks
+ * @param workers Threads deinterleaving
+ * @param writers Threads writing the outputs
+ */
+void run_stats_set_threads(RunStats *stats_p, unsigned int readers, unsigned int workers, unsigned int writers);
+
+/**
+ * Mark the start of a chunk
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param chunkIndex Chunk that is opened
+ */
+void run_stats_begin_chunk(RunStats *stats_p, uint64_t chunkIndex);
+
+/**
+ * Chunk passed to the last run_stats_begin_chunk
+ *
+ * Only meaningful for single-threaded processing, in the pipeline the reader runs ahead.
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @return Chunk index, 0 without statistics
+ */
+uint64_t run_stats_current_chunk(const RunStats *stats_p);
+
+/**
+ * Start time for a measurement
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @return Current time in seconds, 0 without statistics (no clock is read)
+ */
+double run_stats_now(const RunStats *stats_p);
+
+/**
+ * Account the time since startSeconds to a stage of a chunk
+ *
+ * Bytes of RUN_STAGE_READ count as input, bytes of RUN_STAGE_WRITE as output. Reads may
+ * print a progress line. Safe to call from any thread.
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param chunkIndex Chunk the work belongs to, 0 for work that belongs to the whole session
+ * @param stage Stage
+ * @param startSeconds Start time from run_stats_now
+ * @param bytes Bytes moved by the measured work
+ */
+void run_stats_add(RunStats *stats_p, uint64_t chunkIndex, RunStage stage, double startSeconds, uint64_t bytes);
+
+/**
+ * Record how the outputs were compressed
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param codec_p Codec name
+ * @param inputBytes PCM bytes handed to the encoders
+ * @param outputBytes Bytes of the encoded outputs
+ * @param encodeSeconds Time spent encoding, summed over all threads
+ */
+void run_stats_set_compression(RunStats *stats_p, const char *codec_p, uint64_t inputBytes, uint64_t outputBytes,
+                               double encodeSeconds);
+
+/**
+ * Record what the page cache policy did
+ *
+ * @param stats_p Statistics (may be NULL)
+ * @param dirtyLimitBytes Bytes per output that could be dirty or under writeback
+ * @param inputDroppedBytes Input bytes dropped from the cache
+ * @param writtenBackBytes Output bytes written back and dropped before the files were closed
+ * @param writebackWaitSeconds Time the writers waited for writeback, summed over all threads
+ */
+void run_stats_set_page_cache(RunStats *stats_p, uint64_t dirtyLimitBytes, uint64_t inputDroppedBytes,
+                              uint64_t writtenBackBytes, double writebackWaitSeconds);
+
+/**
+ * Stop the clock of the run
+ *
+ * @param stats_p Statistics (may be NULL)
+ */
+void run_stats_finish(RunStats *stats_p);
+
+/**
+ * Write the statistics as a JSON report
+ *
+ * @param stats_p Statistics
+ * @param reportPath_p Path of the report
+ * @return 0 on success, -1 on failure (error printed)
+ */
+int run_stats_write_report(const RunStats *stats_p, const char *reportPath_p);
+
+/**
+ * Free the statistics
+ *
+ * @param stats_p Statistics (may be NULL)
+ */
+void run_stats_destroy(RunStats *stats_p);
+
+#endif // RUN_STATS_H
@@ -0,0 +1,169 @@
+/**
+ * @file sample-convert.h
+ * @brief Sample format conversion of the deinterleaved outputs
+ *
+ * This header file contains the definition of the sample converter. The outputs normally
+ * keep the sample format of the session. When another format is requested, every block is
+ * deinterleaved into a small staging area that stays in the cache and converted from there
+ * into the output buffers, so no second pass over the written files is needed. Conversions
+ * to 32 bit float and between integer widths have AVX2 kernels for the common 24 bit input.
+ *
+ * Reducing the word length adds TPDF dither of one output LSB before rounding. The noise is
+ * derived from the output and the position of the sample, so the outputs do not depend on
+ * the number of jobs or the block sizes and a resumed session continues the same sequence.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef SAMPLE_CONVERT_H
+#define SAMPLE_CONVERT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "wav-header.h"
+#include "wavsplit.h"
+
+// Deinterleaved samples are staged in blocks of at most this size before they are converted
+#define CONVERT_STAGING_BYTES (256 * 1024)
+
+typedef enum {
+    SAMPLE_FORMAT_SOURCE = 0, // Format of the session
+    SAMPLE_FORMAT_S16,        // 16 bit integer PCM
+    SAMPLE_FORMAT_S24,        // 24 bit integer PCM
+    SAMPLE_FORMAT_S32,        // 32 bit integer PCM
+    SAMPLE_FORMAT_F32         // 32 bit IEEE float
+} SampleFormat;
+
+/**
+ * Conversion kernel signature
+ *
+ * Converts count samples from src_p to dst_p. position is the index of the first sample
+ * within its output and together with seed selects the dither noise.
+ *
+ * @param src_p Samples in the session format
+ * @param dst_p Converted samples
+ * @param count Number of samples
+ * @param seed Dither seed of the output
+ * @param position Index of the first sample within the output
+ */
+typedef void (*ConvertKernel)(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                              uint64_t position);
+
+typedef struct {
+    uint16_t inputBytes;      // Bytes per sample of the session
+    uint16_t outputBytes;     // Bytes per sample of the outputs
+    ConvertKernel kernel_p;   // Selected kernel
+    const char *kernelName_p; // Human readable name of the selected kernel
+    uint64_t *positions_p;    // Samples converted per output so far (each entry owned by one thread)
+} SampleConverter;
+
+/**
+ * Parse a sample format as given on the command line
+ *
+ * @param name_p Format name ("s16", "s24", "s32" or "f32")
+ * @param format_p Pointer to store the parsed format
+ * @return 0 on success, -1 if the name is unknown
+ */
+int sample_format_parse(const char *name_p, SampleFormat *format_p);
+
+/**
+ * Name of a sample format as given on the command line
+ *
+ * @param format Sample format
+ * @return Format name ("source" for the session format)
+ */
+const char *sample_format_name(SampleFormat format);
+
+/**
+ * Translate a sample format of the push API (see wavsplit.h)
+ *
+ * @param format Sample format of a WavsplitConfig
+ * @param format_p Pointer to store the sample format
+ * @return 0 on success, -1 if the value is no sample format
+ */
+int sample_format_from_wavsplit(WavsplitSampleFormat format, SampleFormat *format_p);
+
+/**
+ * Sample format of the push API for a sample format
+ *
+ * @param format Sample format
+ * @return Sample format for a WavsplitConfig
+ */
+WavsplitSampleFormat sample_format_to_wavsplit(SampleFormat format);
+
+/**
+ * Work out the format of the outputs
+ *
+ * Only the audio format and the bits per sample change, the channel layout is set per
+ * output by _output_header.
+ *
+ * @param format Requested sample format
+ * @param inputFormat_p Format of the session
+ * @param outputFormat_p Pointer to store the format of the outputs
+ * @return 0 on success, -1 if the session cannot be converted
+ */
+int sample_format_output_header(SampleFormat format, const WavHeader *inputFormat_p, WavHeader *outputFormat_p);
+
+/**
+ * Whether converting between two formats changes the samples
+ *
+ * @param inputFormat_p Format of the session
+ * @param outputFormat_p Format of the outputs
+ * @return true if the samples need to be converted
+ */
+bool sample_format_converts(const WavHeader *inputFormat_p, const WavHeader *outputFormat_p);
+
+/**
+ * Select the fastest kernel for a conversion
+ *
+ * @param converter_p Converter to initialize
+ * @param inputFormat_p Format of the session
+ * @param outputFormat_p Format of the outputs, must differ from the session format
+ * @param outputCount Number of outputs
+ * @param bytesWritten_p Audio bytes every output already holds, the dither continues behind them
+ * @return 0 on success, -1 if the converter cannot be allocated
+ */
+int sample_converter_init(SampleConverter *converter_p, const WavHeader *inputFormat_p,
+                           const WavHeader *outputFormat_p, uint16_t outputCount, const uint64_t *bytesWritten_p);
+
+/**
+ * Convert deinterleaved samples of an output
+ *
+ * Outputs are owned by exactly one thread, so different outputs may be converted at the
+ * same time without locking.
+ *
+ * @param converter_p Converter
+ * @param output Output the samples belong to
+ * @param src_p Samples in the session format
+ * @param dst_p Converted samples
+ * @param count Number of samples (frames times channels of the output)
+ */
+void sample_converter_run(SampleConverter *converter_p, uint16_t output, const uint8_t *src_p, uint8_t *dst_p,
+                          size_t count);
+
+/**
+ * Allocate the staging area a thread deinterleaves into before converting
+ *
+ * The area is split into consecutive slices, one per output, each holding the samples of
+ * the same number of frames in the session format.
+ *
+ * @param converter_p Converter
+ * @param groupSizes_p Number of channels per output
+ * @param outputCount Number of outputs
+ * @param targets_pp Array of outputCount pointers to store the slice of every output
+ * @param frames_p Pointer to store the number of frames the area holds
+ * @return Staging area, to be released with free() (NULL if it cannot be allocated)
+ */
+uint8_t *sample_converter_staging(const SampleConverter *converter_p, const uint16_t *groupSizes_p,
+                                  uint16_t outputCount, uint8_t **targets_pp, size_t *frames_p);
+
+/**
+ * Free the converter state
+ *
+ * @param converter_p Converter
+ */
+void sample_converter_free(SampleConverter *converter_p);
+
+#endif // SAMPLE_CONVERT_H
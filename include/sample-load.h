@@ -0,0 +1,65 @@
+/**
+ * @file sample-load.h
+ * @brief Loading of packed little-endian PCM samples
+ *
+ * This header file contains the sample loaders shared by the analysis, peak overview and
+ * conversion kernels. The scalar loaders widen one 16, 24 or 32 bit sample to a signed 32
+ * bit value. The AVX2 loader widens eight packed 24 bit samples at once.
+ *
+ * Internal to the library, the functions are inlined into their callers.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef SAMPLE_LOAD_H
+#define SAMPLE_LOAD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAMPLE_LOAD_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static inline int32_t _load_s16(const uint8_t *sample_p) {
+    int16_t value;
+    memcpy(&value, sample_p, sizeof(value));
+    return value;
+}
+
+static inline int32_t _load_s24(const uint8_t *sample_p) {
+    // place the sample in the upper three bytes, the arithmetic shift sign-extends it
+    const uint32_t raw = (uint32_t)sample_p[0] << 8 | (uint32_t)sample_p[1] << 16 | (uint32_t)sample_p[2] << 24;
+    return (int32_t)raw >> 8;
+}
+
+static inline int32_t _load_s32(const uint8_t *sample_p) {
+    int32_t value;
+    memcpy(&value, sample_p, sizeof(value));
+    return value;
+}
+
+#ifdef SAMPLE_LOAD_X86_SIMD
+/**
+ * Load eight packed 24 bit samples into the upper three bytes of 32 bit lanes
+ *
+ * The samples come out scaled by 256, an arithmetic shift by 8 gives their value. Two
+ * overlapping 16 byte loads read 4 bytes past the 24 bytes of the samples, so callers keep
+ * at least two more samples in the buffer (loop bound i + 10 <= count).
+ *
+ * @param src_p First of the eight samples
+ * @return The samples, one per 32 bit lane
+ */
+__attribute__((target("avx2")))
+static inline __m256i _load_s24x8_avx2(const uint8_t *src_p) {
+    const __m256i unpack = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m256i packed = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)src_p)),
+                                                   _mm_loadu_si128((const __m128i *)(src_p + 12)), 1);
+    return _mm256_shuffle_epi8(packed, unpack);
+}
+#endif // SAMPLE_LOAD_X86_SIMD
+
+#endif // SAMPLE_LOAD_H
@@ -0,0 +1,134 @@
+/**
+ * @file session-index.h
+ * @brief Validated index of the chunks of a session
+ *
+ * This header file contains the definition of the session index. Before any output is
+ * created, the chunks of a session are enumerated, their numbering is checked for gaps and
+ * their headers are parsed on several threads. Every chunk has to share the format of the
+ * first one. The index records where the audio data of every chunk starts, how much of it
+ * is present and which frame of the session it begins with, so a frame can be located
+ * without opening any chunk.
+ *
+ * The index is cached in a small text file in the session directory. Chunks whose size and
+ * modification time did not change are taken from the cache, so a repeated run only parses
+ * the headers of new or modified chunks.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wav-header.h"
+
+// Name of the index cache inside the session directory
+#define SESSION_INDEX_FILE_NAME ".wav-splitter-index"
+
+// Header reads wait on the storage rather than the CPU, so they use this many threads regardless of -j
+#define SESSION_INDEX_MAX_THREADS 8
+
+typedef struct {
+    uint64_t fileBytes;   // Size of the chunk file
+    int64_t modifiedTime; // Modification time of the chunk file in seconds
+    WavHeader header;     // Header of the chunk (data_bytes as declared)
+    uint64_t dataOffset;  // Offset of the first audio byte in the file
+    uint64_t dataBytes;   // Audio bytes present in the file, the data chunk may claim more
+    uint64_t frames;      // Whole frames present in the file
+    uint64_t firstFrame;  // Frame of the session the chunk starts with
+} ChunkEntry;
+
+typedef struct {
+    bool set;        // Position was given
+    bool inFrames;   // Position is a frame count rather than a time
+    uint64_t frames; // Position in frames (inFrames)
+    double seconds;  // Position in seconds (otherwise)
+} SessionPosition;
+
+typedef struct {
+    uint64_t startFrame;      // First frame of the range
+    uint64_t endFrame;        // Frame behind the last frame of the range
+    uint64_t firstChunk;      // Chunk holding the first frame
+    uint64_t firstChunkSkip;  // Frames of the first chunk in front of the range
+    uint64_t lastChunk;       // Chunk holding the last frame
+    uint64_t lastChunkFrames; // Frames of the last chunk up to the end of the range, counted from its start
+} SessionRange;
+
+typedef struct {
+    uint64_t chunkCount;   // Chunks 1 to chunkCount
+    ChunkEntry *chunks_p;  // Entry of chunk i at index i - 1
+    uint64_t totalFrames;  // Whole frames of all chunks
+    uint64_t cachedChunks; // Entries taken from the index file
+} SessionIndex;
+
+/**
+ * Check that a chunk can be split together with the first chunk of its session
+ *
+ * @param first_p Header of the first chunk (NULL when checking the first chunk itself)
+ * @param header_p Header of the chunk
+ * @param path_p Path of the chunk, for the error message
+ * @return 0 if the chunk fits, -1 otherwise (error printed)
+ */
+int session_index_check_chunk(const WavHeader *first_p, const WavHeader *header_p, const char *path_p);
+
+/**
+ * Index the chunks of a session
+ *
+ * Fails if no chunk is found, if chunks are missing between 1 and the highest index, if a
+ * header cannot be read or if a chunk differs from the format of the first one. The cache
+ * is updated whenever a chunk had to be parsed.
+ *
+ * @param index_p Index to fill
+ * @param sessionPath_p Path to the session directory
+ * @return 0 on success, -1 if the session cannot be split (error printed)
+ */
+int session_index_build(SessionIndex *index_p, const char *sessionPath_p);
+
+/**
+ * Find the chunk holding a frame of the session
+ *
+ * @param index_p Session index
+ * @param frame Frame of the session, below totalFrames
+ * @param chunkIndex_p Pointer to store the chunk index (1 based)
+ * @param frameInChunk_p Pointer to store the frame within that chunk
+ * @return 0 on success, -1 if the frame lies behind the end of the session
+ */
+int session_index_locate(const SessionIndex *index_p, uint64_t frame, uint64_t *chunkIndex_p,
+                         uint64_t *frameInChunk_p);
+
+/**
+ * Parse a position within a session as given on the command line
+ *
+ * Times are given as [[hours:]minutes:]seconds with an optional fraction (e.g. 1:02:03.5),
+ * frame counts with a trailing f for frames (e.g. 48000f).
+ *
+ * @param text_p Position text
+ * @param position_p Pointer to store the parsed position
+ * @return 0 on success, -1 if the text is not a position
+ */
+int session_position_parse(const char *text_p, SessionPosition *position_p);
+
+/**
+ * Work out which chunks and frames hold a range of the session
+ *
+ * An end behind the session is moved to the end of the session.
+ *
+ * @param index_p Session index
+ * @param start_p Start of the range (whole session from the first frame if not set)
+ * @param end_p End of the range, exclusive (end of the session if not set)
+ * @param range_p Pointer to store the range
+ * @return 0 on success, -1 if the range holds no frames or cannot be located (error printed)
+ */
+int session_index_range(const SessionIndex *index_p, const SessionPosition *start_p, const SessionPosition *end_p,
+                        SessionRange *range_p);
+
+/**
+ * Free the entries of an index
+ *
+ * @param index_p Session index
+ */
+void session_index_free(SessionIndex *index_p);
+
+#endif // SESSION_INDEX_H
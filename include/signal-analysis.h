@@ -0,0 +1,154 @@
+/**
+ * @file signal-analysis.h
+ * @brief Per-channel level analysis fused into the split
+ *
+ * This header file contains the definition of the signal analysis. Right after a block of
+ * frames was deinterleaved, the samples every output received are still in the cache and
+ * are reduced to peak, RMS, clip count and DC offset per input channel, so no second pass
+ * over the outputs is needed. Mono outputs use AVX2 reductions where available.
+ *
+ * Channels that stay digitally silent for the whole session can be kept, marked by
+ * renaming their output or dropped. When dropping, buffers of an output that has been
+ * silent so far are not written at all, so a dropped output never costs more than its
+ * header.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef SIGNAL_ANALYSIS_H
+#define SIGNAL_ANALYSIS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "channel-selection.h"
+#include "output-writer.h"
+
+// Name of the analysis table inside the output directory
+#define ANALYSIS_FILE_NAME "analysis.csv"
+
+typedef enum {
+    ANALYSIS_OFF = 0, // No analysis
+    ANALYSIS_KEEP,    // Analyze, keep silent outputs
+    ANALYSIS_MARK,    // Analyze, rename silent outputs to <name>.silent.wav (or .flac)
+    ANALYSIS_DROP     // Analyze, never write silent outputs and remove them
+} AnalysisMode;
+
+typedef struct {
+    uint32_t peak;     // Largest absolute sample value
+    uint64_t clipped;  // Samples at the smallest or largest representable value
+    double sum;        // Sum of all samples (DC offset)
+    double sumSquares; // Sum of all squared samples (RMS)
+    uint64_t samples;  // Number of analyzed samples
+} ChannelLevels;
+
+typedef struct {
+    uint32_t peak;     // Largest absolute sample value
+    uint64_t clipped;  // Samples at the smallest or largest representable value
+    int64_t sum;       // Sum of all samples
+    double sumSquares; // Sum of all squared samples
+} LevelBlock;
+
+// Samples reduced per kernel call, keeps the integer sums of a call from overflowing
+#define ANALYSIS_BLOCK_SAMPLES 65536
+
+/**
+ * Level kernel signature
+ *
+ * Reduces count samples of one channel that are stride samples apart.
+ *
+ * @param samples_p First sample
+ * @param count Number of samples (at most ANALYSIS_BLOCK_SAMPLES)
+ * @param stride Distance between two samples in samples (1 for mono outputs)
+ * @param block_p Pointer to store the levels of the samples
+ */
+typedef void (*LevelKernel)(const uint8_t *samples_p, size_t count, size_t stride, LevelBlock *block_p);
+
+typedef struct {
+    const ChannelSelection *channels_p; // Resolved selection the levels are kept for
+    uint16_t bytesPerSample;            // Bytes per sample of the session
+    AnalysisMode mode;                  // What happens to silent outputs
+    bool sparseWrites;                  // Skip writing buffers of silent outputs (ANALYSIS_DROP only)
+    ChannelLevels *levels_p;            // Levels of every selected channel, in the order of channels_p->channels_p
+    LevelKernel monoKernel_p;           // Reduction for outputs with a single channel
+    LevelKernel strideKernel_p;         // Reduction for a channel of an interleaved group
+    const char *kernelName_p;           // Name of the mono reduction (for logging)
+} SignalAnalysis;
+
+/**
+ * Parse an analysis mode as given on the command line
+ *
+ * @param name_p Mode name ("keep", "mark" or "drop")
+ * @param mode_p Pointer to store the parsed mode
+ * @return 0 on success, -1 if the name is unknown
+ */
+int analysis_mode_parse(const char *name_p, AnalysisMode *mode_p);
+
+/**
+ * Prepare the analysis of a session
+ *
+ * @param analysis_p Analysis to initialize
+ * @param channels_p Resolved channel selection, must outlive the analysis
+ * @param bitsPerSample Bits per sample of the session (16, 24 or 32)
+ * @param mode What happens to silent outputs
+ */
+void signal_analysis_init(SignalAnalysis *analysis_p, const ChannelSelection *channels_p, uint16_t bitsPerSample,
+                          AnalysisMode mode);
+
+/**
+ * Accumulate the levels of samples deinterleaved into an output
+ *
+ * Outputs are owned by exactly one thread, so different outputs may be analyzed at the
+ * same time without locking.
+ *
+ * @param analysis_p Analysis
+ * @param output Output the samples belong to
+ * @param samples_p Interleaved samples of the output's channels
+ * @param frameCount Number of frames at samples_p
+ */
+void signal_analysis_run(SignalAnalysis *analysis_p, uint16_t output, const uint8_t *samples_p, size_t frameCount);
+
+/**
+ * Whether every sample an output received so far was zero
+ *
+ * @param analysis_p Analysis
+ * @param output Output
+ * @return true if the output is silent so far
+ */
+bool signal_analysis_output_silent(const SignalAnalysis *analysis_p, uint16_t output);
+
+/**
+ * Mark a buffer that is about to be submitted as sparse if its output is dropped when silent
+ *
+ * Only buffers up to the first sound of an output become sparse, so the skipped ranges
+ * always precede written data or the end of a file that is removed in the end.
+ *
+ * Must be called by the thread that analyzed the buffer's samples.
+ *
+ * @param analysis_p Analysis (may be NULL)
+ * @param buffer_p Filled buffer
+ */
+void signal_analysis_prepare_submit(const SignalAnalysis *analysis_p, OutputBuffer *buffer_p);
+
+/**
+ * Print the levels, write them to the analysis table and handle silent outputs
+ *
+ * Must be called after the outputs were finalized and closed.
+ *
+ * @param analysis_p Analysis
+ * @param outputPath_p Output directory (with trailing separator)
+ * @param extension_p File name extension of the outputs (output_codec_extension)
+ * @return Number of outputs that were renamed or removed
+ */
+unsigned int signal_analysis_finish(const SignalAnalysis *analysis_p, const char *outputPath_p,
+                                    const char *extension_p);
+
+/**
+ * Free the analysis state
+ *
+ * @param analysis_p Analysis
+ */
+void signal_analysis_free(SignalAnalysis *analysis_p);
+
+#endif // SIGNAL_ANALYSIS_H
@@ -0,0 +1,62 @@
+/**
+ * @file stream.h
+ * @brief Splitting of a continuous interleaved stream read from stdin or a FIFO
+ *
+ * This header file contains the definition of the stream mode. Instead of a session
+ * directory, a single interleaved WAV stream (or a headerless stream of a given format) is
+ * read from stdin, a named pipe or a file and split while it arrives, through the push API
+ * of the library. Streamed WAV headers usually cannot know their length and carry a data
+ * size of 0 or 0xFFFFFFFF, such streams are read until they end.
+ *
+ * The outputs are written as WAV files into an output directory, with their headers brought
+ * up to date about once a second, or each output goes to its own FIFO or file descriptor
+ * so downstream encoders consume the tracks without anything touching the disk. Outputs on
+ * pipes start with a WAV header whose sizes are 0xFFFFFFFF.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include "processing.h"
+
+// Prefix of a pipe pattern naming file descriptors instead of paths
+#define STREAM_FD_PREFIX "fd:"
+
+// Placeholder of a pipe pattern replaced by the output name
+#define STREAM_NAME_PLACEHOLDER "{name}"
+
+typedef struct {
+    const char *inputPath_p;     // Path of the stream, "-" for stdin (NULL without stream mode)
+    bool raw;                    // The stream carries no WAV header
+    WavHeader rawFormat;         // Format of a headerless stream
+    const char *pipePattern_p;   // Per-output path with {name} or fd:<first fd> (NULL for files in the output directory)
+    const char *channelSpec_p;   // Channel list of -c (NULL for all channels)
+    const char *channelMap_p;    // Channel map file of -g (NULL for mono outputs)
+} StreamOptions;
+
+/**
+ * Parse the format of a headerless stream like s24:32:48000
+ *
+ * @param text_p Sample format (s16, s24, s32 or f32), channel count and sample rate separated by colons
+ * @param format_p Pointer to store the format
+ * @return 0 on success, -1 if the text is not a format
+ */
+int stream_raw_format_parse(const char *text_p, WavHeader *format_p);
+
+/**
+ * Split a stream until it ends
+ *
+ * Channel selection, channel map, sample format and large file container are taken from
+ * the options, the other settings of the session pipeline do not apply to streams.
+ *
+ * @param options_p Processing options
+ * @param stream_p Stream options
+ * @param outputPath_p Directory to create for the output files (NULL when writing to pipes)
+ */
+void stream_split(const SplitOptions *options_p, const StreamOptions *stream_p, const char *outputPath_p);
+
+#endif // STREAM_H
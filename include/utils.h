@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "wav-header.h"
+#include "channel-selection.h"
 
 /**
  * Clean up and close all output files and free allocated memory
@@ -27,7 +28,7 @@
  * @param count Number of channels (output files) to clean up
  * @param bytesWritten Pointer to array tracking bytes written per channel to free
  */
-void _cleanup(FILE ***outputFiles, uint16_t count, uint32_t **bytesWritten);
+void _cleanup(FILE ***outputFiles, uint16_t count, uint64_t **bytesWritten);
 
 /**
  * Create the output folder for processed WAV files
@@ -40,6 +41,18 @@ void _cleanup(FILE ***outputFiles, uint16_t count, uint32_t **bytesWritten);
  */
 void _create_output_folder(char *outputPath);
 
+/**
+ * List the chunks of a session directory
+ *
+ * Chunk files are named with eight hexadecimal digits and a .WAV extension (e.g. 00000001.WAV),
+ * other files are ignored.
+ *
+ * @param sessionPath Path to the session directory
+ * @param indices Pointer to store the sorted chunk indices (NULL if there are none, release with free())
+ * @return Number of chunks found
+ */
+uint64_t _list_chunk_indices(const char *sessionPath, uint64_t **indices);
+
 /**
  * Find the highest chunk index in the session directory
  *
@@ -51,33 +64,158 @@ void _create_output_folder(char *outputPath);
  */
 void _find_max_chunk_index(uint64_t *maxChunkIndex, const char *sessionPath);
 
+/**
+ * Reserve disk space for an output file
+ *
+ * Allocates the whole file in one go so that outputs growing side by side stay contiguous.
+ * Failing to preallocate is not fatal, the file then simply grows while it is written.
+ *
+ * @param outputFile Output file handle
+ * @param fileSize Final size of the file in bytes
+ */
+void _preallocate_output(FILE *outputFile, uint64_t fileSize);
+
+/**
+ * Trim an output file to its actual size
+ *
+ * @param outputFile Output file handle
+ * @param fileSize Size of the file in bytes
+ */
+void _truncate_output(FILE *outputFile, uint64_t fileSize);
+
+/**
+ * Flush a file to stable storage
+ *
+ * Flushes the stream buffer and waits until the data of the file reached the disk, so a
+ * journal written afterwards never claims data an OS crash or power loss could still lose.
+ *
+ * @param file File handle
+ * @return 0 on success, -1 on failure
+ */
+int _sync_file(FILE *file);
+
+/**
+ * Flush the entries of a directory to stable storage, e.g. after a rename inside it
+ *
+ * Does nothing on Windows, where renames are made durable with the file itself.
+ *
+ * @param directoryPath Path to the directory
+ * @return 0 on success, -1 on failure
+ */
+int _sync_directory(const char *directoryPath);
+
+/**
+ * File name of an output without directory and extension
+ *
+ * Named outputs of a channel map use their name, mono outputs are called ch_<channel>.
+ *
+ * @param name_p Buffer to store the name
+ * @param nameSize Size of the buffer
+ * @param channels Channel selection
+ * @param output Output index
+ */
+void _output_name(char *name_p, size_t nameSize, const ChannelSelection *channels, uint16_t output);
+
+/**
+ * Derive the header of an output from the input header
+ *
+ * @param inputHeader WAV header of the input
+ * @param channelCount Number of interleaved channels of the output
+ * @param outHeader Pointer to store the output header (sizes are left untouched)
+ */
+void _output_header(const WavHeader *inputHeader, uint16_t channelCount, WavHeader *outHeader);
+
 /**
  * Initialize output files for each channel
  *
- * Creates one output WAV file per channel, writes initial headers (with placeholder sizes),
- * and initializes tracking arrays for file handles and bytes written. The headers will be
- * rewritten with correct sizes after all data has been written.
+ * Creates one output WAV file per output of the channel selection (mono or grouped), writes the
+ * final headers for the planned amount of audio data, preallocates the files to their final size and initializes tracking arrays
+ * for file handles and bytes written.
  *
- * @param inputFile Input file handle (used for error handling context)
  * @param outputFiles Pointer to array of output file handles (allocated by this function)
  * @param inputHeader WAV header from input file containing format information
+ * @param channels Channel selection, one output file is created for each of its outputs
  * @param dataWritten Pointer to array tracking bytes written per channel (allocated by this function)
  * @param outputPath Path to the output directory where channel files will be created
+ * @param frameCount Planned number of frames of every output
+ * @param dataOffset Offset of the audio data in the output files
+ * @param largeContainer Container used for outputs beyond the RIFF limit
+ */
+void _init_output_files(FILE ***outputFiles, const WavHeader *inputHeader, const ChannelSelection *channels,
+                        uint64_t **dataWritten, const char *outputPath, uint64_t frameCount,
+                        uint32_t dataOffset, WavContainer largeContainer);
+
+/**
+ * Reopen the output files of an interrupted or extended session
+ *
+ * Opens the existing output files, writes headers for the planned amount of audio data,
+ * cuts every output back to resumeFrames frames and preallocates it to its final size
+ * again. The files are positioned at the end of their audio data.
+ *
+ * @param outputFiles Pointer to array of output file handles (allocated by this function)
+ * @param inputHeader WAV header from input file containing format information
+ * @param channels Channel selection the outputs were created from
+ * @param dataWritten Pointer to array tracking bytes written per channel (allocated by this function)
+ * @param outputPath Path to the output directory holding the output files
+ * @param resumeFrames Number of frames every output keeps
+ * @param frameCount Planned number of frames of every output
+ * @param dataOffset Offset of the audio data in the output files
+ * @param largeContainer Container used for outputs beyond the RIFF limit
  */
-void _init_output_files(FILE *inputFile, FILE ***outputFiles, const WavHeader *inputHeader, 
-                        uint32_t **dataWritten, const char *outputPath);
+void _reopen_output_files(FILE ***outputFiles, const WavHeader *inputHeader, const ChannelSelection *channels,
+                          uint64_t **dataWritten, const char *outputPath, uint64_t resumeFrames, uint64_t frameCount,
+                          uint32_t dataOffset, WavContainer largeContainer);
 
 /**
- * Rewrite WAV headers with correct file sizes
+ * Rewrite WAV headers of outputs that differ from the planned size
  *
- * After all audio data has been written, this function seeks back to the beginning
- * of each output file and rewrites the WAV header with the correct data_bytes and
- * wav_size fields based on the actual amount of data written.
+ * The headers written by _init_output_files already carry the planned sizes. Outputs that
+ * received a different amount of audio data (e.g. a chunk was modified while processing)
+ * get their header rewritten with the actual size, including the RF64/BW64 decision, and
+ * are trimmed so no preallocated space is left behind.
  *
  * @param inputHeader Original input WAV header containing format information
+ * @param channels Channel selection the outputs were created from
  * @param dataWritten Pointer to array containing actual bytes written per channel
  * @param outputFiles Pointer to array of output file handles to update
+ * @param plannedFrames Planned number of frames of every output
+ * @param dataOffset Offset of the audio data in the output files
+ * @param largeContainer Container used for outputs beyond the RIFF limit
+ */
+void _rewrite_headers(const WavHeader *inputHeader, const ChannelSelection *channels, uint64_t **dataWritten,
+                      FILE ***outputFiles, uint64_t plannedFrames, uint32_t dataOffset,
+                      WavContainer largeContainer);
+
+/**
+ * Write headers carrying the current sizes to all outputs
+ *
+ * Used at checkpoints while a session is still growing. The files stay open and are
+ * positioned at the end of their audio data afterwards.
+ *
+ * @param inputHeader Input WAV header containing format information
+ * @param channels Channel selection the outputs were created from
+ * @param dataWritten Array containing bytes written per output
+ * @param outputFiles Array of output file handles to update
+ * @param dataOffset Offset of the audio data in the output files
+ * @param largeContainer Container used for outputs beyond the RIFF limit
+ */
+void _update_headers(const WavHeader *inputHeader, const ChannelSelection *channels, const uint64_t *dataWritten,
+                     FILE **outputFiles, uint32_t dataOffset, WavContainer largeContainer);
+
+/**
+ * Peak resident set size of the process
+ *
+ * Used to confirm that memory use stays bounded by the buffer budget.
+ *
+ * @return Peak resident memory in bytes (0 if unavailable)
+ */
+uint64_t _peak_memory_bytes(void);
+
+/**
+ * Seconds of a monotonic clock, for measuring durations
+ *
+ * @return Current time in seconds from an arbitrary starting point
  */
-void _rewrite_headers(const WavHeader *inputHeader, uint32_t **dataWritten, FILE ***outputFiles);
+double _monotonic_seconds(void);
 
 #endif // PROCESSING_UTILS_H
@@ -0,0 +1,36 @@
+/**
+ * @file verify.h
+ * @brief Verification of a session and its outputs against a checksum manifest
+ *
+ * This header file contains the definition of the verify mode. The chunks of a session are
+ * read once, hashed and split in memory through the push API of the library, nothing is
+ * written. The CRC32C of every chunk and of every output is compared with the manifest a
+ * run with --checksum left in the output directory, which proves both the recorder's files
+ * and the outputs derived from them bit-exact without reading the outputs.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "processing.h"
+
+/**
+ * Verify a session against a manifest
+ *
+ * The outputs are only reproduced if channel selection, channel map and sample format are
+ * the ones of the run that wrote the manifest. Every mismatch is printed.
+ *
+ * @param options_p Processing options (input backend, buffer size and sample format)
+ * @param channelSpec_p Channel list of -c (NULL for all channels)
+ * @param channelMap_p Channel map file of -g (NULL for mono outputs)
+ * @param manifestPath_p Manifest written by a run with --checksum
+ * @param sessionPath_p Path to the session directory
+ * @return Number of mismatching or missing entries, 0 if everything matches
+ */
+unsigned int verify_session(const SplitOptions *options_p, const char *channelSpec_p, const char *channelMap_p,
+                            const char *manifestPath_p, const char *sessionPath_p);
+
+#endif // VERIFY_H
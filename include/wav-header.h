@@ -30,10 +30,65 @@ typedef struct {
     uint32_t data_bytes;      // Number of bytes in data
 } WavHeader;
 
+// Audio formats of the fmt chunk
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef enum {
+    WAV_CONTAINER_RF64 = 0, // EBU Tech 3306 RF64
+    WAV_CONTAINER_BW64      // ITU-R BS.2088 BW64
+} WavContainer;
+
+// Payload size of a ds64 chunk without table entries
+#define WAV_DS64_CHUNK_SIZE 28
+
+// Size of an output header with reserved ds64 space (RIFF + ds64 + fmt + data chunk headers)
+#define WAV_HEADER_SIZE_RESERVED (12 + 8 + WAV_DS64_CHUNK_SIZE + 8 + 16 + 8)
+
+// Size of a float output header, its fmt chunk carries an empty extension and a fact chunk follows
+#define WAV_HEADER_SIZE_RESERVED_FLOAT (WAV_HEADER_SIZE_RESERVED + 2 + 8 + 4)
+
+// Data size of a stream whose length is not known, written as 0xFFFFFFFF RIFF and data sizes
+#define WAV_STREAM_DATA_BYTES UINT64_MAX
+
 int read_header(FILE *inputFile_p, WavHeader *header_p);
 
+// Same as read_header without printing why a header cannot be read (e.g. while it is still written)
+int read_header_quiet(FILE *inputFile_p, WavHeader *header_p);
+
 int write_header(FILE *outputFile_p, const WavHeader *header_p);
 
+/**
+ * Write a mono output header whose audio data starts at a given offset
+ *
+ * The header always reserves space for a ds64 chunk with a JUNK chunk right after the
+ * WAVE id, so it can be rewritten in place once the final size is known. If the file
+ * exceeds the 4 GiB RIFF limit the JUNK chunk becomes a ds64 chunk and the file is
+ * written as RF64 or BW64. Float formats get an 18 byte fmt chunk and a fact chunk with
+ * the number of frames. Space between the fmt (or fact) chunk and the data chunk is
+ * filled with a second JUNK chunk, so dataOffset must either be the header size
+ * (wav_output_header_size) or at least 8 bytes larger. Outputs streamed to pipes pass
+ * WAV_STREAM_DATA_BYTES, their RIFF and data sizes are set to 0xFFFFFFFF.
+ *
+ * @param outputFile_p Output file, positioned at its start
+ * @param format_p Header providing the format fields (sizes are ignored)
+ * @param dataBytes Number of bytes in the data chunk
+ * @param dataOffset Offset of the first audio byte in the file
+ * @param largeContainer Container used when the file exceeds the RIFF limit
+ * @return 0 on success, -1 on failure
+ */
+int write_output_header(FILE *outputFile_p, const WavHeader *format_p, uint64_t dataBytes, uint32_t dataOffset,
+                        WavContainer largeContainer);
+
+/**
+ * Size of an output header written by write_output_header without padding
+ *
+ * @param audioFormat Audio format of the output
+ * @return WAV_HEADER_SIZE_RESERVED_FLOAT for float outputs, WAV_HEADER_SIZE_RESERVED otherwise
+ */
+uint32_t wav_output_header_size(uint16_t audioFormat);
+
 int create_output_files(const WavHeader *inputHeader_p, const char* basePath_p, FILE ***outputFiles_ppp);
 
 int split_wav_file(FILE *inputFile_p, const WavHeader *inputHeader_p, const char *inputFileName_p);
@@ -0,0 +1,176 @@
+/**
+ * @file wavsplit.h
+ * @brief Embeddable splitting engine with a streaming push API
+ *
+ * This header file contains the public interface of libwavsplit for programs that already
+ * hold the interleaved audio in memory. A context is created for one stream format and
+ * channel selection, interleaved frames are pushed into it in pieces of any size and every
+ * output is handed to a caller-supplied sink block by block, deinterleaved and optionally
+ * converted to another sample format. Nothing is written to disk.
+ *
+ * A context owns all of its state, so any number of contexts may be used at the same time
+ * from different threads. A single context must not be used by two threads at once. No
+ * function of the push API terminates the process, failures are reported as status codes
+ * with a message kept in the context.
+ *
+ * The file based splitting of recorder sessions used by the wav-splitter command line tool
+ * (see processing.h) ends the process on errors and is not part of the library.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#ifndef WAVSPLIT_H
+#define WAVSPLIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Frames per block handed to the sinks when the configuration leaves it open
+#define WAVSPLIT_DEFAULT_BLOCK_FRAMES 16384
+
+// Longest message kept for the last error of a context
+#define WAVSPLIT_MESSAGE_LENGTH 256
+
+typedef enum {
+    WAVSPLIT_OK = 0,               // Success
+    WAVSPLIT_ERROR_ARGUMENT = -1,  // Invalid argument or configuration
+    WAVSPLIT_ERROR_FORMAT = -2,    // Sample format of the stream is not supported
+    WAVSPLIT_ERROR_CHANNELS = -3,  // Channel list or channel map is invalid for the stream
+    WAVSPLIT_ERROR_MEMORY = -4,    // Memory allocation failed
+    WAVSPLIT_ERROR_SINK = -5,      // A sink reported a failure
+    WAVSPLIT_ERROR_STATE = -6      // The context is finished or failed before
+} WavsplitStatus;
+
+typedef enum {
+    WAVSPLIT_SAMPLE_SOURCE = 0,    // Sample format of the stream
+    WAVSPLIT_SAMPLE_S16 = 1,       // 16 bit integer PCM
+    WAVSPLIT_SAMPLE_S24 = 2,       // 24 bit integer PCM
+    WAVSPLIT_SAMPLE_S32 = 3,       // 32 bit integer PCM
+    WAVSPLIT_SAMPLE_F32 = 4        // 32 bit IEEE float
+} WavsplitSampleFormat;
+
+typedef struct {
+    uint16_t output;        // Output the block belongs to (order of the channel selection)
+    const char *name_p;     // Name of the output, ch_<channel> or the name from the channel map
+    uint16_t channels;      // Interleaved channels of the output
+    uint16_t bitsPerSample; // Bits per sample of the output
+    bool floatSamples;      // Samples are 32 bit IEEE float rather than integer PCM
+    uint64_t firstFrame;    // Frame of the stream the block starts with
+    size_t frames;          // Frames in the block
+    const uint8_t *data_p;  // Little endian samples, only valid during the sink call
+    size_t bytes;           // Bytes at data_p
+} WavsplitBlock;
+
+/**
+ * Sink receiving the blocks of the outputs
+ *
+ * All outputs advance together: every block of the stream is delivered to output 0 first,
+ * then output 1 and so on.
+ *
+ * @param user_p Pointer given in the configuration
+ * @param block_p Block of one output
+ * @return 0 to continue, any other value fails the push (WAVSPLIT_ERROR_SINK)
+ */
+typedef int (*WavsplitSink)(void *user_p, const WavsplitBlock *block_p);
+
+typedef struct {
+    uint16_t numChannels;              // Interleaved channels of the pushed frames
+    uint32_t sampleRate;               // Sampling rate of the stream (informational)
+    uint16_t bitsPerSample;            // Bits per sample of the pushed frames, 16, 24 or 32
+    bool floatSamples;                 // Pushed samples are 32 bit IEEE float
+    const char *channels_p;            // Channels to extract like "1-4,17,31" (NULL for all)
+    const char *channelMap_p;          // Channel map file defining the outputs (NULL for mono outputs)
+    WavsplitSampleFormat sampleFormat; // Sample format of the outputs
+    size_t blockFrames;                // Frames per delivered block (0 for WAVSPLIT_DEFAULT_BLOCK_FRAMES)
+    WavsplitSink sink_p;               // Sink receiving the blocks
+    void *user_p;                      // Passed to the sink
+} WavsplitConfig;
+
+typedef struct WavsplitContext WavsplitContext;
+
+/**
+ * Create a context for one stream
+ *
+ * If the configuration cannot be used, the failed context is still stored so
+ * wavsplit_error_message can describe the reason, and it has to be destroyed as well.
+ * Only if the context itself cannot be allocated NULL is stored.
+ *
+ * @param config_p Configuration, copied into the context (the strings are only read here)
+ * @param context_pp Pointer to store the context
+ * @return WAVSPLIT_OK or the reason the configuration cannot be used
+ */
+WavsplitStatus wavsplit_create(const WavsplitConfig *config_p, WavsplitContext **context_pp);
+
+/**
+ * Push interleaved frames of the stream
+ *
+ * The frames are deinterleaved into the block of every output right away, so the memory
+ * can be reused as soon as the call returns. Whenever the blocks are full they are handed
+ * to the sink.
+ *
+ * @param context_p Context
+ * @param frames_p Whole interleaved frames in the format of the configuration
+ * @param frameCount Number of frames at frames_p
+ * @return WAVSPLIT_OK, WAVSPLIT_ERROR_SINK or WAVSPLIT_ERROR_STATE
+ */
+WavsplitStatus wavsplit_push(WavsplitContext *context_p, const void *frames_p, size_t frameCount);
+
+/**
+ * End the stream and hand the partially filled blocks to the sink
+ *
+ * @param context_p Context
+ * @return WAVSPLIT_OK, WAVSPLIT_ERROR_SINK or WAVSPLIT_ERROR_STATE
+ */
+WavsplitStatus wavsplit_finish(WavsplitContext *context_p);
+
+/**
+ * Number of outputs of a context
+ *
+ * @param context_p Context
+ * @return Number of outputs
+ */
+uint16_t wavsplit_output_count(const WavsplitContext *context_p);
+
+/**
+ * Name of an output, as also passed in its blocks
+ *
+ * @param context_p Context
+ * @param output Output below wavsplit_output_count
+ * @return Name owned by the context (NULL for an invalid output)
+ */
+const char *wavsplit_output_name(const WavsplitContext *context_p, uint16_t output);
+
+/**
+ * Frames pushed into a context so far
+ *
+ * @param context_p Context
+ * @return Number of frames
+ */
+uint64_t wavsplit_frames(const WavsplitContext *context_p);
+
+/**
+ * Message describing the last failure of a context
+ *
+ * @param context_p Context
+ * @return Message owned by the context (empty if nothing failed)
+ */
+const char *wavsplit_error_message(const WavsplitContext *context_p);
+
+/**
+ * Short description of a status code
+ *
+ * @param status Status code
+ * @return Static string
+ */
+const char *wavsplit_status_string(WavsplitStatus status);
+
+/**
+ * Release a context and everything it owns
+ *
+ * @param context_p Context (NULL is ignored)
+ */
+void wavsplit_destroy(WavsplitContext *context_p);
+
+#endif // WAVSPLIT_H
@@ -0,0 +1,373 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "batch.h"
+#include "utils.h"
+
+#define MAX_PATH_LENGTH 250
+
+// Input blocks are 1 MB each (see pipeline.c and READ_BLOCK_SIZE_BYTES in processing.c)
+#define INPUT_BLOCK_SIZE_MB 1
+#define INPUT_BLOCKS_PER_WORKER 2
+
+typedef enum {
+    SESSION_PENDING = 0,
+    SESSION_RUNNING,
+    SESSION_DONE
+} SessionState;
+
+typedef struct {
+    char *path_p;           // Session directory
+    uint64_t device;        // Device the session directory lives on
+    uint64_t inputBytes;    // Size of all chunks of the session
+    SessionState state;     // Scheduling state
+    long pid;               // Process splitting the session (while running)
+    double startSeconds;    // Start time (monotonic clock)
+    double seconds;         // Wall time the session took
+    uint64_t peakBytes;     // Peak resident memory of the session process, 0 if unknown
+    bool failed;            // Whether the session failed
+} BatchSession;
+
+
+size_t batch_session_memory_mb(const SplitOptions *options_p) {
+    const size_t inputBlocks = options_p->jobs > 1 ? (size_t)options_p->jobs * INPUT_BLOCKS_PER_WORKER + 2 : 1;
+    return options_p->totalBufferSizeMB + inputBlocks * INPUT_BLOCK_SIZE_MB;
+}
+
+
+/**
+ * Append a session to the batch, sessions without chunks are skipped with a warning
+ *
+ * @param sessions_pp Pointer to the growing session array
+ * @param count_p Number of sessions in the array
+ * @param capacity_p Capacity of the array
+ * @param path_p Session directory (copied)
+ */
+static void _add_session(BatchSession **sessions_pp, size_t *count_p, size_t *capacity_p, const char *path_p) {
+#ifndef WIN32
+    struct stat sessionStat;
+    if (stat(path_p, &sessionStat) != 0 || !S_ISDIR(sessionStat.st_mode)) {
+        fprintf(stderr, "Warning: Skipping %s, not a directory\n", path_p);
+        return;
+    }
+#endif
+    uint64_t maxChunkIndex = 0;
+    _find_max_chunk_index(&maxChunkIndex, path_p);
+    if (maxChunkIndex == 0) {
+        fprintf(stderr, "Warning: Skipping %s, no input files found\n", path_p);
+        return;
+    }
+
+    if (*count_p == *capacity_p) {
+        *capacity_p = *capacity_p ? *capacity_p * 2 : 16;
+        BatchSession *sessions_p = realloc(*sessions_pp, *capacity_p * sizeof(BatchSession));
+        if (!sessions_p) {
+            fprintf(stderr, "ERROR: Memory allocation failed\n");
+            exit(1);
+        }
+        *sessions_pp = sessions_p;
+    }
+
+    BatchSession *session_p = &(*sessions_pp)[(*count_p)++];
+    memset(session_p, 0, sizeof(*session_p));
+    session_p->path_p = malloc(strlen(path_p) + 1);
+    if (!session_p->path_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    strcpy(session_p->path_p, path_p);
+
+#ifndef WIN32
+    session_p->device = (uint64_t)sessionStat.st_dev;
+#endif
+    // the size of all chunks is the input of the throughput summary
+    char chunkPath_p[MAX_PATH_LENGTH];
+    for (uint64_t chunkIndex = 1; chunkIndex <= maxChunkIndex; chunkIndex++) {
+        snprintf(chunkPath_p, MAX_PATH_LENGTH, "%s%c%08" PRIX64 ".WAV", path_p, PATH_SEPARATOR, chunkIndex);
+        FILE *chunk_p = fopen(chunkPath_p, "rb");
+        if (!chunk_p) {
+            continue;
+        }
+        const long chunkBytes = fseek(chunk_p, 0, SEEK_END) == 0 ? ftell(chunk_p) : -1;
+        if (chunkBytes > 0) {
+            session_p->inputBytes += (uint64_t)chunkBytes;
+        }
+        fclose(chunk_p);
+    }
+}
+
+
+static int _compare_sessions(const void *a_p, const void *b_p) {
+    return strcmp(((const BatchSession *)a_p)->path_p, ((const BatchSession *)b_p)->path_p);
+}
+
+
+/**
+ * Collect the sessions of a batch
+ *
+ * A directory is a root whose subdirectories containing chunks are the sessions (in name
+ * order), any other file lists one session path per line. Empty lines and lines starting
+ * with # are ignored.
+ *
+ * @param batchPath_p Root directory or session list
+ * @param count_p Pointer to store the number of sessions
+ * @return Array of sessions, exits if the batch cannot be read
+ */
+static BatchSession *_collect_sessions(const char *batchPath_p, size_t *count_p) {
+    BatchSession *sessions_p = NULL;
+    size_t capacity = 0;
+    char sessionPath_p[MAX_PATH_LENGTH];
+    *count_p = 0;
+
+#ifdef WIN32
+    const DWORD attributes = GetFileAttributes(batchPath_p);
+    const bool isRoot = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat batchStat;
+    const bool isRoot = stat(batchPath_p, &batchStat) == 0 && S_ISDIR(batchStat.st_mode);
+#endif
+
+    if (isRoot) {
+#ifdef WIN32
+        char searchPath[MAX_PATH_LENGTH];
+        snprintf(searchPath, sizeof(searchPath), "%s\\*", batchPath_p);
+        WIN32_FIND_DATA entry;
+        HANDLE directoryHandle = FindFirstFile(searchPath, &entry);
+        if (directoryHandle == INVALID_HANDLE_VALUE) {
+            fprintf(stderr, "ERROR: Failed to open batch directory %s\n", batchPath_p);
+            exit(1);
+        }
+        do {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || entry.cFileName[0] == '.') {
+                continue;
+            }
+            snprintf(sessionPath_p, MAX_PATH_LENGTH, "%s%c%s", batchPath_p, PATH_SEPARATOR, entry.cFileName);
+            _add_session(&sessions_p, count_p, &capacity, sessionPath_p);
+        } while (FindNextFile(directoryHandle, &entry));
+        FindClose(directoryHandle);
+#else
+        DIR *batchDirectory = opendir(batchPath_p);
+        if (!batchDirectory) {
+            fprintf(stderr, "ERROR: Failed to open batch directory %s\n", batchPath_p);
+            exit(1);
+        }
+        struct dirent *entry;
+        while ((entry = readdir(batchDirectory)) != NULL) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            struct stat entryStat;
+            if (snprintf(sessionPath_p, MAX_PATH_LENGTH, "%s%c%s", batchPath_p, PATH_SEPARATOR,
+                         entry->d_name) >= MAX_PATH_LENGTH) {
+                fprintf(stderr, "Warning: Skipping %s, path too long\n", entry->d_name);
+                continue;
+            }
+            if (stat(sessionPath_p, &entryStat) != 0 || !S_ISDIR(entryStat.st_mode)) {
+                continue;
+            }
+            _add_session(&sessions_p, count_p, &capacity, sessionPath_p);
+        }
+        closedir(batchDirectory);
+#endif
+        if (*count_p > 1) {
+            qsort(sessions_p, *count_p, sizeof(BatchSession), _compare_sessions);
+        }
+    } else {
+        FILE *list_p = fopen(batchPath_p, "r");
+        if (!list_p) {
+            fprintf(stderr, "ERROR: Failed to open session list %s\n", batchPath_p);
+            exit(1);
+        }
+        while (fgets(sessionPath_p, MAX_PATH_LENGTH, list_p)) {
+            // trim the line end and surrounding blanks
+            size_t length = strlen(sessionPath_p);
+            while (length > 0 && strchr(" \t\r\n", sessionPath_p[length - 1])) {
+                sessionPath_p[--length] = '\0';
+            }
+            const char *path_p = sessionPath_p + strspn(sessionPath_p, " \t");
+            if (*path_p == '\0' || *path_p == '#') {
+                continue;
+            }
+            _add_session(&sessions_p, count_p, &capacity, path_p);
+        }
+        fclose(list_p);
+    }
+
+    if (*count_p == 0) {
+        fprintf(stderr, "ERROR: No sessions found in %s\n", batchPath_p);
+        exit(1);
+    }
+    return sessions_p;
+}
+
+
+static void _print_session_summary(const BatchSession *session_p) {
+    const double inputMB = session_p->inputBytes / (1024.0 * 1024.0);
+    if (session_p->failed) {
+        printf("Session %s: FAILED after %.2f s\n", session_p->path_p, session_p->seconds);
+        return;
+    }
+    printf("Session %s: %.2f MB in %.2f s (%.2f MB/s)", session_p->path_p, inputMB, session_p->seconds,
+           session_p->seconds > 0 ? inputMB / session_p->seconds : 0.0);
+    if (session_p->peakBytes > 0) {
+        printf(", peak memory %.2f MB", session_p->peakBytes / (1024.0 * 1024.0));
+    }
+    printf("\n");
+}
+
+
+#ifndef WIN32
+/**
+ * Whether a pending session may start without exceeding the scheduling limits
+ *
+ * The memory budget is ignored while nothing runs, so a session larger than the whole
+ * budget still gets processed on its own.
+ */
+static bool _can_start(const BatchSession *sessions_p, size_t count, const BatchSession *candidate_p,
+                       const BatchOptions *batchOptions_p, unsigned int running, size_t memoryInUseMB,
+                       size_t sessionMemoryMB) {
+    if (running >= batchOptions_p->maxSessions) {
+        return false;
+    }
+    if (running > 0 && memoryInUseMB + sessionMemoryMB > batchOptions_p->memoryBudgetMB) {
+        return false;
+    }
+    unsigned int onDevice = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sessions_p[i].state == SESSION_RUNNING && sessions_p[i].device == candidate_p->device) {
+            onDevice++;
+        }
+    }
+    return onDevice < batchOptions_p->sessionsPerDevice;
+}
+
+
+static void _start_session(const SplitOptions *options_p, BatchSession *session_p) {
+    // don't let the child flush output the parent still buffers
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to start session process");
+        exit(1);
+    }
+    if (pid == 0) {
+        // the batch summary replaces the progress output of the sessions, errors stay visible
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(1);
+        }
+        split_session(options_p, session_p->path_p);
+        exit(0);
+    }
+
+    session_p->pid = (long)pid;
+    session_p->state = SESSION_RUNNING;
+    session_p->startSeconds = _monotonic_seconds();
+}
+#endif
+
+
+unsigned int run_batch(const SplitOptions *options_p, const BatchOptions *batchOptions_p, const char *batchPath_p) {
+    size_t count = 0;
+    BatchSession *sessions_p = _collect_sessions(batchPath_p, &count);
+    const size_t sessionMemoryMB = batch_session_memory_mb(options_p);
+
+    printf("Batch: %zu sessions, up to %u at a time, %u per device, memory budget %zu MB (about %zu MB per session)\n",
+           count, batchOptions_p->maxSessions, batchOptions_p->sessionsPerDevice, batchOptions_p->memoryBudgetMB,
+           sessionMemoryMB);
+
+    const double batchStart = _monotonic_seconds();
+    unsigned int failed = 0;
+
+#ifdef WIN32
+    // without fork the sessions run one after another in this process
+    for (size_t i = 0; i < count; i++) {
+        const double sessionStart = _monotonic_seconds();
+        split_session(options_p, sessions_p[i].path_p);
+        sessions_p[i].seconds = _monotonic_seconds() - sessionStart;
+        sessions_p[i].state = SESSION_DONE;
+        _print_session_summary(&sessions_p[i]);
+    }
+#else
+    unsigned int running = 0;
+    size_t memoryInUseMB = 0;
+    size_t done = 0;
+
+    while (done < count) {
+        // start every pending session that fits, later sessions on idle devices may overtake
+        for (size_t i = 0; i < count; i++) {
+            if (sessions_p[i].state == SESSION_PENDING &&
+                _can_start(sessions_p, count, &sessions_p[i], batchOptions_p, running, memoryInUseMB, sessionMemoryMB)) {
+                _start_session(options_p, &sessions_p[i]);
+                running++;
+                memoryInUseMB += sessionMemoryMB;
+            }
+        }
+
+        // wait for any session to finish
+        int status = 0;
+        struct rusage usage;
+        const pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to wait for session process");
+            exit(1);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            BatchSession *session_p = &sessions_p[i];
+            if (session_p->state != SESSION_RUNNING || session_p->pid != (long)pid) {
+                continue;
+            }
+            session_p->state = SESSION_DONE;
+            session_p->seconds = _monotonic_seconds() - session_p->startSeconds;
+            session_p->peakBytes = (uint64_t)usage.ru_maxrss * 1024;
+            session_p->failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            if (session_p->failed) {
+                failed++;
+            }
+            running--;
+            memoryInUseMB -= sessionMemoryMB;
+            done++;
+            _print_session_summary(session_p);
+            break;
+        }
+    }
+#endif
+
+    // aggregate throughput over the wall time of the whole batch
+    const double batchSeconds = _monotonic_seconds() - batchStart;
+    double inputMB = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        if (!sessions_p[i].failed) {
+            inputMB += sessions_p[i].inputBytes / (1024.0 * 1024.0);
+        }
+        free(sessions_p[i].path_p);
+    }
+    free(sessions_p);
+
+    printf("Batch finished: %zu of %zu sessions succeeded, %.2f MB in %.2f s (%.2f MB/s)\n",
+           count - failed, count, inputMB, batchSeconds, batchSeconds > 0 ? inputMB / batchSeconds : 0.0);
+    return failed;
+}
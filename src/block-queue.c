@@ -0,0 +1,62 @@
+#include <stdlib.h>
+
+#include "block-queue.h"
+
+int block_queue_init(BlockQueue *queue_p, size_t capacity) {
+    queue_p->items_pp = malloc(capacity * sizeof(void *));
+    if (!queue_p->items_pp) {
+        return -1;
+    }
+    queue_p->capacity = capacity;
+    queue_p->head = 0;
+    queue_p->count = 0;
+    queue_p->closed = false;
+    pthread_mutex_init(&queue_p->lock, NULL);
+    pthread_cond_init(&queue_p->notEmpty, NULL);
+    pthread_cond_init(&queue_p->notFull, NULL);
+    return 0;
+}
+
+void block_queue_destroy(BlockQueue *queue_p) {
+    pthread_cond_destroy(&queue_p->notFull);
+    pthread_cond_destroy(&queue_p->notEmpty);
+    pthread_mutex_destroy(&queue_p->lock);
+    free(queue_p->items_pp);
+    queue_p->items_pp = NULL;
+}
+
+void block_queue_push(BlockQueue *queue_p, void *item_p) {
+    pthread_mutex_lock(&queue_p->lock);
+    while (queue_p->count == queue_p->capacity) {
+        pthread_cond_wait(&queue_p->notFull, &queue_p->lock);
+    }
+    queue_p->items_pp[(queue_p->head + queue_p->count) % queue_p->capacity] = item_p;
+    queue_p->count++;
+    pthread_cond_signal(&queue_p->notEmpty);
+    pthread_mutex_unlock(&queue_p->lock);
+}
+
+void *block_queue_pop(BlockQueue *queue_p) {
+    pthread_mutex_lock(&queue_p->lock);
+    while (queue_p->count == 0 && !queue_p->closed) {
+        pthread_cond_wait(&queue_p->notEmpty, &queue_p->lock);
+    }
+
+    void *item_p = NULL;
+    if (queue_p->count > 0) {
+        item_p = queue_p->items_pp[queue_p->head];
+        queue_p->head = (queue_p->head + 1) % queue_p->capacity;
+        queue_p->count--;
+        pthread_cond_signal(&queue_p->notFull);
+    }
+    pthread_mutex_unlock(&queue_p->lock);
+    return item_p;
+}
+
+void block_queue_close(BlockQueue *queue_p) {
+    pthread_mutex_lock(&queue_p->lock);
+    queue_p->closed = true;
+    pthread_cond_broadcast(&queue_p->notEmpty);
+    pthread_cond_broadcast(&queue_p->notFull);
+    pthread_mutex_unlock(&queue_p->lock);
+}
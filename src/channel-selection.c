@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "channel-selection.h"
+
+// Channel numbers are one-based and stored in a uint16_t
+#define MAX_CHANNEL_NUMBER 65535
+
+// Longest line accepted in a channel map
+#define CHANNEL_MAP_MAX_LINE_LENGTH 1024
+
+
+static const char *_parse_channel_number(const char *text_p, unsigned long *number_p) {
+    char *end_p;
+    if (*text_p < '0' || *text_p > '9') {
+        return NULL;
+    }
+    *number_p = strtoul(text_p, &end_p, 10);
+    if (*number_p == 0 || *number_p > MAX_CHANNEL_NUMBER) {
+        return NULL;
+    }
+    return end_p;
+}
+
+/**
+ * Append the zero-based channels of a list like "1-4,17,31" in the given order
+ *
+ * @param spec_p Channel list
+ * @param channels_pp Growing channel array
+ * @param count_p Number of channels in the array
+ * @param capacity_p Allocated size of the array
+ * @return 0 on success, -1 if the list is malformed or memory ran out
+ */
+static int _append_channel_list(const char *spec_p, uint16_t **channels_pp, size_t *count_p, size_t *capacity_p) {
+    const char *cursor_p = spec_p;
+    while (1) {
+        unsigned long first;
+        unsigned long last;
+        cursor_p = _parse_channel_number(cursor_p, &first);
+        if (!cursor_p) {
+            return -1;
+        }
+        last = first;
+        if (*cursor_p == '-') {
+            cursor_p = _parse_channel_number(cursor_p + 1, &last);
+            if (!cursor_p || last < first) {
+                return -1;
+            }
+        }
+
+        for (unsigned long channel = first; channel <= last; channel++) {
+            if (*count_p == *capacity_p) {
+                size_t capacity = *capacity_p ? *capacity_p * 2 : 16;
+                uint16_t *channels_p = realloc(*channels_pp, capacity * sizeof(uint16_t));
+                if (!channels_p) {
+                    return -1;
+                }
+                *channels_pp = channels_p;
+                *capacity_p = capacity;
+            }
+            (*channels_pp)[(*count_p)++] = (uint16_t)(channel - 1);
+        }
+
+        if (*cursor_p == '\0') {
+            return 0;
+        }
+        if (*cursor_p != ',') {
+            return -1;
+        }
+        cursor_p++;
+    }
+}
+
+static int _allocate_outputs(ChannelSelection *selection_p, size_t outputCount) {
+    selection_p->groupSizes_p = malloc(outputCount * sizeof(uint16_t));
+    selection_p->firstSlots_p = malloc(outputCount * sizeof(uint32_t));
+    if (!selection_p->groupSizes_p || !selection_p->firstSlots_p) {
+        return -1;
+    }
+    return 0;
+}
+
+int channel_selection_parse(const char *spec_p, ChannelSelection *selection_p) {
+    memset(selection_p, 0, sizeof(*selection_p));
+
+    uint16_t *listed_p = NULL;
+    size_t listedCount = 0;
+    size_t listedCapacity = 0;
+    bool *selected_p = calloc(MAX_CHANNEL_NUMBER, sizeof(bool));
+    if (!selected_p || _append_channel_list(spec_p, &listed_p, &listedCount, &listedCapacity) != 0) {
+        free(selected_p);
+        free(listed_p);
+        return -1;
+    }
+
+    // mark every listed channel, then collect them in ascending order
+    size_t count = 0;
+    for (size_t i = 0; i < listedCount; i++) {
+        if (!selected_p[listed_p[i]]) {
+            selected_p[listed_p[i]] = true;
+            count++;
+        }
+    }
+    free(listed_p);
+
+    selection_p->channels_p = malloc(count * sizeof(uint16_t));
+    if (!selection_p->channels_p || _allocate_outputs(selection_p, count) != 0) {
+        free(selected_p);
+        channel_selection_free(selection_p);
+        return -1;
+    }
+    for (size_t channel = 0; channel < MAX_CHANNEL_NUMBER; channel++) {
+        if (selected_p[channel]) {
+            selection_p->groupSizes_p[selection_p->count] = 1;
+            selection_p->firstSlots_p[selection_p->count] = selection_p->count;
+            selection_p->channels_p[selection_p->count++] = (uint16_t)channel;
+        }
+    }
+    free(selected_p);
+    return 0;
+}
+
+/**
+ * Parse one line of a channel map into a name and a channel list without whitespace
+ *
+ * @param line_p Line to parse, modified in place
+ * @param name_pp Pointer to store the output name (NULL for empty and comment lines)
+ * @param spec_pp Pointer to store the channel list
+ * @return 0 on success, -1 if the line is malformed
+ */
+static int _split_map_line(char *line_p, char **name_pp, char **spec_pp) {
+    *name_pp = NULL;
+    char *comment_p = strchr(line_p, '#');
+    if (comment_p) {
+        *comment_p = '\0';
+    }
+    while (isspace((unsigned char)*line_p)) {
+        line_p++;
+    }
+    if (*line_p == '\0') {
+        return 0;
+    }
+
+    // the name ends at the first whitespace
+    char *name_p = line_p;
+    while (*line_p && !isspace((unsigned char)*line_p)) {
+        line_p++;
+    }
+    if (*line_p == '\0') {
+        return -1;
+    }
+    *line_p++ = '\0';
+    if (strlen(name_p) > CHANNEL_MAP_MAX_NAME_LENGTH || strpbrk(name_p, "/\\:") || name_p[0] == '.') {
+        return -1;
+    }
+
+    // the channel list may contain blanks after commas
+    char *spec_p = line_p;
+    char *write_p = line_p;
+    for (; *line_p; line_p++) {
+        if (!isspace((unsigned char)*line_p)) {
+            *write_p++ = *line_p;
+        }
+    }
+    *write_p = '\0';
+
+    *name_pp = name_p;
+    *spec_pp = spec_p;
+    return 0;
+}
+
+int channel_selection_load_map(const char *path_p, ChannelSelection *selection_p, char *message_p, size_t messageSize) {
+    memset(selection_p, 0, sizeof(*selection_p));
+    FILE *mapFile_p = fopen(path_p, "r");
+    if (!mapFile_p) {
+        snprintf(message_p, messageSize, "Failed to open channel map %s", path_p);
+        return -1;
+    }
+
+    size_t slotCount = 0;
+    size_t slotCapacity = 0;
+    size_t outputCapacity = 0;
+    char line[CHANNEL_MAP_MAX_LINE_LENGTH];
+    unsigned int lineNumber = 0;
+    while (fgets(line, sizeof(line), mapFile_p)) {
+        lineNumber++;
+        char *name_p;
+        char *spec_p;
+        const size_t firstSlot = slotCount;
+        if (_split_map_line(line, &name_p, &spec_p) != 0 ||
+            (name_p && _append_channel_list(spec_p, &selection_p->channels_p, &slotCount, &slotCapacity) != 0) ||
+            slotCount - firstSlot > UINT16_MAX) {
+            snprintf(message_p, messageSize, "Invalid channel map entry in line %u of %s", lineNumber, path_p);
+            fclose(mapFile_p);
+            channel_selection_free(selection_p);
+            return -1;
+        }
+        if (!name_p) {
+            continue;
+        }
+        if (selection_p->count == UINT16_MAX) {
+            snprintf(message_p, messageSize, "Too many outputs in channel map %s", path_p);
+            fclose(mapFile_p);
+            channel_selection_free(selection_p);
+            return -1;
+        }
+
+        // grow the per-output arrays
+        if (selection_p->count == outputCapacity) {
+            outputCapacity = outputCapacity ? outputCapacity * 2 : 16;
+            uint16_t *groupSizes_p = realloc(selection_p->groupSizes_p, outputCapacity * sizeof(uint16_t));
+            if (groupSizes_p) {
+                selection_p->groupSizes_p = groupSizes_p;
+            }
+            uint32_t *firstSlots_p = realloc(selection_p->firstSlots_p, outputCapacity * sizeof(uint32_t));
+            if (firstSlots_p) {
+                selection_p->firstSlots_p = firstSlots_p;
+            }
+            char **names_pp = realloc(selection_p->names_p, outputCapacity * sizeof(char *));
+            if (names_pp) {
+                selection_p->names_p = names_pp;
+            }
+            if (!groupSizes_p || !firstSlots_p || !names_pp) {
+                snprintf(message_p, messageSize, "Memory allocation failed");
+                fclose(mapFile_p);
+                channel_selection_free(selection_p);
+                return -1;
+            }
+        }
+
+        const uint16_t output = selection_p->count;
+        selection_p->names_p[output] = malloc(strlen(name_p) + 1);
+        if (!selection_p->names_p[output]) {
+            snprintf(message_p, messageSize, "Memory allocation failed");
+            fclose(mapFile_p);
+            channel_selection_free(selection_p);
+            return -1;
+        }
+        strcpy(selection_p->names_p[output], name_p);
+        selection_p->groupSizes_p[output] = (uint16_t)(slotCount - firstSlot);
+        selection_p->firstSlots_p[output] = (uint32_t)firstSlot;
+        selection_p->count++;
+
+        // names become file names and have to be unique
+        for (uint16_t other = 0; other < output; other++) {
+            if (strcmp(selection_p->names_p[other], name_p) == 0) {
+                snprintf(message_p, messageSize, "Output %s is defined twice in %s", name_p, path_p);
+                fclose(mapFile_p);
+                channel_selection_free(selection_p);
+                return -1;
+            }
+        }
+    }
+    fclose(mapFile_p);
+
+    if (selection_p->count == 0) {
+        snprintf(message_p, messageSize, "Channel map %s defines no outputs", path_p);
+        return -1;
+    }
+    return 0;
+}
+
+int channel_selection_resolve(ChannelSelection *selection_p, uint16_t numChannels, char *message_p,
+                              size_t messageSize) {
+    if (selection_p->count == 0) {
+        selection_p->channels_p = malloc(numChannels * sizeof(uint16_t));
+        if (!selection_p->channels_p || _allocate_outputs(selection_p, numChannels) != 0) {
+            snprintf(message_p, messageSize, "Memory allocation failed");
+            return -1;
+        }
+        for (uint16_t c = 0; c < numChannels; c++) {
+            selection_p->channels_p[c] = c;
+            selection_p->groupSizes_p[c] = 1;
+            selection_p->firstSlots_p[c] = c;
+        }
+        selection_p->count = numChannels;
+        return 0;
+    }
+
+    for (uint16_t output = 0; output < selection_p->count; output++) {
+        const uint16_t *channels_p = selection_p->channels_p + selection_p->firstSlots_p[output];
+        for (uint16_t c = 0; c < selection_p->groupSizes_p[output]; c++) {
+            if (channels_p[c] >= numChannels) {
+                snprintf(message_p, messageSize, "Channel %d selected, but the input only has %d channels",
+                         channels_p[c] + 1, numChannels);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void channel_selection_free(ChannelSelection *selection_p) {
+    if (selection_p->names_p) {
+        for (uint16_t output = 0; output < selection_p->count; output++) {
+            free(selection_p->names_p[output]);
+        }
+    }
+    free(selection_p->names_p);
+    free(selection_p->channels_p);
+    free(selection_p->groupSizes_p);
+    free(selection_p->firstSlots_p);
+    memset(selection_p, 0, sizeof(*selection_p));
+}
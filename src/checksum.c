@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "checksum.h"
+#include "utils.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHECKSUM_X86_SSE42 1
+#include <immintrin.h>
+#endif
+
+#define MAX_PATH_LENGTH 250
+
+// CRC32C polynomial in reflected form
+#define CRC32C_POLYNOMIAL 0x82F63B78u
+
+// Bytes per lane when three lanes are hashed side by side
+#define CRC32C_LANE_BYTES 1024
+
+typedef uint32_t (*Crc32cKernel)(uint32_t state, const uint8_t *data_p, size_t length);
+
+// slicing-by-8 tables, and the tables moving a state across a lane of zero bytes
+static uint32_t sliceTables[8][256];
+static uint32_t laneShiftTables[4][256];
+static Crc32cKernel selectedKernel_p;
+static const char *selectedKernelName_p;
+static pthread_once_t kernelOnce = PTHREAD_ONCE_INIT;
+
+
+int checksum_mode_parse(const char *name_p, ChecksumMode *mode_p) {
+    if (strcmp(name_p, "crc32c") == 0) {
+        *mode_p = CHECKSUM_CRC32C;
+        return 0;
+    }
+    return -1;
+}
+
+
+/**
+ * Slicing-by-8 kernel, eight table lookups per eight bytes
+ */
+static uint32_t _crc32c_slice8(uint32_t state, const uint8_t *data_p, size_t length) {
+    while (length >= 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, data_p, sizeof(low));
+        memcpy(&high, data_p + 4, sizeof(high));
+        low ^= state;
+        state = sliceTables[7][low & 0xFF] ^ sliceTables[6][(low >> 8) & 0xFF] ^
+                sliceTables[5][(low >> 16) & 0xFF] ^ sliceTables[4][low >> 24] ^
+                sliceTables[3][high & 0xFF] ^ sliceTables[2][(high >> 8) & 0xFF] ^
+                sliceTables[1][(high >> 16) & 0xFF] ^ sliceTables[0][high >> 24];
+        data_p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        state = (state >> 8) ^ sliceTables[0][(state ^ *data_p++) & 0xFF];
+    }
+    return state;
+}
+
+
+/**
+ * State after a lane of zero bytes, the CRC of A followed by B is shift(crc(A)) ^ crc(B) from a zero state
+ */
+static uint32_t _shift_lane(uint32_t state) {
+    return laneShiftTables[0][state & 0xFF] ^ laneShiftTables[1][(state >> 8) & 0xFF] ^
+           laneShiftTables[2][(state >> 16) & 0xFF] ^ laneShiftTables[3][state >> 24];
+}
+
+
+#ifdef CHECKSUM_X86_SSE42
+/**
+ * SSE4.2 kernel
+ *
+ * The crc32 instruction has a latency of three cycles but takes a new one every cycle, so
+ * long runs are split into three lanes hashed side by side and joined with _shift_lane.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(uint32_t state, const uint8_t *data_p, size_t length) {
+    while (length >= 3 * CRC32C_LANE_BYTES) {
+        uint64_t laneA = state;
+        uint64_t laneB = 0;
+        uint64_t laneC = 0;
+        for (size_t i = 0; i < CRC32C_LANE_BYTES; i += 8) {
+            uint64_t wordA;
+            uint64_t wordB;
+            uint64_t wordC;
+            memcpy(&wordA, data_p + i, sizeof(wordA));
+            memcpy(&wordB, data_p + CRC32C_LANE_BYTES + i, sizeof(wordB));
+            memcpy(&wordC, data_p + 2 * CRC32C_LANE_BYTES + i, sizeof(wordC));
+            laneA = _mm_crc32_u64(laneA, wordA);
+            laneB = _mm_crc32_u64(laneB, wordB);
+            laneC = _mm_crc32_u64(laneC, wordC);
+        }
+        state = _shift_lane(_shift_lane((uint32_t)laneA) ^ (uint32_t)laneB) ^ (uint32_t)laneC;
+        data_p += 3 * CRC32C_LANE_BYTES;
+        length -= 3 * CRC32C_LANE_BYTES;
+    }
+
+    uint64_t wideState = state;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data_p, sizeof(word));
+        wideState = _mm_crc32_u64(wideState, word);
+        data_p += 8;
+        length -= 8;
+    }
+    state = (uint32_t)wideState;
+    while (length-- > 0) {
+        state = _mm_crc32_u8(state, *data_p++);
+    }
+    return state;
+}
+#endif
+
+
+static void _init_kernels(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        sliceTables[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            sliceTables[k][n] = (sliceTables[k - 1][n] >> 8) ^ sliceTables[0][sliceTables[k - 1][n] & 0xFF];
+        }
+    }
+
+    // the shift is linear, so it is built from the shifts of the 32 single bits
+    const uint8_t zeros[CRC32C_LANE_BYTES] = {0};
+    uint32_t bitShifts[32];
+    for (int bit = 0; bit < 32; bit++) {
+        bitShifts[bit] = _crc32c_slice8(1u << bit, zeros, sizeof(zeros));
+    }
+    for (int k = 0; k < 4; k++) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t shifted = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (n & (1u << bit)) {
+                    shifted ^= bitShifts[8 * k + bit];
+                }
+            }
+            laneShiftTables[k][n] = shifted;
+        }
+    }
+
+    selectedKernel_p = _crc32c_slice8;
+    selectedKernelName_p = "slice8";
+#ifdef CHECKSUM_X86_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        selectedKernel_p = _crc32c_sse42;
+        selectedKernelName_p = "sse4.2x3";
+    }
+#endif
+}
+
+
+const char *checksum_kernel_name(void) {
+    pthread_once(&kernelOnce, _init_kernels);
+    return selectedKernelName_p;
+}
+
+
+void checksum_update(Checksum *checksum_p, const uint8_t *data_p, size_t length) {
+    if (!checksum_p) {
+        return;
+    }
+    pthread_once(&kernelOnce, _init_kernels);
+    checksum_p->crc = ~selectedKernel_p(~checksum_p->crc, data_p, length);
+    checksum_p->bytes += length;
+}
+
+
+void session_checksums_init(SessionChecksums *checksums_p, uint64_t firstChunk, uint64_t lastChunk,
+                            uint16_t outputCount) {
+    pthread_once(&kernelOnce, _init_kernels);
+    checksums_p->firstChunk = firstChunk;
+    checksums_p->chunkCount = lastChunk - firstChunk + 1;
+    checksums_p->inputs_p = calloc(checksums_p->chunkCount, sizeof(Checksum));
+    checksums_p->currentInput_p = NULL;
+    checksums_p->outputCount = outputCount;
+    checksums_p->outputs_p = calloc(outputCount, sizeof(Checksum));
+    if (!checksums_p->inputs_p || !checksums_p->outputs_p) {
+        fprintf(stderr, "ERROR: Failed to allocate checksum state\n");
+        exit(1);
+    }
+}
+
+
+void session_checksums_begin_input(SessionChecksums *checksums_p, uint64_t chunkIndex) {
+    if (!checksums_p) {
+        return;
+    }
+    checksums_p->currentInput_p = &checksums_p->inputs_p[chunkIndex - checksums_p->firstChunk];
+}
+
+
+Checksum *session_checksums_current_input(SessionChecksums *checksums_p) {
+    return checksums_p ? checksums_p->currentInput_p : NULL;
+}
+
+
+int session_checksums_write(const SessionChecksums *checksums_p, const ChannelSelection *channels_p,
+                            const char *outputPath_p) {
+    char manifestPath[MAX_PATH_LENGTH];
+    snprintf(manifestPath, sizeof(manifestPath), "%s%s", outputPath_p, CHECKSUM_MANIFEST_NAME);
+    FILE *manifest_p = fopen(manifestPath, "w");
+    if (!manifest_p) {
+        fprintf(stderr, "ERROR: Failed to create %s\n", manifestPath);
+        return -1;
+    }
+
+    fprintf(manifest_p, "kind,name,bytes,crc32c\n");
+    for (uint64_t i = 0; i < checksums_p->chunkCount; i++) {
+        fprintf(manifest_p, "input,%08" PRIX64 ".WAV,%" PRIu64 ",%08" PRIx32 "\n", checksums_p->firstChunk + i,
+                checksums_p->inputs_p[i].bytes, checksums_p->inputs_p[i].crc);
+    }
+    for (uint16_t i = 0; i < checksums_p->outputCount; i++) {
+        char name[MAX_PATH_LENGTH];
+        _output_name(name, sizeof(name), channels_p, i);
+        fprintf(manifest_p, "output,%s,%" PRIu64 ",%08" PRIx32 "\n", name, checksums_p->outputs_p[i].bytes,
+                checksums_p->outputs_p[i].crc);
+    }
+    if (fclose(manifest_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to write %s\n", manifestPath);
+        return -1;
+    }
+    printf("Checksums: CRC32C (%s) of %" PRIu64 " chunks and %u outputs written to %s\n", checksum_kernel_name(),
+           checksums_p->chunkCount, checksums_p->outputCount, manifestPath);
+    return 0;
+}
+
+
+void session_checksums_free(SessionChecksums *checksums_p) {
+    free(checksums_p->inputs_p);
+    free(checksums_p->outputs_p);
+    checksums_p->inputs_p = NULL;
+    checksums_p->outputs_p = NULL;
+    checksums_p->currentInput_p = NULL;
+}
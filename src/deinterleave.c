@@ -0,0 +1,727 @@
+#include <string.h>
+
+#include "deinterleave.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEINTERLEAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Scalar kernels
+ *
+ * All kernels walk the source frame by frame so the input block is read sequentially. The
+ * width-specialized variants let the compiler turn the per-sample memcpy into a single load
+ * and store, the channel-specialized variants additionally unroll the inner channel loop.
+ */
+
+static void _deinterleave_scalar_range(const uint8_t *src_p, size_t firstFrame, size_t frameCount,
+                                       size_t frameStride, uint16_t numChannels,
+                                       uint16_t bytesPerSample, uint8_t *const *dst_pp) {
+    const uint8_t *frame_p = src_p + firstFrame * frameStride;
+    for (size_t f = firstFrame; f < frameCount; f++) {
+        for (uint16_t c = 0; c < numChannels; c++) {
+            memcpy(dst_pp[c] + f * bytesPerSample, frame_p + (size_t)c * bytesPerSample, bytesPerSample);
+        }
+        frame_p += frameStride;
+    }
+}
+
+static void _deinterleave_generic(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                  uint16_t numChannels, uint16_t bytesPerSample,
+                                  uint8_t *const *dst_pp) {
+    _deinterleave_scalar_range(src_p, 0, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+#define DEFINE_SCALAR_KERNEL(NAME, WIDTH, CHANNELS)                                             \
+    static void NAME(const uint8_t *src_p, size_t frameCount, size_t frameStride,               \
+                     uint16_t numChannels, uint16_t bytesPerSample, uint8_t *const *dst_pp) {   \
+        const size_t channels = (CHANNELS) ? (size_t)(CHANNELS) : numChannels;                  \
+        (void)bytesPerSample;                                                                   \
+        for (size_t f = 0; f < frameCount; f++) {                                               \
+            const uint8_t *frame_p = src_p + f * frameStride;                                   \
+            for (size_t c = 0; c < channels; c++) {                                             \
+                memcpy(dst_pp[c] + f * (WIDTH), frame_p + c * (WIDTH), (WIDTH));                \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+#define DEFINE_GATHER_KERNEL(NAME, WIDTH)                                                       \
+    static void NAME(const uint8_t *src_p, size_t frameCount, size_t frameStride,               \
+                     const uint16_t *channels_p, const uint16_t *groupSizes_p,                  \
+                     uint16_t outputCount, uint16_t bytesPerSample, uint8_t *const *dst_pp) {   \
+        const size_t width = (WIDTH) ? (size_t)(WIDTH) : bytesPerSample;                        \
+        (void)groupSizes_p;                                                                     \
+        for (size_t f = 0; f < frameCount; f++) {                                               \
+            const uint8_t *frame_p = src_p + f * frameStride;                                   \
+            for (uint16_t c = 0; c < outputCount; c++) {                                        \
+                memcpy(dst_pp[c] + f * width, frame_p + (size_t)channels_p[c] * width, width);  \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+#define DEFINE_REGROUP_KERNEL(NAME, WIDTH)                                                      \
+    static void NAME(const uint8_t *src_p, size_t frameCount, size_t frameStride,               \
+                     const uint16_t *channels_p, const uint16_t *groupSizes_p,                  \
+                     uint16_t outputCount, uint16_t bytesPerSample, uint8_t *const *dst_pp) {   \
+        const size_t width = (WIDTH) ? (size_t)(WIDTH) : bytesPerSample;                        \
+        for (size_t f = 0; f < frameCount; f++) {                                               \
+            const uint8_t *frame_p = src_p + f * frameStride;                                   \
+            const uint16_t *slot_p = channels_p;                                                \
+            for (uint16_t o = 0; o < outputCount; o++) {                                        \
+                const size_t groupSize = groupSizes_p[o];                                       \
+                uint8_t *out_p = dst_pp[o] + f * groupSize * width;                             \
+                for (size_t c = 0; c < groupSize; c++) {                                        \
+                    memcpy(out_p + c * width, frame_p + (size_t)slot_p[c] * width, width);      \
+                }                                                                               \
+                slot_p += groupSize;                                                            \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+DEFINE_GATHER_KERNEL(_gather_generic, 0)
+DEFINE_GATHER_KERNEL(_gather_s16, 2)
+DEFINE_GATHER_KERNEL(_gather_s24, 3)
+DEFINE_GATHER_KERNEL(_gather_s32, 4)
+
+DEFINE_REGROUP_KERNEL(_regroup_generic, 0)
+DEFINE_REGROUP_KERNEL(_regroup_s16, 2)
+DEFINE_REGROUP_KERNEL(_regroup_s24, 3)
+DEFINE_REGROUP_KERNEL(_regroup_s32, 4)
+
+DEFINE_SCALAR_KERNEL(_deinterleave_s16_any, 2, 0)
+DEFINE_SCALAR_KERNEL(_deinterleave_s16_8, 2, 8)
+DEFINE_SCALAR_KERNEL(_deinterleave_s16_16, 2, 16)
+DEFINE_SCALAR_KERNEL(_deinterleave_s16_32, 2, 32)
+DEFINE_SCALAR_KERNEL(_deinterleave_s16_64, 2, 64)
+
+DEFINE_SCALAR_KERNEL(_deinterleave_s24_any, 3, 0)
+DEFINE_SCALAR_KERNEL(_deinterleave_s24_8, 3, 8)
+DEFINE_SCALAR_KERNEL(_deinterleave_s24_16, 3, 16)
+DEFINE_SCALAR_KERNEL(_deinterleave_s24_32, 3, 32)
+DEFINE_SCALAR_KERNEL(_deinterleave_s24_64, 3, 64)
+
+DEFINE_SCALAR_KERNEL(_deinterleave_s32_any, 4, 0)
+DEFINE_SCALAR_KERNEL(_deinterleave_s32_8, 4, 8)
+DEFINE_SCALAR_KERNEL(_deinterleave_s32_16, 4, 16)
+DEFINE_SCALAR_KERNEL(_deinterleave_s32_32, 4, 32)
+DEFINE_SCALAR_KERNEL(_deinterleave_s32_64, 4, 64)
+
+
+/*
+ * Scalar interleave kernels
+ *
+ * The output is written frame by frame, so it leaves the cache sequentially while every
+ * channel is read as its own sequential stream.
+ */
+
+static void _interleave_scalar_range(const uint8_t *const *src_pp, size_t firstFrame, size_t frameCount,
+                                     size_t frameStride, uint16_t numChannels, uint16_t bytesPerSample,
+                                     uint8_t *dst_p) {
+    uint8_t *frame_p = dst_p + firstFrame * frameStride;
+    for (size_t f = firstFrame; f < frameCount; f++) {
+        for (uint16_t c = 0; c < numChannels; c++) {
+            memcpy(frame_p + (size_t)c * bytesPerSample, src_pp[c] + f * bytesPerSample, bytesPerSample);
+        }
+        frame_p += frameStride;
+    }
+}
+
+static void _interleave_generic(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {
+    _interleave_scalar_range(src_pp, 0, frameCount, frameStride, numChannels, bytesPerSample, dst_p);
+}
+
+#define DEFINE_INTERLEAVE_KERNEL(NAME, WIDTH)                                                   \
+    static void NAME(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,       \
+                     uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {           \
+        (void)bytesPerSample;                                                                   \
+        for (size_t f = 0; f < frameCount; f++) {                                               \
+            uint8_t *frame_p = dst_p + f * frameStride;                                         \
+            for (size_t c = 0; c < numChannels; c++) {                                          \
+                memcpy(frame_p + c * (WIDTH), src_pp[c] + f * (WIDTH), (WIDTH));                \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+DEFINE_INTERLEAVE_KERNEL(_interleave_s16, 2)
+DEFINE_INTERLEAVE_KERNEL(_interleave_s24, 3)
+DEFINE_INTERLEAVE_KERNEL(_interleave_s32, 4)
+
+
+#ifdef DEINTERLEAVE_X86_SIMD
+/*
+ * SIMD kernels
+ *
+ * Each kernel transposes a tile of frames x channels in registers. Frames that do not fill a
+ * whole tile are handed to the scalar path. The 24 bit kernels load 16/32 bytes for a 12/24
+ * byte channel group, so they stop one tile early to never read past the end of the block.
+ */
+
+__attribute__((target("sse2")))
+static void _deinterleave_sse2_s16(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                   uint16_t numChannels, uint16_t bytesPerSample,
+                                   uint8_t *const *dst_pp) {
+    size_t f = 0;
+    for (; f + 8 <= frameCount; f += 8) {
+        const uint8_t *tile_p = src_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            const uint8_t *in_p = tile_p + (size_t)g * 2;
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(in_p + 0 * frameStride));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(in_p + 1 * frameStride));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(in_p + 2 * frameStride));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(in_p + 3 * frameStride));
+            __m128i r4 = _mm_loadu_si128((const __m128i *)(in_p + 4 * frameStride));
+            __m128i r5 = _mm_loadu_si128((const __m128i *)(in_p + 5 * frameStride));
+            __m128i r6 = _mm_loadu_si128((const __m128i *)(in_p + 6 * frameStride));
+            __m128i r7 = _mm_loadu_si128((const __m128i *)(in_p + 7 * frameStride));
+
+            __m128i a0 = _mm_unpacklo_epi16(r0, r1);
+            __m128i a1 = _mm_unpackhi_epi16(r0, r1);
+            __m128i a2 = _mm_unpacklo_epi16(r2, r3);
+            __m128i a3 = _mm_unpackhi_epi16(r2, r3);
+            __m128i a4 = _mm_unpacklo_epi16(r4, r5);
+            __m128i a5 = _mm_unpackhi_epi16(r4, r5);
+            __m128i a6 = _mm_unpacklo_epi16(r6, r7);
+            __m128i a7 = _mm_unpackhi_epi16(r6, r7);
+
+            __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+            __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+            __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+            __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+            __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+            __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+            __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+            __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 0] + f * 2), _mm_unpacklo_epi64(b0, b4));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 1] + f * 2), _mm_unpackhi_epi64(b0, b4));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 2] + f * 2), _mm_unpacklo_epi64(b1, b5));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 3] + f * 2), _mm_unpackhi_epi64(b1, b5));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 4] + f * 2), _mm_unpacklo_epi64(b2, b6));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 5] + f * 2), _mm_unpackhi_epi64(b2, b6));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 6] + f * 2), _mm_unpacklo_epi64(b3, b7));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 7] + f * 2), _mm_unpackhi_epi64(b3, b7));
+        }
+    }
+    _deinterleave_scalar_range(src_p, f, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+__attribute__((target("sse2")))
+static void _deinterleave_sse2_s32(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                   uint16_t numChannels, uint16_t bytesPerSample,
+                                   uint8_t *const *dst_pp) {
+    size_t f = 0;
+    for (; f + 4 <= frameCount; f += 4) {
+        const uint8_t *tile_p = src_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 4) {
+            const uint8_t *in_p = tile_p + (size_t)g * 4;
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(in_p + 0 * frameStride));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(in_p + 1 * frameStride));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(in_p + 2 * frameStride));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(in_p + 3 * frameStride));
+
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 0] + f * 4), _mm_unpacklo_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 1] + f * 4), _mm_unpackhi_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 2] + f * 4), _mm_unpacklo_epi64(t1, t3));
+            _mm_storeu_si128((__m128i *)(dst_pp[g + 3] + f * 4), _mm_unpackhi_epi64(t1, t3));
+        }
+    }
+    _deinterleave_scalar_range(src_p, f, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+__attribute__((target("ssse3")))
+static inline void _store_s24x4_ssse3(uint8_t *dst_p, __m128i samples) {
+    // pack four 32 bit lanes back into 12 bytes
+    const __m128i compress = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m128i packed = _mm_shuffle_epi8(samples, compress);
+    uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+    _mm_storel_epi64((__m128i *)dst_p, packed);
+    memcpy(dst_p + 8, &tail, sizeof(tail));
+}
+
+__attribute__((target("ssse3")))
+static void _deinterleave_ssse3_s24(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                    uint16_t numChannels, uint16_t bytesPerSample,
+                                    uint8_t *const *dst_pp) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    size_t f = 0;
+    for (; f + 4 < frameCount; f += 4) {
+        const uint8_t *tile_p = src_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 4) {
+            const uint8_t *in_p = tile_p + (size_t)g * 3;
+            __m128i r0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in_p + 0 * frameStride)), expand);
+            __m128i r1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in_p + 1 * frameStride)), expand);
+            __m128i r2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in_p + 2 * frameStride)), expand);
+            __m128i r3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in_p + 3 * frameStride)), expand);
+
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+            _store_s24x4_ssse3(dst_pp[g + 0] + f * 3, _mm_unpacklo_epi64(t0, t2));
+            _store_s24x4_ssse3(dst_pp[g + 1] + f * 3, _mm_unpackhi_epi64(t0, t2));
+            _store_s24x4_ssse3(dst_pp[g + 2] + f * 3, _mm_unpacklo_epi64(t1, t3));
+            _store_s24x4_ssse3(dst_pp[g + 3] + f * 3, _mm_unpackhi_epi64(t1, t3));
+        }
+    }
+    _deinterleave_scalar_range(src_p, f, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+__attribute__((target("avx2")))
+static inline void _transpose_8x8_epi32_avx2(__m256i *rows) {
+    __m256i t0 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    rows[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    rows[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    rows[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    rows[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    rows[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    rows[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    rows[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    rows[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+__attribute__((target("avx2")))
+static void _deinterleave_avx2_s32(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                   uint16_t numChannels, uint16_t bytesPerSample,
+                                   uint8_t *const *dst_pp) {
+    size_t f = 0;
+    for (; f + 8 <= frameCount; f += 8) {
+        const uint8_t *tile_p = src_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            const uint8_t *in_p = tile_p + (size_t)g * 4;
+            __m256i rows[8];
+            for (int r = 0; r < 8; r++) {
+                rows[r] = _mm256_loadu_si256((const __m256i *)(in_p + r * frameStride));
+            }
+            _transpose_8x8_epi32_avx2(rows);
+            for (int c = 0; c < 8; c++) {
+                _mm256_storeu_si256((__m256i *)(dst_pp[g + c] + f * 4), rows[c]);
+            }
+        }
+    }
+    _deinterleave_scalar_range(src_p, f, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+__attribute__((target("avx2")))
+static void _deinterleave_avx2_s24(const uint8_t *src_p, size_t frameCount, size_t frameStride,
+                                   uint16_t numChannels, uint16_t bytesPerSample,
+                                   uint8_t *const *dst_pp) {
+    // move bytes 12..23 of the group into the upper lane, then widen both lanes to 4 x 32 bit
+    const __m256i splitLanes = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i compress = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                              0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i joinLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t f = 0;
+    for (; f + 8 < frameCount; f += 8) {
+        const uint8_t *tile_p = src_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            const uint8_t *in_p = tile_p + (size_t)g * 3;
+            __m256i rows[8];
+            for (int r = 0; r < 8; r++) {
+                __m256i raw = _mm256_loadu_si256((const __m256i *)(in_p + r * frameStride));
+                rows[r] = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(raw, splitLanes), expand);
+            }
+            _transpose_8x8_epi32_avx2(rows);
+            for (int c = 0; c < 8; c++) {
+                __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(rows[c], compress), joinLanes);
+                uint8_t *out_p = dst_pp[g + c] + f * 3;
+                _mm_storeu_si128((__m128i *)out_p, _mm256_castsi256_si128(packed));
+                _mm_storel_epi64((__m128i *)(out_p + 16), _mm256_extracti128_si256(packed, 1));
+            }
+        }
+    }
+    _deinterleave_scalar_range(src_p, f, frameCount, frameStride, numChannels, bytesPerSample, dst_pp);
+}
+
+/*
+ * SIMD interleave kernels
+ *
+ * A transpose is its own inverse, so these load a tile of channels x frames from the sample
+ * streams and store it as frames. The 24 bit kernel loads exactly the 24 bytes of eight
+ * samples, so no stream is read past its end.
+ */
+
+__attribute__((target("sse2")))
+static void _interleave_sse2_s16(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                 uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {
+    size_t f = 0;
+    for (; f + 8 <= frameCount; f += 8) {
+        uint8_t *tile_p = dst_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(src_pp[g + 0] + f * 2));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(src_pp[g + 1] + f * 2));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(src_pp[g + 2] + f * 2));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(src_pp[g + 3] + f * 2));
+            __m128i r4 = _mm_loadu_si128((const __m128i *)(src_pp[g + 4] + f * 2));
+            __m128i r5 = _mm_loadu_si128((const __m128i *)(src_pp[g + 5] + f * 2));
+            __m128i r6 = _mm_loadu_si128((const __m128i *)(src_pp[g + 6] + f * 2));
+            __m128i r7 = _mm_loadu_si128((const __m128i *)(src_pp[g + 7] + f * 2));
+
+            __m128i a0 = _mm_unpacklo_epi16(r0, r1);
+            __m128i a1 = _mm_unpackhi_epi16(r0, r1);
+            __m128i a2 = _mm_unpacklo_epi16(r2, r3);
+            __m128i a3 = _mm_unpackhi_epi16(r2, r3);
+            __m128i a4 = _mm_unpacklo_epi16(r4, r5);
+            __m128i a5 = _mm_unpackhi_epi16(r4, r5);
+            __m128i a6 = _mm_unpacklo_epi16(r6, r7);
+            __m128i a7 = _mm_unpackhi_epi16(r6, r7);
+
+            __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+            __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+            __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+            __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+            __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+            __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+            __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+            __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+            uint8_t *out_p = tile_p + (size_t)g * 2;
+            _mm_storeu_si128((__m128i *)(out_p + 0 * frameStride), _mm_unpacklo_epi64(b0, b4));
+            _mm_storeu_si128((__m128i *)(out_p + 1 * frameStride), _mm_unpackhi_epi64(b0, b4));
+            _mm_storeu_si128((__m128i *)(out_p + 2 * frameStride), _mm_unpacklo_epi64(b1, b5));
+            _mm_storeu_si128((__m128i *)(out_p + 3 * frameStride), _mm_unpackhi_epi64(b1, b5));
+            _mm_storeu_si128((__m128i *)(out_p + 4 * frameStride), _mm_unpacklo_epi64(b2, b6));
+            _mm_storeu_si128((__m128i *)(out_p + 5 * frameStride), _mm_unpackhi_epi64(b2, b6));
+            _mm_storeu_si128((__m128i *)(out_p + 6 * frameStride), _mm_unpacklo_epi64(b3, b7));
+            _mm_storeu_si128((__m128i *)(out_p + 7 * frameStride), _mm_unpackhi_epi64(b3, b7));
+        }
+    }
+    _interleave_scalar_range(src_pp, f, frameCount, frameStride, numChannels, bytesPerSample, dst_p);
+}
+
+__attribute__((target("sse2")))
+static void _interleave_sse2_s32(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                 uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {
+    size_t f = 0;
+    for (; f + 4 <= frameCount; f += 4) {
+        uint8_t *tile_p = dst_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 4) {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(src_pp[g + 0] + f * 4));
+            __m128i r1 = _mm_loadu_si128((const __m128i *)(src_pp[g + 1] + f * 4));
+            __m128i r2 = _mm_loadu_si128((const __m128i *)(src_pp[g + 2] + f * 4));
+            __m128i r3 = _mm_loadu_si128((const __m128i *)(src_pp[g + 3] + f * 4));
+
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+            uint8_t *out_p = tile_p + (size_t)g * 4;
+            _mm_storeu_si128((__m128i *)(out_p + 0 * frameStride), _mm_unpacklo_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(out_p + 1 * frameStride), _mm_unpackhi_epi64(t0, t2));
+            _mm_storeu_si128((__m128i *)(out_p + 2 * frameStride), _mm_unpacklo_epi64(t1, t3));
+            _mm_storeu_si128((__m128i *)(out_p + 3 * frameStride), _mm_unpackhi_epi64(t1, t3));
+        }
+    }
+    _interleave_scalar_range(src_pp, f, frameCount, frameStride, numChannels, bytesPerSample, dst_p);
+}
+
+__attribute__((target("avx2")))
+static void _interleave_avx2_s32(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                 uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {
+    size_t f = 0;
+    for (; f + 8 <= frameCount; f += 8) {
+        uint8_t *tile_p = dst_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            __m256i rows[8];
+            for (int c = 0; c < 8; c++) {
+                rows[c] = _mm256_loadu_si256((const __m256i *)(src_pp[g + c] + f * 4));
+            }
+            _transpose_8x8_epi32_avx2(rows);
+            uint8_t *out_p = tile_p + (size_t)g * 4;
+            for (int r = 0; r < 8; r++) {
+                _mm256_storeu_si256((__m256i *)(out_p + r * frameStride), rows[r]);
+            }
+        }
+    }
+    _interleave_scalar_range(src_pp, f, frameCount, frameStride, numChannels, bytesPerSample, dst_p);
+}
+
+__attribute__((target("avx2")))
+static void _interleave_avx2_s24(const uint8_t *const *src_pp, size_t frameCount, size_t frameStride,
+                                 uint16_t numChannels, uint16_t bytesPerSample, uint8_t *dst_p) {
+    // same lane shuffles as the deinterleave kernel, on eight samples of a stream instead of a frame
+    const __m256i splitLanes = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i compress = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                              0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i joinLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t f = 0;
+    for (; f + 8 <= frameCount; f += 8) {
+        uint8_t *tile_p = dst_p + f * frameStride;
+        for (uint16_t g = 0; g < numChannels; g += 8) {
+            __m256i rows[8];
+            for (int c = 0; c < 8; c++) {
+                const uint8_t *in_p = src_pp[g + c] + f * 3;
+                __m256i raw = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in_p)),
+                                                      _mm_loadl_epi64((const __m128i *)(in_p + 16)), 1);
+                rows[c] = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(raw, splitLanes), expand);
+            }
+            _transpose_8x8_epi32_avx2(rows);
+            uint8_t *out_p = tile_p + (size_t)g * 3;
+            for (int r = 0; r < 8; r++) {
+                __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(rows[r], compress), joinLanes);
+                _mm_storeu_si128((__m128i *)(out_p + r * frameStride), _mm256_castsi256_si128(packed));
+                _mm_storel_epi64((__m128i *)(out_p + r * frameStride + 16), _mm256_extracti128_si256(packed, 1));
+            }
+        }
+    }
+    _interleave_scalar_range(src_pp, f, frameCount, frameStride, numChannels, bytesPerSample, dst_p);
+}
+#endif // DEINTERLEAVE_X86_SIMD
+
+
+static void _select_scalar_kernel(Deinterleaver *deinterleaver_p) {
+    // kernels indexed by channel count 8, 16, 32, 64 and "any"
+    static const DeinterleaveKernel kernels[3][5] = {
+        {_deinterleave_s16_8, _deinterleave_s16_16, _deinterleave_s16_32, _deinterleave_s16_64, _deinterleave_s16_any},
+        {_deinterleave_s24_8, _deinterleave_s24_16, _deinterleave_s24_32, _deinterleave_s24_64, _deinterleave_s24_any},
+        {_deinterleave_s32_8, _deinterleave_s32_16, _deinterleave_s32_32, _deinterleave_s32_64, _deinterleave_s32_any},
+    };
+    static const char *names[3][5] = {
+        {"scalar-s16x8", "scalar-s16x16", "scalar-s16x32", "scalar-s16x64", "scalar-s16"},
+        {"scalar-s24x8", "scalar-s24x16", "scalar-s24x32", "scalar-s24x64", "scalar-s24"},
+        {"scalar-s32x8", "scalar-s32x16", "scalar-s32x32", "scalar-s32x64", "scalar-s32"},
+    };
+
+    if (deinterleaver_p->bytesPerSample < 2 || deinterleaver_p->bytesPerSample > 4) {
+        deinterleaver_p->kernel_p = _deinterleave_generic;
+        deinterleaver_p->kernelName_p = "scalar-generic";
+        return;
+    }
+
+    int widthIndex = deinterleaver_p->bytesPerSample - 2;
+    int channelIndex;
+    switch (deinterleaver_p->numChannels) {
+        case 8:  channelIndex = 0; break;
+        case 16: channelIndex = 1; break;
+        case 32: channelIndex = 2; break;
+        case 64: channelIndex = 3; break;
+        default: channelIndex = 4; break;
+    }
+    deinterleaver_p->kernel_p = kernels[widthIndex][channelIndex];
+    deinterleaver_p->kernelName_p = names[widthIndex][channelIndex];
+}
+
+void deinterleaver_init(Deinterleaver *deinterleaver_p, uint16_t numChannels,
+                        uint16_t bytesPerSample, bool allowSimd) {
+    deinterleaver_init_range(deinterleaver_p, numChannels, bytesPerSample, 0, numChannels, allowSimd);
+}
+
+void deinterleaver_init_range(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                              uint16_t bytesPerSample, uint16_t firstChannel,
+                              uint16_t channelCount, bool allowSimd) {
+    const uint16_t numChannels = channelCount;
+    deinterleaver_p->numChannels = channelCount;
+    deinterleaver_p->firstChannel = firstChannel;
+    deinterleaver_p->channels_p = NULL;
+    deinterleaver_p->groupSizes_p = NULL;
+    deinterleaver_p->gather_p = NULL;
+    deinterleaver_p->bytesPerSample = bytesPerSample;
+    deinterleaver_p->blockAlign = (uint16_t)(frameChannels * bytesPerSample);
+    _select_scalar_kernel(deinterleaver_p);
+
+#ifdef DEINTERLEAVE_X86_SIMD
+    if (!allowSimd) {
+        return;
+    }
+    __builtin_cpu_init();
+    const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    const bool hasSsse3 = __builtin_cpu_supports("ssse3");
+    const bool hasSse2 = __builtin_cpu_supports("sse2");
+
+    switch (bytesPerSample) {
+        case 2:
+            if (hasSse2 && numChannels % 8 == 0) {
+                deinterleaver_p->kernel_p = _deinterleave_sse2_s16;
+                deinterleaver_p->kernelName_p = "sse2-s16";
+            }
+            break;
+        case 3:
+            if (hasAvx2 && numChannels % 8 == 0) {
+                deinterleaver_p->kernel_p = _deinterleave_avx2_s24;
+                deinterleaver_p->kernelName_p = "avx2-s24";
+            } else if (hasSsse3 && numChannels % 4 == 0) {
+                deinterleaver_p->kernel_p = _deinterleave_ssse3_s24;
+                deinterleaver_p->kernelName_p = "ssse3-s24";
+            }
+            break;
+        case 4:
+            if (hasAvx2 && numChannels % 8 == 0) {
+                deinterleaver_p->kernel_p = _deinterleave_avx2_s32;
+                deinterleaver_p->kernelName_p = "avx2-s32";
+            } else if (hasSse2 && numChannels % 4 == 0) {
+                deinterleaver_p->kernel_p = _deinterleave_sse2_s32;
+                deinterleaver_p->kernelName_p = "sse2-s32";
+            }
+            break;
+        default:
+            break;
+    }
+#else
+    (void)allowSimd;
+#endif
+}
+
+void deinterleaver_init_gather(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                               uint16_t bytesPerSample, const uint16_t *channels_p,
+                               uint16_t channelCount, bool allowSimd) {
+    // contiguous ranges keep the transpose kernels
+    bool isRange = true;
+    for (uint16_t c = 1; c < channelCount && isRange; c++) {
+        isRange = channels_p[c] == channels_p[0] + c;
+    }
+    if (isRange) {
+        deinterleaver_init_range(deinterleaver_p, frameChannels, bytesPerSample,
+                                 channelCount ? channels_p[0] : 0, channelCount, allowSimd);
+        return;
+    }
+
+    static const GatherKernel kernels[3] = {_gather_s16, _gather_s24, _gather_s32};
+    static const char *names[3] = {"gather-s16", "gather-s24", "gather-s32"};
+    deinterleaver_p->numChannels = channelCount;
+    deinterleaver_p->firstChannel = 0;
+    deinterleaver_p->channels_p = channels_p;
+    deinterleaver_p->groupSizes_p = NULL;
+    deinterleaver_p->bytesPerSample = bytesPerSample;
+    deinterleaver_p->blockAlign = (uint16_t)(frameChannels * bytesPerSample);
+    deinterleaver_p->kernel_p = NULL;
+    if (bytesPerSample < 2 || bytesPerSample > 4) {
+        deinterleaver_p->gather_p = _gather_generic;
+        deinterleaver_p->kernelName_p = "gather-generic";
+    } else {
+        deinterleaver_p->gather_p = kernels[bytesPerSample - 2];
+        deinterleaver_p->kernelName_p = names[bytesPerSample - 2];
+    }
+}
+
+void deinterleaver_init_regroup(Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                                uint16_t bytesPerSample, const uint16_t *channels_p,
+                                const uint16_t *groupSizes_p, uint16_t outputCount, bool allowSimd) {
+    bool isMono = true;
+    for (uint16_t o = 0; o < outputCount && isMono; o++) {
+        isMono = groupSizes_p[o] == 1;
+    }
+    if (isMono) {
+        deinterleaver_init_gather(deinterleaver_p, frameChannels, bytesPerSample, channels_p, outputCount,
+                                  allowSimd);
+        return;
+    }
+
+    static const GatherKernel kernels[3] = {_regroup_s16, _regroup_s24, _regroup_s32};
+    static const char *names[3] = {"regroup-s16", "regroup-s24", "regroup-s32"};
+    deinterleaver_p->numChannels = outputCount;
+    deinterleaver_p->firstChannel = 0;
+    deinterleaver_p->channels_p = channels_p;
+    deinterleaver_p->groupSizes_p = groupSizes_p;
+    deinterleaver_p->bytesPerSample = bytesPerSample;
+    deinterleaver_p->blockAlign = (uint16_t)(frameChannels * bytesPerSample);
+    deinterleaver_p->kernel_p = NULL;
+    if (bytesPerSample < 2 || bytesPerSample > 4) {
+        deinterleaver_p->gather_p = _regroup_generic;
+        deinterleaver_p->kernelName_p = "regroup-generic";
+    } else {
+        deinterleaver_p->gather_p = kernels[bytesPerSample - 2];
+        deinterleaver_p->kernelName_p = names[bytesPerSample - 2];
+    }
+}
+
+void deinterleaver_run(const Deinterleaver *deinterleaver_p, const uint8_t *src_p,
+                       size_t frameCount, uint8_t *const *dst_pp) {
+    if (deinterleaver_p->channels_p) {
+        deinterleaver_p->gather_p(src_p, frameCount, deinterleaver_p->blockAlign, deinterleaver_p->channels_p,
+                                  deinterleaver_p->groupSizes_p, deinterleaver_p->numChannels,
+                                  deinterleaver_p->bytesPerSample, dst_pp);
+        return;
+    }
+    const size_t firstByte = (size_t)deinterleaver_p->firstChannel * deinterleaver_p->bytesPerSample;
+    deinterleaver_p->kernel_p(src_p + firstByte, frameCount, deinterleaver_p->blockAlign,
+                              deinterleaver_p->numChannels, deinterleaver_p->bytesPerSample, dst_pp);
+}
+
+void interleaver_init(Interleaver *interleaver_p, uint16_t numChannels, uint16_t bytesPerSample,
+                      bool allowSimd) {
+    static const InterleaveKernel kernels[3] = {_interleave_s16, _interleave_s24, _interleave_s32};
+    static const char *names[3] = {"scalar-s16", "scalar-s24", "scalar-s32"};
+    interleaver_p->numChannels = numChannels;
+    interleaver_p->bytesPerSample = bytesPerSample;
+    interleaver_p->blockAlign = (uint16_t)(numChannels * bytesPerSample);
+    if (bytesPerSample < 2 || bytesPerSample > 4) {
+        interleaver_p->kernel_p = _interleave_generic;
+        interleaver_p->kernelName_p = "scalar-generic";
+        return;
+    }
+    interleaver_p->kernel_p = kernels[bytesPerSample - 2];
+    interleaver_p->kernelName_p = names[bytesPerSample - 2];
+
+#ifdef DEINTERLEAVE_X86_SIMD
+    if (!allowSimd) {
+        return;
+    }
+    __builtin_cpu_init();
+    const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    const bool hasSse2 = __builtin_cpu_supports("sse2");
+
+    switch (bytesPerSample) {
+        case 2:
+            if (hasSse2 && numChannels % 8 == 0) {
+                interleaver_p->kernel_p = _interleave_sse2_s16;
+                interleaver_p->kernelName_p = "sse2-s16";
+            }
+            break;
+        case 3:
+            if (hasAvx2 && numChannels % 8 == 0) {
+                interleaver_p->kernel_p = _interleave_avx2_s24;
+                interleaver_p->kernelName_p = "avx2-s24";
+            }
+            break;
+        case 4:
+            if (hasAvx2 && numChannels % 8 == 0) {
+                interleaver_p->kernel_p = _interleave_avx2_s32;
+                interleaver_p->kernelName_p = "avx2-s32";
+            } else if (hasSse2 && numChannels % 4 == 0) {
+                interleaver_p->kernel_p = _interleave_sse2_s32;
+                interleaver_p->kernelName_p = "sse2-s32";
+            }
+            break;
+        default:
+            break;
+    }
+#else
+    (void)allowSimd;
+#endif
+}
+
+void interleaver_run(const Interleaver *interleaver_p, const uint8_t *const *src_pp, size_t frameCount,
+                     uint8_t *dst_p) {
+    interleaver_p->kernel_p(src_pp, frameCount, interleaver_p->blockAlign, interleaver_p->numChannels,
+                            interleaver_p->bytesPerSample, dst_p);
+}
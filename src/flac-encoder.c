@@ -0,0 +1,971 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "flac-encoder.h"
+#include "utils.h"
+
+#define FLAC_PI 3.14159265358979323846
+
+// Size of the STREAMINFO block and its offset behind the stream marker and block header
+#define STREAMINFO_BYTES 34
+#define STREAMINFO_OFFSET 8
+
+// Finest partitioning of a residual (2^8 partitions)
+#define RICE_MAX_PARTITION_ORDER 8
+
+// Largest Rice parameter of the 4 bit and 5 bit parameter codings (the next value escapes)
+#define RICE_MAX_PARAMETER_4BIT 14
+#define RICE_MAX_PARAMETER_5BIT 30
+
+// Subframe types as written to the subframe header
+#define SUBFRAME_CONSTANT 0x00
+#define SUBFRAME_VERBATIM 0x01
+#define SUBFRAME_FIXED 0x08
+#define SUBFRAME_LPC 0x20
+
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t block[64];
+} Md5Context;
+
+typedef struct {
+    uint8_t *data_p;
+    size_t bytes;
+    uint64_t accumulator;
+    unsigned int bits;
+} BitWriter;
+
+typedef struct {
+    unsigned int partitionOrder;
+    unsigned int parameterBits; // 4 or 5
+    uint8_t parameters[1 << RICE_MAX_PARTITION_ORDER];
+} RicePlan;
+
+typedef struct {
+    uint64_t bits;      // Size of the subframe body (UINT64_MAX if the predictor cannot be used)
+    unsigned int order;
+    int32_t coefficients[FLAC_MAX_LPC_ORDER];
+    unsigned int precision;
+    int shift;
+    int32_t *residual_p;
+    RicePlan rice;
+} Prediction;
+
+struct FlacEncoder {
+    FILE *file_p;
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    uint16_t bytesPerSample;
+    uint32_t sampleRate;
+
+    int32_t *samples_p;      // pending frames, FLAC_BLOCK_SIZE samples per channel
+    size_t pendingFrames;
+    uint64_t frameNumber;
+    uint64_t encodedFrames;
+    uint32_t minFrameBytes;
+    uint32_t maxFrameBytes;
+
+    // scratch space of a block
+    uint8_t *frame_p;
+    int32_t *shifted_p;
+    int32_t *residuals_p[2];
+    double *window_p;
+    double *windowed_p;
+    size_t windowLength;
+    uint64_t partitionSums[1 << RICE_MAX_PARTITION_ORDER];
+
+    Md5Context md5;
+    FlacEncoderStats stats;
+};
+
+
+/*
+ * MD5 (RFC 1321) of the unencoded audio, as stored in STREAMINFO
+ */
+
+static const uint32_t MD5_SINES[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint8_t MD5_ROTATIONS[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+
+static void _md5_init(Md5Context *md5_p) {
+    md5_p->state[0] = 0x67452301;
+    md5_p->state[1] = 0xefcdab89;
+    md5_p->state[2] = 0x98badcfe;
+    md5_p->state[3] = 0x10325476;
+    md5_p->length = 0;
+}
+
+
+static void _md5_block(uint32_t *state_p, const uint8_t *block_p) {
+    uint32_t words[16];
+    for (int i = 0; i < 16; i++) {
+        words[i] = (uint32_t)block_p[i * 4] | (uint32_t)block_p[i * 4 + 1] << 8 |
+                   (uint32_t)block_p[i * 4 + 2] << 16 | (uint32_t)block_p[i * 4 + 3] << 24;
+    }
+
+    // one loop per round keeps the round function out of the loop body
+#define MD5_STEP(f, g)                                                                     \
+    do {                                                                                   \
+        const uint32_t rotated = a + (f) + MD5_SINES[i] + words[g];                        \
+        a = d;                                                                             \
+        d = c;                                                                             \
+        c = b;                                                                             \
+        b += (rotated << MD5_ROTATIONS[i]) | (rotated >> (32 - MD5_ROTATIONS[i]));         \
+    } while (0)
+    uint32_t a = state_p[0], b = state_p[1], c = state_p[2], d = state_p[3];
+    int i = 0;
+    for (; i < 16; i++) {
+        MD5_STEP((b & c) | (~b & d), i);
+    }
+    for (; i < 32; i++) {
+        MD5_STEP((d & b) | (~d & c), (5 * i + 1) % 16);
+    }
+    for (; i < 48; i++) {
+        MD5_STEP(b ^ c ^ d, (3 * i + 5) % 16);
+    }
+    for (; i < 64; i++) {
+        MD5_STEP(c ^ (b | ~d), (7 * i) % 16);
+    }
+#undef MD5_STEP
+    state_p[0] += a;
+    state_p[1] += b;
+    state_p[2] += c;
+    state_p[3] += d;
+}
+
+
+static void _md5_update(Md5Context *md5_p, const uint8_t *data_p, size_t bytes) {
+    size_t used = (size_t)(md5_p->length % 64);
+    md5_p->length += bytes;
+    if (used > 0) {
+        const size_t take = bytes < 64 - used ? bytes : 64 - used;
+        memcpy(md5_p->block + used, data_p, take);
+        data_p += take;
+        bytes -= take;
+        used += take;
+        if (used < 64) {
+            return;
+        }
+        _md5_block(md5_p->state, md5_p->block);
+    }
+    for (; bytes >= 64; data_p += 64, bytes -= 64) {
+        _md5_block(md5_p->state, data_p);
+    }
+    memcpy(md5_p->block, data_p, bytes);
+}
+
+
+static void _md5_final(Md5Context *md5_p, uint8_t *digest_p) {
+    const uint64_t bitLength = md5_p->length * 8;
+    size_t used = (size_t)(md5_p->length % 64);
+    md5_p->block[used++] = 0x80;
+    if (used > 56) {
+        memset(md5_p->block + used, 0, 64 - used);
+        _md5_block(md5_p->state, md5_p->block);
+        used = 0;
+    }
+    memset(md5_p->block + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++) {
+        md5_p->block[56 + i] = (uint8_t)(bitLength >> (8 * i));
+    }
+    _md5_block(md5_p->state, md5_p->block);
+    for (int i = 0; i < 16; i++) {
+        digest_p[i] = (uint8_t)(md5_p->state[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+
+/*
+ * Bit writer and checksums of the frames
+ */
+
+static inline void _put_bits(BitWriter *writer_p, uint64_t value, unsigned int count) {
+    writer_p->accumulator = (writer_p->accumulator << count) | (value & ((1ull << count) - 1));
+    writer_p->bits += count;
+    while (writer_p->bits >= 8) {
+        writer_p->bits -= 8;
+        writer_p->data_p[writer_p->bytes++] = (uint8_t)(writer_p->accumulator >> writer_p->bits);
+    }
+}
+
+
+static inline void _put_rice(BitWriter *writer_p, int32_t residual, unsigned int parameter) {
+    const uint32_t folded = ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+    uint32_t quotient = folded >> parameter;
+    if (quotient + 1 + parameter <= 32) {
+        // unary quotient, stop bit and remainder in one go
+        _put_bits(writer_p, (1ull << parameter) | (folded & ((1ull << parameter) - 1)), quotient + 1 + parameter);
+        return;
+    }
+    for (; quotient >= 32; quotient -= 32) {
+        _put_bits(writer_p, 0, 32);
+    }
+    _put_bits(writer_p, 1, quotient + 1);
+    _put_bits(writer_p, folded, parameter);
+}
+
+
+static void _align_bits(BitWriter *writer_p) {
+    if (writer_p->bits > 0) {
+        _put_bits(writer_p, 0, 8 - writer_p->bits);
+    }
+}
+
+
+static uint8_t _crc8(const uint8_t *data_p, size_t bytes) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        crc ^= data_p[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+// slice-by-8 tables, CRC16_TABLES[0] is the plain byte-wise table
+static uint16_t CRC16_TABLES[8][256];
+
+static void _crc16_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+        }
+        CRC16_TABLES[0][i] = crc;
+    }
+    for (int table = 1; table < 8; table++) {
+        for (int i = 0; i < 256; i++) {
+            const uint16_t previous = CRC16_TABLES[table - 1][i];
+            CRC16_TABLES[table][i] = (uint16_t)((previous << 8) ^ CRC16_TABLES[0][previous >> 8]);
+        }
+    }
+}
+
+
+static uint16_t _crc16(const uint8_t *data_p, size_t bytes) {
+    uint16_t crc = 0;
+    for (; bytes >= 8; data_p += 8, bytes -= 8) {
+        crc = (uint16_t)(CRC16_TABLES[7][data_p[0] ^ (crc >> 8)] ^ CRC16_TABLES[6][data_p[1] ^ (crc & 0xFF)] ^
+                         CRC16_TABLES[5][data_p[2]] ^ CRC16_TABLES[4][data_p[3]] ^ CRC16_TABLES[3][data_p[4]] ^
+                         CRC16_TABLES[2][data_p[5]] ^ CRC16_TABLES[1][data_p[6]] ^ CRC16_TABLES[0][data_p[7]]);
+    }
+    for (; bytes > 0; data_p++, bytes--) {
+        crc = (uint16_t)((crc << 8) ^ CRC16_TABLES[0][(crc >> 8) ^ *data_p]);
+    }
+    return crc;
+}
+
+
+/*
+ * Residual coding
+ */
+
+/**
+ * Bits of a Rice coded partition, the exact size never exceeds this estimate
+ */
+static inline uint64_t _rice_bits(uint64_t sum, uint64_t count, unsigned int parameter) {
+    return count * (parameter + 1) + (sum >> parameter);
+}
+
+
+static inline unsigned int _floor_log2(uint64_t value) {
+#if defined(__GNUC__)
+    return 63u - (unsigned int)__builtin_clzll(value);
+#else
+    unsigned int log = 0;
+    while (value >>= 1) {
+        log++;
+    }
+    return log;
+#endif
+}
+
+
+static unsigned int _rice_parameter(uint64_t sum, uint64_t count) {
+    // the estimate is smallest near log2(mean * ln 2), one of three neighbours of log2(mean)
+    const uint64_t mean = sum / count;
+    unsigned int parameter = mean > 1 ? _floor_log2(mean) - 1 : 0;
+    unsigned int last = parameter + 2;
+    if (last > RICE_MAX_PARAMETER_5BIT) {
+        last = RICE_MAX_PARAMETER_5BIT;
+    }
+    uint64_t bestBits = _rice_bits(sum, count, parameter);
+    for (unsigned int candidate = parameter + 1; candidate <= last; candidate++) {
+        const uint64_t bits = _rice_bits(sum, count, candidate);
+        if (bits < bestBits) {
+            bestBits = bits;
+            parameter = candidate;
+        }
+    }
+    return parameter;
+}
+
+
+/**
+ * Find the cheapest partitioning of a residual
+ *
+ * @return Size of the coded residual in bits
+ */
+static uint64_t _plan_rice(FlacEncoder *encoder_p, const int32_t *residual_p, size_t blockSize, unsigned int order,
+                           RicePlan *plan_p) {
+    unsigned int maxOrder = RICE_MAX_PARTITION_ORDER;
+    while (maxOrder > 0 && (blockSize % ((size_t)1 << maxOrder) != 0 || (blockSize >> maxOrder) <= order)) {
+        maxOrder--;
+    }
+
+    // sums of the folded residual of the finest partitions, merged pairwise for coarser ones
+    uint64_t *sums_p = encoder_p->partitionSums;
+    const size_t partitionSize = blockSize >> maxOrder;
+    size_t sample = 0;
+    for (size_t partition = 0; partition < ((size_t)1 << maxOrder); partition++) {
+        const size_t end = (partition + 1) * partitionSize - order;
+        uint64_t sum = 0;
+        for (; sample < end; sample++) {
+            sum += ((uint32_t)residual_p[sample] << 1) ^ (uint32_t)(residual_p[sample] >> 31);
+        }
+        sums_p[partition] = sum;
+    }
+
+    uint64_t bestBits = UINT64_MAX;
+    for (int partitionOrder = (int)maxOrder; partitionOrder >= 0; partitionOrder--) {
+        const size_t partitions = (size_t)1 << partitionOrder;
+        uint8_t parameters[1 << RICE_MAX_PARTITION_ORDER];
+        uint64_t bits = 0;
+        unsigned int maxParameter = 0;
+        for (size_t partition = 0; partition < partitions; partition++) {
+            const uint64_t count = (blockSize >> partitionOrder) - (partition == 0 ? order : 0);
+            parameters[partition] = (uint8_t)_rice_parameter(sums_p[partition], count);
+            bits += _rice_bits(sums_p[partition], count, parameters[partition]);
+            if (parameters[partition] > maxParameter) {
+                maxParameter = parameters[partition];
+            }
+        }
+        const unsigned int parameterBits = maxParameter > RICE_MAX_PARAMETER_4BIT ? 5 : 4;
+        bits += 2 + 4 + partitions * parameterBits;
+        if (bits < bestBits) {
+            bestBits = bits;
+            plan_p->partitionOrder = (unsigned int)partitionOrder;
+            plan_p->parameterBits = parameterBits;
+            memcpy(plan_p->parameters, parameters, partitions);
+        }
+
+        for (size_t partition = 0; partition < partitions / 2; partition++) {
+            sums_p[partition] = sums_p[2 * partition] + sums_p[2 * partition + 1];
+        }
+    }
+    return bestBits;
+}
+
+
+static void _write_residual(BitWriter *writer_p, const int32_t *residual_p, size_t blockSize, unsigned int order,
+                            const RicePlan *plan_p) {
+    _put_bits(writer_p, plan_p->parameterBits == 5 ? 1 : 0, 2);
+    _put_bits(writer_p, plan_p->partitionOrder, 4);
+    const size_t partitions = (size_t)1 << plan_p->partitionOrder;
+    size_t sample = 0;
+    for (size_t partition = 0; partition < partitions; partition++) {
+        const unsigned int parameter = plan_p->parameters[partition];
+        _put_bits(writer_p, parameter, plan_p->parameterBits);
+        const size_t end = (partition + 1) * (blockSize >> plan_p->partitionOrder) - order;
+        for (; sample < end; sample++) {
+            _put_rice(writer_p, residual_p[sample], parameter);
+        }
+    }
+}
+
+
+/*
+ * Predictors
+ */
+
+/**
+ * Pick the fixed polynomial predictor with the smallest residual and code it
+ */
+static void _predict_fixed(FlacEncoder *encoder_p, const int32_t *samples_p, size_t blockSize,
+                           unsigned int bitsPerSample, Prediction *prediction_p) {
+    // differences of order 0 to 4, each one derived from the previous order
+    uint64_t errors[5] = {0, 0, 0, 0, 0};
+    if (blockSize > 4) {
+        int64_t last0 = samples_p[3];
+        int64_t last1 = last0 - samples_p[2];
+        int64_t last2 = last1 - ((int64_t)samples_p[2] - samples_p[1]);
+        int64_t last3 = last2 - ((int64_t)samples_p[2] - 2 * (int64_t)samples_p[1] + samples_p[0]);
+        for (size_t i = 4; i < blockSize; i++) {
+            const int64_t e0 = samples_p[i];
+            const int64_t e1 = e0 - last0;
+            const int64_t e2 = e1 - last1;
+            const int64_t e3 = e2 - last2;
+            const int64_t e4 = e3 - last3;
+            errors[0] += (uint64_t)(e0 < 0 ? -e0 : e0);
+            errors[1] += (uint64_t)(e1 < 0 ? -e1 : e1);
+            errors[2] += (uint64_t)(e2 < 0 ? -e2 : e2);
+            errors[3] += (uint64_t)(e3 < 0 ? -e3 : e3);
+            errors[4] += (uint64_t)(e4 < 0 ? -e4 : e4);
+            last0 = e0;
+            last1 = e1;
+            last2 = e2;
+            last3 = e3;
+        }
+    }
+    unsigned int order = 0;
+    for (unsigned int candidate = 1; candidate <= 4 && candidate < blockSize; candidate++) {
+        if (errors[candidate] < errors[order]) {
+            order = candidate;
+        }
+    }
+
+    int32_t *residual_p = prediction_p->residual_p;
+    for (size_t i = order; i < blockSize; i++) {
+        int64_t value;
+        switch (order) {
+            case 0: value = samples_p[i]; break;
+            case 1: value = (int64_t)samples_p[i] - samples_p[i - 1]; break;
+            case 2: value = (int64_t)samples_p[i] - 2 * (int64_t)samples_p[i - 1] + samples_p[i - 2]; break;
+            case 3:
+                value = (int64_t)samples_p[i] - 3 * (int64_t)samples_p[i - 1] + 3 * (int64_t)samples_p[i - 2] -
+                        samples_p[i - 3];
+                break;
+            default:
+                value = (int64_t)samples_p[i] - 4 * (int64_t)samples_p[i - 1] + 6 * (int64_t)samples_p[i - 2] -
+                        4 * (int64_t)samples_p[i - 3] + samples_p[i - 4];
+                break;
+        }
+        // full scale 32 bit audio can leave the range a residual may have
+        if (value < INT32_MIN || value > INT32_MAX) {
+            prediction_p->bits = UINT64_MAX;
+            return;
+        }
+        residual_p[i - order] = (int32_t)value;
+    }
+    prediction_p->order = order;
+    prediction_p->bits = (uint64_t)order * bitsPerSample +
+                         _plan_rice(encoder_p, residual_p, blockSize, order, &prediction_p->rice);
+}
+
+
+static void _tukey_window(double *window_p, size_t length) {
+    const size_t taper = length / 4;
+    for (size_t i = 0; i < length; i++) {
+        window_p[i] = 1.0;
+    }
+    for (size_t i = 0; i < taper; i++) {
+        const double value = 0.5 - 0.5 * cos(FLAC_PI * (double)i / (double)taper);
+        window_p[i] = value;
+        window_p[length - 1 - i] = value;
+    }
+}
+
+
+/**
+ * Quantize LPC coefficients to precision bits with a non-negative shift
+ *
+ * @return 0 on success, -1 if the coefficients cannot be represented
+ */
+static int _quantize_coefficients(const double *coefficients_p, unsigned int order, unsigned int precision,
+                                  int32_t *quantized_p, int *shift_p) {
+    double largest = 0.0;
+    for (unsigned int i = 0; i < order; i++) {
+        if (fabs(coefficients_p[i]) > largest) {
+            largest = fabs(coefficients_p[i]);
+        }
+    }
+    if (largest <= 0.0) {
+        return -1;
+    }
+
+    int exponent;
+    frexp(largest, &exponent);
+    int shift = (int)precision - exponent - 1;
+    if (shift > 15) {
+        shift = 15;
+    }
+    if (shift < 0) {
+        return -1;
+    }
+
+    // carry the rounding error to the next coefficient
+    const int32_t maxValue = (1 << (precision - 1)) - 1;
+    const int32_t minValue = -(1 << (precision - 1));
+    double error = 0.0;
+    for (unsigned int i = 0; i < order; i++) {
+        error += coefficients_p[i] * (double)(1 << shift);
+        long value = lround(error);
+        value = value < minValue ? minValue : value > maxValue ? maxValue : value;
+        quantized_p[i] = (int32_t)value;
+        error -= (double)value;
+    }
+    *shift_p = shift;
+    return 0;
+}
+
+
+/**
+ * Fit an LPC predictor with the order that promises the fewest bits and code it
+ */
+static void _predict_lpc(FlacEncoder *encoder_p, const int32_t *samples_p, size_t blockSize,
+                         unsigned int bitsPerSample, Prediction *prediction_p) {
+    prediction_p->bits = UINT64_MAX;
+    unsigned int maxOrder = FLAC_MAX_LPC_ORDER;
+    if (blockSize <= maxOrder) {
+        return;
+    }
+
+    if (encoder_p->windowLength != blockSize) {
+        _tukey_window(encoder_p->window_p, blockSize);
+        encoder_p->windowLength = blockSize;
+    }
+    double *windowed_p = encoder_p->windowed_p;
+    for (size_t i = 0; i < blockSize; i++) {
+        windowed_p[i] = samples_p[i] * encoder_p->window_p[i];
+    }
+    // all lags in one pass, the inner loop over the lags vectorizes
+    double autocorrelation[FLAC_MAX_LPC_ORDER + 1] = {0.0};
+    for (size_t i = 0; i < maxOrder; i++) {
+        for (size_t lag = 0; lag <= i; lag++) {
+            autocorrelation[lag] += windowed_p[i] * windowed_p[i - lag];
+        }
+    }
+    for (size_t i = maxOrder; i < blockSize; i++) {
+        for (size_t lag = 0; lag <= FLAC_MAX_LPC_ORDER; lag++) {
+            autocorrelation[lag] += windowed_p[i] * windowed_p[i - lag];
+        }
+    }
+    if (autocorrelation[0] <= 0.0) {
+        return;
+    }
+
+    // Levinson-Durbin recursion, coefficients and prediction error of every order
+    double coefficients[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+    double errors[FLAC_MAX_LPC_ORDER];
+    double lpc[FLAC_MAX_LPC_ORDER];
+    double error = autocorrelation[0];
+    for (unsigned int i = 0; i < maxOrder; i++) {
+        double reflection = -autocorrelation[i + 1];
+        for (unsigned int j = 0; j < i; j++) {
+            reflection -= lpc[j] * autocorrelation[i - j];
+        }
+        reflection /= error;
+        lpc[i] = reflection;
+        unsigned int j;
+        for (j = 0; j < i / 2; j++) {
+            const double previous = lpc[j];
+            lpc[j] += reflection * lpc[i - 1 - j];
+            lpc[i - 1 - j] += reflection * previous;
+        }
+        if (i & 1) {
+            lpc[j] += lpc[j] * reflection;
+        }
+        error *= 1.0 - reflection * reflection;
+        for (j = 0; j <= i; j++) {
+            coefficients[i][j] = -lpc[j];
+        }
+        errors[i] = error;
+        if (error <= 0.0) {
+            maxOrder = i + 1;
+            break;
+        }
+    }
+
+    // expected residual bits per sample follow from the prediction error
+    const unsigned int precision = bitsPerSample <= 16 ? 12 : 15;
+    unsigned int order = 1;
+    double bestBits = -1.0;
+    for (unsigned int candidate = 1; candidate <= maxOrder; candidate++) {
+        double bitsPerResidual = 0.0;
+        if (errors[candidate - 1] > 0.0) {
+            bitsPerResidual = 0.5 * log2(0.5 * errors[candidate - 1] / (double)blockSize);
+            bitsPerResidual = bitsPerResidual > 0.0 ? bitsPerResidual : 0.0;
+        }
+        const double bits = bitsPerResidual * (double)(blockSize - candidate) +
+                            (double)candidate * (bitsPerSample + precision);
+        if (bestBits < 0.0 || bits < bestBits) {
+            bestBits = bits;
+            order = candidate;
+        }
+    }
+
+    int32_t *quantized_p = prediction_p->coefficients;
+    int shift;
+    if (_quantize_coefficients(coefficients[order - 1], order, precision, quantized_p, &shift) != 0) {
+        return;
+    }
+
+    int32_t *residual_p = prediction_p->residual_p;
+    for (size_t i = order; i < blockSize; i++) {
+        int64_t sum = 0;
+        for (unsigned int j = 0; j < order; j++) {
+            sum += (int64_t)quantized_p[j] * samples_p[i - j - 1];
+        }
+        const int64_t value = (int64_t)samples_p[i] - (sum >> shift);
+        if (value < INT32_MIN || value > INT32_MAX) {
+            return;
+        }
+        residual_p[i - order] = (int32_t)value;
+    }
+    prediction_p->order = order;
+    prediction_p->precision = precision;
+    prediction_p->shift = shift;
+    prediction_p->bits = (uint64_t)order * bitsPerSample + 4 + 5 + (uint64_t)order * precision +
+                         _plan_rice(encoder_p, residual_p, blockSize, order, &prediction_p->rice);
+}
+
+
+/*
+ * Frames
+ */
+
+static void _write_subframe(FlacEncoder *encoder_p, BitWriter *writer_p, const int32_t *samples_p,
+                            size_t blockSize) {
+    unsigned int bitsPerSample = encoder_p->bitsPerSample;
+
+    bool constant = true;
+    uint32_t setBits = 0;
+    for (size_t i = 0; i < blockSize; i++) {
+        constant = constant && samples_p[i] == samples_p[0];
+        setBits |= (uint32_t)samples_p[i];
+    }
+    if (constant) {
+        _put_bits(writer_p, SUBFRAME_CONSTANT << 1, 8);
+        _put_bits(writer_p, (uint32_t)samples_p[0], bitsPerSample);
+        return;
+    }
+
+    // low bits that are zero in every sample (e.g. 16 bit audio in a 24 bit file) are not coded
+    unsigned int wastedBits = 0;
+    while (!(setBits & 1)) {
+        setBits >>= 1;
+        wastedBits++;
+    }
+    if (wastedBits > 0) {
+        int32_t *shifted_p = encoder_p->shifted_p;
+        for (size_t i = 0; i < blockSize; i++) {
+            shifted_p[i] = samples_p[i] >> wastedBits;
+        }
+        samples_p = shifted_p;
+        bitsPerSample -= wastedBits;
+    }
+
+    Prediction fixed;
+    Prediction lpc;
+    fixed.residual_p = encoder_p->residuals_p[0];
+    lpc.residual_p = encoder_p->residuals_p[1];
+    _predict_fixed(encoder_p, samples_p, blockSize, bitsPerSample, &fixed);
+    _predict_lpc(encoder_p, samples_p, blockSize, bitsPerSample, &lpc);
+    const uint64_t verbatimBits = (uint64_t)blockSize * bitsPerSample;
+
+    const Prediction *best_p = fixed.bits <= lpc.bits ? &fixed : &lpc;
+    unsigned int type = SUBFRAME_VERBATIM;
+    if (best_p->bits < verbatimBits) {
+        type = best_p == &fixed ? SUBFRAME_FIXED | best_p->order : SUBFRAME_LPC | (best_p->order - 1);
+    }
+    _put_bits(writer_p, (type << 1) | (wastedBits > 0), 8);
+    if (wastedBits > 0) {
+        _put_bits(writer_p, 1, wastedBits);
+    }
+
+    if (type == SUBFRAME_VERBATIM) {
+        for (size_t i = 0; i < blockSize; i++) {
+            _put_bits(writer_p, (uint32_t)samples_p[i], bitsPerSample);
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < best_p->order; i++) {
+        _put_bits(writer_p, (uint32_t)samples_p[i], bitsPerSample);
+    }
+    if (best_p == &lpc) {
+        _put_bits(writer_p, best_p->precision - 1, 4);
+        _put_bits(writer_p, (uint32_t)best_p->shift, 5);
+        for (unsigned int i = 0; i < best_p->order; i++) {
+            _put_bits(writer_p, (uint32_t)best_p->coefficients[i], best_p->precision);
+        }
+    }
+    _write_residual(writer_p, best_p->residual_p, blockSize, best_p->order, &best_p->rice);
+}
+
+
+static unsigned int _sample_rate_code(uint32_t sampleRate) {
+    switch (sampleRate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0; // taken from STREAMINFO
+    }
+}
+
+
+static void _put_frame_number(BitWriter *writer_p, uint64_t number) {
+    if (number < 0x80) {
+        _put_bits(writer_p, number, 8);
+        return;
+    }
+    // UTF-8 like coding, extended to 36 bits
+    unsigned int bytes = 2;
+    while (bytes < 7 && number >= (1ull << (5 * bytes + 1))) {
+        bytes++;
+    }
+    const unsigned int leadBits = bytes == 7 ? 0 : 7 - bytes;
+    _put_bits(writer_p, (0xFFu << (8 - bytes)) | (leadBits ? number >> (6 * (bytes - 1)) : 0), 8);
+    for (int i = (int)bytes - 2; i >= 0; i--) {
+        _put_bits(writer_p, 0x80 | ((number >> (6 * i)) & 0x3F), 8);
+    }
+}
+
+
+static void _encode_block(FlacEncoder *encoder_p, size_t blockSize) {
+    BitWriter writer = {encoder_p->frame_p, 0, 0, 0};
+
+    _put_bits(&writer, 0x3FFE, 14); // sync code
+    _put_bits(&writer, 0, 1);
+    _put_bits(&writer, 0, 1);       // fixed block size
+    const unsigned int blockSizeCode = blockSize == FLAC_BLOCK_SIZE ? 12 : blockSize <= 256 ? 6 : 7;
+    _put_bits(&writer, blockSizeCode, 4);
+    _put_bits(&writer, _sample_rate_code(encoder_p->sampleRate), 4);
+    _put_bits(&writer, encoder_p->channels - 1u, 4); // independent channels
+    _put_bits(&writer, encoder_p->bitsPerSample == 16 ? 4 : encoder_p->bitsPerSample == 24 ? 6 : 7, 3);
+    _put_bits(&writer, 0, 1);
+    _put_frame_number(&writer, encoder_p->frameNumber);
+    if (blockSizeCode == 6) {
+        _put_bits(&writer, blockSize - 1, 8);
+    } else if (blockSizeCode == 7) {
+        _put_bits(&writer, blockSize - 1, 16);
+    }
+    _put_bits(&writer, _crc8(writer.data_p, writer.bytes), 8);
+
+    for (uint16_t channel = 0; channel < encoder_p->channels; channel++) {
+        _write_subframe(encoder_p, &writer, encoder_p->samples_p + (size_t)channel * FLAC_BLOCK_SIZE, blockSize);
+    }
+    _align_bits(&writer);
+    _put_bits(&writer, _crc16(writer.data_p, writer.bytes), 16);
+
+    if (fwrite(writer.data_p, writer.bytes, 1, encoder_p->file_p) != 1) {
+        fprintf(stderr, "ERROR: Writing FLAC frame\n");
+        exit(1);
+    }
+    const uint32_t frameBytes = (uint32_t)writer.bytes;
+    if (encoder_p->frameNumber == 0 || frameBytes < encoder_p->minFrameBytes) {
+        encoder_p->minFrameBytes = frameBytes;
+    }
+    if (frameBytes > encoder_p->maxFrameBytes) {
+        encoder_p->maxFrameBytes = frameBytes;
+    }
+    encoder_p->stats.outputBytes += frameBytes;
+    encoder_p->frameNumber++;
+    encoder_p->encodedFrames += blockSize;
+}
+
+
+static void _write_streaminfo(FlacEncoder *encoder_p, uint64_t totalFrames, const uint8_t *md5_p) {
+    uint8_t header[STREAMINFO_OFFSET + STREAMINFO_BYTES];
+    BitWriter writer = {header, 0, 0, 0};
+    _put_bits(&writer, 0x664C6143, 32); // "fLaC"
+    _put_bits(&writer, 1, 1);           // last metadata block
+    _put_bits(&writer, 0, 7);           // STREAMINFO
+    _put_bits(&writer, STREAMINFO_BYTES, 24);
+    _put_bits(&writer, FLAC_BLOCK_SIZE, 16);
+    _put_bits(&writer, FLAC_BLOCK_SIZE, 16);
+    _put_bits(&writer, encoder_p->minFrameBytes, 24);
+    _put_bits(&writer, encoder_p->maxFrameBytes, 24);
+    _put_bits(&writer, encoder_p->sampleRate, 20);
+    _put_bits(&writer, encoder_p->channels - 1u, 3);
+    _put_bits(&writer, encoder_p->bitsPerSample - 1u, 5);
+    _put_bits(&writer, totalFrames >> 32, 4);
+    _put_bits(&writer, totalFrames, 32);
+    memcpy(header + writer.bytes, md5_p, 16);
+
+    if (fwrite(header, sizeof(header), 1, encoder_p->file_p) != 1) {
+        fprintf(stderr, "ERROR: Writing FLAC stream header\n");
+        exit(1);
+    }
+}
+
+
+int flac_check_format(const WavHeader *format_p, uint16_t maxChannels) {
+    const bool isInteger = format_p->audio_format == WAV_FORMAT_PCM ||
+                           format_p->audio_format == WAV_FORMAT_EXTENSIBLE;
+    const uint16_t bits = format_p->bits_per_sample;
+    if (!isInteger || (bits != 16 && bits != 24 && bits != 32)) {
+        fprintf(stderr, "ERROR: FLAC outputs need 16, 24 or 32 bit integer samples\n");
+        return -1;
+    }
+    if (format_p->sample_rate == 0 || format_p->sample_rate >= (1u << 20)) {
+        fprintf(stderr, "ERROR: FLAC does not support a sample rate of %u Hz\n", format_p->sample_rate);
+        return -1;
+    }
+    if (maxChannels > FLAC_MAX_CHANNELS) {
+        fprintf(stderr, "ERROR: FLAC outputs carry at most %d channels, an output has %u\n", FLAC_MAX_CHANNELS,
+                maxChannels);
+        return -1;
+    }
+    return 0;
+}
+
+
+FlacEncoder *flac_encoder_create(FILE *file_p, const WavHeader *format_p, uint16_t channels,
+                                 uint64_t plannedFrames) {
+    // encoders are created before any thread uses them
+    if (CRC16_TABLES[0][1] == 0) {
+        _crc16_init();
+    }
+
+    FlacEncoder *encoder_p = calloc(1, sizeof(FlacEncoder));
+    if (!encoder_p) {
+        fprintf(stderr, "ERROR: Failed to allocate FLAC encoder\n");
+        exit(1);
+    }
+    encoder_p->file_p = file_p;
+    encoder_p->channels = channels;
+    encoder_p->bitsPerSample = format_p->bits_per_sample;
+    encoder_p->bytesPerSample = format_p->bits_per_sample / 8;
+    encoder_p->sampleRate = format_p->sample_rate;
+
+    // a frame never exceeds its verbatim size plus the headers
+    const size_t frameCapacity = 32 + (size_t)channels * (FLAC_BLOCK_SIZE * 4 + 8);
+    encoder_p->samples_p = malloc((size_t)channels * FLAC_BLOCK_SIZE * sizeof(int32_t));
+    encoder_p->frame_p = malloc(frameCapacity);
+    encoder_p->shifted_p = malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    encoder_p->residuals_p[0] = malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    encoder_p->residuals_p[1] = malloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    encoder_p->window_p = malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    encoder_p->windowed_p = malloc(FLAC_BLOCK_SIZE * sizeof(double));
+    if (!encoder_p->samples_p || !encoder_p->frame_p || !encoder_p->shifted_p || !encoder_p->residuals_p[0] ||
+        !encoder_p->residuals_p[1] || !encoder_p->window_p || !encoder_p->windowed_p) {
+        fprintf(stderr, "ERROR: Failed to allocate FLAC encoder\n");
+        exit(1);
+    }
+    _md5_init(&encoder_p->md5);
+
+    const uint8_t unknownMd5[16] = {0};
+    _write_streaminfo(encoder_p, plannedFrames, unknownMd5);
+    encoder_p->stats.outputBytes = STREAMINFO_OFFSET + STREAMINFO_BYTES;
+    return encoder_p;
+}
+
+
+/**
+ * Widen the little-endian samples of one channel to 32 bit
+ */
+static void _load_samples(int32_t *target_p, const uint8_t *source_p, size_t frames, uint16_t channels,
+                          uint16_t bytesPerSample) {
+    const size_t stride = (size_t)channels * bytesPerSample;
+    switch (bytesPerSample) {
+        case 2:
+            for (size_t i = 0; i < frames; i++, source_p += stride) {
+                target_p[i] = (int16_t)((uint16_t)source_p[0] | (uint16_t)source_p[1] << 8);
+            }
+            break;
+        case 3:
+            for (size_t i = 0; i < frames; i++, source_p += stride) {
+                target_p[i] = (int32_t)((uint32_t)source_p[0] << 8 | (uint32_t)source_p[1] << 16 |
+                                        (uint32_t)source_p[2] << 24) >> 8;
+            }
+            break;
+        default:
+            for (size_t i = 0; i < frames; i++, source_p += stride) {
+                target_p[i] = (int32_t)((uint32_t)source_p[0] | (uint32_t)source_p[1] << 8 |
+                                        (uint32_t)source_p[2] << 16 | (uint32_t)source_p[3] << 24);
+            }
+            break;
+    }
+}
+
+
+void flac_encoder_write(FlacEncoder *encoder_p, const uint8_t *samples_p, size_t bytes) {
+    const double startSeconds = _monotonic_seconds();
+    _md5_update(&encoder_p->md5, samples_p, bytes);
+    encoder_p->stats.inputBytes += bytes;
+
+    const uint16_t channels = encoder_p->channels;
+    const uint16_t bytesPerSample = encoder_p->bytesPerSample;
+    size_t frames = bytes / ((size_t)channels * bytesPerSample);
+    while (frames > 0) {
+        const size_t take = frames < FLAC_BLOCK_SIZE - encoder_p->pendingFrames ?
+                            frames : FLAC_BLOCK_SIZE - encoder_p->pendingFrames;
+        for (uint16_t channel = 0; channel < channels; channel++) {
+            _load_samples(encoder_p->samples_p + (size_t)channel * FLAC_BLOCK_SIZE + encoder_p->pendingFrames,
+                          samples_p + (size_t)channel * bytesPerSample, take, channels, bytesPerSample);
+        }
+        samples_p += take * channels * bytesPerSample;
+        frames -= take;
+        encoder_p->pendingFrames += take;
+        if (encoder_p->pendingFrames == FLAC_BLOCK_SIZE) {
+            _encode_block(encoder_p, FLAC_BLOCK_SIZE);
+            encoder_p->pendingFrames = 0;
+        }
+    }
+    encoder_p->stats.encodeSeconds += _monotonic_seconds() - startSeconds;
+}
+
+
+int flac_encoder_finish(FlacEncoder *encoder_p) {
+    const double startSeconds = _monotonic_seconds();
+    if (encoder_p->pendingFrames > 0) {
+        _encode_block(encoder_p, encoder_p->pendingFrames);
+        encoder_p->pendingFrames = 0;
+    }
+    uint8_t md5[16];
+    _md5_final(&encoder_p->md5, md5);
+
+#ifdef WIN32
+    const int seekResult = _fseeki64(encoder_p->file_p, 0, SEEK_SET);
+#else
+    const int seekResult = fseeko(encoder_p->file_p, 0, SEEK_SET);
+#endif
+    if (seekResult != 0) {
+        fprintf(stderr, "ERROR: Failed to complete the FLAC stream header\n");
+        return -1;
+    }
+    _write_streaminfo(encoder_p, encoder_p->encodedFrames, md5);
+    fflush(encoder_p->file_p);
+    encoder_p->stats.encodeSeconds += _monotonic_seconds() - startSeconds;
+    return 0;
+}
+
+
+void flac_encoder_stats(const FlacEncoder *encoder_p, FlacEncoderStats *stats_p) {
+    *stats_p = encoder_p->stats;
+}
+
+
+void flac_encoder_destroy(FlacEncoder *encoder_p) {
+    if (!encoder_p) {
+        return;
+    }
+    free(encoder_p->samples_p);
+    free(encoder_p->frame_p);
+    free(encoder_p->shifted_p);
+    free(encoder_p->residuals_p[0]);
+    free(encoder_p->residuals_p[1]);
+    free(encoder_p->window_p);
+    free(encoder_p->windowed_p);
+    free(encoder_p);
+}
@@ -0,0 +1,391 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#ifdef HAVE_INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "follow.h"
+#include "journal.h"
+#include "signal-analysis.h"
+#include "utils.h"
+
+#define MAX_PATH_LENGTH 250
+
+// Directory changes are rechecked at least this often (milliseconds)
+#define FOLLOW_POLL_INTERVAL_MS 1000
+
+typedef struct {
+    int fd;                // inotify instance watching the session directory (-1 when polling)
+    uint64_t closedIndex;  // Highest chunk the recorder finished writing (IN_CLOSE_WRITE or moved in)
+} ChunkWatch;
+
+
+static void _watch_init(ChunkWatch *watch_p, const char *sessionPath_p) {
+    watch_p->fd = -1;
+    watch_p->closedIndex = 0;
+#ifdef HAVE_INOTIFY
+    watch_p->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_p->fd >= 0 &&
+        inotify_add_watch(watch_p->fd, sessionPath_p, IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(watch_p->fd);
+        watch_p->fd = -1;
+    }
+    if (watch_p->fd < 0) {
+        fprintf(stderr, "Warning: Cannot watch %s, polling for new chunks instead\n", sessionPath_p);
+    }
+#else
+    (void)sessionPath_p;
+#endif
+}
+
+
+static void _watch_close(ChunkWatch *watch_p) {
+#ifdef HAVE_INOTIFY
+    if (watch_p->fd >= 0) {
+        close(watch_p->fd);
+    }
+#endif
+    watch_p->fd = -1;
+}
+
+
+#ifdef HAVE_INOTIFY
+/**
+ * Remember chunks the recorder finished, other events only wake up the caller
+ */
+static void _watch_read_events(ChunkWatch *watch_p) {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+
+    while ((length = read(watch_p->fd, events, sizeof(events))) > 0) {
+        for (char *event_p = events; event_p < events + length;) {
+            const struct inotify_event *inotifyEvent_p = (const struct inotify_event *)event_p;
+            event_p += sizeof(struct inotify_event) + inotifyEvent_p->len;
+
+            // chunks are called <8 hex digits>.WAV
+            uint64_t chunkIndex = 0;
+            if (!(inotifyEvent_p->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) || inotifyEvent_p->len == 0 ||
+                strlen(inotifyEvent_p->name) != 12 || strcasecmp(inotifyEvent_p->name + 8, ".wav") != 0 ||
+                sscanf(inotifyEvent_p->name, "%8" SCNx64, &chunkIndex) != 1) {
+                continue;
+            }
+            if (chunkIndex > watch_p->closedIndex) {
+                watch_p->closedIndex = chunkIndex;
+            }
+        }
+    }
+}
+#endif
+
+
+/**
+ * Block until the session directory changes or the poll interval passed
+ */
+static void _watch_wait(ChunkWatch *watch_p) {
+#ifdef HAVE_INOTIFY
+    if (watch_p->fd >= 0) {
+        struct pollfd pollFd = {.fd = watch_p->fd, .events = POLLIN};
+        if (poll(&pollFd, 1, FOLLOW_POLL_INTERVAL_MS) > 0) {
+            _watch_read_events(watch_p);
+        }
+        return;
+    }
+#else
+    (void)watch_p;
+#endif
+#ifdef WIN32
+    Sleep(FOLLOW_POLL_INTERVAL_MS);
+#else
+    usleep(FOLLOW_POLL_INTERVAL_MS * 1000);
+#endif
+}
+
+
+/**
+ * Size of a file
+ *
+ * @return Size in bytes, -1 if the file does not exist
+ */
+static int64_t _file_size(const char *path_p) {
+    struct stat fileStat;
+    if (stat(path_p, &fileStat) != 0) {
+        return -1;
+    }
+    return (int64_t)fileStat.st_size;
+}
+
+
+/**
+ * Whether a chunk holds all audio its header announces
+ *
+ * @param chunkPath_p Path of the chunk
+ * @param fileBytes Current size of the chunk
+ * @return 1 if it does, 0 if audio is missing, -1 if the header cannot be read yet or leaves the length open
+ */
+static int _chunk_data_complete(const char *chunkPath_p, int64_t fileBytes) {
+    FILE *chunkFile_p = fopen(chunkPath_p, "rb");
+    if (!chunkFile_p) {
+        return -1;
+    }
+    WavHeader header;
+    const int headerStatus = read_header_quiet(chunkFile_p, &header);
+    const long dataOffset = ftell(chunkFile_p);
+    fclose(chunkFile_p);
+
+    // streamed headers carry no length (0 or 0xFFFFFFFF) until the recorder patches them
+    if (headerStatus != 0 || dataOffset < 0 || header.data_bytes == 0 || header.data_bytes == UINT32_MAX) {
+        return -1;
+    }
+    return (uint64_t)fileBytes >= (uint64_t)dataOffset + header.data_bytes ? 1 : 0;
+}
+
+
+/**
+ * Wait until a chunk is complete
+ *
+ * A chunk is complete once the file holds all audio its header announces. For a header
+ * that leaves the length open, the recorder closing the chunk or the next chunk appearing
+ * completes it as well. A chunk whose size did not change for settleSeconds counts as
+ * complete in any case, shorter than announced if the recorder stopped writing it. A chunk
+ * that does not show up within settleSeconds ends the session, unless waitForever is set.
+ *
+ * @param watch_p Watch of the session directory
+ * @param sessionPath_p Path to the session directory
+ * @param chunkIndex Chunk to wait for
+ * @param settleSeconds Seconds without change after which the chunk is complete or missing
+ * @param waitForever Whether to keep waiting for a chunk that does not exist yet
+ * @return true if the chunk is complete, false if the session ended before it
+ */
+static bool _wait_for_chunk(ChunkWatch *watch_p, const char *sessionPath_p, uint64_t chunkIndex,
+                            unsigned int settleSeconds, bool waitForever) {
+    char chunkPath_p[MAX_PATH_LENGTH];
+    char nextPath_p[MAX_PATH_LENGTH];
+    snprintf(chunkPath_p, MAX_PATH_LENGTH, "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
+    snprintf(nextPath_p, MAX_PATH_LENGTH, "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex + 1);
+
+    int64_t lastSize = -2;
+    double lastChange = _monotonic_seconds();
+    while (1) {
+        const int64_t size = _file_size(chunkPath_p);
+        if (size >= 0) {
+            // a close only ends a chunk of unknown length, recorders may write a chunk in several passes
+            const int complete = _chunk_data_complete(chunkPath_p, size);
+            if (complete == 1 ||
+                (complete < 0 && (watch_p->closedIndex >= chunkIndex || _file_size(nextPath_p) >= 0))) {
+                return true;
+            }
+        }
+
+        const double now = _monotonic_seconds();
+        if (size != lastSize) {
+            lastSize = size;
+            lastChange = now;
+        } else if (now - lastChange >= settleSeconds) {
+            if (size >= 0) {
+                return true;
+            }
+            if (!waitForever) {
+                return false;
+            }
+        }
+        _watch_wait(watch_p);
+    }
+}
+
+
+void follow_session(const SplitOptions *options_p, const char *sessionPath_p, unsigned int settleSeconds) {
+    // checkpoints append behind partially filled blocks, which O_DIRECT cannot do
+    if (options_p->outputBackend == OUTPUT_BACKEND_DIRECT) {
+        fprintf(stderr, "ERROR: Follow mode requires the stdio or uring output backend\n");
+        exit(1);
+    }
+    if (options_p->jobs > 1) {
+        fprintf(stderr, "Warning: Follow mode splits chunks on a single thread, ignoring -j\n");
+    }
+
+    // the selection is resolved against this session only
+    SplitOptions options = *options_p;
+    options.jobs = 1;
+
+    ChunkWatch watch;
+    _watch_init(&watch, sessionPath_p);
+
+    printf("Waiting for the first chunk in %s\n", sessionPath_p);
+    _wait_for_chunk(&watch, sessionPath_p, 1, settleSeconds, true);
+
+    // the outputs start empty and grow chunk by chunk
+    SessionPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan_chunk(sessionPath_p, 1, &plan);
+    char message[CHANNEL_SELECTION_MESSAGE_LENGTH];
+    if (channel_selection_resolve(&options.channels, plan.format.num_channels, message, sizeof(message)) != 0) {
+        fprintf(stderr, "ERROR: %s\n", message);
+        exit(1);
+    }
+    plan_output_format(&options, &plan);
+
+    // a journal left by an earlier run, e.g. before a restart during the show, is continued
+    char *outputPath_p = NULL;
+    bool resume = false;
+    initialize_session(sessionPath_p, &outputPath_p, &resume);
+    SessionPlan emptyPlan = plan;
+    emptyPlan.totalFrames = 0;
+    emptyPlan.channelDataBytes = 0;
+
+    // the length of a session that is still recorded is unknown, so there is no ETA
+    run_stats_begin_session(options.stats_p, sessionPath_p, &plan.format, options.channels.count, 0);
+
+    // every checkpoint leaves complete outputs, so silent buffers are written even when dropping
+    SignalAnalysis analysis;
+    if (options.analysisMode != ANALYSIS_OFF && resume) {
+        fprintf(stderr, "Warning: Resuming %s, skipping the channel analysis\n", sessionPath_p);
+    } else if (options.analysisMode != ANALYSIS_OFF) {
+        signal_analysis_init(&analysis, &options.channels, plan.format.bits_per_sample, options.analysisMode);
+        analysis.sparseWrites = false;
+        options.analysis_p = &analysis;
+    }
+    PeakOverview peaks;
+    if (options.peakLevels.count > 0 && resume) {
+        fprintf(stderr, "Warning: Resuming %s, skipping the peak overviews\n", sessionPath_p);
+    } else if (options.peakLevels.count > 0) {
+        peak_overview_init(&peaks, &options.peakLevels, &options.channels, &plan.format, outputPath_p);
+        options.peaks_p = &peaks;
+    }
+
+    PageCache cache;
+    if (options.cachePolicy == CACHE_POLICY_DROP) {
+        page_cache_init(&cache, options.dirtyLimitMB, options.channels.count);
+        options.cache_p = &cache;
+    }
+
+    SessionJournal journal;
+    journal_init(&journal, outputPath_p, &options, &plan.format, &plan.outputFormat);
+
+    FILE **outputFiles_pp = NULL;
+    uint64_t *bytesWritten_p = NULL;
+    uint64_t chunkIndex = 1;
+    uint64_t skipFrames = 0;
+    bool chunkReady = true;
+    if (resume) {
+        // continue behind the chunks the journal recorded, the plan catches up to that chunk
+        SessionIndex index;
+        if (session_index_build(&index, sessionPath_p) != 0) {
+            exit(1);
+        }
+        SessionPlan indexPlan;
+        plan_session(&index, NULL, &indexPlan);
+        plan_output_format(&options, &indexPlan);
+        uint64_t *journaledBytes_p = malloc(options.channels.count * sizeof(uint64_t));
+        if (!journaledBytes_p || journal_load(&journal, journaledBytes_p) != 0) {
+            exit(1);
+        }
+        if (resume_output_files(&options, &indexPlan, journaledBytes_p, &index, outputPath_p, &outputFiles_pp,
+                                &bytesWritten_p, &chunkIndex, &skipFrames)) {
+            for (uint64_t i = 2; i <= chunkIndex; i++) {
+                plan_chunk(sessionPath_p, i, &plan);
+            }
+        } else {
+            for (uint64_t i = 2; i <= index.chunkCount; i++) {
+                plan_chunk(sessionPath_p, i, &plan);
+            }
+            chunkIndex = index.chunkCount + 1;
+            chunkReady = _wait_for_chunk(&watch, sessionPath_p, chunkIndex, settleSeconds, false);
+            if (chunkReady) {
+                plan_chunk(sessionPath_p, chunkIndex, &plan);
+            }
+        }
+        free(journaledBytes_p);
+        session_index_free(&index);
+    } else {
+        initialize_output_files(&options, &emptyPlan, outputPath_p, &outputFiles_pp, &bytesWritten_p);
+        journal_commit(&journal, outputFiles_pp, bytesWritten_p, 0);
+    }
+
+    // the dither of converted samples continues behind the audio the outputs already hold
+    SampleConverter converter;
+    if (sample_format_converts(&plan.format, &plan.outputFormat)) {
+        if (sample_converter_init(&converter, &plan.format, &plan.outputFormat, options.channels.count,
+                                  bytesWritten_p) != 0) {
+            fprintf(stderr, "ERROR: Failed to allocate sample converter\n");
+            exit(1);
+        }
+        options.converter_p = &converter;
+        printf("Converting samples to %s (%s)\n", sample_format_name(options.sampleFormat), converter.kernelName_p);
+    }
+
+    OutputBuffer **writeBuffers_pp = NULL;
+    OutputWriter *writer_p = initialize_output_writer(&options, &plan.outputFormat, outputFiles_pp, bytesWritten_p);
+    initialize_buffers(&options, writer_p, &writeBuffers_pp);
+
+    while (chunkReady) {
+        WavHeader inputHeader;
+        FILE *inputFile_p = read_chunk_header(&options, chunkIndex, sessionPath_p, &inputHeader,
+                                              &outputFiles_pp, &bytesWritten_p);
+        skip_chunk_frames(inputFile_p, &inputHeader, skipFrames);
+        skipFrames = 0;
+        extract_audio_from_chunk(&options, inputFile_p, &inputHeader, writer_p, writeBuffers_pp);
+        fclose(inputFile_p);
+
+        // every completed chunk leaves valid outputs behind
+        checkpoint_output_files(&options, &plan, writer_p, writeBuffers_pp, outputFiles_pp, bytesWritten_p);
+        journal_checkpoint(&journal, writer_p, chunkIndex);
+        printf("Checkpoint after chunk %" PRIu64 ": %.1f s of audio\n", chunkIndex,
+               (double)plan.totalFrames / plan.format.sample_rate);
+        fflush(stdout);
+
+        chunkIndex++;
+        chunkReady = _wait_for_chunk(&watch, sessionPath_p, chunkIndex, settleSeconds, false);
+        if (chunkReady) {
+            plan_chunk(sessionPath_p, chunkIndex, &plan);
+        }
+    }
+    printf("No new chunk for %u s, session complete\n", settleSeconds);
+
+    _watch_close(&watch);
+    flush_remaining_buffers(&options, writer_p, writeBuffers_pp);
+    journal_commit(&journal, outputFiles_pp, bytesWritten_p, chunkIndex - 1);
+    finalize_output_files(&options, &plan, &bytesWritten_p, &outputFiles_pp);
+    if (options.peaks_p) {
+        if (peak_overview_finish(options.peaks_p) != 0) {
+            exit(1);
+        }
+        peak_overview_free(options.peaks_p);
+    }
+    if (options.analysis_p) {
+        // renamed or removed outputs no longer match the journal
+        const char *extension_p = output_codec_extension(options.outputCodec);
+        if (signal_analysis_finish(options.analysis_p, outputPath_p, extension_p) > 0) {
+            journal_discard(&journal);
+        }
+        signal_analysis_free(options.analysis_p);
+    }
+    if (options.cache_p) {
+        page_cache_report(options.cache_p, options.stats_p);
+        page_cache_free(options.cache_p);
+    }
+    if (options.converter_p) {
+        sample_converter_free(options.converter_p);
+    }
+    journal_free(&journal);
+
+    if (options_p->channels.count == 0) {
+        channel_selection_free(&options.channels);
+    }
+    free(outputPath_p);
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "input-source.h"
+
+int input_backend_parse(const char *name_p, InputBackend *backend_p) {
+    if (strcmp(name_p, "stdio") == 0) {
+        *backend_p = INPUT_BACKEND_STDIO;
+        return 0;
+    }
+#ifndef WIN32
+    if (strcmp(name_p, "mmap") == 0) {
+        *backend_p = INPUT_BACKEND_MMAP;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *input_backend_name(InputBackend backend) {
+    return backend == INPUT_BACKEND_MMAP ? "mmap" : "stdio";
+}
+
+#ifndef WIN32
+static int _map_data_region(InputSource *source_p, const WavHeader *inputHeader) {
+    const int fd = fileno(source_p->file_p);
+    const long dataOffset = ftell(source_p->file_p);
+    struct stat fileStat;
+    if (dataOffset < 0 || fstat(fd, &fileStat) != 0) {
+        perror("ERROR: Failed to locate audio data");
+        return -1;
+    }
+
+    // never map past the end of the file, truncated chunks are read up to their last whole frame
+    uint64_t dataEnd = (uint64_t)dataOffset + inputHeader->data_bytes;
+    if (dataEnd > (uint64_t)fileStat.st_size) {
+        dataEnd = (uint64_t)fileStat.st_size;
+    }
+    source_p->remainingFrames = (dataEnd - (uint64_t)dataOffset) / source_p->blockAlign;
+    if (source_p->remainingFrames == 0) {
+        return 0;
+    }
+
+    // mappings must start on a page boundary
+    const uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t mapOffset = (uint64_t)dataOffset - (uint64_t)dataOffset % pageSize;
+    source_p->mapLength = (size_t)(dataEnd - mapOffset);
+    source_p->mapBase_p = mmap(NULL, source_p->mapLength, PROT_READ, MAP_PRIVATE, fd, (off_t)mapOffset);
+    if (source_p->mapBase_p == MAP_FAILED) {
+        perror("ERROR: Failed to map audio data");
+        source_p->mapBase_p = NULL;
+        return -1;
+    }
+
+    // the data is consumed exactly once from front to back
+    madvise(source_p->mapBase_p, source_p->mapLength, MADV_SEQUENTIAL);
+    madvise(source_p->mapBase_p, source_p->mapLength, MADV_WILLNEED);
+
+    source_p->cursor_p = (const uint8_t *)source_p->mapBase_p + ((uint64_t)dataOffset - mapOffset);
+    return 0;
+}
+#endif
+
+int input_source_open(InputSource *source_p, FILE *inputFile_p, const WavHeader *inputHeader,
+                      InputBackend backend, PageCache *cache_p) {
+    memset(source_p, 0, sizeof(*source_p));
+    source_p->backend = backend;
+    source_p->cache_p = cache_p;
+    source_p->file_p = inputFile_p;
+    source_p->blockAlign = inputHeader->block_align;
+    source_p->remainingFrames = inputHeader->data_bytes / inputHeader->block_align;
+
+#ifndef WIN32
+    if (backend == INPUT_BACKEND_MMAP) {
+        return _map_data_region(source_p, inputHeader);
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Drop the part of the chunk that was read from the cache
+ *
+ * The stdio backend drops in steps of PAGE_CACHE_INPUT_DROP_BYTES while reading, the rest
+ * of the chunk goes when the source is closed.
+ */
+static void _drop_consumed(InputSource *source_p, bool closing) {
+#ifndef WIN32
+    if (!source_p->cache_p) {
+        return;
+    }
+    uint64_t consumedEnd;
+    if (closing) {
+        struct stat fileStat;
+        if (fstat(fileno(source_p->file_p), &fileStat) != 0) {
+            return;
+        }
+        consumedEnd = (uint64_t)fileStat.st_size;
+    } else {
+        const off_t position = ftello(source_p->file_p);
+        if (position < 0) {
+            return;
+        }
+        consumedEnd = (uint64_t)position;
+    }
+    if (consumedEnd > source_p->dropOffset &&
+        (closing || consumedEnd - source_p->dropOffset >= PAGE_CACHE_INPUT_DROP_BYTES)) {
+        page_cache_drop_input(source_p->cache_p, fileno(source_p->file_p), source_p->dropOffset,
+                              consumedEnd - source_p->dropOffset);
+        source_p->dropOffset = consumedEnd;
+    }
+#else
+    (void)source_p;
+    (void)closing;
+#endif
+}
+
+size_t input_source_next(InputSource *source_p, uint8_t *scratch_p, size_t maxFrames,
+                         const uint8_t **frames_pp) {
+    size_t frameCount = maxFrames;
+    if (frameCount > source_p->remainingFrames) {
+        frameCount = (size_t)source_p->remainingFrames;
+    }
+    if (frameCount == 0) {
+        return 0;
+    }
+
+    if (source_p->backend == INPUT_BACKEND_MMAP) {
+        *frames_pp = source_p->cursor_p;
+        source_p->cursor_p += frameCount * source_p->blockAlign;
+    } else {
+        size_t framesRead = fread(scratch_p, source_p->blockAlign, frameCount, source_p->file_p);
+        if (framesRead < frameCount) {
+            // truncated chunk, nothing more to read after this
+            source_p->remainingFrames = framesRead;
+        }
+        frameCount = framesRead;
+        *frames_pp = scratch_p;
+        _drop_consumed(source_p, false);
+    }
+
+    checksum_update(source_p->checksum_p, *frames_pp, frameCount * source_p->blockAlign);
+    source_p->remainingFrames -= frameCount;
+    return frameCount;
+}
+
+void input_source_set_checksum(InputSource *source_p, Checksum *checksum_p) {
+    source_p->checksum_p = checksum_p;
+}
+
+void input_source_close(InputSource *source_p) {
+#ifndef WIN32
+    if (source_p->mapBase_p) {
+        munmap(source_p->mapBase_p, source_p->mapLength);
+    }
+#endif
+    // mapped pages stay cached while they are mapped, so mappings are only dropped here
+    if (source_p->file_p) {
+        _drop_consumed(source_p, true);
+    }
+    source_p->mapBase_p = NULL;
+    source_p->cursor_p = NULL;
+    source_p->remainingFrames = 0;
+}
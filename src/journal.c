@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "journal.h"
+#include "utils.h"
+
+#define JOURNAL_MAGIC "wav-splitter journal 1"
+
+bool journal_exists(const char *outputPath_p) {
+    char journalPath[300];
+    snprintf(journalPath, sizeof(journalPath), "%s%s", outputPath_p, JOURNAL_FILE_NAME);
+    FILE *journalFile_p = fopen(journalPath, "r");
+    if (!journalFile_p) {
+        return false;
+    }
+    fclose(journalFile_p);
+    return true;
+}
+
+void journal_init(SessionJournal *journal_p, const char *outputPath_p, const SplitOptions *options_p,
+                  const WavHeader *format_p, const WavHeader *outputFormat_p) {
+    journal_p->options_p = options_p;
+    journal_p->format_p = format_p;
+    journal_p->outputFormat_p = outputFormat_p;
+    // an encoded stream cannot be cut back to a journaled size and a range does not continue
+    // where the journal would, such outputs are never resumed
+    journal_p->active = options_p->outputCodec == OUTPUT_CODEC_WAV && !options_p->range_p;
+    journal_p->path_p = malloc(strlen(outputPath_p) + strlen(JOURNAL_FILE_NAME) + 1);
+    journal_p->directoryPath_p = malloc(strlen(outputPath_p) + 1);
+    journal_p->durableBytes_p = malloc(options_p->channels.count * sizeof(uint64_t));
+    if (!journal_p->path_p || !journal_p->directoryPath_p || !journal_p->durableBytes_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    sprintf(journal_p->path_p, "%s%s", outputPath_p, JOURNAL_FILE_NAME);
+    strcpy(journal_p->directoryPath_p, outputPath_p);
+}
+
+/**
+ * Read the next line of a journal without its line break, false at the end or for an overlong line
+ */
+static bool _next_line(FILE *journalFile_p, char *line_p, size_t size) {
+    if (!fgets(line_p, (int)size, journalFile_p)) {
+        return false;
+    }
+    const size_t length = strlen(line_p);
+    if (length == 0 || line_p[length - 1] != '\n') {
+        return false;
+    }
+    line_p[length - 1] = '\0';
+    return true;
+}
+
+/**
+ * Parse a journal and check it against the current run
+ *
+ * Every value is on a line of its own and a line is only accepted if it is parsed to its end.
+ */
+static int _parse_journal(FILE *journalFile_p, const SessionJournal *journal_p, uint64_t *bytesWritten_p) {
+    const ChannelSelection *channels_p = &journal_p->options_p->channels;
+    char line[128];
+    int consumed = 0;
+    unsigned int numChannels = 0, bitsPerSample = 0, sampleRate = 0, dataOffset = 0, outputCount = 0;
+    unsigned int outputAudioFormat = WAV_FORMAT_PCM, outputBitsPerSample = 0;
+    uint64_t chunkIndex = 0;
+
+    if (!_next_line(journalFile_p, line, sizeof(line)) || strcmp(line, JOURNAL_MAGIC) != 0 ||
+        !_next_line(journalFile_p, line, sizeof(line)) ||
+        sscanf(line, "format %u %u %u%n", &numChannels, &bitsPerSample, &sampleRate, &consumed) != 3 ||
+        line[consumed] != '\0' ||
+        !_next_line(journalFile_p, line, sizeof(line)) ||
+        sscanf(line, "data_offset %u%n", &dataOffset, &consumed) != 1 || line[consumed] != '\0' ||
+        !_next_line(journalFile_p, line, sizeof(line))) {
+        fprintf(stderr, "ERROR: Journal %s is damaged\n", journal_p->path_p);
+        return -1;
+    }
+    // journals written before outputs could be converted have no output format and hold the session format
+    outputBitsPerSample = bitsPerSample;
+    if (strncmp(line, "output_format", strlen("output_format")) == 0 &&
+        (sscanf(line, "output_format %u %u%n", &outputAudioFormat, &outputBitsPerSample, &consumed) != 2 ||
+         line[consumed] != '\0' || !_next_line(journalFile_p, line, sizeof(line)))) {
+        fprintf(stderr, "ERROR: Journal %s is damaged\n", journal_p->path_p);
+        return -1;
+    }
+    if (sscanf(line, "chunk %" SCNu64 "%n", &chunkIndex, &consumed) != 1 || line[consumed] != '\0' ||
+        !_next_line(journalFile_p, line, sizeof(line)) ||
+        sscanf(line, "outputs %u%n", &outputCount, &consumed) != 1 || line[consumed] != '\0') {
+        fprintf(stderr, "ERROR: Journal %s is damaged\n", journal_p->path_p);
+        return -1;
+    }
+
+    // resuming only makes sense into the very same output files
+    if (numChannels != journal_p->format_p->num_channels || bitsPerSample != journal_p->format_p->bits_per_sample ||
+        sampleRate != journal_p->format_p->sample_rate) {
+        fprintf(stderr, "ERROR: Journal %s was written for a different input format\n", journal_p->path_p);
+        return -1;
+    }
+    if (outputAudioFormat != journal_p->outputFormat_p->audio_format ||
+        outputBitsPerSample != journal_p->outputFormat_p->bits_per_sample) {
+        fprintf(stderr, "ERROR: Journal %s was written for a different output sample format\n", journal_p->path_p);
+        return -1;
+    }
+    if (dataOffset != output_backend_data_offset(journal_p->options_p->outputBackend,
+                                                 journal_p->outputFormat_p->audio_format)) {
+        fprintf(stderr, "ERROR: Journal %s was written with an output backend of a different header layout\n",
+                journal_p->path_p);
+        return -1;
+    }
+    if (outputCount != channels_p->count) {
+        fprintf(stderr, "ERROR: Journal %s was written for %u outputs, this run creates %d\n",
+                journal_p->path_p, outputCount, channels_p->count);
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        char journalName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels_p, i);
+        if (!_next_line(journalFile_p, line, sizeof(line)) ||
+            sscanf(line, "%" SCNu64 " %64s%n", &bytesWritten_p[i], journalName, &consumed) != 2 ||
+            line[consumed] != '\0') {
+            fprintf(stderr, "ERROR: Journal %s is damaged\n", journal_p->path_p);
+            return -1;
+        }
+        if (strcmp(journalName, outputName) != 0) {
+            fprintf(stderr, "ERROR: Journal %s lists output %s where this run creates %s\n",
+                    journal_p->path_p, journalName, outputName);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int journal_load(const SessionJournal *journal_p, uint64_t *bytesWritten_p) {
+    FILE *journalFile_p = fopen(journal_p->path_p, "r");
+    if (!journalFile_p) {
+        fprintf(stderr, "ERROR: Failed to open journal %s\n", journal_p->path_p);
+        return -1;
+    }
+    const int result = _parse_journal(journalFile_p, journal_p, bytesWritten_p);
+    fclose(journalFile_p);
+    return result;
+}
+
+/**
+ * Replace the journal atomically, a crash leaves either the old or the new one behind
+ *
+ * The new journal reaches the disk before the rename and the rename before returning, so
+ * after a power loss the journal on disk is never older than the outputs expect.
+ */
+static void _write_journal(const SessionJournal *journal_p, const uint64_t *bytesWritten_p, uint64_t chunkIndex) {
+    const ChannelSelection *channels_p = &journal_p->options_p->channels;
+    if (!journal_p->active) {
+        return;
+    }
+    char tempPath[300];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", journal_p->path_p);
+
+    FILE *journalFile_p = fopen(tempPath, "w");
+    if (!journalFile_p) {
+        fprintf(stderr, "Warning: Failed to write journal %s\n", tempPath);
+        return;
+    }
+    fprintf(journalFile_p, "%s\n", JOURNAL_MAGIC);
+    fprintf(journalFile_p, "format %u %u %u\n", journal_p->format_p->num_channels,
+            journal_p->format_p->bits_per_sample, journal_p->format_p->sample_rate);
+    fprintf(journalFile_p, "data_offset %u\n", output_backend_data_offset(journal_p->options_p->outputBackend,
+                                                                          journal_p->outputFormat_p->audio_format));
+    fprintf(journalFile_p, "output_format %u %u\n", journal_p->outputFormat_p->audio_format,
+            journal_p->outputFormat_p->bits_per_sample);
+    fprintf(journalFile_p, "chunk %" PRIu64 "\n", chunkIndex);
+    fprintf(journalFile_p, "outputs %d\n", channels_p->count);
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels_p, i);
+        fprintf(journalFile_p, "%" PRIu64 " %s\n", bytesWritten_p[i], outputName);
+    }
+    const int syncResult = _sync_file(journalFile_p);
+    if (fclose(journalFile_p) != 0 || syncResult != 0) {
+        fprintf(stderr, "Warning: Failed to write journal %s\n", tempPath);
+        return;
+    }
+
+#ifdef WIN32
+    if (!MoveFileEx(tempPath, journal_p->path_p, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(tempPath, journal_p->path_p) != 0) {
+#endif
+        fprintf(stderr, "Warning: Failed to replace journal %s\n", journal_p->path_p);
+        return;
+    }
+    if (_sync_directory(journal_p->directoryPath_p) != 0) {
+        fprintf(stderr, "Warning: Failed to sync output directory %s\n", journal_p->directoryPath_p);
+    }
+}
+
+void journal_checkpoint(SessionJournal *journal_p, OutputWriter *writer_p, uint64_t chunkIndex) {
+    if (!journal_p->active) {
+        return;
+    }
+    // the previous journal stays valid if the outputs cannot be made durable
+    if (output_writer_sync_point(writer_p, journal_p->durableBytes_p) != 0) {
+        fprintf(stderr, "Warning: Failed to sync the outputs, keeping the previous journal\n");
+        return;
+    }
+    _write_journal(journal_p, journal_p->durableBytes_p, chunkIndex);
+}
+
+void journal_commit(SessionJournal *journal_p, FILE **outputFiles_pp, const uint64_t *bytesWritten_p,
+                    uint64_t chunkIndex) {
+    for (uint16_t i = 0; i < journal_p->options_p->channels.count; i++) {
+        if (!journal_p->active) {
+            fflush(outputFiles_pp[i]);
+        } else if (_sync_file(outputFiles_pp[i]) != 0) {
+            fprintf(stderr, "Warning: Failed to sync the outputs, keeping the previous journal\n");
+            return;
+        }
+    }
+    _write_journal(journal_p, bytesWritten_p, chunkIndex);
+}
+
+void journal_discard(SessionJournal *journal_p) {
+    if (!journal_p->active) {
+        return;
+    }
+    if (remove(journal_p->path_p) != 0) {
+        fprintf(stderr, "Warning: Failed to remove journal %s\n", journal_p->path_p);
+    }
+}
+
+void journal_free(SessionJournal *journal_p) {
+    free(journal_p->path_p);
+    free(journal_p->directoryPath_p);
+    free(journal_p->durableBytes_p);
+    journal_p->path_p = NULL;
+    journal_p->directoryPath_p = NULL;
+    journal_p->durableBytes_p = NULL;
+}
@@ -5,94 +5,516 @@
 
 #include "wav-header.h"
 #include "processing.h"
+#include "batch.h"
+#include "follow.h"
+#include "stream.h"
+#include "merge.h"
+#include "verify.h"
+#include "utils.h"
 
-// Default buffer size: 4096 MB is enough to store around 7 minutes of 32 channel audio at 24 bit, 96 kHz
-#define DEFAULT_BUFFER_SIZE_MB 4096
+// Default buffer size: 32 MB give 32 channels four blocks of about 256 KB each
+#define DEFAULT_BUFFER_SIZE_MB 32
+
+// Default memory budget shared by all sessions of a batch
+#define DEFAULT_BATCH_MEMORY_MB 1024
+
+
+static void print_usage(void) {
+    printf("Usage: wav-splitter [-m buffer_size_mb] [-j jobs] [-i input_backend] [-w output_backend] [-l large_format] [-c channels | -g channel_map]\n");
+    printf("                    [-b max_sessions [-M batch_memory_mb] [-d sessions_per_device] | -f settle_seconds]\n");
+    printf("                    [-a silent_outputs] [--peaks bin_frames] [-s sample_format] [-o output_codec]\n");
+    printf("                    [--start position] [--end position] [--cache cache_policy [--dirty-mb dirty_mb]]\n");
+    printf("                    [--report report_path] [--progress interval_seconds] [--checksum crc32c]\n");
+    printf("                    <session_path | batch>\n");
+    printf("       wav-splitter [-c channels | -g channel_map] [-s sample_format] [-l large_format] [--raw stream_format]\n");
+    printf("                    --stream <stream_path | -> <output_path | --pipes pipe_pattern>\n");
+    printf("       wav-splitter [-m buffer_size_mb] [--chunk-mb chunk_mb] --merge tracks_path <session_path>\n");
+    printf("       wav-splitter [-i input_backend] [-c channels | -g channel_map] [-s sample_format] --verify manifest_path <session_path>\n");
+    printf("  -m buffer_size_mb : Optional total buffer size in MB (default: %d)\n", DEFAULT_BUFFER_SIZE_MB);
+    printf("  -j jobs           : Optional number of deinterleave workers and writer threads (default: 1)\n");
+    printf("  -i input_backend  : Optional input backend, stdio or mmap (default: stdio)\n");
+    printf("  -w output_backend : Optional output backend, stdio, uring or direct (default: stdio)\n");
+    printf("  -l large_format   : Optional format for outputs beyond 4 GiB, rf64 or bw64 (default: rf64)\n");
+    printf("  -c channels       : Optional channels to extract, e.g. 1-4,17,31 (default: all)\n");
+    printf("  -g channel_map    : Optional channel map file defining named mono, stereo or multichannel outputs\n");
+    printf("  -a silent_outputs : Optional per-channel level analysis, keep, mark or drop silent outputs\n");
+    printf("  --peaks bin_frames: Optional min/max peak overview <name>.peaks per output, frames per bin of every level like 256,4096,65536\n");
+    printf("  -s sample_format  : Optional sample format of the outputs, s16, s24, s32 or f32 (default: format of the session)\n");
+    printf("  -o output_codec   : Optional codec of the outputs, wav or flac (default: wav)\n");
+    printf("  --start position  : Optional start of the range to split, [[h:]m:]s[.fraction] or a frame count like 48000f\n");
+    printf("  --end position    : Optional end of the range to split (exclusive), same format as --start\n");
+    printf("  -b max_sessions   : Optional batch mode, splits up to max_sessions sessions of a root directory or list file at a time\n");
+    printf("  -M batch_memory_mb: Optional memory budget of all sessions of a batch in MB (default: %d)\n", DEFAULT_BATCH_MEMORY_MB);
+    printf("  -d sessions_per_device : Optional number of batch sessions per storage device (default: 1)\n");
+    printf("  -f settle_seconds : Optional follow mode, splits chunks while they are recorded and ends after settle_seconds without a new chunk\n");
+    printf("  --cache cache_policy : Optional page cache policy, keep or drop consumed input and write outputs back early (default: keep)\n");
+    printf("  --dirty-mb dirty_mb  : Optional dirty megabytes per output with --cache drop (default: %d)\n", PAGE_CACHE_DEFAULT_DIRTY_MB);
+    printf("  --report report_path : Optional JSON report with per-stage and per-chunk timings\n");
+    printf("  --progress interval_seconds : Optional progress line with ETA on stderr every interval_seconds\n");
+    printf("  --stream stream_path : Stream mode, splits one interleaved WAV stream from a FIFO, a file or stdin (-) until it ends\n");
+    printf("  --raw stream_format  : Optional format of a stream without WAV header, e.g. s24:32:48000\n");
+    printf("  --pipes pipe_pattern : Optional per-output FIFO or file like /run/{name}.wav, or fd:3 for file descriptors 3, 4, ...\n");
+    printf("  --merge tracks_path  : Merge mode, interleaves the ch_<channel>.wav tracks of tracks_path into the chunks of a new session\n");
+    printf("  --chunk-mb chunk_mb  : Optional size limit of a merged chunk in MB (default: 4096, the FAT32 limit of the recorder's card)\n");
+    printf("  --checksum crc32c    : Optional CRC32C of every chunk and output, written to out/%s\n", CHECKSUM_MANIFEST_NAME);
+    printf("  --verify manifest_path : Verify mode, checks the chunks and the outputs they split into against a manifest without writing\n");
+}
+
+
+/**
+ * Parse a strictly positive integer option value
+ *
+ * @param option_p Name of the option (for error messages)
+ * @param value_p Value string to parse
+ * @return Parsed value
+ */
+static long parse_positive_option(const char *option_p, const char *value_p) {
+    char *endptr;
+    long value = strtol(value_p, &endptr, 10);
+
+    if (*endptr != '\0' || value <= 0) {
+        fprintf(stderr, "ERROR: Invalid value '%s' for option %s\n", value_p, option_p);
+        exit(1);
+    }
+    return value;
+}
+
+
+// What a run of the tool does, chosen by at most one mode option
+typedef enum {
+    RUN_MODE_SPLIT,   // Split one session (no mode option)
+    RUN_MODE_BATCH,   // Split the sessions of a batch (-b)
+    RUN_MODE_FOLLOW,  // Split a session while it is recorded (-f)
+    RUN_MODE_STREAM,  // Split one interleaved stream (--stream)
+    RUN_MODE_MERGE,   // Interleave tracks into a new session (--merge)
+    RUN_MODE_VERIFY,  // Check a session against a manifest (--verify)
+    RUN_MODE_COUNT
+} RunMode;
+
+#define MODE_BIT(mode) (1u << (mode))
+#define MODES_SESSION (MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_BATCH) | MODE_BIT(RUN_MODE_FOLLOW))
+
+static const char *const RUN_MODE_DESCRIPTIONS[RUN_MODE_COUNT] = {
+    "when splitting a single session",
+    "in batch mode (-b)",
+    "in follow mode (-f)",
+    "in stream mode (--stream)",
+    "in merge mode (--merge)",
+    "in verify mode (--verify)",
+};
+
+typedef enum {
+    OPTION_BUFFER_SIZE,
+    OPTION_JOBS,
+    OPTION_INPUT_BACKEND,
+    OPTION_OUTPUT_BACKEND,
+    OPTION_LARGE_FORMAT,
+    OPTION_CHANNELS,
+    OPTION_CHANNEL_MAP,
+    OPTION_ANALYSIS,
+    OPTION_PEAKS,
+    OPTION_SAMPLE_FORMAT,
+    OPTION_OUTPUT_CODEC,
+    OPTION_START,
+    OPTION_END,
+    OPTION_BATCH,
+    OPTION_BATCH_MEMORY,
+    OPTION_SESSIONS_PER_DEVICE,
+    OPTION_FOLLOW,
+    OPTION_CACHE,
+    OPTION_DIRTY_MB,
+    OPTION_REPORT,
+    OPTION_PROGRESS,
+    OPTION_STREAM,
+    OPTION_RAW,
+    OPTION_PIPES,
+    OPTION_MERGE,
+    OPTION_CHUNK_MB,
+    OPTION_CHECKSUM,
+    OPTION_VERIFY
+} OptionId;
+
+typedef struct {
+    const char *name_p;   // Option as given on the command line
+    OptionId id;
+    RunMode selects;      // Mode chosen by the option (RUN_MODE_SPLIT for plain options)
+    unsigned int modes;   // Modes the option applies to (MODE_BIT of each)
+} OptionRule;
+
+// Every option with the modes it applies to, an option given in any other mode is rejected
+static const OptionRule OPTION_RULES[] = {
+    {"-m",         OPTION_BUFFER_SIZE,         RUN_MODE_SPLIT,  MODES_SESSION | MODE_BIT(RUN_MODE_MERGE)},
+    {"-j",         OPTION_JOBS,                RUN_MODE_SPLIT,  MODES_SESSION | MODE_BIT(RUN_MODE_STREAM)},
+    {"-i",         OPTION_INPUT_BACKEND,       RUN_MODE_SPLIT,  MODES_SESSION | MODE_BIT(RUN_MODE_VERIFY)},
+    {"-w",         OPTION_OUTPUT_BACKEND,      RUN_MODE_SPLIT,  MODES_SESSION},
+    {"-l",         OPTION_LARGE_FORMAT,        RUN_MODE_SPLIT,  MODES_SESSION | MODE_BIT(RUN_MODE_STREAM)},
+    {"-c",         OPTION_CHANNELS,            RUN_MODE_SPLIT,
+     MODES_SESSION | MODE_BIT(RUN_MODE_STREAM) | MODE_BIT(RUN_MODE_VERIFY)},
+    {"-g",         OPTION_CHANNEL_MAP,         RUN_MODE_SPLIT,
+     MODES_SESSION | MODE_BIT(RUN_MODE_STREAM) | MODE_BIT(RUN_MODE_VERIFY)},
+    {"-a",         OPTION_ANALYSIS,            RUN_MODE_SPLIT,  MODES_SESSION},
+    {"--peaks",    OPTION_PEAKS,               RUN_MODE_SPLIT,  MODES_SESSION},
+    {"-s",         OPTION_SAMPLE_FORMAT,       RUN_MODE_SPLIT,
+     MODES_SESSION | MODE_BIT(RUN_MODE_STREAM) | MODE_BIT(RUN_MODE_VERIFY)},
+    {"-o",         OPTION_OUTPUT_CODEC,        RUN_MODE_SPLIT,  MODES_SESSION},
+    {"--start",    OPTION_START,               RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_BATCH)},
+    {"--end",      OPTION_END,                 RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_BATCH)},
+    {"-b",         OPTION_BATCH,               RUN_MODE_BATCH,  MODE_BIT(RUN_MODE_BATCH)},
+    {"-M",         OPTION_BATCH_MEMORY,        RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_BATCH)},
+    {"-d",         OPTION_SESSIONS_PER_DEVICE, RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_BATCH)},
+    {"-f",         OPTION_FOLLOW,              RUN_MODE_FOLLOW, MODE_BIT(RUN_MODE_FOLLOW)},
+    {"--cache",    OPTION_CACHE,               RUN_MODE_SPLIT,  MODES_SESSION},
+    {"--dirty-mb", OPTION_DIRTY_MB,            RUN_MODE_SPLIT,  MODES_SESSION},
+    {"--report",   OPTION_REPORT,              RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_FOLLOW)},
+    {"--progress", OPTION_PROGRESS,            RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_FOLLOW)},
+    {"--stream",   OPTION_STREAM,              RUN_MODE_STREAM, MODE_BIT(RUN_MODE_STREAM)},
+    {"--raw",      OPTION_RAW,                 RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_STREAM)},
+    {"--pipes",    OPTION_PIPES,               RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_STREAM)},
+    {"--merge",    OPTION_MERGE,               RUN_MODE_MERGE,  MODE_BIT(RUN_MODE_MERGE)},
+    {"--chunk-mb", OPTION_CHUNK_MB,            RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_MERGE)},
+    {"--checksum", OPTION_CHECKSUM,            RUN_MODE_SPLIT,  MODE_BIT(RUN_MODE_SPLIT) | MODE_BIT(RUN_MODE_BATCH)},
+    {"--verify",   OPTION_VERIFY,              RUN_MODE_VERIFY, MODE_BIT(RUN_MODE_VERIFY)},
+};
+
+#define OPTION_RULE_COUNT (sizeof(OPTION_RULES) / sizeof(OPTION_RULES[0]))
+
+typedef struct {
+    RunMode mode;
+    const char *path_p;             // Session, batch, output directory (stream) or new session (merge)
+    SplitOptions options;
+    BatchOptions batch;             // Batch mode only
+    unsigned int settleSeconds;     // Settle time of follow mode
+    const char *reportPath_p;       // Path of the run report (NULL without --report)
+    unsigned int progressInterval;  // Interval of progress lines (0 without --progress)
+    StreamOptions stream;           // Stream mode, the channel selection text is also used by verify mode
+    const char *tracksPath_p;       // Track directory of merge mode
+    uint64_t chunkLimitBytes;       // Size limit of merged chunks
+    const char *manifestPath_p;     // Manifest of verify mode
+} CommandLine;
 
 
 /**
  * Parse command line arguments
- * 
+ *
+ * Options are checked against the mode of the run with OPTION_RULES, so an option that
+ * the mode would ignore is reported instead.
+ *
  * @param argc Argument count
  * @param argv Argument values
- * @param sessionPath_p Pointer to store the session path
- * @param totalBufferSizeMB Pointer to store the buffer size in MB
+ * @param commandLine_p Pointer to store the mode and its options
  */
-static void parse_arguments(int argc, char *argv[], const char **sessionPath_p, size_t *totalBufferSizeMB) {
-    *totalBufferSizeMB = DEFAULT_BUFFER_SIZE_MB;
+static void parse_arguments(int argc, char *argv[], CommandLine *commandLine_p) {
+    memset(commandLine_p, 0, sizeof(*commandLine_p));
+    SplitOptions *options_p = &commandLine_p->options;
+    options_p->totalBufferSizeMB = DEFAULT_BUFFER_SIZE_MB;
+    options_p->jobs = 1;
+    options_p->inputBackend = INPUT_BACKEND_STDIO;
+    options_p->outputBackend = OUTPUT_BACKEND_STDIO;
+    options_p->largeContainer = WAV_CONTAINER_RF64;
+    options_p->analysisMode = ANALYSIS_OFF;
+    options_p->sampleFormat = SAMPLE_FORMAT_SOURCE;
+    options_p->outputCodec = OUTPUT_CODEC_WAV;
+    options_p->cachePolicy = CACHE_POLICY_KEEP;
+    options_p->checksumMode = CHECKSUM_OFF;
+    commandLine_p->mode = RUN_MODE_SPLIT;
+    commandLine_p->batch.memoryBudgetMB = DEFAULT_BATCH_MEMORY_MB;
+    commandLine_p->batch.sessionsPerDevice = 1;
     
     // check for valid input arguments
-    if (argc < 2 || argc > 4) {
-        printf("Usage: wav-splitter [-m buffer_size_mb] <session_path>\n");
-        printf("  -m buffer_size_mb : Optional total buffer size in MB (default: %d)\n", DEFAULT_BUFFER_SIZE_MB);
+    if (argc < 2) {
+        print_usage();
         exit(1);
     }
     
-    // check for -m flag
+    // parse options, each of them takes a value
+    bool given[OPTION_RULE_COUNT] = {false};
     int argIndex = 1;
-    if (argc >= 3 && strcmp(argv[argIndex], "-m") == 0) {
-        char *endptr;
-        long bufferSize = strtol(argv[argIndex + 1], &endptr, 10);
-        
-        if (*endptr != '\0' || bufferSize <= 0) {
-            fprintf(stderr, "ERROR: Invalid buffer size '%s'\n", argv[argIndex + 1]);
+    while (argIndex < argc && argv[argIndex][0] == '-') {
+        const OptionRule *rule_p = NULL;
+        for (size_t i = 0; i < OPTION_RULE_COUNT && !rule_p; i++) {
+            if (strcmp(argv[argIndex], OPTION_RULES[i].name_p) == 0) {
+                rule_p = &OPTION_RULES[i];
+                given[i] = true;
+            }
+        }
+        if (!rule_p) {
+            fprintf(stderr, "ERROR: Unknown option %s\n", argv[argIndex]);
+            print_usage();
+            exit(1);
+        }
+        if (argIndex + 1 >= argc) {
+            fprintf(stderr, "ERROR: Missing value for option %s\n", argv[argIndex]);
+            print_usage();
             exit(1);
         }
-        
-        *totalBufferSizeMB = (size_t)bufferSize;
+        if (rule_p->selects != RUN_MODE_SPLIT) {
+            if (commandLine_p->mode != RUN_MODE_SPLIT) {
+                fprintf(stderr, "ERROR: Only one of -b, -f, --stream, --merge and --verify may be given\n");
+                exit(1);
+            }
+            commandLine_p->mode = rule_p->selects;
+        }
+
+        const char *value_p = argv[argIndex + 1];
+        switch (rule_p->id) {
+            case OPTION_BUFFER_SIZE:
+                options_p->totalBufferSizeMB = (size_t)parse_positive_option("-m", value_p);
+                printf("Using buffer size: %zu MB\n", options_p->totalBufferSizeMB);
+                break;
+            case OPTION_JOBS:
+                options_p->jobs = (unsigned int)parse_positive_option("-j", value_p);
+                break;
+            case OPTION_INPUT_BACKEND:
+                if (input_backend_parse(value_p, &options_p->inputBackend) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported input backend '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_OUTPUT_BACKEND:
+                if (output_backend_parse(value_p, &options_p->outputBackend) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported output backend '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_LARGE_FORMAT:
+                if (strcmp(value_p, "rf64") == 0) {
+                    options_p->largeContainer = WAV_CONTAINER_RF64;
+                } else if (strcmp(value_p, "bw64") == 0) {
+                    options_p->largeContainer = WAV_CONTAINER_BW64;
+                } else {
+                    fprintf(stderr, "ERROR: Unsupported large file format '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_CHANNELS:
+            case OPTION_CHANNEL_MAP: {
+                if (options_p->channels.count > 0) {
+                    fprintf(stderr, "ERROR: Only one of -c and -g may be given\n");
+                    exit(1);
+                }
+                char message[CHANNEL_SELECTION_MESSAGE_LENGTH];
+                if (rule_p->id == OPTION_CHANNELS && channel_selection_parse(value_p, &options_p->channels) != 0) {
+                    fprintf(stderr, "ERROR: Invalid channel selection '%s'\n", value_p);
+                    exit(1);
+                }
+                if (rule_p->id == OPTION_CHANNEL_MAP &&
+                    channel_selection_load_map(value_p, &options_p->channels, message, sizeof(message)) != 0) {
+                    fprintf(stderr, "ERROR: %s\n", message);
+                    exit(1);
+                }
+                // streams hand the selection to the library, which parses it on its own
+                if (rule_p->id == OPTION_CHANNELS) {
+                    commandLine_p->stream.channelSpec_p = value_p;
+                } else {
+                    commandLine_p->stream.channelMap_p = value_p;
+                }
+                break;
+            }
+            case OPTION_ANALYSIS:
+                if (analysis_mode_parse(value_p, &options_p->analysisMode) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported analysis mode '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_PEAKS:
+                if (peak_levels_parse(value_p, &options_p->peakLevels) != 0) {
+                    fprintf(stderr, "ERROR: Invalid peak levels '%s', expected up to %d ascending multiples like "
+                                    "256,4096,65536\n", value_p, PEAK_MAX_LEVELS);
+                    exit(1);
+                }
+                break;
+            case OPTION_SAMPLE_FORMAT:
+                if (sample_format_parse(value_p, &options_p->sampleFormat) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported sample format '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_OUTPUT_CODEC:
+                if (output_codec_parse(value_p, &options_p->outputCodec) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported output codec '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_START:
+            case OPTION_END:
+                if (session_position_parse(value_p, rule_p->id == OPTION_START ? &options_p->start
+                                                                                : &options_p->end) != 0) {
+                    fprintf(stderr, "ERROR: Invalid position '%s' for %s\n", value_p, rule_p->name_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_BATCH:
+                commandLine_p->batch.maxSessions = (unsigned int)parse_positive_option("-b", value_p);
+                break;
+            case OPTION_BATCH_MEMORY:
+                commandLine_p->batch.memoryBudgetMB = (size_t)parse_positive_option("-M", value_p);
+                break;
+            case OPTION_SESSIONS_PER_DEVICE:
+                commandLine_p->batch.sessionsPerDevice = (unsigned int)parse_positive_option("-d", value_p);
+                break;
+            case OPTION_FOLLOW:
+                commandLine_p->settleSeconds = (unsigned int)parse_positive_option("-f", value_p);
+                break;
+            case OPTION_CACHE:
+                if (cache_policy_parse(value_p, &options_p->cachePolicy) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported cache policy '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_DIRTY_MB:
+                options_p->dirtyLimitMB = (size_t)parse_positive_option("--dirty-mb", value_p);
+                break;
+            case OPTION_REPORT:
+                commandLine_p->reportPath_p = value_p;
+                break;
+            case OPTION_PROGRESS:
+                commandLine_p->progressInterval = (unsigned int)parse_positive_option("--progress", value_p);
+                break;
+            case OPTION_STREAM:
+                commandLine_p->stream.inputPath_p = value_p;
+                break;
+            case OPTION_RAW:
+                if (stream_raw_format_parse(value_p, &commandLine_p->stream.rawFormat) != 0) {
+                    fprintf(stderr, "ERROR: Invalid stream format '%s', expected e.g. s24:32:48000\n", value_p);
+                    exit(1);
+                }
+                commandLine_p->stream.raw = true;
+                break;
+            case OPTION_PIPES:
+                commandLine_p->stream.pipePattern_p = value_p;
+                break;
+            case OPTION_MERGE:
+                commandLine_p->tracksPath_p = value_p;
+                break;
+            case OPTION_CHUNK_MB:
+                commandLine_p->chunkLimitBytes = (uint64_t)parse_positive_option("--chunk-mb", value_p) * 1024 * 1024;
+                break;
+            case OPTION_CHECKSUM:
+                if (checksum_mode_parse(value_p, &options_p->checksumMode) != 0) {
+                    fprintf(stderr, "ERROR: Unsupported checksum '%s'\n", value_p);
+                    exit(1);
+                }
+                break;
+            case OPTION_VERIFY:
+                commandLine_p->manifestPath_p = value_p;
+                break;
+        }
         argIndex += 2;
-        printf("Using buffer size: %zu MB\n", *totalBufferSizeMB);
     }
-    
+
+    // the mode is only known once all options are read
+    for (size_t i = 0; i < OPTION_RULE_COUNT; i++) {
+        if (given[i] && (OPTION_RULES[i].modes & MODE_BIT(commandLine_p->mode)) == 0) {
+            fprintf(stderr, "ERROR: %s does not apply %s\n", OPTION_RULES[i].name_p,
+                    RUN_MODE_DESCRIPTIONS[commandLine_p->mode]);
+            exit(1);
+        }
+    }
+
+    // combinations depending on the values rather than the mode
+    if (options_p->outputCodec == OUTPUT_CODEC_FLAC && options_p->outputBackend != OUTPUT_BACKEND_STDIO) {
+        fprintf(stderr, "ERROR: FLAC outputs are written with the stdio output backend\n");
+        exit(1);
+    }
+    if (options_p->outputCodec == OUTPUT_CODEC_FLAC && commandLine_p->mode == RUN_MODE_FOLLOW) {
+        fprintf(stderr, "ERROR: FLAC outputs are completed at the end of a session and cannot be combined with -f\n");
+        exit(1);
+    }
+    if (options_p->checksumMode != CHECKSUM_OFF && (options_p->start.set || options_p->end.set)) {
+        fprintf(stderr, "ERROR: --checksum covers whole sessions and cannot be combined with --start or --end\n");
+        exit(1);
+    }
+    if (options_p->dirtyLimitMB > 0 && options_p->cachePolicy != CACHE_POLICY_DROP) {
+        fprintf(stderr, "ERROR: --dirty-mb requires --cache drop\n");
+        exit(1);
+    }
+    if (options_p->cachePolicy == CACHE_POLICY_DROP && options_p->dirtyLimitMB == 0) {
+        options_p->dirtyLimitMB = PAGE_CACHE_DEFAULT_DIRTY_MB;
+    }
+    if (commandLine_p->mode == RUN_MODE_MERGE && commandLine_p->chunkLimitBytes == 0) {
+        commandLine_p->chunkLimitBytes = MERGE_CHUNK_LIMIT_BYTES;
+    }
+
+    // outputs on pipes need no output directory
+    if (commandLine_p->stream.pipePattern_p && argIndex == argc) {
+        return;
+    }
+
     // get session path
     if (argIndex >= argc) {
         fprintf(stderr, "ERROR: Session path not provided\n");
         exit(1);
     }
-    *sessionPath_p = argv[argIndex];
+    if (argIndex + 1 < argc || commandLine_p->stream.pipePattern_p) {
+        print_usage();
+        exit(1);
+    }
+    commandLine_p->path_p = argv[argIndex];
 }
 
 
 int main(const int argc, char *argv[]) {
     // parse command line arguments
-    const char *sessionPath_p = NULL;
-    size_t totalBufferSizeMB = 0;
-    parse_arguments(argc, argv, &sessionPath_p, &totalBufferSizeMB);
-
-    // initialize session and find chunks
-    uint64_t maxChunkIndex = 0;
-    char *outputPath_p = NULL;
-    initialize_session(sessionPath_p, &maxChunkIndex, &outputPath_p);
-
-    // prepare processing state
-    WavHeader inputHeader;
-    FILE **outputFiles_pp = NULL;
-    uint32_t *bytesWritten_p = NULL;
-    uint8_t **writeBuffers_pp = NULL;
-    size_t *bufferFillBytes_p = NULL;
-    size_t bufferSizeBytes = 0;
-
-    for (uint64_t chunkIndex = 1; chunkIndex <= maxChunkIndex; chunkIndex++) {
-        // read chunk header and initialize output files on first chunk
-        FILE *inputFile_p = read_chunk_header(chunkIndex, sessionPath_p, &inputHeader, 
-                                             &outputFiles_pp, &bytesWritten_p, outputPath_p);
-                                             
-        if (chunkIndex == 1) {
-            initialize_buffers(&inputHeader, totalBufferSizeMB, &writeBuffers_pp, 
-                             &bufferFillBytes_p, &bufferSizeBytes);
-        }
+    CommandLine commandLine;
+    parse_arguments(argc, argv, &commandLine);
+    SplitOptions *options_p = &commandLine.options;
+    const char *path_p = commandLine.path_p;
 
-        extract_audio_from_chunk(inputFile_p, &inputHeader, writeBuffers_pp, bufferFillBytes_p,
-                                bufferSizeBytes, outputFiles_pp, bytesWritten_p);
+    switch (commandLine.mode) {
+        case RUN_MODE_MERGE:
+            // the path names the session to create
+            merge_tracks(options_p, commandLine.tracksPath_p, path_p, commandLine.chunkLimitBytes);
+            printf("Peak memory usage: %.2f MB\n", _peak_memory_bytes() / (1024.0 * 1024.0));
+            return 0;
+        case RUN_MODE_VERIFY: {
+            // nothing is written, the exit status tells whether everything matched
+            const unsigned int mismatches = verify_session(options_p, commandLine.stream.channelSpec_p,
+                                                           commandLine.stream.channelMap_p,
+                                                           commandLine.manifestPath_p, path_p);
+            channel_selection_free(&options_p->channels);
+            return mismatches > 0 ? 1 : 0;
+        }
+        case RUN_MODE_STREAM:
+            // the path names the output directory
+            stream_split(options_p, &commandLine.stream, path_p);
+            printf("Peak memory usage: %.2f MB\n", _peak_memory_bytes() / (1024.0 * 1024.0));
+            channel_selection_free(&options_p->channels);
+            return 0;
+        case RUN_MODE_BATCH: {
+            const unsigned int failed = run_batch(options_p, &commandLine.batch, path_p);
+            channel_selection_free(&options_p->channels);
+            return failed > 0 ? 1 : 0;
+        }
+        default:
+            break;
+    }
 
-        fclose(inputFile_p);
+    // stage timing is only collected when something consumes it
+    if (commandLine.reportPath_p || commandLine.progressInterval > 0) {
+        options_p->stats_p = run_stats_create(commandLine.progressInterval);
+        run_stats_set_config(options_p->stats_p, options_p->totalBufferSizeMB, options_p->jobs,
+                             input_backend_name(options_p->inputBackend),
+                             output_backend_name(options_p->outputBackend));
     }
 
-    flush_remaining_buffers(&inputHeader, writeBuffers_pp, bufferFillBytes_p, 
-                           outputFiles_pp, bytesWritten_p);
+    if (commandLine.mode == RUN_MODE_FOLLOW) {
+        follow_session(options_p, path_p, commandLine.settleSeconds);
+    } else {
+        split_session(options_p, path_p);
+    }
+    run_stats_finish(options_p->stats_p);
+    printf("Peak memory usage: %.2f MB\n", _peak_memory_bytes() / (1024.0 * 1024.0));
 
-    finalize_output_files(&inputHeader, &bytesWritten_p, &outputFiles_pp);
+    int status = 0;
+    if (commandLine.reportPath_p) {
+        if (run_stats_write_report(options_p->stats_p, commandLine.reportPath_p) != 0) {
+            status = 1;
+        } else {
+            printf("Run report written to %s\n", commandLine.reportPath_p);
+        }
+    }
+    run_stats_destroy(options_p->stats_p);
 
-    free(outputPath_p);
-    return 0;
+    channel_selection_free(&options_p->channels);
+    return status;
 }
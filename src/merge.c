@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <dirent.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "merge.h"
+#include "deinterleave.h"
+#include "utils.h"
+
+#define MAX_PATH_LENGTH 250
+
+// Smallest block of frames read from every track at a time
+#define MERGE_MIN_BLOCK_FRAMES 4096
+
+typedef struct {
+    FILE *file_p;     // Track of the channel (NULL for a silent channel)
+    uint64_t frames;  // Frames in the data chunk of the track
+} MergeTrack;
+
+
+/**
+ * Channel of a track file name, tracks are called ch_<channel>.wav
+ *
+ * @return 0 if the name belongs to a track, -1 otherwise
+ */
+static int _track_name_channel(const char *filename, uint16_t *channel_p) {
+    const size_t length = strlen(filename);
+    if (length < 8 || strncmp(filename, "ch_", 3) != 0 || filename[length - 4] != '.' ||
+        toupper((unsigned char)filename[length - 3]) != 'W' || toupper((unsigned char)filename[length - 2]) != 'A' ||
+        toupper((unsigned char)filename[length - 1]) != 'V') {
+        return -1;
+    }
+    uint32_t channel = 0;
+    for (size_t i = 3; i < length - 4; i++) {
+        if (!isdigit((unsigned char)filename[i]) || i - 3 >= 5) {
+            return -1;
+        }
+        channel = channel * 10 + (uint32_t)(filename[i] - '0');
+    }
+    if (channel == 0 || channel > UINT16_MAX) {
+        return -1;
+    }
+    *channel_p = (uint16_t)channel;
+    return 0;
+}
+
+
+/**
+ * Remember the file name of a track, a channel may only have one
+ */
+static void _add_track_name(char ***names_ppp, uint16_t *maxChannel_p, const char *filename, uint16_t channel) {
+    if (channel > *maxChannel_p) {
+        char **grown_pp = realloc(*names_ppp, channel * sizeof(char *));
+        if (!grown_pp) {
+            fprintf(stderr, "ERROR: Memory allocation failed\n");
+            exit(1);
+        }
+        memset(grown_pp + *maxChannel_p, 0, (channel - *maxChannel_p) * sizeof(char *));
+        *names_ppp = grown_pp;
+        *maxChannel_p = channel;
+    }
+    if ((*names_ppp)[channel - 1]) {
+        fprintf(stderr, "ERROR: Both %s and %s are tracks of channel %u\n", (*names_ppp)[channel - 1], filename, channel);
+        exit(1);
+    }
+    const size_t nameSize = strlen(filename) + 1;
+    (*names_ppp)[channel - 1] = malloc(nameSize);
+    if (!(*names_ppp)[channel - 1]) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy((*names_ppp)[channel - 1], filename, nameSize);
+}
+
+
+/**
+ * List the tracks of a directory by channel
+ *
+ * @param tracksPath_p Directory holding the tracks
+ * @param names_ppp Pointer to store the file name of every channel (NULL for channels without a track)
+ * @return Highest channel with a track, 0 if the directory holds no tracks
+ */
+static uint16_t _list_tracks(const char *tracksPath_p, char ***names_ppp) {
+    uint16_t maxChannel = 0;
+    uint16_t channel = 0;
+    *names_ppp = NULL;
+
+#ifdef WIN32
+    char searchPath[MAX_PATH_LENGTH];
+    snprintf(searchPath, sizeof(searchPath), "%s\\*.*", tracksPath_p);
+    searchPath[MAX_PATH_LENGTH - 1] = '\0';
+
+    WIN32_FIND_DATA currentEntry;
+    HANDLE directoryHandle = FindFirstFile(searchPath, &currentEntry);
+    if (directoryHandle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "ERROR: Failed to open track directory %s\n", tracksPath_p);
+        exit(1);
+    }
+    do {
+        if (_track_name_channel(currentEntry.cFileName, &channel) == 0) {
+            _add_track_name(names_ppp, &maxChannel, currentEntry.cFileName, channel);
+        }
+    } while (FindNextFile(directoryHandle, &currentEntry));
+    FindClose(directoryHandle);
+#else
+    DIR *tracksDirectory = opendir(tracksPath_p);
+    if (!tracksDirectory) {
+        fprintf(stderr, "ERROR: Failed to open track directory %s\n", tracksPath_p);
+        exit(1);
+    }
+    struct dirent *entry;
+    while ((entry = readdir(tracksDirectory)) != NULL) {
+        if (_track_name_channel(entry->d_name, &channel) == 0) {
+            _add_track_name(names_ppp, &maxChannel, entry->d_name, channel);
+        }
+    }
+    closedir(tracksDirectory);
+#endif
+
+    return maxChannel;
+}
+
+
+/**
+ * Open a track and position it at its audio data
+ *
+ * The frame count is taken from the data chunk, limited to what the file holds. RF64 and
+ * BW64 tracks carry their real size in the ds64 chunk, their audio runs to the end of the file.
+ *
+ * @return 0 on success, -1 if the track cannot be read (errors printed)
+ */
+static int _open_track(const char *trackPath_p, WavHeader *header_p, MergeTrack *track_p) {
+    track_p->file_p = fopen(trackPath_p, "rb");
+    if (!track_p->file_p) {
+        fprintf(stderr, "ERROR: Failed to open track %s\n", trackPath_p);
+        return -1;
+    }
+    if (read_header(track_p->file_p, header_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to read WAV header of %s\n", trackPath_p);
+        return -1;
+    }
+    if (header_p->audio_format != WAV_FORMAT_PCM || header_p->num_channels != 1 ||
+        header_p->bits_per_sample < 16 || header_p->bits_per_sample > 32 || header_p->bits_per_sample % 8 != 0 ||
+        header_p->block_align != header_p->bits_per_sample / 8) {
+        fprintf(stderr, "ERROR: %s is not a mono PCM track with 16, 24 or 32 bit samples\n", trackPath_p);
+        return -1;
+    }
+
+#ifdef WIN32
+    const int64_t dataOffset = _ftelli64(track_p->file_p);
+    const int64_t fileSize = _fseeki64(track_p->file_p, 0, SEEK_END) == 0 ? _ftelli64(track_p->file_p) : -1;
+    const int seekResult = _fseeki64(track_p->file_p, dataOffset, SEEK_SET);
+#else
+    const int64_t dataOffset = (int64_t)ftello(track_p->file_p);
+    const int64_t fileSize = fseeko(track_p->file_p, 0, SEEK_END) == 0 ? (int64_t)ftello(track_p->file_p) : -1;
+    const int seekResult = fseeko(track_p->file_p, (off_t)dataOffset, SEEK_SET);
+#endif
+    if (dataOffset < 0 || fileSize < dataOffset || seekResult != 0) {
+        fprintf(stderr, "ERROR: Failed to locate the audio data of %s\n", trackPath_p);
+        return -1;
+    }
+
+    uint64_t dataBytes = (uint64_t)(fileSize - dataOffset);
+    const bool isLarge = strncmp(header_p->riff_header, "RF64", 4) == 0 ||
+                         strncmp(header_p->riff_header, "BW64", 4) == 0;
+    if (!isLarge && header_p->data_bytes < dataBytes) {
+        dataBytes = header_p->data_bytes;
+    }
+    track_p->frames = dataBytes / header_p->block_align;
+    return 0;
+}
+
+
+/**
+ * Read the next block of every track, channels without a track or past their end get silence
+ */
+static void _read_block(MergeTrack *tracks_p, uint16_t channelCount, uint16_t bytesPerSample,
+                        uint64_t position, size_t frameCount, uint8_t *const *blocks_pp) {
+    for (uint16_t c = 0; c < channelCount; c++) {
+        size_t framesRead = 0;
+        if (tracks_p[c].file_p && position < tracks_p[c].frames) {
+            size_t framesLeft = frameCount;
+            if (framesLeft > tracks_p[c].frames - position) {
+                framesLeft = (size_t)(tracks_p[c].frames - position);
+            }
+            framesRead = fread(blocks_pp[c], bytesPerSample, framesLeft, tracks_p[c].file_p);
+            if (framesRead < framesLeft) {
+                fprintf(stderr, "ERROR: Failed to read track of channel %u\n", c + 1);
+                exit(1);
+            }
+        }
+        memset(blocks_pp[c] + framesRead * bytesPerSample, 0, (frameCount - framesRead) * bytesPerSample);
+    }
+}
+
+
+void merge_tracks(const SplitOptions *options_p, const char *tracksPath_p, const char *sessionPath_p,
+                  uint64_t chunkLimitBytes) {
+    char **names_pp = NULL;
+    const uint16_t channelCount = _list_tracks(tracksPath_p, &names_pp);
+    if (channelCount == 0) {
+        fprintf(stderr, "ERROR: No ch_<channel>.wav tracks found in %s\n", tracksPath_p);
+        exit(1);
+    }
+
+    // open every track and check that they share one format
+    MergeTrack *tracks_p = calloc(channelCount, sizeof(MergeTrack));
+    if (!tracks_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    WavHeader format;
+    bool hasFormat = false;
+    uint64_t totalFrames = 0;
+    uint16_t silentChannels = 0;
+    for (uint16_t c = 0; c < channelCount; c++) {
+        if (!names_pp[c]) {
+            silentChannels++;
+            continue;
+        }
+        char trackPath[MAX_PATH_LENGTH];
+        snprintf(trackPath, sizeof(trackPath), "%s%c%s", tracksPath_p, PATH_SEPARATOR, names_pp[c]);
+        free(names_pp[c]);
+
+        WavHeader header;
+        if (_open_track(trackPath, &header, &tracks_p[c]) != 0) {
+            exit(1);
+        }
+        if (!hasFormat) {
+            format = header;
+            hasFormat = true;
+        } else if (header.sample_rate != format.sample_rate || header.bits_per_sample != format.bits_per_sample) {
+            fprintf(stderr, "ERROR: %s has %u Hz and %u bit, the tracks before have %u Hz and %u bit\n", trackPath,
+                    header.sample_rate, header.bits_per_sample, format.sample_rate, format.bits_per_sample);
+            exit(1);
+        }
+        if (tracks_p[c].frames > totalFrames) {
+            totalFrames = tracks_p[c].frames;
+        }
+    }
+    free(names_pp);
+
+    const uint16_t bytesPerSample = format.block_align;
+    if ((uint32_t)channelCount * bytesPerSample > UINT16_MAX) {
+        fprintf(stderr, "ERROR: %u channels of %u bit do not fit into a WAV frame\n", channelCount,
+                format.bits_per_sample);
+        exit(1);
+    }
+    if (silentChannels > 0) {
+        fprintf(stderr, "Warning: %u of %u channels have no track and are silent\n", silentChannels, channelCount);
+    }
+    for (uint16_t c = 0; c < channelCount; c++) {
+        if (tracks_p[c].file_p && tracks_p[c].frames < totalFrames) {
+            fprintf(stderr, "Warning: Track of channel %u is %" PRIu64 " frames short, padded with silence\n",
+                    c + 1, totalFrames - tracks_p[c].frames);
+        }
+    }
+
+    // every chunk is a plain RIFF file of whole frames below the limit of the card
+    WavHeader chunkHeader = format;
+    memcpy(chunkHeader.riff_header, "RIFF", 4);
+    memcpy(chunkHeader.wave_header, "WAVE", 4);
+    memcpy(chunkHeader.fmt_header, "fmt ", 4);
+    memcpy(chunkHeader.data_header, "data", 4);
+    chunkHeader.fmt_chunk_size = 16;
+    chunkHeader.num_channels = channelCount;
+    chunkHeader.block_align = (uint16_t)(channelCount * bytesPerSample);
+    chunkHeader.byte_rate = format.sample_rate * chunkHeader.block_align;
+    const uint64_t headerBytes = 44;
+    if (chunkLimitBytes > UINT32_MAX) {
+        chunkLimitBytes = UINT32_MAX;
+    }
+    if (chunkLimitBytes < headerBytes + chunkHeader.block_align) {
+        fprintf(stderr, "ERROR: A chunk limit of %" PRIu64 " bytes does not hold a single frame\n", chunkLimitBytes);
+        exit(1);
+    }
+    const uint64_t chunkFrames = (chunkLimitBytes - headerBytes) / chunkHeader.block_align;
+    const uint64_t chunkCount = totalFrames == 0 ? 1 : (totalFrames + chunkFrames - 1) / chunkFrames;
+
+    // half of the buffer holds a block of every track, the other half the interleaved block
+    size_t blockFrames = options_p->totalBufferSizeMB * 1024 * 1024 / (2 * (size_t)chunkHeader.block_align);
+    if (blockFrames < MERGE_MIN_BLOCK_FRAMES) {
+        blockFrames = MERGE_MIN_BLOCK_FRAMES;
+    }
+    uint8_t *trackBlocks_p = malloc(blockFrames * chunkHeader.block_align);
+    uint8_t *frames_p = malloc(blockFrames * chunkHeader.block_align);
+    uint8_t **blocks_pp = malloc(channelCount * sizeof(uint8_t *));
+    if (!trackBlocks_p || !frames_p || !blocks_pp) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    for (uint16_t c = 0; c < channelCount; c++) {
+        blocks_pp[c] = trackBlocks_p + (size_t)c * blockFrames * bytesPerSample;
+    }
+
+    Interleaver interleaver;
+    interleaver_init(&interleaver, channelCount, bytesPerSample, true);
+    printf("Merging %u tracks (%u Hz, %u bit) into %" PRIu64 " chunks of up to %" PRIu64 " frames, "
+           "interleave kernel: %s\n", channelCount, format.sample_rate, format.bits_per_sample, chunkCount,
+           chunkFrames, interleaver.kernelName_p);
+
+    char sessionPath[MAX_PATH_LENGTH];
+    snprintf(sessionPath, sizeof(sessionPath), "%s", sessionPath_p);
+    _create_output_folder(sessionPath);
+
+    const double startTime = _monotonic_seconds();
+    uint64_t position = 0;
+    for (uint64_t chunkIndex = 1; chunkIndex <= chunkCount; chunkIndex++) {
+        uint64_t framesLeft = totalFrames - position;
+        if (framesLeft > chunkFrames) {
+            framesLeft = chunkFrames;
+        }
+
+        char chunkPath[MAX_PATH_LENGTH];
+        snprintf(chunkPath, sizeof(chunkPath), "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
+        FILE *chunkFile_p = fopen(chunkPath, "wb");
+        if (!chunkFile_p) {
+            fprintf(stderr, "ERROR: Failed to create chunk %s\n", chunkPath);
+            exit(1);
+        }
+        chunkHeader.data_bytes = (uint32_t)(framesLeft * chunkHeader.block_align);
+        chunkHeader.wav_size = (uint32_t)(headerBytes - 8 + chunkHeader.data_bytes);
+        if (write_header(chunkFile_p, &chunkHeader) != 0) {
+            exit(1);
+        }
+        _preallocate_output(chunkFile_p, headerBytes + chunkHeader.data_bytes);
+
+        while (framesLeft > 0) {
+            const size_t frameCount = framesLeft < blockFrames ? (size_t)framesLeft : blockFrames;
+            _read_block(tracks_p, channelCount, bytesPerSample, position, frameCount, blocks_pp);
+            interleaver_run(&interleaver, (const uint8_t *const *)blocks_pp, frameCount, frames_p);
+            if (fwrite(frames_p, chunkHeader.block_align, frameCount, chunkFile_p) != frameCount) {
+                fprintf(stderr, "ERROR: Failed to write chunk %s\n", chunkPath);
+                exit(1);
+            }
+            position += frameCount;
+            framesLeft -= frameCount;
+        }
+        if (fclose(chunkFile_p) != 0) {
+            fprintf(stderr, "ERROR: Failed to write chunk %s\n", chunkPath);
+            exit(1);
+        }
+        printf("Chunk %08" PRIX64 ".WAV: %.2f MB\n", chunkIndex,
+               (headerBytes + chunkHeader.data_bytes) / (1024.0 * 1024.0));
+    }
+
+    const double elapsed = _monotonic_seconds() - startTime;
+    const double megabytes = (double)totalFrames * chunkHeader.block_align / (1024.0 * 1024.0);
+    printf("Merged %.2f MB in %.2f s (%.2f MB/s)\n", megabytes, elapsed, elapsed > 0 ? megabytes / elapsed : 0.0);
+
+    for (uint16_t c = 0; c < channelCount; c++) {
+        if (tracks_p[c].file_p) {
+            fclose(tracks_p[c].file_p);
+        }
+    }
+    free(blocks_pp);
+    free(frames_p);
+    free(trackBlocks_p);
+    free(tracks_p);
+}
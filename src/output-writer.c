@@ -0,0 +1,666 @@
+#ifdef HAVE_IO_URING
+#define _GNU_SOURCE // O_DIRECT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "output-writer.h"
+#include "wav-header.h"
+#include "utils.h"
+
+// Target number of pool blocks per output, more blocks keep more writes in flight
+#define OUTPUT_BLOCKS_PER_OUTPUT 4
+
+// Bounds for the size of a single pool block
+#define OUTPUT_BLOCK_MIN_BYTES (64 * 1024)
+#define OUTPUT_BLOCK_MAX_BYTES (4 * 1024 * 1024)
+
+// Upper bound for the io_uring submission queue size
+#define URING_MAX_ENTRIES 4096
+
+
+#ifdef HAVE_IO_URING
+typedef struct {
+    int ringFd;
+    unsigned int entries;
+    unsigned int inFlight;     // queued and submitted writes that did not complete yet
+    unsigned int pending;      // queued writes the kernel was not told about yet
+    unsigned int batchSize;    // pending writes that are submitted without waiting for a reap
+
+    void *sqRing_p;
+    size_t sqRingSize;
+    unsigned int *sqHead_p;
+    unsigned int *sqTail_p;
+    unsigned int *sqMask_p;
+    unsigned int *sqArray_p;
+    struct io_uring_sqe *sqes_p;
+    size_t sqesSize;
+
+    void *cqRing_p;
+    size_t cqRingSize;
+    unsigned int *cqHead_p;
+    unsigned int *cqTail_p;
+    unsigned int *cqMask_p;
+    struct io_uring_cqe *cqes_p;
+} UringState;
+#endif
+
+struct OutputWriter {
+    OutputBackend backend;
+    FILE **outputFiles_pp;
+    uint64_t *bytesWritten_p;
+    uint16_t outputCount;
+    uint32_t dataOffset;
+    FlacEncoder **encoders_pp; // FLAC encoder per output (NULL when writing PCM)
+    PageCache *cache_p;        // Write-behind of the outputs (NULL to leave the cache alone)
+
+    size_t bufferSize;
+    size_t *capacity_p;       // usable bytes of a block per output (whole frames)
+    size_t bufferCount;
+    OutputBuffer *buffers_p;
+    uint8_t *storage_p;
+
+    // pool of free buffers, protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t bufferFreed;
+    OutputBuffer **free_pp;
+    size_t freeCount;
+
+    uint64_t *nextOffset_p;   // next write position per output
+    uint64_t *exactSize_p;    // file size to restore after a padded direct write (0 = none)
+
+    // completed writes per output, contiguous from the data start (protected by lock)
+    uint64_t *durable_p;
+    OutputBuffer **early_pp;  // buffers that completed before an earlier write of their output
+    size_t earlyCount;
+
+#ifdef HAVE_IO_URING
+    UringState uring;
+    int *fds_p;
+    bool directActive;        // O_DIRECT was enabled on the output descriptors
+#endif
+};
+
+
+int output_backend_parse(const char *name_p, OutputBackend *backend_p) {
+    if (strcmp(name_p, "stdio") == 0) {
+        *backend_p = OUTPUT_BACKEND_STDIO;
+        return 0;
+    }
+#ifdef HAVE_IO_URING
+    if (strcmp(name_p, "uring") == 0) {
+        *backend_p = OUTPUT_BACKEND_URING;
+        return 0;
+    }
+    if (strcmp(name_p, "direct") == 0) {
+        *backend_p = OUTPUT_BACKEND_DIRECT;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *output_backend_name(OutputBackend backend) {
+    switch (backend) {
+        case OUTPUT_BACKEND_URING:
+            return "uring";
+        case OUTPUT_BACKEND_DIRECT:
+            return "direct";
+        default:
+            return "stdio";
+    }
+}
+
+uint32_t output_backend_data_offset(OutputBackend backend, uint16_t audioFormat) {
+    return backend == OUTPUT_BACKEND_DIRECT ? OUTPUT_DIRECT_ALIGNMENT : wav_output_header_size(audioFormat);
+}
+
+int output_codec_parse(const char *name_p, OutputCodec *codec_p) {
+    if (strcmp(name_p, "wav") == 0) {
+        *codec_p = OUTPUT_CODEC_WAV;
+        return 0;
+    }
+    if (strcmp(name_p, "flac") == 0) {
+        *codec_p = OUTPUT_CODEC_FLAC;
+        return 0;
+    }
+    return -1;
+}
+
+const char *output_codec_extension(OutputCodec codec) {
+    return codec == OUTPUT_CODEC_FLAC ? ".flac" : ".wav";
+}
+
+bool output_backend_is_async(OutputBackend backend) {
+    return backend == OUTPUT_BACKEND_URING || backend == OUTPUT_BACKEND_DIRECT;
+}
+
+
+#ifdef HAVE_IO_URING
+static int _uring_setup(UringState *uring_p, unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(uring_p, 0, sizeof(*uring_p));
+
+    uring_p->ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (uring_p->ringFd < 0) {
+        perror("ERROR: io_uring_setup");
+        return -1;
+    }
+    uring_p->entries = params.sq_entries;
+
+    uring_p->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    uring_p->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring_p->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    uring_p->sqRing_p = mmap(NULL, uring_p->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             uring_p->ringFd, IORING_OFF_SQ_RING);
+    uring_p->cqRing_p = mmap(NULL, uring_p->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             uring_p->ringFd, IORING_OFF_CQ_RING);
+    uring_p->sqes_p = mmap(NULL, uring_p->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           uring_p->ringFd, IORING_OFF_SQES);
+    if (uring_p->sqRing_p == MAP_FAILED || uring_p->cqRing_p == MAP_FAILED || uring_p->sqes_p == MAP_FAILED) {
+        perror("ERROR: Failed to map io_uring rings");
+        return -1;
+    }
+
+    uint8_t *sq_p = uring_p->sqRing_p;
+    uring_p->sqHead_p = (unsigned int *)(sq_p + params.sq_off.head);
+    uring_p->sqTail_p = (unsigned int *)(sq_p + params.sq_off.tail);
+    uring_p->sqMask_p = (unsigned int *)(sq_p + params.sq_off.ring_mask);
+    uring_p->sqArray_p = (unsigned int *)(sq_p + params.sq_off.array);
+
+    uint8_t *cq_p = uring_p->cqRing_p;
+    uring_p->cqHead_p = (unsigned int *)(cq_p + params.cq_off.head);
+    uring_p->cqTail_p = (unsigned int *)(cq_p + params.cq_off.tail);
+    uring_p->cqMask_p = (unsigned int *)(cq_p + params.cq_off.ring_mask);
+    uring_p->cqes_p = (struct io_uring_cqe *)(cq_p + params.cq_off.cqes);
+    return 0;
+}
+
+static void _uring_teardown(UringState *uring_p) {
+    if (uring_p->sqes_p && uring_p->sqes_p != MAP_FAILED) munmap(uring_p->sqes_p, uring_p->sqesSize);
+    if (uring_p->cqRing_p && uring_p->cqRing_p != MAP_FAILED) munmap(uring_p->cqRing_p, uring_p->cqRingSize);
+    if (uring_p->sqRing_p && uring_p->sqRing_p != MAP_FAILED) munmap(uring_p->sqRing_p, uring_p->sqRingSize);
+    if (uring_p->ringFd >= 0) close(uring_p->ringFd);
+}
+
+static int _uring_enter(UringState *uring_p, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    while (1) {
+        long result = syscall(__NR_io_uring_enter, uring_p->ringFd, toSubmit, minComplete, flags, NULL, 0);
+        if (result >= 0) {
+            return (int)result;
+        }
+        if (errno != EINTR) {
+            perror("ERROR: io_uring_enter");
+            return -1;
+        }
+    }
+}
+
+// hand all pending writes to the kernel in one call, caller holds the writer lock
+static void _uring_submit(UringState *uring_p) {
+    while (uring_p->pending > 0) {
+        const int submitted = _uring_enter(uring_p, uring_p->pending, 0, 0);
+        if (submitted < 0) {
+            exit(1);
+        }
+        if (submitted == 0) {
+            // the rest goes out with the next reap
+            return;
+        }
+        uring_p->pending -= (unsigned int)submitted;
+    }
+}
+
+// queue the remaining bytes of a buffer, submitted with the next batch or reap, caller holds the writer lock
+static void _uring_queue_write(OutputWriter *writer_p, OutputBuffer *buffer_p) {
+    UringState *uring_p = &writer_p->uring;
+    const unsigned int tail = *uring_p->sqTail_p;
+    const unsigned int index = tail & *uring_p->sqMask_p;
+
+    struct io_uring_sqe *sqe_p = &uring_p->sqes_p[index];
+    memset(sqe_p, 0, sizeof(*sqe_p));
+    sqe_p->opcode = IORING_OP_WRITE;
+    sqe_p->fd = writer_p->fds_p[buffer_p->channel];
+    sqe_p->addr = (uint64_t)(uintptr_t)(buffer_p->data_p + buffer_p->completedBytes);
+    sqe_p->len = (uint32_t)(buffer_p->submittedBytes - buffer_p->completedBytes);
+    sqe_p->off = buffer_p->fileOffset + buffer_p->completedBytes;
+    sqe_p->user_data = (uint64_t)(uintptr_t)buffer_p;
+
+    uring_p->sqArray_p[index] = index;
+    __atomic_store_n(uring_p->sqTail_p, tail + 1, __ATOMIC_RELEASE);
+    uring_p->pending++;
+    uring_p->inFlight++;
+
+    if (uring_p->pending >= uring_p->batchSize) {
+        _uring_submit(uring_p);
+    }
+}
+
+/**
+ * Account a completed buffer and return it to the pool
+ *
+ * Writes of one output may complete out of order. A buffer that completes before an earlier
+ * write of its output is held back until that write completed, so at most all buffers wait
+ * and the durable range stays contiguous. Caller holds the writer lock.
+ */
+static void _complete_buffer(OutputWriter *writer_p, OutputBuffer *buffer_p) {
+    const uint16_t channel = buffer_p->channel;
+    if (buffer_p->fileOffset != writer_p->dataOffset + writer_p->durable_p[channel]) {
+        writer_p->early_pp[writer_p->earlyCount++] = buffer_p;
+        return;
+    }
+    writer_p->durable_p[channel] += buffer_p->fillBytes;
+    writer_p->free_pp[writer_p->freeCount++] = buffer_p;
+
+    // buffers that completed early may now continue the contiguous range
+    for (size_t i = 0; i < writer_p->earlyCount;) {
+        OutputBuffer *early_p = writer_p->early_pp[i];
+        if (early_p->channel == channel && early_p->fileOffset == writer_p->dataOffset + writer_p->durable_p[channel]) {
+            writer_p->durable_p[channel] += early_p->fillBytes;
+            writer_p->free_pp[writer_p->freeCount++] = early_p;
+            writer_p->early_pp[i] = writer_p->early_pp[--writer_p->earlyCount];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    pthread_cond_broadcast(&writer_p->bufferFreed);
+}
+
+// wait for at least one completion and recycle finished buffers, caller holds the writer lock
+static void _uring_reap(OutputWriter *writer_p) {
+    UringState *uring_p = &writer_p->uring;
+    // pending writes are submitted by the same call that waits
+    const int submitted = _uring_enter(uring_p, uring_p->pending, 1, IORING_ENTER_GETEVENTS);
+    if (submitted < 0) {
+        exit(1);
+    }
+    uring_p->pending -= (unsigned int)submitted;
+
+    unsigned int head = *uring_p->cqHead_p;
+    const unsigned int tail = __atomic_load_n(uring_p->cqTail_p, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe_p = &uring_p->cqes_p[head & *uring_p->cqMask_p];
+        OutputBuffer *buffer_p = (OutputBuffer *)(uintptr_t)cqe_p->user_data;
+        const int result = cqe_p->res;
+        head++;
+        __atomic_store_n(uring_p->cqHead_p, head, __ATOMIC_RELEASE);
+        uring_p->inFlight--;
+
+        if (result <= 0) {
+            fprintf(stderr, "ERROR: Writing data to channel %d: %s\n", buffer_p->channel + 1,
+                    result < 0 ? strerror(-result) : "no progress");
+            exit(1);
+        }
+
+        // short writes are continued where the kernel stopped
+        buffer_p->completedBytes += (size_t)result;
+        if (buffer_p->completedBytes < buffer_p->submittedBytes) {
+            _uring_queue_write(writer_p, buffer_p);
+            continue;
+        }
+
+        _complete_buffer(writer_p, buffer_p);
+    }
+}
+
+static void _enable_direct_io(OutputWriter *writer_p) {
+    // O_DIRECT is a file status flag, so it can be switched on the already opened descriptors
+    for (uint16_t i = 0; i < writer_p->outputCount; i++) {
+        const int flags = fcntl(writer_p->fds_p[i], F_GETFL);
+        if (flags < 0 || fcntl(writer_p->fds_p[i], F_SETFL, flags | O_DIRECT) != 0) {
+            fprintf(stderr, "WARNING: O_DIRECT not supported for the output files, writing through the page cache\n");
+            for (uint16_t j = 0; j < i; j++) {
+                fcntl(writer_p->fds_p[j], F_SETFL, fcntl(writer_p->fds_p[j], F_GETFL) & ~O_DIRECT);
+            }
+            return;
+        }
+    }
+    writer_p->directActive = true;
+}
+
+static void _disable_direct_io(OutputWriter *writer_p) {
+    if (!writer_p->directActive) {
+        return;
+    }
+    for (uint16_t i = 0; i < writer_p->outputCount; i++) {
+        fcntl(writer_p->fds_p[i], F_SETFL, fcntl(writer_p->fds_p[i], F_GETFL) & ~O_DIRECT);
+    }
+    writer_p->directActive = false;
+}
+#endif // HAVE_IO_URING
+
+
+static size_t _greatest_common_divisor(size_t a, size_t b) {
+    while (b != 0) {
+        size_t rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+OutputWriter *output_writer_create(OutputBackend backend, FILE **outputFiles_pp, uint64_t *bytesWritten_p,
+                                   uint16_t outputCount, const size_t *frameBytes_p, size_t totalBufferBytes,
+                                   uint32_t dataOffset) {
+    OutputWriter *writer_p = calloc(1, sizeof(OutputWriter));
+    if (!writer_p) {
+        fprintf(stderr, "ERROR: Failed to allocate output writer\n");
+        exit(1);
+    }
+    writer_p->backend = backend;
+    writer_p->outputFiles_pp = outputFiles_pp;
+    writer_p->bytesWritten_p = bytesWritten_p;
+    writer_p->outputCount = outputCount;
+    writer_p->dataOffset = dataOffset;
+
+    // fixed-size blocks start on a page, which direct writes require
+    size_t blockSize = totalBufferBytes / ((size_t)outputCount * OUTPUT_BLOCKS_PER_OUTPUT);
+    if (blockSize > OUTPUT_BLOCK_MAX_BYTES) {
+        blockSize = OUTPUT_BLOCK_MAX_BYTES;
+    }
+    if (blockSize < OUTPUT_BLOCK_MIN_BYTES) {
+        blockSize = OUTPUT_BLOCK_MIN_BYTES;
+    }
+    blockSize = blockSize / OUTPUT_DIRECT_ALIGNMENT * OUTPUT_DIRECT_ALIGNMENT;
+
+    // every output fills blocks with whole frames, direct writes additionally need aligned lengths
+    writer_p->capacity_p = malloc(outputCount * sizeof(size_t));
+    if (!writer_p->capacity_p) {
+        fprintf(stderr, "ERROR: Failed to allocate output writer\n");
+        exit(1);
+    }
+    for (uint16_t i = 0; i < outputCount; i++) {
+        size_t unit = frameBytes_p[i];
+        if (backend == OUTPUT_BACKEND_DIRECT) {
+            unit = OUTPUT_DIRECT_ALIGNMENT / _greatest_common_divisor(OUTPUT_DIRECT_ALIGNMENT, unit) * unit;
+        }
+        if (blockSize < unit) {
+            blockSize = (unit + OUTPUT_DIRECT_ALIGNMENT - 1) / OUTPUT_DIRECT_ALIGNMENT * OUTPUT_DIRECT_ALIGNMENT;
+        }
+        writer_p->capacity_p[i] = unit;
+    }
+    writer_p->bufferSize = blockSize;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        writer_p->capacity_p[i] = blockSize / writer_p->capacity_p[i] * writer_p->capacity_p[i];
+    }
+
+    // the budget decides the block count, but every output needs one block to fill and one in flight
+    writer_p->bufferCount = totalBufferBytes / writer_p->bufferSize;
+    if (writer_p->bufferCount < (size_t)outputCount * 2) {
+        writer_p->bufferCount = (size_t)outputCount * 2;
+    }
+
+    writer_p->buffers_p = calloc(writer_p->bufferCount, sizeof(OutputBuffer));
+    writer_p->free_pp = malloc(writer_p->bufferCount * sizeof(OutputBuffer *));
+    writer_p->nextOffset_p = malloc(outputCount * sizeof(uint64_t));
+    writer_p->exactSize_p = calloc(outputCount, sizeof(uint64_t));
+    writer_p->durable_p = malloc(outputCount * sizeof(uint64_t));
+    writer_p->early_pp = malloc(writer_p->bufferCount * sizeof(OutputBuffer *));
+#ifdef WIN32
+    writer_p->storage_p = malloc(writer_p->bufferCount * writer_p->bufferSize);
+#else
+    void *storage_p = NULL;
+    if (posix_memalign(&storage_p, OUTPUT_DIRECT_ALIGNMENT, writer_p->bufferCount * writer_p->bufferSize) == 0) {
+        writer_p->storage_p = storage_p;
+    }
+#endif
+    if (!writer_p->buffers_p || !writer_p->free_pp || !writer_p->nextOffset_p || !writer_p->exactSize_p ||
+        !writer_p->durable_p || !writer_p->early_pp || !writer_p->storage_p) {
+        fprintf(stderr, "ERROR: Failed to allocate output buffers\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < writer_p->bufferCount; i++) {
+        writer_p->buffers_p[i].data_p = writer_p->storage_p + i * writer_p->bufferSize;
+        writer_p->free_pp[i] = &writer_p->buffers_p[i];
+    }
+    writer_p->freeCount = writer_p->bufferCount;
+    // outputs continue behind the audio they already hold
+    for (uint16_t i = 0; i < outputCount; i++) {
+        writer_p->nextOffset_p[i] = writer_p->dataOffset + bytesWritten_p[i];
+        writer_p->durable_p[i] = bytesWritten_p[i];
+    }
+    pthread_mutex_init(&writer_p->lock, NULL);
+    pthread_cond_init(&writer_p->bufferFreed, NULL);
+
+#ifdef HAVE_IO_URING
+    if (output_backend_is_async(backend)) {
+        writer_p->fds_p = malloc(outputCount * sizeof(int));
+        if (!writer_p->fds_p) {
+            fprintf(stderr, "ERROR: Failed to allocate output writer\n");
+            exit(1);
+        }
+        // headers went through stdio, make sure they reach the files before the data does
+        for (uint16_t i = 0; i < outputCount; i++) {
+            fflush(outputFiles_pp[i]);
+            writer_p->fds_p[i] = fileno(outputFiles_pp[i]);
+        }
+
+        unsigned int entries = 1;
+        while (entries < writer_p->bufferCount && entries < URING_MAX_ENTRIES) {
+            entries <<= 1;
+        }
+        if (_uring_setup(&writer_p->uring, entries) != 0) {
+            exit(1);
+        }
+        // every output fills its buffer at about the same time, so one round of them goes out together
+        writer_p->uring.batchSize = outputCount < writer_p->uring.entries ? outputCount : writer_p->uring.entries;
+        if (backend == OUTPUT_BACKEND_DIRECT) {
+            _enable_direct_io(writer_p);
+        }
+    }
+#endif
+
+    return writer_p;
+}
+
+void output_writer_set_encoders(OutputWriter *writer_p, FlacEncoder **encoders_pp) {
+    writer_p->encoders_pp = encoders_pp;
+}
+
+void output_writer_set_page_cache(OutputWriter *writer_p, PageCache *cache_p) {
+    writer_p->cache_p = writer_p->backend == OUTPUT_BACKEND_DIRECT ? NULL : cache_p;
+}
+
+size_t output_writer_buffer_size(const OutputWriter *writer_p) {
+    return writer_p->bufferSize;
+}
+
+size_t output_writer_buffer_capacity(const OutputWriter *writer_p, uint16_t output) {
+    return writer_p->capacity_p[output];
+}
+
+size_t output_writer_buffer_count(const OutputWriter *writer_p) {
+    return writer_p->bufferCount;
+}
+
+OutputBuffer *output_writer_acquire(OutputWriter *writer_p, uint16_t channel) {
+    pthread_mutex_lock(&writer_p->lock);
+    while (writer_p->freeCount == 0) {
+#ifdef HAVE_IO_URING
+        if (output_backend_is_async(writer_p->backend) && writer_p->uring.inFlight > 0) {
+            _uring_reap(writer_p);
+            continue;
+        }
+#endif
+        pthread_cond_wait(&writer_p->bufferFreed, &writer_p->lock);
+    }
+    OutputBuffer *buffer_p = writer_p->free_pp[--writer_p->freeCount];
+    pthread_mutex_unlock(&writer_p->lock);
+
+    buffer_p->channel = channel;
+    buffer_p->fillBytes = 0;
+    buffer_p->sparse = false;
+    return buffer_p;
+}
+
+void output_writer_release(OutputWriter *writer_p, OutputBuffer *buffer_p) {
+    pthread_mutex_lock(&writer_p->lock);
+    writer_p->free_pp[writer_p->freeCount++] = buffer_p;
+    pthread_cond_broadcast(&writer_p->bufferFreed);
+    pthread_mutex_unlock(&writer_p->lock);
+}
+
+void output_writer_submit(OutputWriter *writer_p, OutputBuffer *buffer_p) {
+    const uint16_t channel = buffer_p->channel;
+    writer_p->bytesWritten_p[channel] += buffer_p->fillBytes;
+
+    if (!output_backend_is_async(writer_p->backend)) {
+        if (writer_p->encoders_pp) {
+            // encoded streams have no holes, silence costs only a few bytes per block
+            flac_encoder_write(writer_p->encoders_pp[channel], buffer_p->data_p, buffer_p->fillBytes);
+        } else if (buffer_p->sparse) {
+            // skipped buffers only ever precede written data, the gap reads back as zeros
+#ifdef WIN32
+            const int seekResult = _fseeki64(writer_p->outputFiles_pp[channel], (__int64)buffer_p->fillBytes, SEEK_CUR);
+#else
+            const int seekResult = fseeko(writer_p->outputFiles_pp[channel], (off_t)buffer_p->fillBytes, SEEK_CUR);
+#endif
+            if (seekResult != 0) {
+                fprintf(stderr, "ERROR: Seeking in channel %d\n", channel + 1);
+                exit(1);
+            }
+        } else if (fwrite(buffer_p->data_p, buffer_p->fillBytes, 1, writer_p->outputFiles_pp[channel]) != 1) {
+            fprintf(stderr, "ERROR: Writing data to channel %d\n", channel + 1);
+            exit(1);
+        }
+        pthread_mutex_lock(&writer_p->lock);
+        writer_p->durable_p[channel] += buffer_p->fillBytes;
+        pthread_mutex_unlock(&writer_p->lock);
+        output_writer_release(writer_p, buffer_p);
+
+        // the stream position also covers encoded outputs, whose size differs from the audio
+        if (writer_p->cache_p) {
+            FILE *file_p = writer_p->outputFiles_pp[channel];
+#ifdef WIN32
+            const __int64 position = fflush(file_p) == 0 ? _ftelli64(file_p) : -1;
+#else
+            const off_t position = fflush(file_p) == 0 ? ftello(file_p) : -1;
+#endif
+            if (position > 0) {
+                page_cache_write_behind(writer_p->cache_p, channel, fileno(file_p), (uint64_t)position);
+            }
+        }
+        return;
+    }
+
+#ifdef HAVE_IO_URING
+    buffer_p->fileOffset = writer_p->nextOffset_p[channel];
+    buffer_p->submittedBytes = buffer_p->fillBytes;
+    buffer_p->completedBytes = 0;
+    writer_p->nextOffset_p[channel] += buffer_p->fillBytes;
+
+    if (buffer_p->sparse) {
+        pthread_mutex_lock(&writer_p->lock);
+        _complete_buffer(writer_p, buffer_p);
+        pthread_mutex_unlock(&writer_p->lock);
+        return;
+    }
+
+    // a partial direct write is padded to the alignment and the file cut back in finish
+    if (writer_p->directActive && buffer_p->fillBytes % OUTPUT_DIRECT_ALIGNMENT != 0) {
+        size_t paddedBytes = (buffer_p->fillBytes + OUTPUT_DIRECT_ALIGNMENT - 1) / OUTPUT_DIRECT_ALIGNMENT *
+                             OUTPUT_DIRECT_ALIGNMENT;
+        memset(buffer_p->data_p + buffer_p->fillBytes, 0, paddedBytes - buffer_p->fillBytes);
+        buffer_p->submittedBytes = paddedBytes;
+        writer_p->exactSize_p[channel] = writer_p->nextOffset_p[channel];
+    }
+
+    pthread_mutex_lock(&writer_p->lock);
+    while (writer_p->uring.inFlight >= writer_p->uring.entries) {
+        _uring_reap(writer_p);
+    }
+    _uring_queue_write(writer_p, buffer_p);
+    const uint64_t writtenEnd = writer_p->dataOffset + writer_p->durable_p[channel];
+    pthread_mutex_unlock(&writer_p->lock);
+
+    // only completed writes are handed to writeback
+    if (writer_p->cache_p) {
+        page_cache_write_behind(writer_p->cache_p, channel, writer_p->fds_p[channel], writtenEnd);
+    }
+#endif
+}
+
+int output_writer_sync_point(OutputWriter *writer_p, uint64_t *durableBytes_p) {
+    output_writer_drain(writer_p);
+    pthread_mutex_lock(&writer_p->lock);
+    memcpy(durableBytes_p, writer_p->durable_p, writer_p->outputCount * sizeof(uint64_t));
+    pthread_mutex_unlock(&writer_p->lock);
+
+    // everything counted above completed, syncing afterwards makes it durable (data of the
+    // stdio backend may still sit in the stream buffers, which _sync_file flushes first)
+    for (uint16_t i = 0; i < writer_p->outputCount; i++) {
+        if (_sync_file(writer_p->outputFiles_pp[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void output_writer_drain(OutputWriter *writer_p) {
+#ifdef HAVE_IO_URING
+    if (output_backend_is_async(writer_p->backend)) {
+        pthread_mutex_lock(&writer_p->lock);
+        while (writer_p->uring.inFlight > 0) {
+            _uring_reap(writer_p);
+        }
+        pthread_mutex_unlock(&writer_p->lock);
+    }
+#else
+    (void)writer_p;
+#endif
+}
+
+void output_writer_finish(OutputWriter *writer_p) {
+    output_writer_drain(writer_p);
+#ifdef HAVE_IO_URING
+    if (output_backend_is_async(writer_p->backend)) {
+        // header rewriting goes through stdio again, which needs buffered I/O
+        _disable_direct_io(writer_p);
+        for (uint16_t i = 0; i < writer_p->outputCount; i++) {
+            if (writer_p->exactSize_p[i] != 0 && ftruncate(writer_p->fds_p[i], (off_t)writer_p->exactSize_p[i]) != 0) {
+                fprintf(stderr, "ERROR: Failed to trim padding of channel %d\n", i + 1);
+                exit(1);
+            }
+        }
+    }
+#endif
+}
+
+void output_writer_destroy(OutputWriter *writer_p) {
+    if (!writer_p) {
+        return;
+    }
+#ifdef HAVE_IO_URING
+    if (output_backend_is_async(writer_p->backend)) {
+        _uring_teardown(&writer_p->uring);
+    }
+    free(writer_p->fds_p);
+#endif
+    pthread_cond_destroy(&writer_p->bufferFreed);
+    pthread_mutex_destroy(&writer_p->lock);
+    free(writer_p->storage_p);
+    free(writer_p->buffers_p);
+    free(writer_p->free_pp);
+    free(writer_p->nextOffset_p);
+    free(writer_p->exactSize_p);
+    free(writer_p->durable_p);
+    free(writer_p->early_pp);
+    free(writer_p->capacity_p);
+    free(writer_p);
+}
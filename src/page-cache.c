@@ -0,0 +1,125 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sync_file_range
+#include <fcntl.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page-cache.h"
+#include "utils.h"
+
+// Largest folio of the page cache, a folio is only dropped when a range covers all of it
+#define PAGE_CACHE_FOLIO_BYTES (2 * 1024 * 1024)
+
+
+int cache_policy_parse(const char *name_p, CachePolicy *policy_p) {
+    if (strcmp(name_p, "keep") == 0) {
+        *policy_p = CACHE_POLICY_KEEP;
+        return 0;
+    }
+#ifdef __linux__
+    if (strcmp(name_p, "drop") == 0) {
+        *policy_p = CACHE_POLICY_DROP;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+
+void page_cache_init(PageCache *cache_p, size_t dirtyLimitMB, uint16_t outputCount) {
+    cache_p->dirtyLimitBytes = (uint64_t)dirtyLimitMB * 1024 * 1024;
+    cache_p->outputCount = outputCount;
+    cache_p->outputs_p = calloc(outputCount, sizeof(PageCacheOutput));
+    if (!cache_p->outputs_p) {
+        fprintf(stderr, "ERROR: Failed to allocate page cache state\n");
+        exit(1);
+    }
+    atomic_init(&cache_p->inputDroppedBytes, 0);
+    atomic_init(&cache_p->writtenBackBytes, 0);
+    atomic_init(&cache_p->writebackWaitNanos, 0);
+    printf("Page cache: dropping consumed input, writing back outputs behind %zu MB each\n", dirtyLimitMB);
+}
+
+
+#ifdef __linux__
+/**
+ * Drop a range from the cache, starting early enough to cover folios that straddle the range before
+ */
+static int _drop_range(int fd, uint64_t offset, uint64_t length) {
+    const uint64_t start = offset - offset % PAGE_CACHE_FOLIO_BYTES;
+    return posix_fadvise(fd, (off_t)start, (off_t)(offset + length - start), POSIX_FADV_DONTNEED);
+}
+#endif
+
+
+void page_cache_drop_input(PageCache *cache_p, int fd, uint64_t offset, uint64_t length) {
+    if (!cache_p) {
+        return;
+    }
+#ifdef __linux__
+    // only a hint, a failure leaves the pages to the kernel
+    if (_drop_range(fd, offset, length) == 0) {
+        atomic_fetch_add(&cache_p->inputDroppedBytes, length);
+    }
+#else
+    (void)fd;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+
+void page_cache_write_behind(PageCache *cache_p, uint16_t output, int fd, uint64_t writtenEnd) {
+    if (!cache_p) {
+        return;
+    }
+#ifdef __linux__
+    PageCacheOutput *output_p = &cache_p->outputs_p[output];
+    const uint64_t window = cache_p->dirtyLimitBytes / 2;
+    if (writtenEnd < output_p->startedEnd + window) {
+        return;
+    }
+
+    // the previous window has been under writeback for a whole window of writes, waiting on it is cheap
+    if (output_p->startedEnd > output_p->droppedEnd) {
+        const double waitStart = _monotonic_seconds();
+        const uint64_t length = output_p->startedEnd - output_p->droppedEnd;
+        if (sync_file_range(fd, (off_t)output_p->droppedEnd, (off_t)length,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == 0 &&
+            _drop_range(fd, output_p->droppedEnd, length) == 0) {
+            atomic_fetch_add(&cache_p->writtenBackBytes, length);
+        }
+        atomic_fetch_add(&cache_p->writebackWaitNanos, (uint64_t)((_monotonic_seconds() - waitStart) * 1e9));
+        output_p->droppedEnd = output_p->startedEnd;
+    }
+
+    // start writeback of everything written since, without waiting for it
+    sync_file_range(fd, (off_t)output_p->startedEnd, (off_t)(writtenEnd - output_p->startedEnd),
+                    SYNC_FILE_RANGE_WRITE);
+    output_p->startedEnd = writtenEnd;
+#else
+    (void)output;
+    (void)fd;
+    (void)writtenEnd;
+#endif
+}
+
+
+void page_cache_report(PageCache *cache_p, RunStats *stats_p) {
+    const uint64_t inputDroppedBytes = atomic_load(&cache_p->inputDroppedBytes);
+    const uint64_t writtenBackBytes = atomic_load(&cache_p->writtenBackBytes);
+    const double writebackWaitSeconds = atomic_load(&cache_p->writebackWaitNanos) / 1e9;
+    printf("Page cache: dropped %.2f MB of input, wrote back %.2f MB of output early, waited %.3f s for writeback\n",
+           inputDroppedBytes / (1024.0 * 1024.0), writtenBackBytes / (1024.0 * 1024.0), writebackWaitSeconds);
+    run_stats_set_page_cache(stats_p, cache_p->dirtyLimitBytes, inputDroppedBytes, writtenBackBytes,
+                             writebackWaitSeconds);
+}
+
+
+void page_cache_free(PageCache *cache_p) {
+    free(cache_p->outputs_p);
+    cache_p->outputs_p = NULL;
+}
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "peak-overview.h"
+#include "utils.h"
+#include "sample-load.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PEAKS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define MAX_PATH_LENGTH 250
+
+
+/*
+ * Kernels
+ *
+ * The extremes are found in the native sample width and scaled to 16 bit afterwards. The
+ * scaling keeps the order of samples, so the scaled extremes are the extremes of the scaled
+ * samples.
+ */
+
+#define DEFINE_PEAK_KERNEL(NAME, WIDTH, LOAD, SHIFT)                                               \
+    static void NAME(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,    \
+                     int16_t *maximum_p) {                                                         \
+        int32_t minimum = INT32_MAX;                                                               \
+        int32_t maximum = INT32_MIN;                                                               \
+        for (size_t i = 0; i < count; i++) {                                                       \
+            const int32_t value = LOAD(samples_p + i * stride * (WIDTH));                          \
+            minimum = value < minimum ? value : minimum;                                           \
+            maximum = value > maximum ? value : maximum;                                           \
+        }                                                                                          \
+        *minimum_p = (int16_t)(minimum >> (SHIFT));                                                \
+        *maximum_p = (int16_t)(maximum >> (SHIFT));                                                \
+    }
+
+DEFINE_PEAK_KERNEL(_peaks_s16, 2, _load_s16, 0)
+DEFINE_PEAK_KERNEL(_peaks_s24, 3, _load_s24, 8)
+DEFINE_PEAK_KERNEL(_peaks_s32, 4, _load_s32, 16)
+
+static int16_t _scale_f32(float value) {
+    if (value >= 1.0f) {
+        return INT16_MAX;
+    }
+    if (value <= -1.0f) {
+        return -INT16_MAX;
+    }
+    return (int16_t)(value * 32767.0f);
+}
+
+static void _peaks_f32(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,
+                       int16_t *maximum_p) {
+    float minimum = INFINITY;
+    float maximum = -INFINITY;
+    for (size_t i = 0; i < count; i++) {
+        float value;
+        memcpy(&value, samples_p + i * stride * 4, sizeof(value));
+        // NaN fails both comparisons and is skipped
+        minimum = value < minimum ? value : minimum;
+        maximum = value > maximum ? value : maximum;
+    }
+    *minimum_p = minimum <= maximum ? _scale_f32(minimum) : 0;
+    *maximum_p = minimum <= maximum ? _scale_f32(maximum) : 0;
+}
+
+
+#ifdef PEAKS_X86_SIMD
+/*
+ * AVX2 kernels for mono outputs
+ *
+ * Minimum and maximum are kept per lane over the block and reduced once at its end. The
+ * samples that do not fill a vector go through the scalar kernel and are merged in.
+ */
+
+__attribute__((target("avx2")))
+static void _extremes_epi32(__m256i minimum, __m256i maximum, int32_t *minimum_p, int32_t *maximum_p) {
+    int32_t minimums[8], maximums[8];
+    _mm256_storeu_si256((__m256i *)minimums, minimum);
+    _mm256_storeu_si256((__m256i *)maximums, maximum);
+    for (int i = 0; i < 8; i++) {
+        *minimum_p = minimums[i] < *minimum_p ? minimums[i] : *minimum_p;
+        *maximum_p = maximums[i] > *maximum_p ? maximums[i] : *maximum_p;
+    }
+}
+
+static void _merge_tail(const uint8_t *samples_p, size_t count, PeakKernel kernel_p, int16_t *minimum_p,
+                        int16_t *maximum_p) {
+    if (count > 0) {
+        int16_t minimum, maximum;
+        kernel_p(samples_p, count, 1, &minimum, &maximum);
+        *minimum_p = minimum < *minimum_p ? minimum : *minimum_p;
+        *maximum_p = maximum > *maximum_p ? maximum : *maximum_p;
+    }
+}
+
+__attribute__((target("avx2")))
+static void _peaks_avx2_s16(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,
+                            int16_t *maximum_p) {
+    (void)stride;
+    __m256i minimum = _mm256_set1_epi16(INT16_MAX);
+    __m256i maximum = _mm256_set1_epi16(INT16_MIN);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i value = _mm256_loadu_si256((const __m256i *)(samples_p + i * 2));
+        minimum = _mm256_min_epi16(minimum, value);
+        maximum = _mm256_max_epi16(maximum, value);
+    }
+
+    // widen the 16 bit extremes before the horizontal reduction
+    int32_t minimum32 = INT16_MAX, maximum32 = INT16_MIN;
+    _extremes_epi32(_mm256_min_epi32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(minimum)),
+                                     _mm256_cvtepi16_epi32(_mm256_extracti128_si256(minimum, 1))),
+                    _mm256_max_epi32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(maximum)),
+                                     _mm256_cvtepi16_epi32(_mm256_extracti128_si256(maximum, 1))),
+                    &minimum32, &maximum32);
+    *minimum_p = (int16_t)minimum32;
+    *maximum_p = (int16_t)maximum32;
+    _merge_tail(samples_p + i * 2, count - i, _peaks_s16, minimum_p, maximum_p);
+}
+
+__attribute__((target("avx2")))
+static void _peaks_avx2_s24(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,
+                            int16_t *maximum_p) {
+    (void)stride;
+    __m256i minimum = _mm256_set1_epi32(INT32_MAX);
+    __m256i maximum = _mm256_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        // the samples stay scaled by 256, which the conversion to 16 bit drops anyway
+        const __m256i value = _load_s24x8_avx2(samples_p + i * 3);
+        minimum = _mm256_min_epi32(minimum, value);
+        maximum = _mm256_max_epi32(maximum, value);
+    }
+
+    int32_t minimum32 = INT32_MAX, maximum32 = INT32_MIN;
+    _extremes_epi32(minimum, maximum, &minimum32, &maximum32);
+    *minimum_p = (int16_t)(minimum32 >> 16);
+    *maximum_p = (int16_t)(maximum32 >> 16);
+    _merge_tail(samples_p + i * 3, count - i, _peaks_s24, minimum_p, maximum_p);
+}
+
+__attribute__((target("avx2")))
+static void _peaks_avx2_s32(const uint8_t *samples_p, size_t count, size_t stride, int16_t *minimum_p,
+                            int16_t *maximum_p) {
+    (void)stride;
+    __m256i minimum = _mm256_set1_epi32(INT32_MAX);
+    __m256i maximum = _mm256_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i value = _mm256_loadu_si256((const __m256i *)(samples_p + i * 4));
+        minimum = _mm256_min_epi32(minimum, value);
+        maximum = _mm256_max_epi32(maximum, value);
+    }
+
+    int32_t minimum32 = INT32_MAX, maximum32 = INT32_MIN;
+    _extremes_epi32(minimum, maximum, &minimum32, &maximum32);
+    *minimum_p = (int16_t)(minimum32 >> 16);
+    *maximum_p = (int16_t)(maximum32 >> 16);
+    _merge_tail(samples_p + i * 4, count - i, _peaks_s32, minimum_p, maximum_p);
+}
+#endif // PEAKS_X86_SIMD
+
+
+int peak_levels_parse(const char *text_p, PeakLevels *levels_p) {
+    levels_p->count = 0;
+    const char *next_p = text_p;
+    while (*next_p) {
+        if (levels_p->count == PEAK_MAX_LEVELS) {
+            return -1;
+        }
+        char *end_p;
+        errno = 0;
+        const unsigned long long framesPerBin = strtoull(next_p, &end_p, 10);
+        if (end_p == next_p || errno != 0 || framesPerBin < 2 || framesPerBin > UINT32_MAX ||
+            (*end_p != ',' && *end_p != '\0')) {
+            return -1;
+        }
+
+        // every bin has to cover a whole number of bins of the level below
+        if (levels_p->count > 0) {
+            const uint32_t finer = levels_p->framesPerBin[levels_p->count - 1];
+            if (framesPerBin <= finer || framesPerBin % finer != 0) {
+                return -1;
+            }
+        }
+        levels_p->framesPerBin[levels_p->count++] = (uint32_t)framesPerBin;
+        next_p = *end_p == ',' ? end_p + 1 : end_p;
+        if (*end_p == ',' && *next_p == '\0') {
+            return -1;
+        }
+    }
+    return levels_p->count > 0 ? 0 : -1;
+}
+
+
+/**
+ * Reset the bin of a level being built so any sample replaces its extremes
+ */
+static void _reset_bin(int16_t *bin_p, uint16_t channels) {
+    for (uint16_t c = 0; c < channels; c++) {
+        bin_p[2 * c] = INT16_MAX;
+        bin_p[2 * c + 1] = INT16_MIN;
+    }
+}
+
+
+static void _merge_bin(int16_t *bin_p, const int16_t *other_p, uint16_t channels) {
+    for (uint16_t c = 0; c < channels; c++) {
+        bin_p[2 * c] = other_p[2 * c] < bin_p[2 * c] ? other_p[2 * c] : bin_p[2 * c];
+        bin_p[2 * c + 1] = other_p[2 * c + 1] > bin_p[2 * c + 1] ? other_p[2 * c + 1] : bin_p[2 * c + 1];
+    }
+}
+
+
+static void _write_pending(PeakOutput *output_p) {
+    if (output_p->pendingBins > 0 && !output_p->failed &&
+        fwrite(output_p->pending_p, (size_t)output_p->channels * 4, output_p->pendingBins, output_p->file_p) !=
+            output_p->pendingBins) {
+        output_p->failed = true;
+    }
+    output_p->pendingBins = 0;
+}
+
+
+/**
+ * Store the completed bin of a level and fold it into the bin of the next coarser level
+ */
+static void _complete_bin(const PeakOverview *overview_p, PeakOutput *output_p, uint16_t level) {
+    const uint16_t channels = output_p->channels;
+    int16_t *bin_p = output_p->bins_p + (size_t)level * channels * 2;
+
+    if (level == 0) {
+        memcpy(output_p->pending_p + output_p->pendingBins * channels * 2, bin_p, (size_t)channels * 4);
+        if (++output_p->pendingBins == PEAK_WRITE_BINS) {
+            _write_pending(output_p);
+        }
+    } else {
+        if (output_p->binCount[level] == output_p->coarseCapacity[level]) {
+            const uint64_t capacity = output_p->coarseCapacity[level] ? output_p->coarseCapacity[level] * 2 : 256;
+            int16_t *coarse_p = realloc(output_p->coarse_p[level], capacity * channels * 4);
+            if (!coarse_p) {
+                fprintf(stderr, "ERROR: Failed to allocate peak overview\n");
+                exit(1);
+            }
+            output_p->coarse_p[level] = coarse_p;
+            output_p->coarseCapacity[level] = capacity;
+        }
+        memcpy(output_p->coarse_p[level] + output_p->binCount[level] * channels * 2, bin_p, (size_t)channels * 4);
+    }
+    output_p->binCount[level]++;
+
+    if (level + 1 < overview_p->levels.count) {
+        _merge_bin(bin_p + (size_t)channels * 2, bin_p, channels);
+        const uint32_t binsPerBin = overview_p->levels.framesPerBin[level + 1] / overview_p->levels.framesPerBin[level];
+        if (++output_p->fill[level + 1] == binsPerBin) {
+            _complete_bin(overview_p, output_p, level + 1);
+        }
+    }
+    _reset_bin(bin_p, channels);
+    output_p->fill[level] = 0;
+}
+
+
+void peak_overview_init(PeakOverview *overview_p, const PeakLevels *levels_p, const ChannelSelection *channels_p,
+                        const WavHeader *format_p, const char *outputPath_p) {
+    overview_p->levels = *levels_p;
+    overview_p->channels_p = channels_p;
+    overview_p->format_p = format_p;
+    overview_p->bytesPerSample = format_p->bits_per_sample / 8;
+    overview_p->outputs_p = calloc(channels_p->count, sizeof(PeakOutput));
+    if (!overview_p->outputs_p) {
+        fprintf(stderr, "ERROR: Failed to allocate peak overview\n");
+        exit(1);
+    }
+
+    if (format_p->audio_format == WAV_FORMAT_IEEE_FLOAT) {
+        overview_p->strideKernel_p = _peaks_f32;
+    } else {
+        switch (overview_p->bytesPerSample) {
+            case 2:  overview_p->strideKernel_p = _peaks_s16; break;
+            case 3:  overview_p->strideKernel_p = _peaks_s24; break;
+            default: overview_p->strideKernel_p = _peaks_s32; break;
+        }
+    }
+    overview_p->monoKernel_p = overview_p->strideKernel_p;
+    overview_p->kernelName_p = "scalar";
+
+#ifdef PEAKS_X86_SIMD
+    __builtin_cpu_init();
+    if (format_p->audio_format != WAV_FORMAT_IEEE_FLOAT && __builtin_cpu_supports("avx2")) {
+        switch (overview_p->bytesPerSample) {
+            case 2:  overview_p->monoKernel_p = _peaks_avx2_s16; break;
+            case 3:  overview_p->monoKernel_p = _peaks_avx2_s24; break;
+            default: overview_p->monoKernel_p = _peaks_avx2_s32; break;
+        }
+        overview_p->kernelName_p = "avx2";
+    }
+#endif
+
+    // the level 0 bins follow the header and level table, space for both is reserved up front
+    const size_t headerSize = PEAK_HEADER_SIZE + (size_t)levels_p->count * PEAK_LEVEL_ENTRY_SIZE;
+    uint8_t header[PEAK_HEADER_SIZE + PEAK_MAX_LEVELS * PEAK_LEVEL_ENTRY_SIZE] = {0};
+
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        PeakOutput *output_p = &overview_p->outputs_p[i];
+        output_p->channels = channels_p->groupSizes_p[i];
+        output_p->bins_p = malloc((size_t)levels_p->count * output_p->channels * 2 * sizeof(int16_t));
+        output_p->pending_p = malloc((size_t)PEAK_WRITE_BINS * output_p->channels * 2 * sizeof(int16_t));
+        if (!output_p->bins_p || !output_p->pending_p) {
+            fprintf(stderr, "ERROR: Failed to allocate peak overview\n");
+            exit(1);
+        }
+        for (uint16_t level = 0; level < levels_p->count; level++) {
+            _reset_bin(output_p->bins_p + (size_t)level * output_p->channels * 2, output_p->channels);
+        }
+
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 16];
+        _output_name(outputName, sizeof(outputName), channels_p, i);
+        char filePath[MAX_PATH_LENGTH];
+        snprintf(filePath, sizeof(filePath), "%s%s%s", outputPath_p, outputName, PEAK_FILE_EXTENSION);
+        output_p->file_p = fopen(filePath, "wb");
+        if (!output_p->file_p || fwrite(header, 1, headerSize, output_p->file_p) != headerSize) {
+            fprintf(stderr, "ERROR: Failed to create %s\n", filePath);
+            exit(1);
+        }
+    }
+
+    printf("Writing peak overviews with %u levels (", levels_p->count);
+    for (uint16_t level = 0; level < levels_p->count; level++) {
+        printf("%s%" PRIu32, level > 0 ? ", " : "", levels_p->framesPerBin[level]);
+    }
+    printf(" frames per bin, %s)\n", overview_p->kernelName_p);
+}
+
+
+void peak_overview_run(PeakOverview *overview_p, uint16_t output, const uint8_t *samples_p, size_t frameCount) {
+    PeakOutput *output_p = &overview_p->outputs_p[output];
+    const size_t channels = output_p->channels;
+    const size_t frameBytes = channels * overview_p->bytesPerSample;
+    const uint32_t framesPerBin = overview_p->levels.framesPerBin[0];
+    const PeakKernel kernel_p = channels == 1 ? overview_p->monoKernel_p : overview_p->strideKernel_p;
+
+    // reduce the frames bin by bin, a bin may span several calls
+    for (size_t done = 0; done < frameCount;) {
+        const uint64_t binLeft = framesPerBin - output_p->fill[0];
+        const size_t count = frameCount - done < binLeft ? frameCount - done : (size_t)binLeft;
+        for (size_t c = 0; c < channels; c++) {
+            int16_t minimum, maximum;
+            kernel_p(samples_p + done * frameBytes + c * overview_p->bytesPerSample, count, channels, &minimum,
+                     &maximum);
+            int16_t *bin_p = output_p->bins_p + 2 * c;
+            bin_p[0] = minimum < bin_p[0] ? minimum : bin_p[0];
+            bin_p[1] = maximum > bin_p[1] ? maximum : bin_p[1];
+        }
+        output_p->fill[0] += count;
+        output_p->frames += count;
+        done += count;
+        if (output_p->fill[0] == framesPerBin) {
+            _complete_bin(overview_p, output_p, 0);
+        }
+    }
+}
+
+
+static void _put_u16(uint8_t *target_p, uint16_t value) {
+    target_p[0] = (uint8_t)value;
+    target_p[1] = (uint8_t)(value >> 8);
+}
+
+
+static void _put_u32(uint8_t *target_p, uint32_t value) {
+    _put_u16(target_p, (uint16_t)value);
+    _put_u16(target_p + 2, (uint16_t)(value >> 16));
+}
+
+
+static void _put_u64(uint8_t *target_p, uint64_t value) {
+    _put_u32(target_p, (uint32_t)value);
+    _put_u32(target_p + 4, (uint32_t)(value >> 32));
+}
+
+
+int peak_overview_finish(PeakOverview *overview_p) {
+    const PeakLevels *levels_p = &overview_p->levels;
+    const ChannelSelection *channels_p = overview_p->channels_p;
+    int result = 0;
+
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        PeakOutput *output_p = &overview_p->outputs_p[i];
+
+        // the last bins of all levels cover the frames left over
+        for (uint16_t level = 0; level < levels_p->count; level++) {
+            if (output_p->fill[level] > 0) {
+                _complete_bin(overview_p, output_p, level);
+            }
+        }
+        _write_pending(output_p);
+
+        uint8_t header[PEAK_HEADER_SIZE + PEAK_MAX_LEVELS * PEAK_LEVEL_ENTRY_SIZE] = {0};
+        memcpy(header, PEAK_FILE_MAGIC, 8);
+        _put_u16(header + 8, output_p->channels);
+        _put_u16(header + 10, overview_p->format_p->bits_per_sample);
+        _put_u32(header + 12, overview_p->format_p->sample_rate);
+        _put_u64(header + 16, output_p->frames);
+        _put_u16(header + 24, levels_p->count);
+
+        uint64_t offset = PEAK_HEADER_SIZE + (uint64_t)levels_p->count * PEAK_LEVEL_ENTRY_SIZE;
+        for (uint16_t level = 0; level < levels_p->count; level++) {
+            uint8_t *entry_p = header + PEAK_HEADER_SIZE + level * PEAK_LEVEL_ENTRY_SIZE;
+            _put_u32(entry_p, levels_p->framesPerBin[level]);
+            _put_u64(entry_p + 8, output_p->binCount[level]);
+            _put_u64(entry_p + 16, offset);
+            offset += output_p->binCount[level] * output_p->channels * 4;
+
+            // the coarser levels follow the bins of level 0 in order
+            if (level > 0 && output_p->binCount[level] > 0 && !output_p->failed &&
+                fwrite(output_p->coarse_p[level], (size_t)output_p->channels * 4, output_p->binCount[level],
+                       output_p->file_p) != output_p->binCount[level]) {
+                output_p->failed = true;
+            }
+        }
+
+        const size_t headerSize = PEAK_HEADER_SIZE + (size_t)levels_p->count * PEAK_LEVEL_ENTRY_SIZE;
+        if (!output_p->failed && (fseek(output_p->file_p, 0, SEEK_SET) != 0 ||
+                                  fwrite(header, 1, headerSize, output_p->file_p) != headerSize)) {
+            output_p->failed = true;
+        }
+        if (fclose(output_p->file_p) != 0) {
+            output_p->failed = true;
+        }
+        output_p->file_p = NULL;
+
+        if (output_p->failed) {
+            char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 16];
+            _output_name(outputName, sizeof(outputName), channels_p, i);
+            fprintf(stderr, "ERROR: Failed to write the peak overview %s%s\n", outputName, PEAK_FILE_EXTENSION);
+            result = -1;
+        }
+    }
+    return result;
+}
+
+
+void peak_overview_free(PeakOverview *overview_p) {
+    for (uint16_t i = 0; i < overview_p->channels_p->count; i++) {
+        PeakOutput *output_p = &overview_p->outputs_p[i];
+        if (output_p->file_p) {
+            fclose(output_p->file_p);
+        }
+        free(output_p->bins_p);
+        free(output_p->pending_p);
+        for (uint16_t level = 0; level < PEAK_MAX_LEVELS; level++) {
+            free(output_p->coarse_p[level]);
+        }
+    }
+    free(overview_p->outputs_p);
+    overview_p->outputs_p = NULL;
+}
@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "processing.h"
+#include "deinterleave.h"
+#include "block-queue.h"
+#include "input-source.h"
+#include "output-writer.h"
+
+// Interleaved audio is read in blocks of whole frames of up to this size
+#define INPUT_BLOCK_SIZE_BYTES (1024 * 1024)
+
+// Input blocks in flight per deinterleave worker
+#define INPUT_BLOCKS_PER_WORKER 2
+
+
+typedef struct {
+    FILE *file_p;               // Chunk file
+    uint64_t chunkIndex;        // Chunk the file belongs to
+    InputSource source;         // Data region of the chunk
+    atomic_uint references;     // Reader plus every block still pointing into the source
+} SharedInput;
+
+typedef struct {
+    uint8_t *data_p;            // Read buffer (stdio backend)
+    const uint8_t *frames_p;    // Interleaved frames, data_p or a view into the mapping
+    size_t frameCount;          // Number of valid frames at frames_p
+    SharedInput *input_p;       // Source the frames belong to
+    atomic_uint pendingWorkers; // Workers that still have to process this block
+} InputBlock;
+
+typedef struct Pipeline Pipeline;
+
+typedef struct {
+    Pipeline *pipeline_p;
+    uint16_t firstChannel;      // First output owned by this worker
+    uint16_t channelCount;      // Number of outputs owned by this worker
+    BlockQueue inputQueue;      // Input blocks waiting to be deinterleaved
+    pthread_t thread;
+} PipelineWorker;
+
+typedef struct {
+    Pipeline *pipeline_p;
+    BlockQueue queue;           // Filled output buffers waiting to be written
+    pthread_t thread;
+} PipelineWriter;
+
+struct Pipeline {
+    const SplitOptions *options_p;
+    const WavHeader *inputHeader_p;
+    uint64_t firstChunkIndex;
+    uint64_t maxChunkIndex;
+    const char *sessionPath_p;
+    FILE *firstInputFile_p;
+    OutputWriter *writer_p;
+    FILE ***outputFiles_pp;
+    uint64_t **bytesWritten_p;
+    SessionJournal *journal_p;
+
+    uint16_t bytesPerSample;
+    size_t framesPerBlock;
+
+    size_t inputBlockCount;
+    InputBlock *inputBlocks_p;
+    BlockQueue freeInputs;
+
+    unsigned int workerCount;
+    PipelineWorker *workers_p;
+    atomic_uint activeWorkers;
+
+    unsigned int writerCount;
+    PipelineWriter *writers_p;
+};
+
+
+static void _release_input(SharedInput *input_p) {
+    // the mapping has to outlive every block that still points into it
+    if (atomic_fetch_sub(&input_p->references, 1) == 1) {
+        input_source_close(&input_p->source);
+        fclose(input_p->file_p);
+        free(input_p);
+    }
+}
+
+static void _read_chunk_blocks(Pipeline *pipeline_p, FILE *inputFile_p, const WavHeader *chunkHeader_p,
+                               uint64_t chunkIndex) {
+    RunStats *stats_p = pipeline_p->options_p->stats_p;
+    SharedInput *input_p = malloc(sizeof(SharedInput));
+    if (!input_p) {
+        fprintf(stderr, "ERROR: Failed to allocate input state\n");
+        exit(1);
+    }
+    input_p->file_p = inputFile_p;
+    input_p->chunkIndex = chunkIndex;
+    atomic_store(&input_p->references, 1);
+    if (input_source_open(&input_p->source, inputFile_p, chunkHeader_p, pipeline_p->options_p->inputBackend,
+                          pipeline_p->options_p->cache_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to open audio data of input file\n");
+        exit(1);
+    }
+    input_source_set_checksum(&input_p->source, session_checksums_current_input(pipeline_p->options_p->checksums_p));
+
+    while (1) {
+        InputBlock *block_p = block_queue_pop(&pipeline_p->freeInputs);
+        const double readStart = run_stats_now(stats_p);
+        block_p->frameCount = input_source_next(&input_p->source, block_p->data_p, pipeline_p->framesPerBlock,
+                                                &block_p->frames_p);
+        if (block_p->frameCount == 0) {
+            block_queue_push(&pipeline_p->freeInputs, block_p);
+            break;
+        }
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_READ, readStart,
+                      block_p->frameCount * pipeline_p->inputHeader_p->block_align);
+
+        // every worker deinterleaves its own channels out of the same block
+        atomic_fetch_add(&input_p->references, 1);
+        block_p->input_p = input_p;
+        atomic_store(&block_p->pendingWorkers, pipeline_p->workerCount);
+        for (unsigned int w = 0; w < pipeline_p->workerCount; w++) {
+            block_queue_push(&pipeline_p->workers_p[w].inputQueue, block_p);
+        }
+    }
+
+    _release_input(input_p);
+}
+
+static void *_reader_thread(void *arg_p) {
+    Pipeline *pipeline_p = arg_p;
+
+    _read_chunk_blocks(pipeline_p, pipeline_p->firstInputFile_p, pipeline_p->inputHeader_p,
+                       pipeline_p->firstChunkIndex);
+    journal_checkpoint(pipeline_p->journal_p, pipeline_p->writer_p, pipeline_p->firstChunkIndex);
+
+    for (uint64_t chunkIndex = pipeline_p->firstChunkIndex + 1; chunkIndex <= pipeline_p->maxChunkIndex; chunkIndex++) {
+        WavHeader chunkHeader;
+        FILE *inputFile_p = read_chunk_header(pipeline_p->options_p, chunkIndex, pipeline_p->sessionPath_p, &chunkHeader,
+                                              pipeline_p->outputFiles_pp, pipeline_p->bytesWritten_p);
+        _read_chunk_blocks(pipeline_p, inputFile_p, &chunkHeader, chunkIndex);
+
+        // records what the writers completed so far, the workers may still lag behind
+        journal_checkpoint(pipeline_p->journal_p, pipeline_p->writer_p, chunkIndex);
+    }
+
+    for (unsigned int w = 0; w < pipeline_p->workerCount; w++) {
+        block_queue_close(&pipeline_p->workers_p[w].inputQueue);
+    }
+    return NULL;
+}
+
+static void _submit_output_buffer(Pipeline *pipeline_p, OutputBuffer *buffer_p, uint64_t chunkIndex) {
+    RunStats *stats_p = pipeline_p->options_p->stats_p;
+    buffer_p->chunkIndex = chunkIndex;
+    signal_analysis_prepare_submit(pipeline_p->options_p->analysis_p, buffer_p);
+
+    // asynchronous backends queue the write in the kernel right away
+    if (pipeline_p->writerCount == 0) {
+        const size_t filledBytes = buffer_p->fillBytes;
+        const double writeStart = run_stats_now(stats_p);
+        output_writer_submit(pipeline_p->writer_p, buffer_p);
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE, writeStart, filledBytes);
+        return;
+    }
+
+    // a channel is always written by the same writer thread, which keeps its buffers in order
+    PipelineWriter *writer_p = &pipeline_p->writers_p[buffer_p->channel % pipeline_p->writerCount];
+    const double waitStart = run_stats_now(stats_p);
+    block_queue_push(&writer_p->queue, buffer_p);
+    run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE_WAIT, waitStart, 0);
+}
+
+static void *_worker_thread(void *arg_p) {
+    PipelineWorker *worker_p = arg_p;
+    Pipeline *pipeline_p = worker_p->pipeline_p;
+    const size_t blockAlign = pipeline_p->inputHeader_p->block_align;
+    const uint16_t bytesPerSample = pipeline_p->bytesPerSample;
+
+    Deinterleaver deinterleaver;
+    const ChannelSelection *channels_p = &pipeline_p->options_p->channels;
+    const uint16_t *groupSizes_p = channels_p->groupSizes_p + worker_p->firstChannel;
+    deinterleaver_init_regroup(&deinterleaver, pipeline_p->inputHeader_p->num_channels, bytesPerSample,
+                               channels_p->channels_p + channels_p->firstSlots_p[worker_p->firstChannel],
+                               groupSizes_p, worker_p->channelCount, true);
+
+    OutputBuffer **current_pp = calloc(worker_p->channelCount, sizeof(OutputBuffer *));
+    uint8_t **channelTargets_pp = malloc(worker_p->channelCount * sizeof(uint8_t *));
+    if (!current_pp || !channelTargets_pp) {
+        fprintf(stderr, "ERROR: Failed to allocate worker state\n");
+        exit(1);
+    }
+
+    // converted outputs are deinterleaved into a staging area of the worker and converted from there
+    SampleConverter *converter_p = pipeline_p->options_p->converter_p;
+    const uint16_t outputBytesPerSample = converter_p ? converter_p->outputBytes : bytesPerSample;
+    uint8_t *staging_p = NULL;
+    size_t stagingFrames = SIZE_MAX;
+    if (converter_p) {
+        staging_p = sample_converter_staging(converter_p, groupSizes_p, worker_p->channelCount, channelTargets_pp,
+                                             &stagingFrames);
+        if (!staging_p) {
+            fprintf(stderr, "ERROR: Failed to allocate conversion staging buffer\n");
+            exit(1);
+        }
+    }
+
+    RunStats *stats_p = pipeline_p->options_p->stats_p;
+    SignalAnalysis *analysis_p = pipeline_p->options_p->analysis_p;
+    PeakOverview *peaks_p = pipeline_p->options_p->peaks_p;
+    SessionChecksums *checksums_p = pipeline_p->options_p->checksums_p;
+    uint64_t chunkIndex = pipeline_p->firstChunkIndex;
+    InputBlock *block_p;
+    while (1) {
+        const double waitStart = run_stats_now(stats_p);
+        block_p = block_queue_pop(&worker_p->inputQueue);
+        if (!block_p) {
+            break;
+        }
+        chunkIndex = block_p->input_p->chunkIndex;
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_READ_WAIT, waitStart, 0);
+
+        size_t framesDone = 0;
+        while (framesDone < block_p->frameCount) {
+            // all outputs of a worker advance in lockstep, the fullest buffer limits the step
+            size_t frameCount = block_p->frameCount - framesDone;
+            if (frameCount > stagingFrames) {
+                frameCount = stagingFrames;
+            }
+            for (uint16_t c = 0; c < worker_p->channelCount; c++) {
+                const uint16_t output = worker_p->firstChannel + c;
+                if (!current_pp[c]) {
+                    const double acquireStart = run_stats_now(stats_p);
+                    current_pp[c] = output_writer_acquire(pipeline_p->writer_p, output);
+                    run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE_WAIT, acquireStart, 0);
+                }
+                if (!converter_p) {
+                    channelTargets_pp[c] = current_pp[c]->data_p + current_pp[c]->fillBytes;
+                }
+
+                const size_t framesLeft = (output_writer_buffer_capacity(pipeline_p->writer_p, output) -
+                                           current_pp[c]->fillBytes) / ((size_t)groupSizes_p[c] * outputBytesPerSample);
+                if (frameCount > framesLeft) {
+                    frameCount = framesLeft;
+                }
+            }
+            const double deinterleaveStart = run_stats_now(stats_p);
+            deinterleaver_run(&deinterleaver, block_p->frames_p + framesDone * blockAlign, frameCount,
+                              channelTargets_pp);
+            if (analysis_p) {
+                for (uint16_t c = 0; c < worker_p->channelCount; c++) {
+                    signal_analysis_run(analysis_p, worker_p->firstChannel + c, channelTargets_pp[c], frameCount);
+                }
+            }
+            for (uint16_t c = 0; c < worker_p->channelCount && peaks_p; c++) {
+                peak_overview_run(peaks_p, worker_p->firstChannel + c, channelTargets_pp[c], frameCount);
+            }
+            for (uint16_t c = 0; c < worker_p->channelCount && converter_p; c++) {
+                sample_converter_run(converter_p, worker_p->firstChannel + c, channelTargets_pp[c],
+                                     current_pp[c]->data_p + current_pp[c]->fillBytes, frameCount * groupSizes_p[c]);
+            }
+            for (uint16_t c = 0; c < worker_p->channelCount && checksums_p; c++) {
+                checksum_update(&checksums_p->outputs_p[worker_p->firstChannel + c],
+                                current_pp[c]->data_p + current_pp[c]->fillBytes,
+                                frameCount * groupSizes_p[c] * outputBytesPerSample);
+            }
+            run_stats_add(stats_p, chunkIndex, RUN_STAGE_DEINTERLEAVE, deinterleaveStart, 0);
+
+            for (uint16_t c = 0; c < worker_p->channelCount; c++) {
+                current_pp[c]->fillBytes += frameCount * groupSizes_p[c] * outputBytesPerSample;
+                if (current_pp[c]->fillBytes >=
+                    output_writer_buffer_capacity(pipeline_p->writer_p, worker_p->firstChannel + c)) {
+                    _submit_output_buffer(pipeline_p, current_pp[c], chunkIndex);
+                    current_pp[c] = NULL;
+                }
+            }
+            framesDone += frameCount;
+        }
+
+        if (atomic_fetch_sub(&block_p->pendingWorkers, 1) == 1) {
+            _release_input(block_p->input_p);
+            block_queue_push(&pipeline_p->freeInputs, block_p);
+        }
+    }
+
+    // hand over partially filled buffers
+    for (uint16_t c = 0; c < worker_p->channelCount; c++) {
+        if (current_pp[c] && current_pp[c]->fillBytes > 0) {
+            _submit_output_buffer(pipeline_p, current_pp[c], chunkIndex);
+        } else if (current_pp[c]) {
+            output_writer_release(pipeline_p->writer_p, current_pp[c]);
+        }
+    }
+    free(current_pp);
+    free(staging_p);
+    free(channelTargets_pp);
+
+    // io_uring cancels the queued writes of a thread that exits
+    if (pipeline_p->writerCount == 0) {
+        output_writer_drain(pipeline_p->writer_p);
+    }
+
+    // the last worker to finish tells the writers that no more blocks will come
+    if (atomic_fetch_sub(&pipeline_p->activeWorkers, 1) == 1) {
+        for (unsigned int w = 0; w < pipeline_p->writerCount; w++) {
+            block_queue_close(&pipeline_p->writers_p[w].queue);
+        }
+    }
+    return NULL;
+}
+
+static void *_writer_thread(void *arg_p) {
+    PipelineWriter *writer_p = arg_p;
+    Pipeline *pipeline_p = writer_p->pipeline_p;
+
+    RunStats *stats_p = pipeline_p->options_p->stats_p;
+    OutputBuffer *buffer_p;
+    while ((buffer_p = block_queue_pop(&writer_p->queue)) != NULL) {
+        const uint64_t chunkIndex = buffer_p->chunkIndex;
+        const size_t filledBytes = buffer_p->fillBytes;
+        const double writeStart = run_stats_now(stats_p);
+        output_writer_submit(pipeline_p->writer_p, buffer_p);
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE, writeStart, filledBytes);
+    }
+    return NULL;
+}
+
+static void _plan_workers(Pipeline *pipeline_p, unsigned int jobs) {
+    const uint16_t numChannels = pipeline_p->options_p->channels.count;
+    if (jobs > numChannels) {
+        jobs = numChannels;
+    }
+
+    // keep worker ranges multiples of 8 channels where possible so the SIMD kernels apply
+    size_t channelsPerWorker = (numChannels + jobs - 1) / jobs;
+    if (channelsPerWorker > 8) {
+        channelsPerWorker = (channelsPerWorker + 7) / 8 * 8;
+    }
+    pipeline_p->workerCount = (unsigned int)((numChannels + channelsPerWorker - 1) / channelsPerWorker);
+
+    // blocking backends get writer threads, asynchronous ones are submitted to by the workers
+    pipeline_p->writerCount = output_backend_is_async(pipeline_p->options_p->outputBackend) ? 0 : jobs;
+
+    pipeline_p->workers_p = calloc(pipeline_p->workerCount, sizeof(PipelineWorker));
+    pipeline_p->writers_p = calloc(pipeline_p->writerCount ? pipeline_p->writerCount : 1, sizeof(PipelineWriter));
+    if (!pipeline_p->workers_p || !pipeline_p->writers_p) {
+        fprintf(stderr, "ERROR: Failed to allocate pipeline threads\n");
+        exit(1);
+    }
+
+    for (unsigned int w = 0; w < pipeline_p->workerCount; w++) {
+        PipelineWorker *worker_p = &pipeline_p->workers_p[w];
+        worker_p->pipeline_p = pipeline_p;
+        const size_t remainingChannels = (size_t)numChannels - w * channelsPerWorker;
+        worker_p->firstChannel = (uint16_t)(w * channelsPerWorker);
+        worker_p->channelCount = (uint16_t)(remainingChannels < channelsPerWorker ? remainingChannels
+                                                                                  : channelsPerWorker);
+    }
+}
+
+static void _allocate_blocks(Pipeline *pipeline_p) {
+    const WavHeader *inputHeader_p = pipeline_p->inputHeader_p;
+
+    // input blocks: whole frames, shared by all workers
+    pipeline_p->framesPerBlock = INPUT_BLOCK_SIZE_BYTES / inputHeader_p->block_align;
+    if (pipeline_p->framesPerBlock == 0) {
+        pipeline_p->framesPerBlock = 1;
+    }
+    pipeline_p->inputBlockCount = (size_t)pipeline_p->workerCount * INPUT_BLOCKS_PER_WORKER + 2;
+    pipeline_p->inputBlocks_p = calloc(pipeline_p->inputBlockCount, sizeof(InputBlock));
+
+    if (!pipeline_p->inputBlocks_p || block_queue_init(&pipeline_p->freeInputs, pipeline_p->inputBlockCount) != 0) {
+        fprintf(stderr, "ERROR: Failed to allocate pipeline buffers\n");
+        exit(1);
+    }
+
+    const bool needsReadBuffers = pipeline_p->options_p->inputBackend == INPUT_BACKEND_STDIO;
+    for (size_t i = 0; i < pipeline_p->inputBlockCount; i++) {
+        if (needsReadBuffers) {
+            pipeline_p->inputBlocks_p[i].data_p = malloc(pipeline_p->framesPerBlock * inputHeader_p->block_align);
+        }
+        if (needsReadBuffers && !pipeline_p->inputBlocks_p[i].data_p) {
+            fprintf(stderr, "ERROR: Failed to allocate input block\n");
+            exit(1);
+        }
+        block_queue_push(&pipeline_p->freeInputs, &pipeline_p->inputBlocks_p[i]);
+    }
+
+    for (unsigned int w = 0; w < pipeline_p->workerCount; w++) {
+        if (block_queue_init(&pipeline_p->workers_p[w].inputQueue, pipeline_p->inputBlockCount) != 0) {
+            fprintf(stderr, "ERROR: Failed to allocate worker queue\n");
+            exit(1);
+        }
+    }
+    for (unsigned int w = 0; w < pipeline_p->writerCount; w++) {
+        pipeline_p->writers_p[w].pipeline_p = pipeline_p;
+        if (block_queue_init(&pipeline_p->writers_p[w].queue, output_writer_buffer_count(pipeline_p->writer_p)) != 0) {
+            fprintf(stderr, "ERROR: Failed to allocate writer queue\n");
+            exit(1);
+        }
+    }
+}
+
+static void _free_blocks(Pipeline *pipeline_p) {
+    for (unsigned int w = 0; w < pipeline_p->workerCount; w++) {
+        block_queue_destroy(&pipeline_p->workers_p[w].inputQueue);
+    }
+    for (unsigned int w = 0; w < pipeline_p->writerCount; w++) {
+        block_queue_destroy(&pipeline_p->writers_p[w].queue);
+    }
+    for (size_t i = 0; i < pipeline_p->inputBlockCount; i++) {
+        free(pipeline_p->inputBlocks_p[i].data_p);
+    }
+    block_queue_destroy(&pipeline_p->freeInputs);
+    free(pipeline_p->inputBlocks_p);
+    free(pipeline_p->workers_p);
+    free(pipeline_p->writers_p);
+}
+
+void run_pipeline(const SplitOptions *options_p, FILE *firstInputFile_p, const WavHeader *inputHeader,
+                  uint64_t firstChunkIndex, uint64_t maxChunkIndex, const char *sessionPath_p,
+                  OutputWriter *writer_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p,
+                  SessionJournal *journal_p) {
+    Pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.options_p = options_p;
+    pipeline.inputHeader_p = inputHeader;
+    pipeline.firstChunkIndex = firstChunkIndex;
+    pipeline.maxChunkIndex = maxChunkIndex;
+    pipeline.sessionPath_p = sessionPath_p;
+    pipeline.firstInputFile_p = firstInputFile_p;
+    pipeline.writer_p = writer_p;
+    pipeline.outputFiles_pp = outputFiles_pp;
+    pipeline.bytesWritten_p = bytesWritten_p;
+    pipeline.journal_p = journal_p;
+    pipeline.bytesPerSample = inputHeader->bits_per_sample / 8;
+
+    _plan_workers(&pipeline, options_p->jobs);
+    _allocate_blocks(&pipeline);
+    atomic_store(&pipeline.activeWorkers, pipeline.workerCount);
+    printf("Pipeline: 1 reader, %u deinterleave workers, %u writers\n",
+           pipeline.workerCount, pipeline.writerCount);
+    run_stats_set_threads(options_p->stats_p, 1, pipeline.workerCount,
+                          pipeline.writerCount ? pipeline.writerCount : pipeline.workerCount);
+
+    // start consumers first, then the reader that feeds them
+    for (unsigned int w = 0; w < pipeline.writerCount; w++) {
+        if (pthread_create(&pipeline.writers_p[w].thread, NULL, _writer_thread, &pipeline.writers_p[w]) != 0) {
+            fprintf(stderr, "ERROR: Failed to start writer thread\n");
+            exit(1);
+        }
+    }
+    for (unsigned int w = 0; w < pipeline.workerCount; w++) {
+        if (pthread_create(&pipeline.workers_p[w].thread, NULL, _worker_thread, &pipeline.workers_p[w]) != 0) {
+            fprintf(stderr, "ERROR: Failed to start deinterleave worker\n");
+            exit(1);
+        }
+    }
+    pthread_t readerThread;
+    if (pthread_create(&readerThread, NULL, _reader_thread, &pipeline) != 0) {
+        fprintf(stderr, "ERROR: Failed to start reader thread\n");
+        exit(1);
+    }
+
+    pthread_join(readerThread, NULL);
+    for (unsigned int w = 0; w < pipeline.workerCount; w++) {
+        pthread_join(pipeline.workers_p[w].thread, NULL);
+    }
+    for (unsigned int w = 0; w < pipeline.writerCount; w++) {
+        pthread_join(pipeline.writers_p[w].thread, NULL);
+    }
+
+    _free_blocks(&pipeline);
+}
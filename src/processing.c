@@ -4,6 +4,12 @@
 #include <inttypes.h>
 
 #include "processing.h"
+#include "deinterleave.h"
+#include "output-writer.h"
+#include "pipeline.h"
+#include "journal.h"
+#include "signal-analysis.h"
+#include "sample-convert.h"
 #include "utils.h"
 
 #ifdef WIN32
@@ -14,15 +20,11 @@
 
 #define MAX_PATH_LENGTH 250
 
+// Interleaved audio is read in blocks of whole frames of up to this size
+#define READ_BLOCK_SIZE_BYTES (1024 * 1024)
 
-void initialize_session(const char *sessionPath_p, uint64_t *maxChunkIndex, char **outputPath_p) {
-    // find highest chunk index
-    _find_max_chunk_index(maxChunkIndex, sessionPath_p);
-    if (*maxChunkIndex == 0) {
-        fprintf(stderr, "ERROR: No input files found\n");
-        exit(1);
-    }
-    
+
+void initialize_session(const char *sessionPath_p, char **outputPath_p, bool *resume_p) {
     // create output directory
     *outputPath_p = malloc(strlen(sessionPath_p) + 7);
     if (*outputPath_p == NULL) {
@@ -30,54 +32,277 @@ void initialize_session(const char *sessionPath_p, uint64_t *maxChunkIndex, char
         exit(1);
     }
     sprintf(*outputPath_p, "%s%c%s%c", sessionPath_p, PATH_SEPARATOR, "out", PATH_SEPARATOR);
+
+    // a journal means an earlier run left outputs behind that can be continued
+    if (resume_p) {
+        *resume_p = journal_exists(*outputPath_p);
+        if (*resume_p) {
+            return;
+        }
+    }
     _create_output_folder(*outputPath_p);
 }
 
 
-void initialize_buffers(const WavHeader *inputHeader, size_t totalBufferSizeMB, 
-                       uint8_t ***writeBuffers_pp, size_t **bufferFillBytes_p, 
-                       size_t *bufferSizeBytes) {
-    // calculate buffer size per channel
-    *bufferSizeBytes = (totalBufferSizeMB * 1024 * 1024) / inputHeader->num_channels;
-    printf("Buffer size per channel: %.2f MB\n", *bufferSizeBytes / (1024.0 * 1024.0));
+OutputWriter *initialize_output_writer(const SplitOptions *options_p, const WavHeader *outputFormat_p,
+                                       FILE **outputFiles_pp, uint64_t *bytesWritten_p) {
+    const uint16_t bytesPerSample = outputFormat_p->bits_per_sample / 8;
+    size_t *frameBytes_p = malloc(options_p->channels.count * sizeof(size_t));
+    if (!frameBytes_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    for (uint16_t i = 0; i < options_p->channels.count; i++) {
+        frameBytes_p[i] = (size_t)options_p->channels.groupSizes_p[i] * bytesPerSample;
+    }
+    OutputWriter *writer_p = output_writer_create(options_p->outputBackend, outputFiles_pp, bytesWritten_p,
+                                                  options_p->channels.count, frameBytes_p,
+                                                  options_p->totalBufferSizeMB * 1024 * 1024,
+                                                  output_backend_data_offset(options_p->outputBackend,
+                                                                             outputFormat_p->audio_format));
+    free(frameBytes_p);
+    if (options_p->encoders_pp) {
+        output_writer_set_encoders(writer_p, options_p->encoders_pp);
+    }
+    if (options_p->cache_p) {
+        output_writer_set_page_cache(writer_p, options_p->cache_p);
+    }
+    printf("Buffer pool: %zu blocks of %zu KB (%.2f MB)\n", output_writer_buffer_count(writer_p),
+           output_writer_buffer_size(writer_p) / 1024,
+           output_writer_buffer_count(writer_p) * output_writer_buffer_size(writer_p) / (1024.0 * 1024.0));
+    return writer_p;
+}
 
-    // allocate buffer arrays
-    *writeBuffers_pp = malloc(inputHeader->num_channels * sizeof(uint8_t *));
-    *bufferFillBytes_p = malloc(inputHeader->num_channels * sizeof(size_t));
-    
-    if (*writeBuffers_pp == NULL || *bufferFillBytes_p == NULL) {
+
+void initialize_buffers(const SplitOptions *options_p, OutputWriter *writer_p, OutputBuffer ***writeBuffers_pp) {
+    *writeBuffers_pp = malloc(options_p->channels.count * sizeof(OutputBuffer *));
+    if (*writeBuffers_pp == NULL) {
         fprintf(stderr, "ERROR: Failed to allocate buffer arrays\n");
         exit(1);
     }
 
-    // allocate individual channel buffers
-    for (int i = 0; i < inputHeader->num_channels; i++) {
-        (*writeBuffers_pp)[i] = malloc(*bufferSizeBytes);
-        (*bufferFillBytes_p)[i] = 0;
-        
-        if ((*writeBuffers_pp)[i] == NULL) {
-            fprintf(stderr, "ERROR: Failed to allocate write buffer for channel %d\n", i + 1);
+    for (uint16_t i = 0; i < options_p->channels.count; i++) {
+        (*writeBuffers_pp)[i] = output_writer_acquire(writer_p, i);
+    }
+}
+
+
+static void _build_chunk_path(char *inputFilePath_p, const char *sessionPath_p, uint64_t chunkIndex) {
+    snprintf(inputFilePath_p, MAX_PATH_LENGTH, "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
+}
+
+
+/**
+ * Number of audio bytes actually present in a chunk, the data chunk may claim more than the file holds
+ *
+ * @param inputFile_p Input file handle, positioned at the start of the audio data
+ * @param inputHeader WAV header of the chunk
+ * @return Bytes of audio data available in the file
+ */
+static uint64_t _available_data_bytes(FILE *inputFile_p, const WavHeader *inputHeader) {
+    const long dataStart = ftell(inputFile_p);
+    if (dataStart < 0 || fseek(inputFile_p, 0, SEEK_END) != 0) {
+        return inputHeader->data_bytes;
+    }
+    const long fileEnd = ftell(inputFile_p);
+    if (fileEnd < dataStart) {
+        return 0;
+    }
+    if ((uint64_t)(fileEnd - dataStart) < inputHeader->data_bytes) {
+        return (uint64_t)(fileEnd - dataStart);
+    }
+    return inputHeader->data_bytes;
+}
+
+
+void plan_chunk(const char *sessionPath_p, uint64_t chunkIndex, SessionPlan *plan_p) {
+    char inputFilePath[MAX_PATH_LENGTH];
+    _build_chunk_path(inputFilePath, sessionPath_p, chunkIndex);
+
+    FILE *inputFile_p = fopen(inputFilePath, "rb");
+    if (!inputFile_p) {
+        fprintf(stderr, "ERROR: Failed to open input file %s\n", inputFilePath);
+        exit(1);
+    }
+
+    WavHeader chunkHeader;
+    if (read_header(inputFile_p, &chunkHeader) != 0) {
+        fprintf(stderr, "ERROR: Failed to read WAV header of %s\n", inputFilePath);
+        fclose(inputFile_p);
+        exit(1);
+    }
+
+    if (session_index_check_chunk(chunkIndex == 1 ? NULL : &plan_p->format, &chunkHeader, inputFilePath) != 0) {
+        fclose(inputFile_p);
+        exit(1);
+    }
+    if (chunkIndex == 1) {
+        plan_p->format = chunkHeader;
+        plan_p->outputFormat = chunkHeader;
+    }
+
+    const uint64_t dataBytes = _available_data_bytes(inputFile_p, &chunkHeader);
+    if (dataBytes < chunkHeader.data_bytes && chunkHeader.data_bytes != UINT32_MAX) {
+        fprintf(stderr, "Warning: %s holds %" PRIu64 " of the %" PRIu32 " audio bytes its header announces, "
+                "splitting only those\n", inputFilePath, dataBytes, chunkHeader.data_bytes);
+    }
+    plan_p->totalFrames += dataBytes / chunkHeader.block_align;
+    plan_p->channelDataBytes = plan_p->totalFrames * (plan_p->outputFormat.bits_per_sample / 8);
+    fclose(inputFile_p);
+}
+
+
+void plan_session(const SessionIndex *index_p, const SessionRange *range_p, SessionPlan *plan_p) {
+    memset(plan_p, 0, sizeof(*plan_p));
+    plan_p->format = index_p->chunks_p[0].header;
+    plan_p->outputFormat = plan_p->format;
+    plan_p->totalFrames = range_p ? range_p->endFrame - range_p->startFrame : index_p->totalFrames;
+    plan_p->channelDataBytes = plan_p->totalFrames * (plan_p->outputFormat.bits_per_sample / 8);
+
+    if (range_p) {
+        const double sampleRate = plan_p->format.sample_rate;
+        printf("Planned %" PRIu64 " frames (%.2f MB per channel) from %.3f s to %.3f s, chunks %" PRIu64 " to %"
+               PRIu64 " of %" PRIu64 "\n", plan_p->totalFrames, plan_p->channelDataBytes / (1024.0 * 1024.0),
+               range_p->startFrame / sampleRate, range_p->endFrame / sampleRate, range_p->firstChunk,
+               range_p->lastChunk, index_p->chunkCount);
+        return;
+    }
+    printf("Planned %" PRIu64 " frames (%.2f MB per channel) from %" PRIu64 " chunks\n",
+           plan_p->totalFrames, plan_p->channelDataBytes / (1024.0 * 1024.0), index_p->chunkCount);
+}
+
+
+void plan_output_format(const SplitOptions *options_p, SessionPlan *plan_p) {
+    if (sample_format_output_header(options_p->sampleFormat, &plan_p->format, &plan_p->outputFormat) != 0) {
+        fprintf(stderr, "ERROR: Only 16, 24 and 32 bit integer PCM sessions can be converted to %s\n",
+                sample_format_name(options_p->sampleFormat));
+        exit(1);
+    }
+    plan_p->channelDataBytes = plan_p->totalFrames * (plan_p->outputFormat.bits_per_sample / 8);
+
+    if (options_p->outputCodec == OUTPUT_CODEC_FLAC) {
+        uint16_t maxChannels = 0;
+        for (uint16_t i = 0; i < options_p->channels.count; i++) {
+            if (options_p->channels.groupSizes_p[i] > maxChannels) {
+                maxChannels = options_p->channels.groupSizes_p[i];
+            }
+        }
+        if (flac_check_format(&plan_p->outputFormat, maxChannels) != 0) {
             exit(1);
         }
     }
 }
 
 
-FILE* read_chunk_header(uint64_t chunkIndex, const char *sessionPath_p, 
-                        WavHeader *inputHeader, FILE ***outputFiles_pp, 
-                        uint32_t **bytesWritten_p, const char *outputPath_p) {
+/**
+ * Frames an output has to advance by so that direct writes stay aligned
+ *
+ * @param frameBytes Bytes per frame of the output
+ * @return Alignment in frames (a power of two)
+ */
+static uint64_t _direct_frame_alignment(size_t frameBytes) {
+    uint64_t frames = 1;
+    while ((frames * frameBytes) % OUTPUT_DIRECT_ALIGNMENT != 0) {
+        frames *= 2;
+    }
+    return frames;
+}
+
+
+bool resume_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, const uint64_t *journaledBytes_p,
+                         const SessionIndex *index_p, const char *outputPath_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p,
+                         uint64_t *firstChunkIndex_p, uint64_t *skipFrames_p) {
+    const ChannelSelection *channels_p = &options_p->channels;
+    const uint16_t bytesPerSample = plan_p->outputFormat.bits_per_sample / 8;
+
+    // outputs are cut back to the frames all of them hold
+    uint64_t resumeFrames = plan_p->totalFrames;
+    uint64_t alignment = 1;
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        const size_t frameBytes = (size_t)channels_p->groupSizes_p[i] * bytesPerSample;
+        if (journaledBytes_p[i] / frameBytes < resumeFrames) {
+            resumeFrames = journaledBytes_p[i] / frameBytes;
+        }
+        if (options_p->outputBackend == OUTPUT_BACKEND_DIRECT && _direct_frame_alignment(frameBytes) > alignment) {
+            alignment = _direct_frame_alignment(frameBytes);
+        }
+    }
+    resumeFrames -= resumeFrames % alignment;
+
+    _reopen_output_files(outputFiles_pp, &plan_p->outputFormat, channels_p, bytesWritten_p, outputPath_p,
+                         resumeFrames, plan_p->totalFrames,
+                         output_backend_data_offset(options_p->outputBackend, plan_p->outputFormat.audio_format),
+                         options_p->largeContainer);
+    if (resumeFrames == plan_p->totalFrames) {
+        printf("Outputs already hold all %" PRIu64 " frames of the session\n", resumeFrames);
+        return false;
+    }
+
+    // find the chunk the first missing frame belongs to
+    session_index_locate(index_p, resumeFrames, firstChunkIndex_p, skipFrames_p);
+
+    printf("Resuming at frame %" PRIu64 " of %" PRIu64 " (chunk %" PRIu64 ")\n", resumeFrames, plan_p->totalFrames,
+           *firstChunkIndex_p);
+    return true;
+}
+
+
+void initialize_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, const char *outputPath_p,
+                             FILE ***outputFiles_pp, uint64_t **bytesWritten_p) {
+    _init_output_files(outputFiles_pp, &plan_p->outputFormat, &options_p->channels, bytesWritten_p, outputPath_p,
+                       plan_p->totalFrames,
+                       output_backend_data_offset(options_p->outputBackend, plan_p->outputFormat.audio_format),
+                       options_p->largeContainer);
+    printf("Created %d output files from %d channels\n", options_p->channels.count, plan_p->format.num_channels);
+}
+
+
+FlacEncoder **initialize_flac_outputs(const SplitOptions *options_p, const SessionPlan *plan_p,
+                                      const char *outputPath_p, FILE ***outputFiles_pp, uint64_t **bytesWritten_p) {
+    const ChannelSelection *channels_p = &options_p->channels;
+    *outputFiles_pp = malloc(channels_p->count * sizeof(FILE *));
+    *bytesWritten_p = calloc(channels_p->count, sizeof(uint64_t));
+    FlacEncoder **encoders_pp = malloc(channels_p->count * sizeof(FlacEncoder *));
+    if (!*outputFiles_pp || !*bytesWritten_p || !encoders_pp) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+
+    for (uint16_t i = 0; i < channels_p->count; i++) {
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels_p, i);
+        char outputFileName[MAX_PATH_LENGTH];
+        snprintf(outputFileName, sizeof(outputFileName), "%s%s%s", outputPath_p, outputName,
+                 output_codec_extension(OUTPUT_CODEC_FLAC));
+        (*outputFiles_pp)[i] = fopen(outputFileName, "wb");
+        if (!(*outputFiles_pp)[i]) {
+            fprintf(stderr, "ERROR: Failed to open output file %s\n", outputFileName);
+            _cleanup(outputFiles_pp, i, bytesWritten_p);
+            exit(1);
+        }
+        encoders_pp[i] = flac_encoder_create((*outputFiles_pp)[i], &plan_p->outputFormat, channels_p->groupSizes_p[i],
+                                             plan_p->totalFrames);
+    }
+    printf("Created %d FLAC output files from %d channels\n", channels_p->count, plan_p->format.num_channels);
+    return encoders_pp;
+}
+
+
+FILE* read_chunk_header(const SplitOptions *options_p, uint64_t chunkIndex, const char *sessionPath_p, WavHeader *inputHeader,
+                        FILE ***outputFiles_pp, uint64_t **bytesWritten_p) {
     // build file path
     char inputFilePath[MAX_PATH_LENGTH];
-    sprintf(inputFilePath, "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
-    inputFilePath[MAX_PATH_LENGTH - 1] = '\0';
+    _build_chunk_path(inputFilePath, sessionPath_p, chunkIndex);
 
     printf("Processing input file: %s\n", inputFilePath);
+    run_stats_begin_chunk(options_p->stats_p, chunkIndex);
+    const double headerStart = run_stats_now(options_p->stats_p);
 
     // open file
     FILE *inputFile_p = fopen(inputFilePath, "rb");
     if (!inputFile_p) {
         fprintf(stderr, "ERROR: Failed to open input file\n");
-        _cleanup(outputFiles_pp, inputHeader->num_channels, bytesWritten_p);
+        _cleanup(outputFiles_pp, options_p->channels.count, bytesWritten_p);
         exit(-1);
     }
 
@@ -85,83 +310,460 @@ FILE* read_chunk_header(uint64_t chunkIndex, const char *sessionPath_p,
     if (read_header(inputFile_p, inputHeader) != 0) {
         fprintf(stderr, "ERROR: Failed to read WAV header\n");
         fclose(inputFile_p);
-        _cleanup(outputFiles_pp, inputHeader->num_channels, bytesWritten_p);
+        _cleanup(outputFiles_pp, options_p->channels.count, bytesWritten_p);
         exit(1);
     }
 
-    // initialize output files on first chunk
-    if (chunkIndex == 1) {
-        _init_output_files(inputFile_p, outputFiles_pp, inputHeader, bytesWritten_p, outputPath_p);
-        printf("Created output files for %d channels\n", inputHeader->num_channels);
+    // the audio behind the end of a range is never read
+    const SessionRange *range_p = options_p->range_p;
+    if (range_p && chunkIndex == range_p->lastChunk &&
+        inputHeader->data_bytes / inputHeader->block_align > range_p->lastChunkFrames) {
+        inputHeader->data_bytes = (uint32_t)(range_p->lastChunkFrames * inputHeader->block_align);
     }
 
+    session_checksums_begin_input(options_p->checksums_p, chunkIndex);
+    run_stats_add(options_p->stats_p, chunkIndex, RUN_STAGE_HEADER, headerStart, 0);
     return inputFile_p;
 }
 
 
-void extract_audio_from_chunk(FILE *inputFile_p, const WavHeader *inputHeader,
-                             uint8_t **writeBuffers_pp, size_t *bufferFillBytes_p,
-                             size_t bufferSizeBytes, FILE **outputFiles_pp,
-                             uint32_t *bytesWritten_p) {
-    // prepare buffer for reading interleaved audio
-    const size_t read_buffer_size = inputHeader->block_align;
-    uint8_t *read_buffer_p = malloc(read_buffer_size);
-    if (!read_buffer_p) {
+void extract_audio_from_chunk(const SplitOptions *options_p, FILE *inputFile_p, const WavHeader *inputHeader,
+                             OutputWriter *writer_p, OutputBuffer **writeBuffers_pp) {
+    const uint16_t outputCount = options_p->channels.count;
+    const uint16_t bytesPerSample = inputHeader->bits_per_sample / 8;
+    const size_t blockAlign = inputHeader->block_align;
+    const uint16_t *groupSizes_p = options_p->channels.groupSizes_p;
+    RunStats *stats_p = options_p->stats_p;
+    const uint64_t chunkIndex = run_stats_current_chunk(stats_p);
+
+    // prepare buffer for reading whole blocks of interleaved frames (unused when mapped)
+    size_t framesPerRead = READ_BLOCK_SIZE_BYTES / blockAlign;
+    if (framesPerRead == 0) {
+        framesPerRead = 1;
+    }
+    uint8_t *read_buffer_p = NULL;
+    if (options_p->inputBackend == INPUT_BACKEND_STDIO) {
+        read_buffer_p = malloc(framesPerRead * blockAlign);
+    }
+    uint8_t **channelTargets_pp = malloc(outputCount * sizeof(uint8_t *));
+    if ((options_p->inputBackend == INPUT_BACKEND_STDIO && !read_buffer_p) || !channelTargets_pp) {
         fprintf(stderr, "ERROR: Failed to allocate read buffer\n");
         exit(1);
     }
 
-    // extract audio sample by sample
-    const uint16_t bytesPerSample = inputHeader->bits_per_sample / 8;
-    while (fread(read_buffer_p, read_buffer_size, 1, inputFile_p) == 1) {
-        for (int i = 0; i < inputHeader->num_channels; i++) {
-            // copy sample to channel buffer
-            memcpy(writeBuffers_pp[i] + bufferFillBytes_p[i], 
-                   read_buffer_p + i * bytesPerSample, 
-                   bytesPerSample);
-            bufferFillBytes_p[i] += bytesPerSample;
-
-            // if buffer is full, write to file
-            if (bufferFillBytes_p[i] >= bufferSizeBytes) {
-                if (fwrite(writeBuffers_pp[i], bufferFillBytes_p[i], 1, outputFiles_pp[i]) != 1) {
-                    fprintf(stderr, "ERROR: Writing data to channel %d\n", i + 1);
-                    free(read_buffer_p);
-                    exit(1);
-                }
-                bytesWritten_p[i] += bufferFillBytes_p[i];
-                bufferFillBytes_p[i] = 0;
+    // converted outputs are deinterleaved into a staging area and converted from there
+    SampleConverter *converter_p = options_p->converter_p;
+    const uint16_t outputBytesPerSample = converter_p ? converter_p->outputBytes : bytesPerSample;
+    uint8_t *staging_p = NULL;
+    if (converter_p) {
+        size_t stagingFrames;
+        staging_p = sample_converter_staging(converter_p, groupSizes_p, outputCount, channelTargets_pp,
+                                             &stagingFrames);
+        if (!staging_p) {
+            fprintf(stderr, "ERROR: Failed to allocate conversion staging buffer\n");
+            exit(1);
+        }
+        if (framesPerRead > stagingFrames) {
+            framesPerRead = stagingFrames;
+        }
+    }
+
+    InputSource source;
+    if (input_source_open(&source, inputFile_p, inputHeader, options_p->inputBackend, options_p->cache_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to open audio data of input file\n");
+        exit(1);
+    }
+    input_source_set_checksum(&source, session_checksums_current_input(options_p->checksums_p));
+
+    Deinterleaver deinterleaver;
+    deinterleaver_init_regroup(&deinterleaver, inputHeader->num_channels, bytesPerSample,
+                               options_p->channels.channels_p, groupSizes_p, outputCount, true);
+
+    // extract audio block by block, never reading past the data chunk
+    while (1) {
+        // all outputs advance by the same number of frames, the fullest buffer limits the block
+        size_t framesToRead = framesPerRead;
+        for (uint16_t i = 0; i < outputCount; i++) {
+            const size_t frameBytes = (size_t)groupSizes_p[i] * outputBytesPerSample;
+            const size_t framesLeft = (output_writer_buffer_capacity(writer_p, i) - writeBuffers_pp[i]->fillBytes) /
+                                      frameBytes;
+            if (framesToRead > framesLeft) {
+                framesToRead = framesLeft;
+            }
+        }
+
+        const uint8_t *frames_p = NULL;
+        const double readStart = run_stats_now(stats_p);
+        size_t framesRead = input_source_next(&source, read_buffer_p, framesToRead, &frames_p);
+        if (framesRead == 0) {
+            break;
+        }
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_READ, readStart, framesRead * blockAlign);
+
+        const double deinterleaveStart = run_stats_now(stats_p);
+        for (int i = 0; i < outputCount && !converter_p; i++) {
+            channelTargets_pp[i] = writeBuffers_pp[i]->data_p + writeBuffers_pp[i]->fillBytes;
+        }
+        deinterleaver_run(&deinterleaver, frames_p, framesRead, channelTargets_pp);
+        if (options_p->analysis_p) {
+            // the deinterleaved samples are still in the cache
+            for (uint16_t i = 0; i < outputCount; i++) {
+                signal_analysis_run(options_p->analysis_p, i, channelTargets_pp[i], framesRead);
+            }
+        }
+        for (uint16_t i = 0; i < outputCount && options_p->peaks_p; i++) {
+            peak_overview_run(options_p->peaks_p, i, channelTargets_pp[i], framesRead);
+        }
+        for (uint16_t i = 0; i < outputCount && converter_p; i++) {
+            sample_converter_run(converter_p, i, channelTargets_pp[i],
+                                 writeBuffers_pp[i]->data_p + writeBuffers_pp[i]->fillBytes,
+                                 framesRead * groupSizes_p[i]);
+        }
+        for (uint16_t i = 0; i < outputCount && options_p->checksums_p; i++) {
+            // hashed as written, after any conversion
+            checksum_update(&options_p->checksums_p->outputs_p[i],
+                            writeBuffers_pp[i]->data_p + writeBuffers_pp[i]->fillBytes,
+                            framesRead * groupSizes_p[i] * outputBytesPerSample);
+        }
+        run_stats_add(stats_p, chunkIndex, RUN_STAGE_DEINTERLEAVE, deinterleaveStart, 0);
+
+        for (uint16_t i = 0; i < outputCount; i++) {
+            writeBuffers_pp[i]->fillBytes += framesRead * groupSizes_p[i] * outputBytesPerSample;
+
+            // if buffer is full, hand it to the writer and continue in a fresh one
+            if (writeBuffers_pp[i]->fillBytes >= output_writer_buffer_capacity(writer_p, i)) {
+                const size_t filledBytes = writeBuffers_pp[i]->fillBytes;
+                const double writeStart = run_stats_now(stats_p);
+                signal_analysis_prepare_submit(options_p->analysis_p, writeBuffers_pp[i]);
+                output_writer_submit(writer_p, writeBuffers_pp[i]);
+                run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE, writeStart, filledBytes);
+
+                const double waitStart = run_stats_now(stats_p);
+                writeBuffers_pp[i] = output_writer_acquire(writer_p, i);
+                run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE_WAIT, waitStart, 0);
             }
         }
     }
 
+    input_source_close(&source);
     free(read_buffer_p);
+    free(staging_p);
+    free(channelTargets_pp);
 }
 
 
-void flush_remaining_buffers(const WavHeader *inputHeader, uint8_t **writeBuffers_pp,
-                            size_t *bufferFillBytes_p, FILE **outputFiles_pp,
-                            uint32_t *bytesWritten_p) {
-    for (int i = 0; i < inputHeader->num_channels; i++) {
-        if (bufferFillBytes_p[i] > 0) {
-            if (fwrite(writeBuffers_pp[i], bufferFillBytes_p[i], 1, outputFiles_pp[i]) != 1) {
-                fprintf(stderr, "ERROR: Writing remaining data to channel %d\n", i + 1);
-                exit(1);
+void flush_remaining_buffers(const SplitOptions *options_p, OutputWriter *writer_p,
+                            OutputBuffer **writeBuffers_pp) {
+    RunStats *stats_p = options_p->stats_p;
+    const uint64_t chunkIndex = run_stats_current_chunk(stats_p);
+    if (writeBuffers_pp) {
+        for (uint16_t i = 0; i < options_p->channels.count; i++) {
+            const size_t filledBytes = writeBuffers_pp[i]->fillBytes;
+            if (filledBytes > 0) {
+                const double writeStart = run_stats_now(stats_p);
+                signal_analysis_prepare_submit(options_p->analysis_p, writeBuffers_pp[i]);
+                output_writer_submit(writer_p, writeBuffers_pp[i]);
+                run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE, writeStart, filledBytes);
+            } else {
+                output_writer_release(writer_p, writeBuffers_pp[i]);
             }
-            bytesWritten_p[i] += bufferFillBytes_p[i];
         }
-        free(writeBuffers_pp[i]);
+        free(writeBuffers_pp);
+    }
+
+    // wait for asynchronous writes before the headers are rewritten
+    const double waitStart = run_stats_now(stats_p);
+    output_writer_finish(writer_p);
+    run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE_WAIT, waitStart, 0);
+    output_writer_destroy(writer_p);
+}
+
+
+void checkpoint_output_files(const SplitOptions *options_p, const SessionPlan *plan_p, OutputWriter *writer_p,
+                             OutputBuffer **writeBuffers_pp, FILE **outputFiles_pp, uint64_t *bytesWritten_p) {
+    RunStats *stats_p = options_p->stats_p;
+    const uint64_t chunkIndex = run_stats_current_chunk(stats_p);
+
+    // hand out partially filled buffers so the outputs hold every frame processed so far
+    for (uint16_t i = 0; i < options_p->channels.count; i++) {
+        const size_t filledBytes = writeBuffers_pp[i]->fillBytes;
+        if (filledBytes > 0) {
+            const double writeStart = run_stats_now(stats_p);
+            signal_analysis_prepare_submit(options_p->analysis_p, writeBuffers_pp[i]);
+            output_writer_submit(writer_p, writeBuffers_pp[i]);
+            run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE, writeStart, filledBytes);
+            writeBuffers_pp[i] = output_writer_acquire(writer_p, i);
+        }
     }
+    const double waitStart = run_stats_now(stats_p);
+    output_writer_drain(writer_p);
+    run_stats_add(stats_p, chunkIndex, RUN_STAGE_WRITE_WAIT, waitStart, 0);
 
-    free(writeBuffers_pp);
-    free(bufferFillBytes_p);
+    _update_headers(&plan_p->outputFormat, &options_p->channels, bytesWritten_p, outputFiles_pp,
+                    output_backend_data_offset(options_p->outputBackend, plan_p->outputFormat.audio_format),
+                    options_p->largeContainer);
 }
 
 
-void finalize_output_files(const WavHeader *inputHeader, uint32_t **bytesWritten_p,
-                          FILE ***outputFiles_pp) {
-    if (*outputFiles_pp) {
-        _rewrite_headers(inputHeader, bytesWritten_p, outputFiles_pp);
-        _cleanup(outputFiles_pp, inputHeader->num_channels, bytesWritten_p);
+/**
+ * Complete the FLAC streams and report how well they compressed
+ */
+static void _finish_flac_outputs(const SplitOptions *options_p) {
+    FlacEncoderStats total = {0, 0, 0.0};
+    for (uint16_t i = 0; i < options_p->channels.count; i++) {
+        if (flac_encoder_finish(options_p->encoders_pp[i]) != 0) {
+            exit(1);
+        }
+        FlacEncoderStats stats;
+        flac_encoder_stats(options_p->encoders_pp[i], &stats);
+        total.inputBytes += stats.inputBytes;
+        total.outputBytes += stats.outputBytes;
+        total.encodeSeconds += stats.encodeSeconds;
+        flac_encoder_destroy(options_p->encoders_pp[i]);
+    }
+    free(options_p->encoders_pp);
+
+    const double inputMB = total.inputBytes / (1024.0 * 1024.0);
+    printf("FLAC: %.2f MB of audio compressed to %.2f MB (%.1f %%), encoding at %.2f MB/s per thread\n",
+           inputMB, total.outputBytes / (1024.0 * 1024.0),
+           total.inputBytes > 0 ? 100.0 * total.outputBytes / total.inputBytes : 0.0,
+           total.encodeSeconds > 0.0 ? inputMB / total.encodeSeconds : 0.0);
+    run_stats_set_compression(options_p->stats_p, "flac", total.inputBytes, total.outputBytes, total.encodeSeconds);
+}
+
+
+void finalize_output_files(const SplitOptions *options_p, const SessionPlan *plan_p,
+                          uint64_t **bytesWritten_p, FILE ***outputFiles_pp) {
+    if (*outputFiles_pp && options_p->encoders_pp) {
+        _finish_flac_outputs(options_p);
+        _cleanup(outputFiles_pp, options_p->channels.count, bytesWritten_p);
+    } else if (*outputFiles_pp) {
+        _rewrite_headers(&plan_p->outputFormat, &options_p->channels, bytesWritten_p, outputFiles_pp,
+                         plan_p->totalFrames,
+                         output_backend_data_offset(options_p->outputBackend, plan_p->outputFormat.audio_format),
+                         options_p->largeContainer);
+        _cleanup(outputFiles_pp, options_p->channels.count, bytesWritten_p);
+    }
+    printf("Output files finalized and closed.\n");
+}
+
+
+void skip_chunk_frames(FILE *inputFile_p, WavHeader *inputHeader, uint64_t skipFrames) {
+    const uint64_t skipBytes = skipFrames * inputHeader->block_align;
+#ifdef WIN32
+    const int result = _fseeki64(inputFile_p, (__int64)skipBytes, SEEK_CUR);
+#else
+    const int result = fseeko(inputFile_p, (off_t)skipBytes, SEEK_CUR);
+#endif
+    if (result != 0) {
+        fprintf(stderr, "ERROR: Failed to seek to the resume position\n");
+        exit(1);
+    }
+    inputHeader->data_bytes = inputHeader->data_bytes > skipBytes ? inputHeader->data_bytes - skipBytes : 0;
+}
+
+
+void split_session(const SplitOptions *options_p, const char *sessionPath_p) {
+    // the selection is resolved against this session only
+    SplitOptions options = *options_p;
+
+    // a missing or mismatching chunk is reported before anything is created
+    SessionIndex index;
+    const double planStart = run_stats_now(options.stats_p);
+    if (session_index_build(&index, sessionPath_p) != 0) {
+        exit(1);
+    }
+    run_stats_add(options.stats_p, 0, RUN_STAGE_HEADER, planStart, 0);
+    uint64_t maxChunkIndex = index.chunkCount;
+
+    // a range only opens the chunks holding it
+    SessionRange range;
+    if (options.start.set || options.end.set) {
+        if (session_index_range(&index, &options.start, &options.end, &range) != 0) {
+            exit(1);
+        }
+        options.range_p = &range;
+        maxChunkIndex = range.lastChunk;
+    }
+
+    // a selection or output format the session cannot satisfy is reported before the output folder is created
+    SessionPlan plan;
+    plan_session(&index, options.range_p, &plan);
+    char message[CHANNEL_SELECTION_MESSAGE_LENGTH];
+    if (channel_selection_resolve(&options.channels, plan.format.num_channels, message, sizeof(message)) != 0) {
+        fprintf(stderr, "ERROR: %s\n", message);
+        exit(1);
+    }
+    plan_output_format(&options, &plan);
+
+    char *outputPath_p = NULL;
+    bool resume = false;
+    initialize_session(sessionPath_p, &outputPath_p, &resume);
+
+    // size all outputs up front and create them with their final headers
+    FILE **outputFiles_pp = NULL;
+    uint64_t *bytesWritten_p = NULL;
+    if (options.outputCodec == OUTPUT_CODEC_FLAC && resume) {
+        fprintf(stderr, "ERROR: %s holds the outputs of an interrupted run, FLAC outputs cannot be resumed\n",
+                outputPath_p);
+        exit(1);
+    }
+    if (options.range_p && resume) {
+        fprintf(stderr, "ERROR: %s holds the outputs of an interrupted run, a range cannot be split into it\n",
+                outputPath_p);
+        exit(1);
+    }
+
+    // levels of a resumed session would only cover the frames of this run
+    SignalAnalysis analysis;
+    if (options.analysisMode != ANALYSIS_OFF && resume) {
+        fprintf(stderr, "Warning: Resuming %s, skipping the channel analysis\n", sessionPath_p);
+    } else if (options.analysisMode != ANALYSIS_OFF) {
+        signal_analysis_init(&analysis, &options.channels, plan.format.bits_per_sample, options.analysisMode);
+        options.analysis_p = &analysis;
+    }
+    PeakOverview peaks;
+    if (options.peakLevels.count > 0 && resume) {
+        fprintf(stderr, "Warning: Resuming %s, skipping the peak overviews\n", sessionPath_p);
+    } else if (options.peakLevels.count > 0) {
+        peak_overview_init(&peaks, &options.peakLevels, &options.channels, &plan.format, outputPath_p);
+        options.peaks_p = &peaks;
+    }
+    SessionChecksums checksums;
+    if (options.checksumMode != CHECKSUM_OFF && resume) {
+        fprintf(stderr, "Warning: Resuming %s, skipping the checksums\n", sessionPath_p);
+    } else if (options.checksumMode != CHECKSUM_OFF) {
+        session_checksums_init(&checksums, options.range_p ? range.firstChunk : 1, maxChunkIndex,
+                               options.channels.count);
+        options.checksums_p = &checksums;
+    }
+
+    SessionJournal journal;
+    journal_init(&journal, outputPath_p, &options, &plan.format, &plan.outputFormat);
+    uint64_t firstChunkIndex = options.range_p ? range.firstChunk : 1;
+    uint64_t skipFrames = options.range_p ? range.firstChunkSkip : 0;
+    if (resume) {
+        // continue behind what the journal recorded, e.g. after a crash or when chunks were added
+        uint64_t *journaledBytes_p = malloc(options.channels.count * sizeof(uint64_t));
+        if (!journaledBytes_p || journal_load(&journal, journaledBytes_p) != 0) {
+            exit(1);
+        }
+        const bool framesLeft = resume_output_files(&options, &plan, journaledBytes_p, &index, outputPath_p,
+                                                    &outputFiles_pp, &bytesWritten_p, &firstChunkIndex, &skipFrames);
+        free(journaledBytes_p);
+        if (!framesLeft) {
+            finalize_output_files(&options, &plan, &bytesWritten_p, &outputFiles_pp);
+            journal_free(&journal);
+            session_index_free(&index);
+            if (options_p->channels.count == 0) {
+                channel_selection_free(&options.channels);
+            }
+            free(outputPath_p);
+            return;
+        }
+    } else if (options.outputCodec == OUTPUT_CODEC_FLAC) {
+        options.encoders_pp = initialize_flac_outputs(&options, &plan, outputPath_p, &outputFiles_pp,
+                                                      &bytesWritten_p);
+    } else {
+        initialize_output_files(&options, &plan, outputPath_p, &outputFiles_pp, &bytesWritten_p);
+
+        // from here on a crashed run can be resumed
+        journal_commit(&journal, outputFiles_pp, bytesWritten_p, 0);
+    }
+
+    PageCache cache;
+    if (options.cachePolicy == CACHE_POLICY_DROP) {
+        page_cache_init(&cache, options.dirtyLimitMB, options.channels.count);
+        options.cache_p = &cache;
+    }
+
+    // prepare processing state from the first chunk
+    WavHeader inputHeader;
+    OutputBuffer **writeBuffers_pp = NULL;
+    FILE *inputFile_p = read_chunk_header(&options, firstChunkIndex, sessionPath_p, &inputHeader,
+                                          &outputFiles_pp, &bytesWritten_p);
+    skip_chunk_frames(inputFile_p, &inputHeader, skipFrames);
+
+    // frames the journal already accounts for are not read again
+    uint64_t resumedFrames = 0;
+    if (resume) {
+        resumedFrames = bytesWritten_p[0] /
+                        ((size_t)options.channels.groupSizes_p[0] * (plan.outputFormat.bits_per_sample / 8));
+    }
+
+    // the dither of converted samples continues behind the audio the outputs already hold
+    SampleConverter converter;
+    if (sample_format_converts(&plan.format, &plan.outputFormat)) {
+        if (sample_converter_init(&converter, &plan.format, &plan.outputFormat, options.channels.count,
+                                  bytesWritten_p) != 0) {
+            fprintf(stderr, "ERROR: Failed to allocate sample converter\n");
+            exit(1);
+        }
+        options.converter_p = &converter;
+        printf("Converting samples to %s (%s)\n", sample_format_name(options.sampleFormat), converter.kernelName_p);
+    }
+    run_stats_begin_session(options.stats_p, sessionPath_p, &plan.format, options.channels.count,
+                            (plan.totalFrames - resumedFrames) * plan.format.block_align);
+    OutputWriter *writer_p = initialize_output_writer(&options, &plan.outputFormat, outputFiles_pp, bytesWritten_p);
+
+    if (options.jobs > 1) {
+        // overlap reading, deinterleaving and writing on multiple threads
+        run_pipeline(&options, inputFile_p, &inputHeader, firstChunkIndex, maxChunkIndex, sessionPath_p,
+                     writer_p, &outputFiles_pp, &bytesWritten_p, &journal);
+    } else {
+        initialize_buffers(&options, writer_p, &writeBuffers_pp);
+
+        for (uint64_t chunkIndex = firstChunkIndex; chunkIndex <= maxChunkIndex; chunkIndex++) {
+            // read chunk header (the first chunk is already open)
+            if (chunkIndex > firstChunkIndex) {
+                inputFile_p = read_chunk_header(&options, chunkIndex, sessionPath_p, &inputHeader,
+                                                &outputFiles_pp, &bytesWritten_p);
+            }
+
+            extract_audio_from_chunk(&options, inputFile_p, &inputHeader, writer_p, writeBuffers_pp);
+
+            fclose(inputFile_p);
+            journal_checkpoint(&journal, writer_p, chunkIndex);
+        }
+    }
+
+    flush_remaining_buffers(&options, writer_p, writeBuffers_pp);
+    journal_commit(&journal, outputFiles_pp, bytesWritten_p, maxChunkIndex);
+
+    finalize_output_files(&options, &plan, &bytesWritten_p, &outputFiles_pp);
+    if (options.peaks_p) {
+        if (peak_overview_finish(options.peaks_p) != 0) {
+            exit(1);
+        }
+        peak_overview_free(options.peaks_p);
+    }
+    if (options.analysis_p) {
+        // renamed or removed outputs no longer match the journal
+        const char *extension_p = output_codec_extension(options.outputCodec);
+        if (signal_analysis_finish(options.analysis_p, outputPath_p, extension_p) > 0) {
+            journal_discard(&journal);
+        }
+        signal_analysis_free(options.analysis_p);
+    }
+    if (options.checksums_p) {
+        if (session_checksums_write(options.checksums_p, &options.channels, outputPath_p) != 0) {
+            exit(1);
+        }
+        session_checksums_free(options.checksums_p);
+    }
+    if (options.cache_p) {
+        page_cache_report(options.cache_p, options.stats_p);
+        page_cache_free(options.cache_p);
+    }
+    if (options.converter_p) {
+        sample_converter_free(options.converter_p);
+    }
+    journal_free(&journal);
+    session_index_free(&index);
+
+    // a selection given by the caller stays with the caller
+    if (options_p->channels.count == 0) {
+        channel_selection_free(&options.channels);
     }
-    printf("Header rewriting completed and files closed.\n");
+    free(outputPath_p);
 }
@@ -0,0 +1,396 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "run-stats.h"
+#include "utils.h"
+
+static const char *const STAGE_NAMES[RUN_STAGE_COUNT] = {
+    "header", "read", "deinterleave", "write", "write_wait", "read_wait"
+};
+
+typedef struct {
+    bool started;                         // Chunk was opened in this run
+    double startSeconds;                  // Chunk opened, relative to the start of the run
+    double endSeconds;                    // Last work on the chunk finished
+    double stageSeconds[RUN_STAGE_COUNT]; // Time per stage
+    uint64_t inputBytes;                  // Audio bytes read from the chunk
+    uint64_t outputBytes;                 // Bytes handed to the outputs for the chunk
+} ChunkStats;
+
+struct RunStats {
+    pthread_mutex_t lock;
+    double startSeconds;
+    double endSeconds;
+    double progressInterval;
+    double lastProgress;
+
+    // configuration and session
+    size_t bufferSizeMB;
+    unsigned int jobs;
+    const char *inputBackend_p;
+    const char *outputBackend_p;
+    char *sessionPath_p;
+    WavHeader format;
+    uint16_t outputCount;
+    uint64_t expectedInputBytes;
+    unsigned int stageThreads[RUN_STAGE_COUNT];
+
+    // totals
+    double stageSeconds[RUN_STAGE_COUNT];
+    uint64_t inputBytes;
+    uint64_t outputBytes;
+
+    // encoded outputs (no codec for PCM outputs)
+    const char *codec_p;
+    uint64_t codecInputBytes;
+    uint64_t codecOutputBytes;
+    double encodeSeconds;
+
+    // page cache policy (no dirty limit when the cache is left to the kernel)
+    uint64_t dirtyLimitBytes;
+    uint64_t inputDroppedBytes;
+    uint64_t writtenBackBytes;
+    double writebackWaitSeconds;
+
+    // per chunk, indexed by chunk index - 1
+    ChunkStats *chunks_p;
+    uint64_t chunkCapacity;
+    uint64_t currentChunk;
+};
+
+
+RunStats *run_stats_create(double progressInterval) {
+    RunStats *stats_p = calloc(1, sizeof(RunStats));
+    if (!stats_p) {
+        fprintf(stderr, "ERROR: Failed to allocate run statistics\n");
+        exit(1);
+    }
+    pthread_mutex_init(&stats_p->lock, NULL);
+    stats_p->startSeconds = _monotonic_seconds();
+    stats_p->lastProgress = stats_p->startSeconds;
+    stats_p->progressInterval = progressInterval;
+    run_stats_set_threads(stats_p, 1, 1, 1);
+    return stats_p;
+}
+
+
+void run_stats_set_config(RunStats *stats_p, size_t bufferSizeMB, unsigned int jobs, const char *inputBackend_p,
+                          const char *outputBackend_p) {
+    if (!stats_p) {
+        return;
+    }
+    stats_p->bufferSizeMB = bufferSizeMB;
+    stats_p->jobs = jobs;
+    stats_p->inputBackend_p = inputBackend_p;
+    stats_p->outputBackend_p = outputBackend_p;
+}
+
+
+void run_stats_begin_session(RunStats *stats_p, const char *sessionPath_p, const WavHeader *format_p,
+                             uint16_t outputCount, uint64_t expectedInputBytes) {
+    if (!stats_p) {
+        return;
+    }
+    free(stats_p->sessionPath_p);
+    stats_p->sessionPath_p = malloc(strlen(sessionPath_p) + 1);
+    if (!stats_p->sessionPath_p) {
+        fprintf(stderr, "ERROR: Failed to allocate run statistics\n");
+        exit(1);
+    }
+    strcpy(stats_p->sessionPath_p, sessionPath_p);
+    stats_p->format = *format_p;
+    stats_p->outputCount = outputCount;
+    stats_p->expectedInputBytes = expectedInputBytes;
+}
+
+
+void run_stats_set_threads(RunStats *stats_p, unsigned int readers, unsigned int workers, unsigned int writers) {
+    if (!stats_p) {
+        return;
+    }
+    stats_p->stageThreads[RUN_STAGE_HEADER] = readers;
+    stats_p->stageThreads[RUN_STAGE_READ] = readers;
+    stats_p->stageThreads[RUN_STAGE_DEINTERLEAVE] = workers;
+    stats_p->stageThreads[RUN_STAGE_WRITE] = writers;
+    stats_p->stageThreads[RUN_STAGE_WRITE_WAIT] = workers;
+    stats_p->stageThreads[RUN_STAGE_READ_WAIT] = workers;
+}
+
+
+/**
+ * Statistics of a chunk, growing the table as needed (caller holds the lock)
+ */
+static ChunkStats *_chunk_stats(RunStats *stats_p, uint64_t chunkIndex) {
+    if (chunkIndex > stats_p->chunkCapacity) {
+        uint64_t capacity = stats_p->chunkCapacity ? stats_p->chunkCapacity : 16;
+        while (capacity < chunkIndex) {
+            capacity *= 2;
+        }
+        ChunkStats *chunks_p = realloc(stats_p->chunks_p, capacity * sizeof(ChunkStats));
+        if (!chunks_p) {
+            fprintf(stderr, "ERROR: Failed to allocate run statistics\n");
+            exit(1);
+        }
+        memset(chunks_p + stats_p->chunkCapacity, 0, (capacity - stats_p->chunkCapacity) * sizeof(ChunkStats));
+        stats_p->chunks_p = chunks_p;
+        stats_p->chunkCapacity = capacity;
+    }
+    return &stats_p->chunks_p[chunkIndex - 1];
+}
+
+
+void run_stats_begin_chunk(RunStats *stats_p, uint64_t chunkIndex) {
+    if (!stats_p) {
+        return;
+    }
+    pthread_mutex_lock(&stats_p->lock);
+    ChunkStats *chunk_p = _chunk_stats(stats_p, chunkIndex);
+    chunk_p->started = true;
+    chunk_p->startSeconds = _monotonic_seconds() - stats_p->startSeconds;
+    chunk_p->endSeconds = chunk_p->startSeconds;
+    stats_p->currentChunk = chunkIndex;
+    pthread_mutex_unlock(&stats_p->lock);
+}
+
+
+uint64_t run_stats_current_chunk(const RunStats *stats_p) {
+    return stats_p ? stats_p->currentChunk : 0;
+}
+
+
+double run_stats_now(const RunStats *stats_p) {
+    return stats_p ? _monotonic_seconds() : 0.0;
+}
+
+
+/**
+ * Print a progress line if the interval passed (caller holds the lock)
+ */
+static void _print_progress(RunStats *stats_p, double now) {
+    if (stats_p->progressInterval <= 0.0 || now - stats_p->lastProgress < stats_p->progressInterval) {
+        return;
+    }
+    stats_p->lastProgress = now;
+
+    const double elapsed = now - stats_p->startSeconds;
+    const double inputMB = stats_p->inputBytes / (1024.0 * 1024.0);
+    const double rate = elapsed > 0.0 ? inputMB / elapsed : 0.0;
+    if (stats_p->expectedInputBytes == 0) {
+        fprintf(stderr, "Progress: chunk %" PRIu64 ", %.1f MB read, %.1f MB/s\n", stats_p->currentChunk, inputMB,
+                rate);
+        return;
+    }
+
+    const double expectedMB = stats_p->expectedInputBytes / (1024.0 * 1024.0);
+    const double remaining = rate > 0.0 && expectedMB > inputMB ? (expectedMB - inputMB) / rate : 0.0;
+    const unsigned int etaSeconds = (unsigned int)(remaining + 0.5);
+    fprintf(stderr, "Progress: chunk %" PRIu64 ", %.1f of %.1f MB (%.1f%%), %.1f MB/s, ETA %u:%02u\n",
+            stats_p->currentChunk, inputMB, expectedMB, 100.0 * inputMB / expectedMB, rate, etaSeconds / 60,
+            etaSeconds % 60);
+}
+
+
+void run_stats_add(RunStats *stats_p, uint64_t chunkIndex, RunStage stage, double startSeconds, uint64_t bytes) {
+    if (!stats_p) {
+        return;
+    }
+    const double now = _monotonic_seconds();
+    const double seconds = now - startSeconds;
+
+    pthread_mutex_lock(&stats_p->lock);
+    stats_p->stageSeconds[stage] += seconds;
+    if (stage == RUN_STAGE_READ) {
+        stats_p->inputBytes += bytes;
+    } else if (stage == RUN_STAGE_WRITE) {
+        stats_p->outputBytes += bytes;
+    }
+
+    if (chunkIndex > 0) {
+        ChunkStats *chunk_p = _chunk_stats(stats_p, chunkIndex);
+        chunk_p->stageSeconds[stage] += seconds;
+        if (stage == RUN_STAGE_READ) {
+            chunk_p->inputBytes += bytes;
+        } else if (stage == RUN_STAGE_WRITE) {
+            chunk_p->outputBytes += bytes;
+        }
+        if (now - stats_p->startSeconds > chunk_p->endSeconds) {
+            chunk_p->endSeconds = now - stats_p->startSeconds;
+        }
+    }
+
+    if (stage == RUN_STAGE_READ) {
+        _print_progress(stats_p, now);
+    }
+    pthread_mutex_unlock(&stats_p->lock);
+}
+
+
+void run_stats_set_compression(RunStats *stats_p, const char *codec_p, uint64_t inputBytes, uint64_t outputBytes,
+                               double encodeSeconds) {
+    if (!stats_p) {
+        return;
+    }
+    stats_p->codec_p = codec_p;
+    stats_p->codecInputBytes = inputBytes;
+    stats_p->codecOutputBytes = outputBytes;
+    stats_p->encodeSeconds = encodeSeconds;
+}
+
+
+void run_stats_set_page_cache(RunStats *stats_p, uint64_t dirtyLimitBytes, uint64_t inputDroppedBytes,
+                              uint64_t writtenBackBytes, double writebackWaitSeconds) {
+    if (!stats_p) {
+        return;
+    }
+    stats_p->dirtyLimitBytes = dirtyLimitBytes;
+    stats_p->inputDroppedBytes = inputDroppedBytes;
+    stats_p->writtenBackBytes = writtenBackBytes;
+    stats_p->writebackWaitSeconds = writebackWaitSeconds;
+}
+
+
+void run_stats_finish(RunStats *stats_p) {
+    if (stats_p) {
+        stats_p->endSeconds = _monotonic_seconds();
+    }
+}
+
+
+/**
+ * Write a string as a JSON string literal
+ */
+static void _write_json_string(FILE *file_p, const char *string_p) {
+    fputc('"', file_p);
+    for (const unsigned char *c_p = (const unsigned char *)string_p; *c_p; c_p++) {
+        if (*c_p == '"' || *c_p == '\\') {
+            fprintf(file_p, "\\%c", *c_p);
+        } else if (*c_p < 0x20) {
+            fprintf(file_p, "\\u%04x", *c_p);
+        } else {
+            fputc(*c_p, file_p);
+        }
+    }
+    fputc('"', file_p);
+}
+
+
+static void _write_stage_seconds(FILE *file_p, const double *stageSeconds_p) {
+    for (int stage = 0; stage < RUN_STAGE_COUNT; stage++) {
+        fprintf(file_p, "%s\"%s_seconds\": %.6f", stage > 0 ? ", " : "", STAGE_NAMES[stage], stageSeconds_p[stage]);
+    }
+}
+
+
+int run_stats_write_report(const RunStats *stats_p, const char *reportPath_p) {
+    FILE *report_p = fopen(reportPath_p, "w");
+    if (!report_p) {
+        fprintf(stderr, "ERROR: Failed to create report %s\n", reportPath_p);
+        return -1;
+    }
+
+    const double endSeconds = stats_p->endSeconds > 0.0 ? stats_p->endSeconds : _monotonic_seconds();
+    const double wallSeconds = endSeconds - stats_p->startSeconds;
+    const double inputMB = stats_p->inputBytes / (1024.0 * 1024.0);
+    const double outputMB = stats_p->outputBytes / (1024.0 * 1024.0);
+    const uint64_t frames = stats_p->format.block_align ? stats_p->inputBytes / stats_p->format.block_align : 0;
+
+    // the busiest stage relative to the threads working on it limits the run
+    double utilization[RUN_STAGE_COUNT];
+    for (int stage = 0; stage < RUN_STAGE_COUNT; stage++) {
+        const unsigned int threads = stats_p->stageThreads[stage] ? stats_p->stageThreads[stage] : 1;
+        utilization[stage] = wallSeconds > 0.0 ? stats_p->stageSeconds[stage] / (threads * wallSeconds) : 0.0;
+    }
+    const double readLoad = utilization[RUN_STAGE_HEADER] + utilization[RUN_STAGE_READ];
+    const double deinterleaveLoad = utilization[RUN_STAGE_DEINTERLEAVE];
+    const double writeLoad = utilization[RUN_STAGE_WRITE] > utilization[RUN_STAGE_WRITE_WAIT]
+                                 ? utilization[RUN_STAGE_WRITE] : utilization[RUN_STAGE_WRITE_WAIT];
+    const char *bound_p = "read";
+    if (deinterleaveLoad > readLoad && deinterleaveLoad >= writeLoad) {
+        bound_p = "deinterleave";
+    } else if (writeLoad > readLoad && writeLoad > deinterleaveLoad) {
+        bound_p = "write";
+    }
+
+    fprintf(report_p, "{\n  \"session\": ");
+    _write_json_string(report_p, stats_p->sessionPath_p ? stats_p->sessionPath_p : "");
+    fprintf(report_p, ",\n  \"config\": {\"buffer_size_mb\": %zu, \"jobs\": %u, \"input_backend\": ",
+            stats_p->bufferSizeMB, stats_p->jobs);
+    _write_json_string(report_p, stats_p->inputBackend_p ? stats_p->inputBackend_p : "");
+    fprintf(report_p, ", \"output_backend\": ");
+    _write_json_string(report_p, stats_p->outputBackend_p ? stats_p->outputBackend_p : "");
+    fprintf(report_p, "},\n");
+    fprintf(report_p, "  \"format\": {\"channels\": %u, \"bits_per_sample\": %u, \"sample_rate\": %u, \"outputs\": %u},\n",
+            stats_p->format.num_channels, stats_p->format.bits_per_sample, stats_p->format.sample_rate,
+            stats_p->outputCount);
+    fprintf(report_p, "  \"wall_seconds\": %.6f,\n", wallSeconds);
+    fprintf(report_p, "  \"frames\": %" PRIu64 ",\n", frames);
+    fprintf(report_p, "  \"input_bytes\": %" PRIu64 ",\n", stats_p->inputBytes);
+    fprintf(report_p, "  \"output_bytes\": %" PRIu64 ",\n", stats_p->outputBytes);
+    fprintf(report_p, "  \"input_mb_per_s\": %.2f,\n", wallSeconds > 0.0 ? inputMB / wallSeconds : 0.0);
+    fprintf(report_p, "  \"output_mb_per_s\": %.2f,\n", wallSeconds > 0.0 ? outputMB / wallSeconds : 0.0);
+    fprintf(report_p, "  \"frames_per_s\": %.0f,\n", wallSeconds > 0.0 ? frames / wallSeconds : 0.0);
+    fprintf(report_p, "  \"peak_memory_mb\": %.2f,\n", _peak_memory_bytes() / (1024.0 * 1024.0));
+    fprintf(report_p, "  \"bound\": \"%s\",\n", bound_p);
+    if (stats_p->codec_p) {
+        const double codecInputMB = stats_p->codecInputBytes / (1024.0 * 1024.0);
+        fprintf(report_p, "  \"compression\": {\"codec\": \"%s\", \"input_bytes\": %" PRIu64 ", \"output_bytes\": %"
+                PRIu64 ", \"ratio\": %.4f, \"encode_seconds\": %.6f, \"encode_mb_per_s\": %.2f},\n",
+                stats_p->codec_p, stats_p->codecInputBytes, stats_p->codecOutputBytes,
+                stats_p->codecInputBytes > 0 ? (double)stats_p->codecOutputBytes / stats_p->codecInputBytes : 0.0,
+                stats_p->encodeSeconds, stats_p->encodeSeconds > 0.0 ? codecInputMB / stats_p->encodeSeconds : 0.0);
+    }
+
+    if (stats_p->dirtyLimitBytes > 0) {
+        fprintf(report_p, "  \"page_cache\": {\"policy\": \"drop\", \"dirty_limit_bytes\": %" PRIu64
+                ", \"input_dropped_bytes\": %" PRIu64 ", \"output_written_back_bytes\": %" PRIu64
+                ", \"writeback_wait_seconds\": %.6f},\n",
+                stats_p->dirtyLimitBytes, stats_p->inputDroppedBytes, stats_p->writtenBackBytes,
+                stats_p->writebackWaitSeconds);
+    }
+
+    fprintf(report_p, "  \"stages\": {\n");
+    for (int stage = 0; stage < RUN_STAGE_COUNT; stage++) {
+        fprintf(report_p, "    \"%s\": {\"seconds\": %.6f, \"threads\": %u, \"utilization\": %.4f}%s\n",
+                STAGE_NAMES[stage], stats_p->stageSeconds[stage], stats_p->stageThreads[stage], utilization[stage],
+                stage + 1 < RUN_STAGE_COUNT ? "," : "");
+    }
+    fprintf(report_p, "  },\n");
+
+    fprintf(report_p, "  \"chunks\": [");
+    bool first = true;
+    for (uint64_t i = 0; i < stats_p->chunkCapacity; i++) {
+        const ChunkStats *chunk_p = &stats_p->chunks_p[i];
+        if (!chunk_p->started) {
+            continue;
+        }
+        fprintf(report_p, "%s\n    {\"index\": %" PRIu64 ", \"start_seconds\": %.6f, \"wall_seconds\": %.6f, "
+                "\"input_bytes\": %" PRIu64 ", \"output_bytes\": %" PRIu64 ", ",
+                first ? "" : ",", i + 1, chunk_p->startSeconds, chunk_p->endSeconds - chunk_p->startSeconds,
+                chunk_p->inputBytes, chunk_p->outputBytes);
+        _write_stage_seconds(report_p, chunk_p->stageSeconds);
+        fprintf(report_p, "}");
+        first = false;
+    }
+    fprintf(report_p, "%s]\n}\n", first ? "" : "\n  ");
+
+    if (fclose(report_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to write report %s\n", reportPath_p);
+        return -1;
+    }
+    return 0;
+}
+
+
+void run_stats_destroy(RunStats *stats_p) {
+    if (!stats_p) {
+        return;
+    }
+    pthread_mutex_destroy(&stats_p->lock);
+    free(stats_p->chunks_p);
+    free(stats_p->sessionPath_p);
+    free(stats_p);
+}
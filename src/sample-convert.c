@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample-convert.h"
+#include "sample-load.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+int sample_format_parse(const char *name_p, SampleFormat *format_p) {
+    if (strcmp(name_p, "s16") == 0) {
+        *format_p = SAMPLE_FORMAT_S16;
+    } else if (strcmp(name_p, "s24") == 0) {
+        *format_p = SAMPLE_FORMAT_S24;
+    } else if (strcmp(name_p, "s32") == 0) {
+        *format_p = SAMPLE_FORMAT_S32;
+    } else if (strcmp(name_p, "f32") == 0) {
+        *format_p = SAMPLE_FORMAT_F32;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+
+const char *sample_format_name(SampleFormat format) {
+    switch (format) {
+        case SAMPLE_FORMAT_S16: return "s16";
+        case SAMPLE_FORMAT_S24: return "s24";
+        case SAMPLE_FORMAT_S32: return "s32";
+        case SAMPLE_FORMAT_F32: return "f32";
+        default:                return "source";
+    }
+}
+
+
+int sample_format_from_wavsplit(WavsplitSampleFormat format, SampleFormat *format_p) {
+    switch (format) {
+        case WAVSPLIT_SAMPLE_SOURCE: *format_p = SAMPLE_FORMAT_SOURCE; return 0;
+        case WAVSPLIT_SAMPLE_S16:    *format_p = SAMPLE_FORMAT_S16;    return 0;
+        case WAVSPLIT_SAMPLE_S24:    *format_p = SAMPLE_FORMAT_S24;    return 0;
+        case WAVSPLIT_SAMPLE_S32:    *format_p = SAMPLE_FORMAT_S32;    return 0;
+        case WAVSPLIT_SAMPLE_F32:    *format_p = SAMPLE_FORMAT_F32;    return 0;
+        default:                     return -1;
+    }
+}
+
+
+WavsplitSampleFormat sample_format_to_wavsplit(SampleFormat format) {
+    switch (format) {
+        case SAMPLE_FORMAT_S16: return WAVSPLIT_SAMPLE_S16;
+        case SAMPLE_FORMAT_S24: return WAVSPLIT_SAMPLE_S24;
+        case SAMPLE_FORMAT_S32: return WAVSPLIT_SAMPLE_S32;
+        case SAMPLE_FORMAT_F32: return WAVSPLIT_SAMPLE_F32;
+        default:                return WAVSPLIT_SAMPLE_SOURCE;
+    }
+}
+
+
+int sample_format_output_header(SampleFormat format, const WavHeader *inputFormat_p, WavHeader *outputFormat_p) {
+    *outputFormat_p = *inputFormat_p;
+    if (format == SAMPLE_FORMAT_SOURCE) {
+        return 0;
+    }
+
+    // extensible headers are taken for integer PCM, their sub format is not read
+    const bool isInteger = inputFormat_p->audio_format == WAV_FORMAT_PCM ||
+                           inputFormat_p->audio_format == WAV_FORMAT_EXTENSIBLE;
+    const uint16_t bits = inputFormat_p->bits_per_sample;
+    if (!isInteger || (bits != 16 && bits != 24 && bits != 32)) {
+        return -1;
+    }
+
+    static const uint16_t formatBits[] = {0, 16, 24, 32, 32};
+    outputFormat_p->bits_per_sample = formatBits[format];
+    outputFormat_p->audio_format = format == SAMPLE_FORMAT_F32 ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+    return 0;
+}
+
+
+bool sample_format_converts(const WavHeader *inputFormat_p, const WavHeader *outputFormat_p) {
+    const bool inputFloat = inputFormat_p->audio_format == WAV_FORMAT_IEEE_FLOAT;
+    const bool outputFloat = outputFormat_p->audio_format == WAV_FORMAT_IEEE_FLOAT;
+    return inputFormat_p->bits_per_sample != outputFormat_p->bits_per_sample || inputFloat != outputFloat;
+}
+
+
+/*
+ * Scalar kernels
+ *
+ * Samples are widened to 32 bit, converted and stored in the output width. Integer
+ * widening shifts the sample into the upper bits, float conversion scales by the full
+ * scale of the session, which is exact for 16 and 24 bit. The SIMD kernels produce
+ * bit-identical results, so the tail of a block may take either path.
+ */
+
+static inline void _store_s16(uint8_t *sample_p, int32_t value) {
+    const int16_t narrow = (int16_t)value;
+    memcpy(sample_p, &narrow, sizeof(narrow));
+}
+
+
+static inline void _store_s24(uint8_t *sample_p, int32_t value) {
+    const uint32_t raw = (uint32_t)value;
+    sample_p[0] = (uint8_t)raw;
+    sample_p[1] = (uint8_t)(raw >> 8);
+    sample_p[2] = (uint8_t)(raw >> 16);
+}
+
+
+static inline void _store_s32(uint8_t *sample_p, int32_t value) {
+    memcpy(sample_p, &value, sizeof(value));
+}
+
+
+/**
+ * Hash a sample position into 32 random bits (lowbias32)
+ */
+static inline uint32_t _dither_hash(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x7FEB352Du;
+    key ^= key >> 15;
+    key *= 0x846CA68Bu;
+    key ^= key >> 16;
+    return key;
+}
+
+
+/**
+ * Triangular noise of one output LSB, the difference of two uniform values of shift bits
+ */
+static inline int32_t _tpdf_noise(uint32_t seed, uint64_t position, unsigned int shift) {
+    const uint32_t hash = _dither_hash((uint32_t)position ^ seed);
+    const uint32_t mask = (1u << shift) - 1;
+    return (int32_t)(hash & mask) - (int32_t)((hash >> 16) & mask);
+}
+
+
+#define DEFINE_WIDEN_KERNEL(NAME, IN_WIDTH, LOAD, OUT_WIDTH, STORE, SHIFT)                      \
+    static void NAME(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,         \
+                     uint64_t position) {                                                       \
+        (void)seed;                                                                             \
+        (void)position;                                                                         \
+        for (size_t i = 0; i < count; i++) {                                                    \
+            const uint32_t value = (uint32_t)LOAD(src_p + i * (IN_WIDTH));                      \
+            STORE(dst_p + i * (OUT_WIDTH), (int32_t)(value << (SHIFT)));                        \
+        }                                                                                       \
+    }
+
+#define DEFINE_DITHER_KERNEL(NAME, IN_WIDTH, LOAD, OUT_WIDTH, STORE, SHIFT)                     \
+    static void NAME(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,         \
+                     uint64_t position) {                                                       \
+        const int64_t minValue = -((int64_t)1 << ((OUT_WIDTH) * 8 - 1));                        \
+        const int64_t maxValue = ((int64_t)1 << ((OUT_WIDTH) * 8 - 1)) - 1;                     \
+        for (size_t i = 0; i < count; i++) {                                                    \
+            const int64_t dithered = (int64_t)LOAD(src_p + i * (IN_WIDTH)) +                    \
+                                     _tpdf_noise(seed, position + i, (SHIFT)) +                 \
+                                     ((int64_t)1 << ((SHIFT) - 1));                             \
+            int64_t value = dithered >> (SHIFT);                                                \
+            value = value < minValue ? minValue : value > maxValue ? maxValue : value;          \
+            STORE(dst_p + i * (OUT_WIDTH), (int32_t)value);                                     \
+        }                                                                                       \
+    }
+
+#define DEFINE_FLOAT_KERNEL(NAME, IN_WIDTH, LOAD, FULL_SCALE)                                   \
+    static void NAME(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,         \
+                     uint64_t position) {                                                       \
+        (void)seed;                                                                             \
+        (void)position;                                                                         \
+        for (size_t i = 0; i < count; i++) {                                                    \
+            const float value = (float)LOAD(src_p + i * (IN_WIDTH)) * (1.0f / (FULL_SCALE));    \
+            memcpy(dst_p + i * 4, &value, sizeof(value));                                       \
+        }                                                                                       \
+    }
+
+DEFINE_WIDEN_KERNEL(_convert_scalar_s16_s24, 2, _load_s16, 3, _store_s24, 8)
+DEFINE_WIDEN_KERNEL(_convert_scalar_s16_s32, 2, _load_s16, 4, _store_s32, 16)
+DEFINE_WIDEN_KERNEL(_convert_scalar_s24_s32, 3, _load_s24, 4, _store_s32, 8)
+
+DEFINE_DITHER_KERNEL(_convert_scalar_s24_s16, 3, _load_s24, 2, _store_s16, 8)
+DEFINE_DITHER_KERNEL(_convert_scalar_s32_s16, 4, _load_s32, 2, _store_s16, 16)
+DEFINE_DITHER_KERNEL(_convert_scalar_s32_s24, 4, _load_s32, 3, _store_s24, 8)
+
+DEFINE_FLOAT_KERNEL(_convert_scalar_s16_f32, 2, _load_s16, 32768.0f)
+DEFINE_FLOAT_KERNEL(_convert_scalar_s24_f32, 3, _load_s24, 8388608.0f)
+DEFINE_FLOAT_KERNEL(_convert_scalar_s32_f32, 4, _load_s32, 2147483648.0f)
+
+
+#ifdef CONVERT_X86_SIMD
+/*
+ * AVX2 kernels
+ *
+ * Eight samples per iteration. The 24 bit kernels stop two samples early for the over-read
+ * of _load_s24x8_avx2.
+ */
+
+__attribute__((target("avx2")))
+static void _convert_avx2_s24_s32(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                                  uint64_t position) {
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst_p + i * 4), _load_s24x8_avx2(src_p + i * 3));
+    }
+    _convert_scalar_s24_s32(src_p + i * 3, dst_p + i * 4, count - i, seed, position + i);
+}
+
+__attribute__((target("avx2")))
+static void _convert_avx2_s24_f32(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                                  uint64_t position) {
+    // the samples are loaded shifted up by 8 bit, which the scale takes back out
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        const __m256 value = _mm256_cvtepi32_ps(_load_s24x8_avx2(src_p + i * 3));
+        _mm256_storeu_ps((float *)(dst_p + i * 4), _mm256_mul_ps(value, scale));
+    }
+    _convert_scalar_s24_f32(src_p + i * 3, dst_p + i * 4, count - i, seed, position + i);
+}
+
+__attribute__((target("avx2")))
+static void _convert_avx2_s24_s16(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                                  uint64_t position) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lowByte = _mm256_set1_epi32(0xFF);
+    const __m256i rounding = _mm256_set1_epi32(128);
+    const __m256i multiplier1 = _mm256_set1_epi32((int32_t)0x7FEB352Du);
+    const __m256i multiplier2 = _mm256_set1_epi32((int32_t)0x846CA68Bu);
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        // the same noise as _tpdf_noise, computed for eight positions at once
+        __m256i hash = _mm256_xor_si256(_mm256_add_epi32(_mm256_set1_epi32((int32_t)(uint32_t)(position + i)), lanes),
+                                        _mm256_set1_epi32((int32_t)seed));
+        hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 16));
+        hash = _mm256_mullo_epi32(hash, multiplier1);
+        hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+        hash = _mm256_mullo_epi32(hash, multiplier2);
+        hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 16));
+        const __m256i noise = _mm256_sub_epi32(_mm256_and_si256(hash, lowByte),
+                                               _mm256_and_si256(_mm256_srli_epi32(hash, 16), lowByte));
+
+        __m256i value = _mm256_srai_epi32(_load_s24x8_avx2(src_p + i * 3), 8);
+        value = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(value, noise), rounding), 8);
+
+        // saturating pack clamps like the scalar path, then the two lanes are joined
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(value, value), 0xD8);
+        _mm_storeu_si128((__m128i *)(dst_p + i * 2), _mm256_castsi256_si128(packed));
+    }
+    _convert_scalar_s24_s16(src_p + i * 3, dst_p + i * 2, count - i, seed, position + i);
+}
+
+__attribute__((target("avx2")))
+static void _convert_avx2_s16_f32(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                                  uint64_t position) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i value = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src_p + i * 2)));
+        _mm256_storeu_ps((float *)(dst_p + i * 4), _mm256_mul_ps(_mm256_cvtepi32_ps(value), scale));
+    }
+    _convert_scalar_s16_f32(src_p + i * 2, dst_p + i * 4, count - i, seed, position + i);
+}
+
+__attribute__((target("avx2")))
+static void _convert_avx2_s32_f32(const uint8_t *src_p, uint8_t *dst_p, size_t count, uint32_t seed,
+                                  uint64_t position) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i value = _mm256_loadu_si256((const __m256i *)(src_p + i * 4));
+        _mm256_storeu_ps((float *)(dst_p + i * 4), _mm256_mul_ps(_mm256_cvtepi32_ps(value), scale));
+    }
+    _convert_scalar_s32_f32(src_p + i * 4, dst_p + i * 4, count - i, seed, position + i);
+}
+#endif // CONVERT_X86_SIMD
+
+
+int sample_converter_init(SampleConverter *converter_p, const WavHeader *inputFormat_p,
+                           const WavHeader *outputFormat_p, uint16_t outputCount, const uint64_t *bytesWritten_p) {
+    // kernels indexed by input width 16, 24, 32 and output s16, s24, s32, f32
+    static const ConvertKernel kernels[3][4] = {
+        {NULL, _convert_scalar_s16_s24, _convert_scalar_s16_s32, _convert_scalar_s16_f32},
+        {_convert_scalar_s24_s16, NULL, _convert_scalar_s24_s32, _convert_scalar_s24_f32},
+        {_convert_scalar_s32_s16, _convert_scalar_s32_s24, NULL, _convert_scalar_s32_f32},
+    };
+    static const char *names[3][4] = {
+        {"copy", "scalar-s16-s24", "scalar-s16-s32", "scalar-s16-f32"},
+        {"scalar-s24-s16-tpdf", "copy", "scalar-s24-s32", "scalar-s24-f32"},
+        {"scalar-s32-s16-tpdf", "scalar-s32-s24-tpdf", "copy", "scalar-s32-f32"},
+    };
+
+    converter_p->inputBytes = inputFormat_p->bits_per_sample / 8;
+    converter_p->outputBytes = outputFormat_p->bits_per_sample / 8;
+    const int inputIndex = converter_p->inputBytes - 2;
+    const int outputIndex = outputFormat_p->audio_format == WAV_FORMAT_IEEE_FLOAT ? 3 : converter_p->outputBytes - 2;
+    converter_p->kernel_p = kernels[inputIndex][outputIndex];
+    converter_p->kernelName_p = names[inputIndex][outputIndex];
+
+    converter_p->positions_p = calloc(outputCount, sizeof(uint64_t));
+    if (!converter_p->positions_p) {
+        return -1;
+    }
+    for (uint16_t i = 0; i < outputCount; i++) {
+        converter_p->positions_p[i] = bytesWritten_p[i] / converter_p->outputBytes;
+    }
+
+#ifdef CONVERT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        if (inputIndex == 1 && outputIndex == 0) {
+            converter_p->kernel_p = _convert_avx2_s24_s16;
+            converter_p->kernelName_p = "avx2-s24-s16-tpdf";
+        } else if (inputIndex == 1 && outputIndex == 2) {
+            converter_p->kernel_p = _convert_avx2_s24_s32;
+            converter_p->kernelName_p = "avx2-s24-s32";
+        } else if (outputIndex == 3) {
+            static const ConvertKernel floatKernels[3] = {_convert_avx2_s16_f32, _convert_avx2_s24_f32,
+                                                          _convert_avx2_s32_f32};
+            static const char *floatNames[3] = {"avx2-s16-f32", "avx2-s24-f32", "avx2-s32-f32"};
+            converter_p->kernel_p = floatKernels[inputIndex];
+            converter_p->kernelName_p = floatNames[inputIndex];
+        }
+    }
+#endif
+    return 0;
+}
+
+
+void sample_converter_run(SampleConverter *converter_p, uint16_t output, const uint8_t *src_p, uint8_t *dst_p,
+                          size_t count) {
+    // every output gets its own noise sequence
+    const uint32_t seed = _dither_hash(0x9E3779B9u * ((uint32_t)output + 1));
+    converter_p->kernel_p(src_p, dst_p, count, seed, converter_p->positions_p[output]);
+    converter_p->positions_p[output] += count;
+}
+
+
+uint8_t *sample_converter_staging(const SampleConverter *converter_p, const uint16_t *groupSizes_p,
+                                  uint16_t outputCount, uint8_t **targets_pp, size_t *frames_p) {
+    size_t frameBytes = 0;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        frameBytes += (size_t)groupSizes_p[i] * converter_p->inputBytes;
+    }
+    size_t frames = CONVERT_STAGING_BYTES / frameBytes;
+    if (frames == 0) {
+        frames = 1;
+    }
+
+    uint8_t *staging_p = malloc(frames * frameBytes);
+    if (!staging_p) {
+        return NULL;
+    }
+    uint8_t *target_p = staging_p;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        targets_pp[i] = target_p;
+        target_p += frames * groupSizes_p[i] * converter_p->inputBytes;
+    }
+    *frames_p = frames;
+    return staging_p;
+}
+
+
+void sample_converter_free(SampleConverter *converter_p) {
+    free(converter_p->positions_p);
+    converter_p->positions_p = NULL;
+}
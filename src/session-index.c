@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "session-index.h"
+#include "utils.h"
+
+#define MAX_PATH_LENGTH 250
+
+#define SESSION_INDEX_MAGIC "wav-splitter index 1"
+
+// Missing chunks listed in the error message before it is cut short
+#define MAX_REPORTED_GAPS 8
+
+
+typedef struct {
+    const char *sessionPath_p;
+    SessionIndex *index_p;
+    const uint64_t *pending_p;  // Chunks whose header has to be read
+    uint64_t pendingCount;
+    atomic_uint_fast64_t next;  // Next entry of pending_p to claim
+    int *results_p;             // Parse result per chunk
+} IndexParse;
+
+
+static void _build_chunk_path(char *chunkPath_p, const char *sessionPath_p, uint64_t chunkIndex) {
+    snprintf(chunkPath_p, MAX_PATH_LENGTH, "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
+}
+
+
+static int _stat_chunk(const char *chunkPath_p, ChunkEntry *entry_p) {
+#ifdef WIN32
+    struct _stat64 chunkStat;
+    if (_stat64(chunkPath_p, &chunkStat) != 0) {
+#else
+    struct stat chunkStat;
+    if (stat(chunkPath_p, &chunkStat) != 0) {
+#endif
+        return -1;
+    }
+    entry_p->fileBytes = (uint64_t)chunkStat.st_size;
+    entry_p->modifiedTime = (int64_t)chunkStat.st_mtime;
+    return 0;
+}
+
+
+/**
+ * Report every run of missing chunk indices
+ *
+ * @return Number of missing chunks
+ */
+static uint64_t _report_gaps(const char *sessionPath_p, const uint64_t *indices_p, uint64_t count) {
+    uint64_t missing = 0;
+    unsigned int reported = 0;
+    uint64_t expected = 1;
+    for (uint64_t i = 0; i <= count; i++) {
+        const uint64_t present = i < count ? indices_p[i] : expected;
+        if (present > expected) {
+            if (missing == 0) {
+                fprintf(stderr, "ERROR: Chunks missing from %s:", sessionPath_p);
+            }
+            if (reported < MAX_REPORTED_GAPS) {
+                if (present - expected == 1) {
+                    fprintf(stderr, " %08" PRIX64, expected);
+                } else {
+                    fprintf(stderr, " %08" PRIX64 "-%08" PRIX64, expected, present - 1);
+                }
+            } else if (reported == MAX_REPORTED_GAPS) {
+                fprintf(stderr, " ...");
+            }
+            reported++;
+            missing += present - expected;
+        }
+        expected = present + 1;
+    }
+    if (missing > 0) {
+        fprintf(stderr, " (%" PRIu64 " of %" PRIu64 ")\n", missing, indices_p[count - 1]);
+    }
+    return missing;
+}
+
+
+/**
+ * Take the entries of unchanged chunks from the cache
+ *
+ * @param cached_p Set for every chunk taken from the cache
+ * @return Number of entries in the cache file
+ */
+static uint64_t _load_cache(const char *cachePath_p, SessionIndex *index_p, bool *cached_p) {
+    FILE *cacheFile_p = fopen(cachePath_p, "r");
+    if (!cacheFile_p) {
+        return 0;
+    }
+    char line[256];
+    if (!fgets(line, sizeof(line), cacheFile_p) || strncmp(line, SESSION_INDEX_MAGIC, strlen(SESSION_INDEX_MAGIC)) != 0) {
+        fclose(cacheFile_p);
+        return 0;
+    }
+
+    uint64_t entries = 0;
+    while (fgets(line, sizeof(line), cacheFile_p)) {
+        uint64_t chunkIndex, fileBytes, dataOffset;
+        int64_t modifiedTime;
+        unsigned int wavSize, fmtChunkSize, audioFormat, numChannels, sampleRate, byteRate, blockAlign;
+        unsigned int bitsPerSample, dataBytes;
+        if (sscanf(line, "chunk %" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNu64 " %u %u %u %u %u %u %u %u %u",
+                   &chunkIndex, &fileBytes, &modifiedTime, &dataOffset, &wavSize, &fmtChunkSize, &audioFormat,
+                   &numChannels, &sampleRate, &byteRate, &blockAlign, &bitsPerSample, &dataBytes) != 13) {
+            continue;
+        }
+        entries++;
+        if (chunkIndex == 0 || chunkIndex > index_p->chunkCount) {
+            continue;
+        }
+        ChunkEntry *entry_p = &index_p->chunks_p[chunkIndex - 1];
+        if (entry_p->fileBytes != fileBytes || entry_p->modifiedTime != modifiedTime) {
+            continue;
+        }
+        WavHeader *header_p = &entry_p->header;
+        memcpy(header_p->riff_header, "RIFF", 4);
+        memcpy(header_p->wave_header, "WAVE", 4);
+        memcpy(header_p->fmt_header, "fmt ", 4);
+        memcpy(header_p->data_header, "data", 4);
+        header_p->wav_size = wavSize;
+        header_p->fmt_chunk_size = fmtChunkSize;
+        header_p->audio_format = (uint16_t)audioFormat;
+        header_p->num_channels = (uint16_t)numChannels;
+        header_p->sample_rate = sampleRate;
+        header_p->byte_rate = byteRate;
+        header_p->block_align = (uint16_t)blockAlign;
+        header_p->bits_per_sample = (uint16_t)bitsPerSample;
+        header_p->data_bytes = dataBytes;
+        entry_p->dataOffset = dataOffset;
+        cached_p[chunkIndex - 1] = true;
+    }
+    fclose(cacheFile_p);
+    return entries;
+}
+
+
+/**
+ * Replace the cache atomically, a failure only costs the next run some header reads
+ */
+static void _write_cache(const char *cachePath_p, const SessionIndex *index_p) {
+    char tempPath[MAX_PATH_LENGTH + 8];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath_p);
+
+    FILE *cacheFile_p = fopen(tempPath, "w");
+    if (!cacheFile_p) {
+        fprintf(stderr, "Warning: Failed to write session index %s\n", tempPath);
+        return;
+    }
+    fprintf(cacheFile_p, "%s\n", SESSION_INDEX_MAGIC);
+    for (uint64_t i = 0; i < index_p->chunkCount; i++) {
+        const ChunkEntry *entry_p = &index_p->chunks_p[i];
+        const WavHeader *header_p = &entry_p->header;
+        fprintf(cacheFile_p, "chunk %" PRIu64 " %" PRIu64 " %" PRId64 " %" PRIu64 " %u %u %u %u %u %u %u %u %u\n",
+                i + 1, entry_p->fileBytes, entry_p->modifiedTime, entry_p->dataOffset, header_p->wav_size,
+                header_p->fmt_chunk_size, header_p->audio_format, header_p->num_channels, header_p->sample_rate,
+                header_p->byte_rate, header_p->block_align, header_p->bits_per_sample, header_p->data_bytes);
+    }
+    if (fclose(cacheFile_p) != 0) {
+        fprintf(stderr, "Warning: Failed to write session index %s\n", tempPath);
+        remove(tempPath);
+        return;
+    }
+
+#ifdef WIN32
+    if (!MoveFileEx(tempPath, cachePath_p, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(tempPath, cachePath_p) != 0) {
+#endif
+        fprintf(stderr, "Warning: Failed to replace session index %s\n", cachePath_p);
+        remove(tempPath);
+    }
+}
+
+
+static int _parse_chunk(const char *sessionPath_p, uint64_t chunkIndex, ChunkEntry *entry_p) {
+    char chunkPath[MAX_PATH_LENGTH];
+    _build_chunk_path(chunkPath, sessionPath_p, chunkIndex);
+
+    FILE *chunkFile_p = fopen(chunkPath, "rb");
+    if (!chunkFile_p) {
+        fprintf(stderr, "ERROR: Failed to open input file %s\n", chunkPath);
+        return -1;
+    }
+    if (read_header(chunkFile_p, &entry_p->header) != 0) {
+        fprintf(stderr, "ERROR: Failed to read WAV header of %s\n", chunkPath);
+        fclose(chunkFile_p);
+        return -1;
+    }
+#ifdef WIN32
+    const int64_t dataOffset = _ftelli64(chunkFile_p);
+#else
+    const int64_t dataOffset = (int64_t)ftello(chunkFile_p);
+#endif
+    fclose(chunkFile_p);
+    if (dataOffset < 0) {
+        fprintf(stderr, "ERROR: Failed to locate the audio data of %s\n", chunkPath);
+        return -1;
+    }
+    entry_p->dataOffset = (uint64_t)dataOffset;
+    return 0;
+}
+
+
+static void *_parse_worker(void *argument_p) {
+    IndexParse *parse_p = argument_p;
+    uint64_t next;
+    while ((next = atomic_fetch_add(&parse_p->next, 1)) < parse_p->pendingCount) {
+        const uint64_t chunkIndex = parse_p->pending_p[next];
+        parse_p->results_p[chunkIndex - 1] = _parse_chunk(parse_p->sessionPath_p, chunkIndex,
+                                                          &parse_p->index_p->chunks_p[chunkIndex - 1]);
+    }
+    return NULL;
+}
+
+
+/**
+ * Read the headers of the given chunks, spread over up to SESSION_INDEX_MAX_THREADS threads
+ *
+ * @return 0 if every header was read, -1 otherwise (errors printed)
+ */
+static int _parse_chunks(const char *sessionPath_p, SessionIndex *index_p, const uint64_t *pending_p,
+                         uint64_t pendingCount) {
+    IndexParse parse;
+    parse.sessionPath_p = sessionPath_p;
+    parse.index_p = index_p;
+    parse.pending_p = pending_p;
+    parse.pendingCount = pendingCount;
+    atomic_init(&parse.next, 0);
+    parse.results_p = calloc(index_p->chunkCount, sizeof(int));
+    if (!parse.results_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+
+    // the calling thread parses as well, threads that cannot be started simply leave it more work
+    unsigned int threadCount = SESSION_INDEX_MAX_THREADS - 1;
+    if (pendingCount - 1 < threadCount) {
+        threadCount = (unsigned int)(pendingCount - 1);
+    }
+    pthread_t threads[SESSION_INDEX_MAX_THREADS];
+    unsigned int started = 0;
+    while (started < threadCount && pthread_create(&threads[started], NULL, _parse_worker, &parse) == 0) {
+        started++;
+    }
+    _parse_worker(&parse);
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int result = 0;
+    for (uint64_t i = 0; i < pendingCount; i++) {
+        if (parse.results_p[pending_p[i] - 1] != 0) {
+            result = -1;
+        }
+    }
+    free(parse.results_p);
+    return result;
+}
+
+
+int session_index_check_chunk(const WavHeader *first_p, const WavHeader *header_p, const char *path_p) {
+    // all chunks are appended to the same outputs, so they have to share one format
+    if (!first_p) {
+        if (header_p->block_align == 0 || header_p->bits_per_sample % 8 != 0 ||
+            header_p->block_align != header_p->num_channels * (header_p->bits_per_sample / 8)) {
+            fprintf(stderr, "ERROR: Unsupported sample layout in %s\n", path_p);
+            return -1;
+        }
+        return 0;
+    }
+    if (header_p->audio_format != first_p->audio_format || header_p->num_channels != first_p->num_channels ||
+        header_p->bits_per_sample != first_p->bits_per_sample || header_p->sample_rate != first_p->sample_rate ||
+        header_p->block_align != first_p->block_align) {
+        fprintf(stderr, "ERROR: Format of %s differs from the first chunk\n", path_p);
+        return -1;
+    }
+    return 0;
+}
+
+
+int session_index_build(SessionIndex *index_p, const char *sessionPath_p) {
+    memset(index_p, 0, sizeof(*index_p));
+
+    uint64_t *indices_p = NULL;
+    const uint64_t found = _list_chunk_indices(sessionPath_p, &indices_p);
+    if (found == 0) {
+        fprintf(stderr, "ERROR: No input files found\n");
+        return -1;
+    }
+    // a chunk missing in the middle would only be noticed hours into the run
+    if (_report_gaps(sessionPath_p, indices_p, found) > 0) {
+        free(indices_p);
+        return -1;
+    }
+
+    index_p->chunkCount = found;
+    index_p->chunks_p = calloc(found, sizeof(ChunkEntry));
+    bool *cached_p = calloc(found, sizeof(bool));
+    if (!index_p->chunks_p || !cached_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    char chunkPath[MAX_PATH_LENGTH];
+    for (uint64_t i = 0; i < found; i++) {
+        _build_chunk_path(chunkPath, sessionPath_p, i + 1);
+        if (_stat_chunk(chunkPath, &index_p->chunks_p[i]) != 0) {
+            fprintf(stderr, "ERROR: Failed to open input file %s\n", chunkPath);
+            free(indices_p);
+            free(cached_p);
+            session_index_free(index_p);
+            return -1;
+        }
+    }
+
+    char cachePath[MAX_PATH_LENGTH];
+    snprintf(cachePath, sizeof(cachePath), "%s%c%s", sessionPath_p, PATH_SEPARATOR, SESSION_INDEX_FILE_NAME);
+    const uint64_t cacheEntries = _load_cache(cachePath, index_p, cached_p);
+
+    // indices_p is reused for the chunks that are not in the cache
+    uint64_t pendingCount = 0;
+    for (uint64_t i = 0; i < found; i++) {
+        if (cached_p[i]) {
+            index_p->cachedChunks++;
+        } else {
+            indices_p[pendingCount++] = i + 1;
+        }
+    }
+    free(cached_p);
+    if (pendingCount > 0 && _parse_chunks(sessionPath_p, index_p, indices_p, pendingCount) != 0) {
+        free(indices_p);
+        session_index_free(index_p);
+        return -1;
+    }
+    free(indices_p);
+
+    for (uint64_t i = 0; i < found; i++) {
+        ChunkEntry *entry_p = &index_p->chunks_p[i];
+        _build_chunk_path(chunkPath, sessionPath_p, i + 1);
+        if (session_index_check_chunk(i == 0 ? NULL : &index_p->chunks_p[0].header, &entry_p->header,
+                                      chunkPath) != 0) {
+            session_index_free(index_p);
+            return -1;
+        }
+        // truncated chunks only count up to their last whole frame, like the input backends read them
+        const uint64_t present = entry_p->fileBytes > entry_p->dataOffset ? entry_p->fileBytes - entry_p->dataOffset : 0;
+        entry_p->dataBytes = present < entry_p->header.data_bytes ? present : entry_p->header.data_bytes;
+        entry_p->frames = entry_p->dataBytes / entry_p->header.block_align;
+        entry_p->firstFrame = index_p->totalFrames;
+        index_p->totalFrames += entry_p->frames;
+    }
+
+    if (pendingCount > 0 || cacheEntries != found) {
+        _write_cache(cachePath, index_p);
+    }
+    printf("Indexed %" PRIu64 " chunks (%" PRIu64 " from cache, %" PRIu64 " headers read)\n", found,
+           index_p->cachedChunks, pendingCount);
+    return 0;
+}
+
+
+int session_index_locate(const SessionIndex *index_p, uint64_t frame, uint64_t *chunkIndex_p,
+                         uint64_t *frameInChunk_p) {
+    if (frame >= index_p->totalFrames) {
+        return -1;
+    }
+    // last chunk starting at or before the frame, empty chunks share their start with the next one
+    uint64_t low = 0;
+    uint64_t high = index_p->chunkCount - 1;
+    while (low < high) {
+        const uint64_t middle = low + (high - low + 1) / 2;
+        if (index_p->chunks_p[middle].firstFrame <= frame) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    *chunkIndex_p = low + 1;
+    *frameInChunk_p = frame - index_p->chunks_p[low].firstFrame;
+    return 0;
+}
+
+
+int session_position_parse(const char *text_p, SessionPosition *position_p) {
+    memset(position_p, 0, sizeof(*position_p));
+    const size_t length = strlen(text_p);
+    char *end_p = NULL;
+
+    // a trailing f marks a frame count, 90f is 90 frames while 90 is 90 seconds
+    if (length > 1 && text_p[length - 1] == 'f') {
+        if (text_p[0] < '0' || text_p[0] > '9') {
+            return -1;
+        }
+        position_p->frames = strtoull(text_p, &end_p, 10);
+        if (end_p != text_p + length - 1) {
+            return -1;
+        }
+        position_p->inFrames = true;
+        position_p->set = true;
+        return 0;
+    }
+
+    // up to two colon separated whole fields (hours, minutes) in front of the seconds
+    double minutes = 0.0;
+    const char *field_p = text_p;
+    for (int field = 0; field < 3; field++) {
+        if (*field_p < '0' || *field_p > '9') {
+            return -1;
+        }
+        const char *colon_p = strchr(field_p, ':');
+        if (!colon_p) {
+            const double seconds = strtod(field_p, &end_p);
+            if (*end_p != '\0' || (field > 0 && seconds >= 60.0)) {
+                return -1;
+            }
+            position_p->seconds = minutes * 60.0 + seconds;
+            position_p->set = true;
+            return 0;
+        }
+        const unsigned long value = strtoul(field_p, &end_p, 10);
+        if (end_p != colon_p || field == 2 || (field > 0 && value >= 60)) {
+            return -1;
+        }
+        minutes = minutes * 60.0 + (double)value;
+        field_p = colon_p + 1;
+    }
+    return -1;
+}
+
+
+/**
+ * Frame of the session a position refers to
+ */
+static uint64_t _position_frame(const SessionPosition *position_p, uint32_t sampleRate) {
+    if (position_p->inFrames) {
+        return position_p->frames;
+    }
+    return (uint64_t)(position_p->seconds * sampleRate + 0.5);
+}
+
+
+int session_index_range(const SessionIndex *index_p, const SessionPosition *start_p, const SessionPosition *end_p,
+                        SessionRange *range_p) {
+    const uint32_t sampleRate = index_p->chunks_p[0].header.sample_rate;
+    range_p->startFrame = start_p->set ? _position_frame(start_p, sampleRate) : 0;
+    range_p->endFrame = end_p->set ? _position_frame(end_p, sampleRate) : index_p->totalFrames;
+    if (range_p->endFrame > index_p->totalFrames) {
+        range_p->endFrame = index_p->totalFrames;
+    }
+    if (range_p->startFrame >= range_p->endFrame) {
+        fprintf(stderr, "ERROR: The range from frame %" PRIu64 " to %" PRIu64 " holds no audio, the session has %"
+                PRIu64 " frames (%.3f s)\n", range_p->startFrame, range_p->endFrame, index_p->totalFrames,
+                (double)index_p->totalFrames / sampleRate);
+        return -1;
+    }
+
+    uint64_t lastFrame = 0;
+    if (session_index_locate(index_p, range_p->startFrame, &range_p->firstChunk, &range_p->firstChunkSkip) != 0 ||
+        session_index_locate(index_p, range_p->endFrame - 1, &range_p->lastChunk, &lastFrame) != 0) {
+        fprintf(stderr, "ERROR: The range from frame %" PRIu64 " to %" PRIu64 " lies outside the session index\n",
+                range_p->startFrame, range_p->endFrame);
+        return -1;
+    }
+    range_p->lastChunkFrames = lastFrame + 1;
+    return 0;
+}
+
+
+void session_index_free(SessionIndex *index_p) {
+    free(index_p->chunks_p);
+    index_p->chunks_p = NULL;
+    index_p->chunkCount = 0;
+}
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "signal-analysis.h"
+#include "peak-overview.h"
+#include "utils.h"
+#include "sample-load.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANALYSIS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define MAX_PATH_LENGTH 250
+
+
+/*
+ * Scalar kernels
+ *
+ * Integer sums stay exact within a kernel call. Squares of 32 bit samples would overflow
+ * 64 bit sums after a few samples, so they are summed as doubles right away.
+ */
+
+#define DEFINE_SCALAR_LEVEL_KERNEL(NAME, WIDTH, LOAD, MIN_VALUE, MAX_VALUE, SQUARE_TYPE)      \
+    static void NAME(const uint8_t *samples_p, size_t count, size_t stride, LevelBlock *block_p) { \
+        uint32_t peak = 0;                                                                    \
+        uint64_t clipped = 0;                                                                 \
+        int64_t sum = 0;                                                                      \
+        SQUARE_TYPE sumSquares = 0;                                                           \
+        for (size_t i = 0; i < count; i++) {                                                  \
+            const int32_t value = LOAD(samples_p + i * stride * (WIDTH));                     \
+            const uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;    \
+            peak = magnitude > peak ? magnitude : peak;                                       \
+            clipped += value == (MIN_VALUE) || value == (MAX_VALUE);                          \
+            sum += value;                                                                     \
+            sumSquares += (SQUARE_TYPE)value * value;                                         \
+        }                                                                                     \
+        block_p->peak = peak;                                                                 \
+        block_p->clipped = clipped;                                                           \
+        block_p->sum = sum;                                                                   \
+        block_p->sumSquares = (double)sumSquares;                                             \
+    }
+
+DEFINE_SCALAR_LEVEL_KERNEL(_levels_scalar_s16, 2, _load_s16, INT16_MIN, INT16_MAX, int64_t)
+DEFINE_SCALAR_LEVEL_KERNEL(_levels_scalar_s24, 3, _load_s24, -8388608, 8388607, int64_t)
+DEFINE_SCALAR_LEVEL_KERNEL(_levels_scalar_s32, 4, _load_s32, INT32_MIN, INT32_MAX, double)
+
+
+#ifdef ANALYSIS_X86_SIMD
+/*
+ * AVX2 kernels for mono outputs
+ *
+ * Peak, clip count, sum and sum of squares are accumulated per lane in widths that cannot
+ * overflow within a block. The samples that do not fill a vector go through the scalar
+ * kernel and are merged in.
+ */
+
+__attribute__((target("avx2")))
+static uint32_t _max_epu32(__m256i value) {
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, value);
+    uint32_t result = 0;
+    for (int i = 0; i < 8; i++) {
+        result = lanes[i] > result ? lanes[i] : result;
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+static int64_t _sum_epi64(__m256i value) {
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, value);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static void _merge_tail(LevelBlock *block_p, const LevelBlock *tail_p) {
+    block_p->peak = tail_p->peak > block_p->peak ? tail_p->peak : block_p->peak;
+    block_p->clipped += tail_p->clipped;
+    block_p->sum += tail_p->sum;
+    block_p->sumSquares += tail_p->sumSquares;
+}
+
+__attribute__((target("avx2")))
+static void _levels_avx2_s16(const uint8_t *samples_p, size_t count, size_t stride, LevelBlock *block_p) {
+    const __m256i maxValue = _mm256_set1_epi16(INT16_MAX);
+    const __m256i minValue = _mm256_set1_epi16(INT16_MIN);
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i peak = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256();
+    __m256i sumSquares = _mm256_setzero_si256();
+    uint64_t clipped = 0;
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i value = _mm256_loadu_si256((const __m256i *)(samples_p + i * 2));
+        // |INT16_MIN| wraps to 0x8000, which is still the largest value when compared unsigned
+        peak = _mm256_max_epu16(peak, _mm256_abs_epi16(value));
+        const __m256i clip = _mm256_or_si256(_mm256_cmpeq_epi16(value, maxValue), _mm256_cmpeq_epi16(value, minValue));
+        clipped += (uint64_t)__builtin_popcount((unsigned int)_mm256_movemask_epi8(clip)) / 2;
+
+        // pairwise sums fit 32 bit signed, pairwise squares fit 32 bit unsigned
+        const __m256i pairSums = _mm256_madd_epi16(value, ones);
+        const __m256i pairSquares = _mm256_madd_epi16(value, value);
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(pairSums)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(pairSums, 1)));
+        sumSquares = _mm256_add_epi64(sumSquares, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(pairSquares)));
+        sumSquares = _mm256_add_epi64(sumSquares, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(pairSquares, 1)));
+    }
+
+    // widen the 16 bit peaks before the horizontal maximum
+    const __m256i peakLow = _mm256_unpacklo_epi16(peak, _mm256_setzero_si256());
+    const __m256i peakHigh = _mm256_unpackhi_epi16(peak, _mm256_setzero_si256());
+    block_p->peak = _max_epu32(_mm256_max_epu32(peakLow, peakHigh));
+    block_p->clipped = clipped;
+    block_p->sum = _sum_epi64(sum);
+    block_p->sumSquares = (double)_sum_epi64(sumSquares);
+
+    LevelBlock tail;
+    _levels_scalar_s16(samples_p + i * 2, count - i, stride, &tail);
+    _merge_tail(block_p, &tail);
+}
+
+__attribute__((target("avx2")))
+static void _levels_avx2_s24(const uint8_t *samples_p, size_t count, size_t stride, LevelBlock *block_p) {
+    const __m256i maxValue = _mm256_set1_epi32(8388607);
+    const __m256i minValue = _mm256_set1_epi32(-8388608);
+    __m256i peak = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256();
+    __m256i sumSquares = _mm256_setzero_si256();
+    uint64_t clipped = 0;
+
+    size_t i = 0;
+    for (; i + 10 <= count; i += 8) {
+        const __m256i value = _mm256_srai_epi32(_load_s24x8_avx2(samples_p + i * 3), 8);
+
+        peak = _mm256_max_epu32(peak, _mm256_abs_epi32(value));
+        const __m256i clip = _mm256_or_si256(_mm256_cmpeq_epi32(value, maxValue), _mm256_cmpeq_epi32(value, minValue));
+        clipped += (uint64_t)__builtin_popcount((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(clip)));
+
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(value, 1)));
+        // squares of 24 bit samples need 47 bits, so even and odd lanes are multiplied separately
+        sumSquares = _mm256_add_epi64(sumSquares, _mm256_mul_epi32(value, value));
+        const __m256i odd = _mm256_srli_epi64(value, 32);
+        sumSquares = _mm256_add_epi64(sumSquares, _mm256_mul_epi32(odd, odd));
+    }
+
+    block_p->peak = _max_epu32(peak);
+    block_p->clipped = clipped;
+    block_p->sum = _sum_epi64(sum);
+    block_p->sumSquares = (double)_sum_epi64(sumSquares);
+
+    LevelBlock tail;
+    _levels_scalar_s24(samples_p + i * 3, count - i, stride, &tail);
+    _merge_tail(block_p, &tail);
+}
+
+__attribute__((target("avx2")))
+static void _levels_avx2_s32(const uint8_t *samples_p, size_t count, size_t stride, LevelBlock *block_p) {
+    const __m256i maxValue = _mm256_set1_epi32(INT32_MAX);
+    const __m256i minValue = _mm256_set1_epi32(INT32_MIN);
+    __m256i peak = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256();
+    __m256d sumSquares = _mm256_setzero_pd();
+    uint64_t clipped = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i value = _mm256_loadu_si256((const __m256i *)(samples_p + i * 4));
+        // |INT32_MIN| wraps to 0x80000000, which is still the largest value when compared unsigned
+        peak = _mm256_max_epu32(peak, _mm256_abs_epi32(value));
+        const __m256i clip = _mm256_or_si256(_mm256_cmpeq_epi32(value, maxValue), _mm256_cmpeq_epi32(value, minValue));
+        clipped += (uint64_t)__builtin_popcount((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(clip)));
+
+        const __m128i low = _mm256_castsi256_si128(value);
+        const __m128i high = _mm256_extracti128_si256(value, 1);
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(low));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(high));
+        const __m256d lowDouble = _mm256_cvtepi32_pd(low);
+        const __m256d highDouble = _mm256_cvtepi32_pd(high);
+        sumSquares = _mm256_add_pd(sumSquares, _mm256_mul_pd(lowDouble, lowDouble));
+        sumSquares = _mm256_add_pd(sumSquares, _mm256_mul_pd(highDouble, highDouble));
+    }
+
+    double squares[4];
+    _mm256_storeu_pd(squares, sumSquares);
+    block_p->peak = _max_epu32(peak);
+    block_p->clipped = clipped;
+    block_p->sum = _sum_epi64(sum);
+    block_p->sumSquares = squares[0] + squares[1] + squares[2] + squares[3];
+
+    LevelBlock tail;
+    _levels_scalar_s32(samples_p + i * 4, count - i, stride, &tail);
+    _merge_tail(block_p, &tail);
+}
+#endif // ANALYSIS_X86_SIMD
+
+
+int analysis_mode_parse(const char *name_p, AnalysisMode *mode_p) {
+    if (strcmp(name_p, "keep") == 0) {
+        *mode_p = ANALYSIS_KEEP;
+    } else if (strcmp(name_p, "mark") == 0) {
+        *mode_p = ANALYSIS_MARK;
+    } else if (strcmp(name_p, "drop") == 0) {
+        *mode_p = ANALYSIS_DROP;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+
+void signal_analysis_init(SignalAnalysis *analysis_p, const ChannelSelection *channels_p, uint16_t bitsPerSample,
+                          AnalysisMode mode) {
+    const uint16_t lastOutput = channels_p->count - 1;
+    const uint32_t slotCount = channels_p->firstSlots_p[lastOutput] + channels_p->groupSizes_p[lastOutput];
+
+    analysis_p->channels_p = channels_p;
+    analysis_p->bytesPerSample = bitsPerSample / 8;
+    analysis_p->mode = mode;
+    analysis_p->sparseWrites = mode == ANALYSIS_DROP;
+    analysis_p->levels_p = calloc(slotCount, sizeof(ChannelLevels));
+    if (!analysis_p->levels_p) {
+        fprintf(stderr, "ERROR: Failed to allocate channel analysis\n");
+        exit(1);
+    }
+
+    switch (analysis_p->bytesPerSample) {
+        case 2:  analysis_p->strideKernel_p = _levels_scalar_s16; break;
+        case 3:  analysis_p->strideKernel_p = _levels_scalar_s24; break;
+        default: analysis_p->strideKernel_p = _levels_scalar_s32; break;
+    }
+    analysis_p->monoKernel_p = analysis_p->strideKernel_p;
+    analysis_p->kernelName_p = "scalar";
+
+#ifdef ANALYSIS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        switch (analysis_p->bytesPerSample) {
+            case 2:  analysis_p->monoKernel_p = _levels_avx2_s16; break;
+            case 3:  analysis_p->monoKernel_p = _levels_avx2_s24; break;
+            default: analysis_p->monoKernel_p = _levels_avx2_s32; break;
+        }
+        analysis_p->kernelName_p = "avx2";
+    }
+#endif
+}
+
+
+void signal_analysis_run(SignalAnalysis *analysis_p, uint16_t output, const uint8_t *samples_p, size_t frameCount) {
+    const ChannelSelection *channels_p = analysis_p->channels_p;
+    const size_t groupSize = channels_p->groupSizes_p[output];
+    const size_t bytesPerSample = analysis_p->bytesPerSample;
+    const LevelKernel kernel_p = groupSize == 1 ? analysis_p->monoKernel_p : analysis_p->strideKernel_p;
+    ChannelLevels *levels_p = analysis_p->levels_p + channels_p->firstSlots_p[output];
+
+    for (size_t c = 0; c < groupSize; c++) {
+        const uint8_t *channel_p = samples_p + c * bytesPerSample;
+        for (size_t done = 0; done < frameCount;) {
+            const size_t count = frameCount - done < ANALYSIS_BLOCK_SAMPLES ? frameCount - done
+                                                                            : ANALYSIS_BLOCK_SAMPLES;
+            LevelBlock block;
+            kernel_p(channel_p + done * groupSize * bytesPerSample, count, groupSize, &block);
+
+            levels_p[c].peak = block.peak > levels_p[c].peak ? block.peak : levels_p[c].peak;
+            levels_p[c].clipped += block.clipped;
+            levels_p[c].sum += (double)block.sum;
+            levels_p[c].sumSquares += block.sumSquares;
+            levels_p[c].samples += count;
+            done += count;
+        }
+    }
+}
+
+
+bool signal_analysis_output_silent(const SignalAnalysis *analysis_p, uint16_t output) {
+    const ChannelSelection *channels_p = analysis_p->channels_p;
+    const ChannelLevels *levels_p = analysis_p->levels_p + channels_p->firstSlots_p[output];
+    for (uint16_t c = 0; c < channels_p->groupSizes_p[output]; c++) {
+        if (levels_p[c].peak != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void signal_analysis_prepare_submit(const SignalAnalysis *analysis_p, OutputBuffer *buffer_p) {
+    // the levels include the buffer, so an output silent so far only holds zeros in it
+    if (analysis_p && analysis_p->sparseWrites) {
+        buffer_p->sparse = signal_analysis_output_silent(analysis_p, buffer_p->channel);
+    }
+}
+
+
+/**
+ * Level relative to full scale in dB
+ */
+static double _dbfs(double level, double fullScale) {
+    return level > 0.0 ? 20.0 * log10(level / fullScale) : -INFINITY;
+}
+
+
+unsigned int signal_analysis_finish(const SignalAnalysis *analysis_p, const char *outputPath_p,
+                                    const char *extension_p) {
+    const ChannelSelection *channels_p = analysis_p->channels_p;
+    const double fullScale = (double)(1u << (analysis_p->bytesPerSample * 8 - 1));
+
+    char tablePath[MAX_PATH_LENGTH];
+    snprintf(tablePath, sizeof(tablePath), "%s%s", outputPath_p, ANALYSIS_FILE_NAME);
+    FILE *table_p = fopen(tablePath, "w");
+    if (!table_p) {
+        fprintf(stderr, "Warning: Failed to create %s\n", tablePath);
+    } else {
+        fprintf(table_p, "output,channel,peak_dbfs,rms_dbfs,clipped_samples,dc_offset,silent,action\n");
+    }
+
+    printf("Channel analysis (%s):\n", analysis_p->kernelName_p);
+    printf("  %-24s %7s %10s %10s %10s %10s\n", "output", "channel", "peak dBFS", "RMS dBFS", "clipped", "DC offset");
+
+    unsigned int handled = 0;
+    for (uint16_t output = 0; output < channels_p->count; output++) {
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 16];
+        _output_name(outputName, sizeof(outputName), channels_p, output);
+        const bool silent = signal_analysis_output_silent(analysis_p, output);
+
+        // silent outputs are renamed or removed, the table records what happened
+        const char *action_p = "kept";
+        if (silent && analysis_p->mode != ANALYSIS_KEEP) {
+            char filePath[MAX_PATH_LENGTH];
+            snprintf(filePath, sizeof(filePath), "%s%s%s", outputPath_p, outputName, extension_p);
+            if (analysis_p->mode == ANALYSIS_DROP) {
+                action_p = remove(filePath) == 0 ? "dropped" : "kept";
+            } else {
+                char markedPath[MAX_PATH_LENGTH];
+                snprintf(markedPath, sizeof(markedPath), "%s%s.silent%s", outputPath_p, outputName, extension_p);
+                action_p = rename(filePath, markedPath) == 0 ? "marked" : "kept";
+            }
+            if (strcmp(action_p, "kept") == 0) {
+                fprintf(stderr, "Warning: Failed to %s %s\n",
+                        analysis_p->mode == ANALYSIS_DROP ? "remove" : "rename", filePath);
+            } else {
+                handled++;
+
+                // a peak overview follows its output, outputs without one are left as they are
+                snprintf(filePath, sizeof(filePath), "%s%s%s", outputPath_p, outputName, PEAK_FILE_EXTENSION);
+                if (analysis_p->mode == ANALYSIS_DROP) {
+                    remove(filePath);
+                } else {
+                    char markedPath[MAX_PATH_LENGTH];
+                    snprintf(markedPath, sizeof(markedPath), "%s%s.silent%s", outputPath_p, outputName,
+                             PEAK_FILE_EXTENSION);
+                    rename(filePath, markedPath);
+                }
+            }
+        }
+
+        const ChannelLevels *levels_p = analysis_p->levels_p + channels_p->firstSlots_p[output];
+        for (uint16_t c = 0; c < channels_p->groupSizes_p[output]; c++) {
+            const ChannelLevels *channel_p = &levels_p[c];
+            const uint16_t inputChannel = channels_p->channels_p[channels_p->firstSlots_p[output] + c] + 1;
+            const double samples = channel_p->samples > 0 ? (double)channel_p->samples : 1.0;
+            const double peakDbfs = _dbfs(channel_p->peak, fullScale);
+            const double rmsDbfs = _dbfs(sqrt(channel_p->sumSquares / samples), fullScale);
+            const double dcOffset = channel_p->sum / samples / fullScale;
+
+            if (channel_p->peak == 0) {
+                printf("  %-24s %7u %10s %10s %10" PRIu64 " %10s\n", c == 0 ? outputName : "", inputChannel,
+                       "silent", "", channel_p->clipped, "");
+            } else {
+                printf("  %-24s %7u %10.2f %10.2f %10" PRIu64 " %10.6f\n", c == 0 ? outputName : "", inputChannel,
+                       peakDbfs, rmsDbfs, channel_p->clipped, dcOffset);
+            }
+            if (table_p) {
+                fprintf(table_p, "%s,%u,%.2f,%.2f,%" PRIu64 ",%.8f,%d,%s\n", outputName, inputChannel, peakDbfs,
+                        rmsDbfs, channel_p->clipped, dcOffset, silent, action_p);
+            }
+        }
+    }
+
+    if (table_p && fclose(table_p) != 0) {
+        fprintf(stderr, "Warning: Failed to write %s\n", tablePath);
+    }
+    if (handled > 0) {
+        printf("%s %u silent outputs\n", analysis_p->mode == ANALYSIS_DROP ? "Dropped" : "Marked", handled);
+    }
+    return handled;
+}
+
+
+void signal_analysis_free(SignalAnalysis *analysis_p) {
+    free(analysis_p->levels_p);
+    analysis_p->levels_p = NULL;
+}
@@ -0,0 +1,419 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#define PATH_SEPARATOR '\\'
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "stream.h"
+#include "session-index.h"
+#include "wavsplit.h"
+#include "utils.h"
+
+#define MAX_PATH_LENGTH 250
+
+// Bytes read from the stream at a time
+#define STREAM_READ_BYTES (256 * 1024)
+
+// Headers of output files are brought up to date this often (seconds)
+#define STREAM_HEADER_INTERVAL_SECONDS 1.0
+
+typedef struct {
+    const StreamOptions *stream_p; // Stream options (pipe pattern)
+    const char *outputPath_p;      // Directory of the output files (NULL when writing to pipes)
+    WavContainer largeContainer;   // Container for output files beyond the RIFF limit
+    uint32_t sampleRate;           // Sampling rate of the stream
+    uint16_t outputCount;          // Number of outputs
+    FILE **outputFiles_pp;         // File of every output (NULL until its first block arrives)
+    WavHeader *formats_p;          // Format of every output
+    uint64_t *bytesWritten_p;      // Audio bytes written to every output
+    double lastHeaderUpdate;       // When the headers of the output files were last updated
+} StreamOutputs;
+
+
+int stream_raw_format_parse(const char *text_p, WavHeader *format_p) {
+    char sampleFormat_p[8];
+    unsigned int channels;
+    unsigned int sampleRate;
+    char trailing;
+    if (sscanf(text_p, "%7[^:]:%u:%u%c", sampleFormat_p, &channels, &sampleRate, &trailing) != 3) {
+        return -1;
+    }
+
+    SampleFormat sampleFormat;
+    if (sample_format_parse(sampleFormat_p, &sampleFormat) != 0 || channels == 0 || sampleRate == 0) {
+        return -1;
+    }
+    static const uint16_t formatBits[] = {0, 16, 24, 32, 32};
+    const uint16_t bits = formatBits[sampleFormat];
+    if (channels * (bits / 8) > UINT16_MAX) {
+        return -1;
+    }
+
+    memset(format_p, 0, sizeof(*format_p));
+    format_p->audio_format = sampleFormat == SAMPLE_FORMAT_F32 ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+    format_p->num_channels = (uint16_t)channels;
+    format_p->sample_rate = sampleRate;
+    format_p->bits_per_sample = bits;
+    format_p->block_align = (uint16_t)(channels * (bits / 8));
+    format_p->byte_rate = sampleRate * format_p->block_align;
+    return 0;
+}
+
+
+/**
+ * Check that a pipe pattern names a path per output or a first file descriptor
+ */
+static int _check_pipe_pattern(const char *pattern_p) {
+    if (strncmp(pattern_p, STREAM_FD_PREFIX, strlen(STREAM_FD_PREFIX)) == 0) {
+        char *end_p;
+        const long fd = strtol(pattern_p + strlen(STREAM_FD_PREFIX), &end_p, 10);
+        if (*end_p != '\0' || end_p == pattern_p + strlen(STREAM_FD_PREFIX) || fd < 3) {
+            fprintf(stderr, "ERROR: Invalid first file descriptor in '%s', 0 to 2 are taken\n", pattern_p);
+            return -1;
+        }
+        return 0;
+    }
+    if (!strstr(pattern_p, STREAM_NAME_PLACEHOLDER)) {
+        fprintf(stderr, "ERROR: Pipe pattern '%s' needs %s or %s<fd>\n", pattern_p, STREAM_NAME_PLACEHOLDER,
+                STREAM_FD_PREFIX);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Open the file, FIFO or file descriptor of an output and write its header
+ *
+ * Opening a FIFO blocks until its reader opened it as well.
+ */
+static FILE *_open_output(StreamOutputs *outputs_p, const WavsplitBlock *block_p) {
+    const char *pattern_p = outputs_p->stream_p->pipePattern_p;
+    char path_p[MAX_PATH_LENGTH];
+    FILE *outputFile_p;
+    if (!pattern_p) {
+        snprintf(path_p, MAX_PATH_LENGTH, "%s%s.wav", outputs_p->outputPath_p, block_p->name_p);
+        outputFile_p = fopen(path_p, "wb");
+    } else if (strncmp(pattern_p, STREAM_FD_PREFIX, strlen(STREAM_FD_PREFIX)) == 0) {
+        const int fd = atoi(pattern_p + strlen(STREAM_FD_PREFIX)) + block_p->output;
+        snprintf(path_p, MAX_PATH_LENGTH, "file descriptor %d", fd);
+        outputFile_p = fdopen(fd, "wb");
+    } else {
+        const char *placeholder_p = strstr(pattern_p, STREAM_NAME_PLACEHOLDER);
+        snprintf(path_p, MAX_PATH_LENGTH, "%.*s%s%s", (int)(placeholder_p - pattern_p), pattern_p, block_p->name_p,
+                 placeholder_p + strlen(STREAM_NAME_PLACEHOLDER));
+        outputFile_p = fopen(path_p, "wb");
+    }
+    if (!outputFile_p) {
+        fprintf(stderr, "ERROR: Failed to open %s for output %s\n", path_p, block_p->name_p);
+        return NULL;
+    }
+
+    WavHeader *format_p = &outputs_p->formats_p[block_p->output];
+    memset(format_p, 0, sizeof(*format_p));
+    format_p->audio_format = block_p->floatSamples ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+    format_p->num_channels = block_p->channels;
+    format_p->sample_rate = outputs_p->sampleRate;
+    format_p->bits_per_sample = block_p->bitsPerSample;
+    format_p->block_align = block_p->channels * (block_p->bitsPerSample / 8);
+    format_p->byte_rate = format_p->sample_rate * format_p->block_align;
+
+    // a pipe cannot be rewound, its header announces a stream of unknown length
+    const uint64_t dataBytes = pattern_p ? WAV_STREAM_DATA_BYTES : 0;
+    if (write_output_header(outputFile_p, format_p, dataBytes, wav_output_header_size(format_p->audio_format),
+                            outputs_p->largeContainer) != 0) {
+        fclose(outputFile_p);
+        return NULL;
+    }
+    return outputFile_p;
+}
+
+
+/**
+ * Rewrite the headers of the output files with the audio written so far
+ *
+ * @param outputs_p Outputs of the stream
+ * @param final Whether the stream ended (otherwise writing continues behind the audio)
+ */
+static void _update_file_headers(StreamOutputs *outputs_p, bool final) {
+    for (uint16_t i = 0; i < outputs_p->outputCount; i++) {
+        FILE *outputFile_p = outputs_p->outputFiles_pp[i];
+        if (!outputFile_p) {
+            continue;
+        }
+        const uint32_t dataOffset = wav_output_header_size(outputs_p->formats_p[i].audio_format);
+        fseek(outputFile_p, 0, SEEK_SET);
+        if (write_output_header(outputFile_p, &outputs_p->formats_p[i], outputs_p->bytesWritten_p[i], dataOffset,
+                                outputs_p->largeContainer) != 0) {
+            fprintf(stderr, "Warning: Failed to update header of output %d\n", i + 1);
+        }
+        if (final) {
+            continue;
+        }
+        fflush(outputFile_p);
+#ifdef WIN32
+        _fseeki64(outputFile_p, (__int64)(dataOffset + outputs_p->bytesWritten_p[i]), SEEK_SET);
+#else
+        fseeko(outputFile_p, (off_t)(dataOffset + outputs_p->bytesWritten_p[i]), SEEK_SET);
+#endif
+    }
+}
+
+
+/**
+ * Sink of the push API, appends a block to its output
+ */
+static int _write_block(void *user_p, const WavsplitBlock *block_p) {
+    StreamOutputs *outputs_p = user_p;
+    FILE **outputFile_pp = &outputs_p->outputFiles_pp[block_p->output];
+    if (!*outputFile_pp) {
+        *outputFile_pp = _open_output(outputs_p, block_p);
+        if (!*outputFile_pp) {
+            return -1;
+        }
+    }
+
+    if (fwrite(block_p->data_p, 1, block_p->bytes, *outputFile_pp) != block_p->bytes) {
+        fprintf(stderr, "ERROR: Failed to write output %s\n", block_p->name_p);
+        return -1;
+    }
+    outputs_p->bytesWritten_p[block_p->output] += block_p->bytes;
+
+    // consumers of pipes get every block right away
+    if (outputs_p->stream_p->pipePattern_p) {
+        if (fflush(*outputFile_pp) != 0) {
+            fprintf(stderr, "ERROR: Failed to write output %s\n", block_p->name_p);
+            return -1;
+        }
+        return 0;
+    }
+
+    // output files stay valid WAV files while the stream is running
+    const double now = _monotonic_seconds();
+    if (block_p->output == outputs_p->outputCount - 1 &&
+        now - outputs_p->lastHeaderUpdate >= STREAM_HEADER_INTERVAL_SECONDS) {
+        _update_file_headers(outputs_p, false);
+        outputs_p->lastHeaderUpdate = now;
+    }
+    return 0;
+}
+
+
+/**
+ * Read whatever part of the stream arrived, waiting only until some bytes are available
+ *
+ * @return Bytes read, 0 at the end of the stream, -1 on failure
+ */
+static int64_t _read_stream(FILE *inputFile_p, uint8_t *buffer_p, size_t byteCount) {
+#ifdef WIN32
+    const size_t bytesRead = fread(buffer_p, 1, byteCount, inputFile_p);
+    return ferror(inputFile_p) ? -1 : (int64_t)bytesRead;
+#else
+    // fread would wait for the whole buffer, which stalls live streams of few channels
+    while (1) {
+        const ssize_t bytesRead = read(fileno(inputFile_p), buffer_p, byteCount);
+        if (bytesRead >= 0 || errno != EINTR) {
+            return bytesRead;
+        }
+    }
+#endif
+}
+
+
+/**
+ * Open the stream and read its format
+ *
+ * @param stream_p Stream options
+ * @param format_p Pointer to store the format of the stream
+ * @param dataBytes_p Pointer to store the audio bytes announced by the header (UINT64_MAX if unknown)
+ * @return Opened stream, positioned at the first audio byte
+ */
+static FILE *_open_stream(const StreamOptions *stream_p, WavHeader *format_p, uint64_t *dataBytes_p) {
+    FILE *inputFile_p = stdin;
+    if (strcmp(stream_p->inputPath_p, "-") == 0) {
+#ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    } else {
+        inputFile_p = fopen(stream_p->inputPath_p, "rb");
+        if (!inputFile_p) {
+            fprintf(stderr, "ERROR: Failed to open stream %s\n", stream_p->inputPath_p);
+            exit(1);
+        }
+    }
+
+    // without buffering no audio is read ahead while parsing the header, so the audio can be read directly
+    setvbuf(inputFile_p, NULL, _IONBF, 0);
+
+    *dataBytes_p = UINT64_MAX;
+    if (stream_p->raw) {
+        *format_p = stream_p->rawFormat;
+        return inputFile_p;
+    }
+
+    if (read_header(inputFile_p, format_p) != 0 ||
+        session_index_check_chunk(NULL, format_p, stream_p->inputPath_p) != 0) {
+        exit(1);
+    }
+    // streamed headers are written before the length is known, RF64 keeps it in ds64
+    const bool unknownLength = format_p->data_bytes == 0 || format_p->data_bytes == UINT32_MAX ||
+                               strncmp(format_p->riff_header, "RIFF", 4) != 0;
+    if (!unknownLength) {
+        *dataBytes_p = format_p->data_bytes;
+    }
+    return inputFile_p;
+}
+
+
+void stream_split(const SplitOptions *options_p, const StreamOptions *stream_p, const char *outputPath_p) {
+    if (stream_p->pipePattern_p && _check_pipe_pattern(stream_p->pipePattern_p) != 0) {
+        exit(1);
+    }
+    if (options_p->jobs > 1) {
+        fprintf(stderr, "Warning: Streams are split on a single thread, ignoring -j\n");
+    }
+#ifndef WIN32
+    // a consumer closing its pipe fails the write instead of ending the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    WavHeader format;
+    uint64_t dataBytes;
+    FILE *inputFile_p = _open_stream(stream_p, &format, &dataBytes);
+
+    StreamOutputs outputs;
+    memset(&outputs, 0, sizeof(outputs));
+    outputs.stream_p = stream_p;
+    outputs.largeContainer = options_p->largeContainer;
+    outputs.sampleRate = format.sample_rate;
+    outputs.lastHeaderUpdate = _monotonic_seconds();
+
+    char *outputDirectory_p = NULL;
+    if (!stream_p->pipePattern_p) {
+        outputDirectory_p = malloc(strlen(outputPath_p) + 2);
+        if (!outputDirectory_p) {
+            fprintf(stderr, "ERROR: Memory allocation failed\n");
+            exit(1);
+        }
+        sprintf(outputDirectory_p, "%s%c", outputPath_p, PATH_SEPARATOR);
+        _create_output_folder(outputDirectory_p);
+        outputs.outputPath_p = outputDirectory_p;
+    }
+
+    // pipe consumers see every block within a tenth of a second of audio
+    WavsplitConfig config;
+    memset(&config, 0, sizeof(config));
+    config.numChannels = format.num_channels;
+    config.sampleRate = format.sample_rate;
+    config.bitsPerSample = format.bits_per_sample;
+    config.floatSamples = format.audio_format == WAV_FORMAT_IEEE_FLOAT;
+    config.channels_p = stream_p->channelSpec_p;
+    config.channelMap_p = stream_p->channelMap_p;
+    config.sampleFormat = sample_format_to_wavsplit(options_p->sampleFormat);
+    config.blockFrames = format.sample_rate / 10 > 0 ? format.sample_rate / 10 : 1;
+    config.sink_p = _write_block;
+    config.user_p = &outputs;
+
+    WavsplitContext *context_p = NULL;
+    if (wavsplit_create(&config, &context_p) != WAVSPLIT_OK) {
+        fprintf(stderr, "ERROR: %s\n", context_p ? wavsplit_error_message(context_p) : "Memory allocation failed");
+        exit(1);
+    }
+    outputs.outputCount = wavsplit_output_count(context_p);
+    outputs.outputFiles_pp = calloc(outputs.outputCount, sizeof(FILE *));
+    outputs.formats_p = calloc(outputs.outputCount, sizeof(WavHeader));
+    outputs.bytesWritten_p = calloc(outputs.outputCount, sizeof(uint64_t));
+    uint8_t *readBuffer_p = malloc(STREAM_READ_BYTES + format.block_align);
+    if (!outputs.outputFiles_pp || !outputs.formats_p || !outputs.bytesWritten_p || !readBuffer_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+
+    printf("Splitting %s stream of %d channels at %u Hz into %d outputs\n",
+           strcmp(stream_p->inputPath_p, "-") == 0 ? "stdin" : stream_p->inputPath_p, format.num_channels,
+           format.sample_rate, outputs.outputCount);
+    fflush(stdout);
+
+    // reads may end within a frame, the rest of it is kept for the next read
+    const size_t blockAlign = format.block_align;
+    size_t pendingBytes = 0;
+    uint64_t bytesLeft = dataBytes;
+    const double start = _monotonic_seconds();
+    while (bytesLeft > 0) {
+        size_t bytesToRead = STREAM_READ_BYTES;
+        if (bytesToRead > bytesLeft) {
+            bytesToRead = (size_t)bytesLeft;
+        }
+        const int64_t bytesRead = _read_stream(inputFile_p, readBuffer_p + pendingBytes, bytesToRead);
+        if (bytesRead < 0) {
+            fprintf(stderr, "ERROR: Failed to read stream %s\n", stream_p->inputPath_p);
+            exit(1);
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        if (bytesLeft != UINT64_MAX) {
+            bytesLeft -= (uint64_t)bytesRead;
+        }
+
+        const size_t availableBytes = pendingBytes + (size_t)bytesRead;
+        const size_t frames = availableBytes / blockAlign;
+        const WavsplitStatus status = wavsplit_push(context_p, readBuffer_p, frames);
+        if (status != WAVSPLIT_OK) {
+            fprintf(stderr, "ERROR: %s\n", wavsplit_error_message(context_p));
+            exit(1);
+        }
+        pendingBytes = availableBytes - frames * blockAlign;
+        memmove(readBuffer_p, readBuffer_p + frames * blockAlign, pendingBytes);
+    }
+    if (pendingBytes > 0) {
+        fprintf(stderr, "Warning: Stream ended within a frame, dropping %zu bytes\n", pendingBytes);
+    }
+    if (bytesLeft != UINT64_MAX && bytesLeft > 0) {
+        fprintf(stderr, "Warning: Stream ended %" PRIu64 " bytes before the end of its data chunk\n", bytesLeft);
+    }
+
+    if (wavsplit_finish(context_p) != WAVSPLIT_OK) {
+        fprintf(stderr, "ERROR: %s\n", wavsplit_error_message(context_p));
+        exit(1);
+    }
+    const uint64_t frames = wavsplit_frames(context_p);
+    const double seconds = _monotonic_seconds() - start;
+    printf("Stream ended after %" PRIu64 " frames (%.1f s of audio) in %.1f s\n", frames,
+           (double)frames / format.sample_rate, seconds);
+
+    if (!stream_p->pipePattern_p) {
+        _update_file_headers(&outputs, true);
+    }
+    for (uint16_t i = 0; i < outputs.outputCount; i++) {
+        if (outputs.outputFiles_pp[i]) {
+            fclose(outputs.outputFiles_pp[i]);
+        }
+    }
+    if (inputFile_p != stdin) {
+        fclose(inputFile_p);
+    }
+
+    wavsplit_destroy(context_p);
+    free(readBuffer_p);
+    free(outputs.outputFiles_pp);
+    free(outputs.formats_p);
+    free(outputs.bytesWritten_p);
+    free(outputDirectory_p);
+}
@@ -2,14 +2,22 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
 
 #define MAX_PATH_LENGTH 250
 
 #ifdef WIN32
 #include <windows.h>
+#include <io.h>
+#include <psapi.h>
 #define PATH_SEPARATOR '\\'
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #define PATH_SEPARATOR '/'
@@ -17,9 +25,9 @@
 
 #include "utils.h"
 
-void _cleanup(FILE ***outputFiles, const uint16_t count, uint32_t **bytesWritten) {
+void _cleanup(FILE ***outputFiles, const uint16_t count, uint64_t **bytesWritten) {
     if (outputFiles) {
-        for (int i = 0; i < count + 1; i++) {
+        for (int i = 0; i < count; i++) {
             if ((*outputFiles)[i]) fclose((*outputFiles)[i]);
         }
         free(*outputFiles);
@@ -45,9 +53,58 @@ void _create_output_folder(char *outputPath) {
 #endif
 }
 
-void _find_max_chunk_index(uint64_t *maxChunkIndex, const char *sessionPath) {
-    uint64_t currentChunkIndex = 0;
-    char currentHexIndex[9] = {0};
+/**
+ * Chunk index of a file name, chunks are called <8 hex digits>.WAV
+ *
+ * @return 0 if the name belongs to a chunk, -1 otherwise
+ */
+static int _chunk_name_index(const char *filename, uint64_t *chunkIndex) {
+    if (strlen(filename) != 12 || filename[8] != '.' || toupper((unsigned char)filename[9]) != 'W' ||
+        toupper((unsigned char)filename[10]) != 'A' || toupper((unsigned char)filename[11]) != 'V') {
+        return -1;
+    }
+    uint64_t index = 0;
+    for (int i = 0; i < 8; i++) {
+        if (!isxdigit((unsigned char)filename[i])) {
+            return -1;
+        }
+        const int digit = toupper((unsigned char)filename[i]);
+        index = index * 16 + (uint64_t)(digit <= '9' ? digit - '0' : digit - 'A' + 10);
+    }
+    *chunkIndex = index;
+    return 0;
+}
+
+
+static int _compare_chunk_indices(const void *a_p, const void *b_p) {
+    const uint64_t a = *(const uint64_t *)a_p;
+    const uint64_t b = *(const uint64_t *)b_p;
+    return a < b ? -1 : a > b;
+}
+
+
+/**
+ * Append a chunk index to a growing array
+ */
+static void _append_chunk_index(uint64_t **indices, uint64_t *count, uint64_t *capacity, uint64_t chunkIndex) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        uint64_t *grown = realloc(*indices, *capacity * sizeof(uint64_t));
+        if (!grown) {
+            fprintf(stderr, "ERROR: Memory allocation failed\n");
+            exit(1);
+        }
+        *indices = grown;
+    }
+    (*indices)[(*count)++] = chunkIndex;
+}
+
+
+uint64_t _list_chunk_indices(const char *sessionPath, uint64_t **indices) {
+    uint64_t count = 0;
+    uint64_t capacity = 0;
+    uint64_t chunkIndex = 0;
+    *indices = NULL;
 
 #ifdef WIN32
     char searchPath[MAX_PATH_LENGTH];
@@ -62,105 +119,276 @@ void _find_max_chunk_index(uint64_t *maxChunkIndex, const char *sessionPath) {
     }
 
     do {
-        if (!strstr(currentEntry.cFileName, ".WAV")) {
-            continue;
-        }
-        strncpy(currentHexIndex, currentEntry.cFileName, strlen(currentEntry.cFileName) - 4);
-        currentHexIndex[8] = '\0';
-        if (sscanf(currentHexIndex, "%lx", &currentChunkIndex) != 1) {
-            continue;
-        }
-        if (currentChunkIndex > *maxChunkIndex) {
-            *maxChunkIndex = currentChunkIndex;
+        if (_chunk_name_index(currentEntry.cFileName, &chunkIndex) == 0) {
+            _append_chunk_index(indices, &count, &capacity, chunkIndex);
         }
     } while (FindNextFile(directoryHandle, &currentEntry));
 
     FindClose(directoryHandle);
 #else
     DIR *sessionDirectory = opendir(sessionPath);
+    if (!sessionDirectory) {
+        fprintf(stderr, "ERROR: Failed to open session directory %s\n", sessionPath);
+        exit(1);
+    }
 
     struct dirent *entry;
     while ((entry = readdir(sessionDirectory)) != NULL) {
-      const char *filename = entry->d_name;
-      
-      size_t fileNameLength = strlen(filename);
-      if (fileNameLength < 4) {
-        continue;
-      }
-      if (strcasecmp(filename + fileNameLength - 4, ".wav") != 0) {
-        continue;
-      }
-      size_t hexIndexLength = fileNameLength - 4;
-      if (hexIndexLength > 8) {
-        hexIndexLength = 8;
-      }
-      strncpy(currentHexIndex, filename, hexIndexLength);
-      currentHexIndex[hexIndexLength] = '\0';
-
-      if (sscanf(currentHexIndex, "%lx", &currentChunkIndex) != 1) {
-        continue;
-      }
-      if (currentChunkIndex > *maxChunkIndex) {
-          *maxChunkIndex = currentChunkIndex;
-      }
-    }
-    
+        if (_chunk_name_index(entry->d_name, &chunkIndex) == 0) {
+            _append_chunk_index(indices, &count, &capacity, chunkIndex);
+        }
+    }
+
     closedir(sessionDirectory);
 #endif
+
+    // the same index may show up twice on case sensitive file systems (.WAV and .wav)
+    if (count > 1) {
+        qsort(*indices, count, sizeof(uint64_t), _compare_chunk_indices);
+        uint64_t unique = 1;
+        for (uint64_t i = 1; i < count; i++) {
+            if ((*indices)[i] != (*indices)[unique - 1]) {
+                (*indices)[unique++] = (*indices)[i];
+            }
+        }
+        count = unique;
+    }
+    return count;
+}
+
+void _find_max_chunk_index(uint64_t *maxChunkIndex, const char *sessionPath) {
+    uint64_t *indices = NULL;
+    const uint64_t count = _list_chunk_indices(sessionPath, &indices);
+    if (count > 0 && indices[count - 1] > *maxChunkIndex) {
+        *maxChunkIndex = indices[count - 1];
+    }
+    free(indices);
+}
+
+void _preallocate_output(FILE *outputFile, uint64_t fileSize) {
+#ifndef WIN32
+    // reserve the whole file at once so the outputs don't fragment while growing side by side
+    fflush(outputFile);
+    const int result = posix_fallocate(fileno(outputFile), 0, (off_t)fileSize);
+    if (result != 0) {
+        fprintf(stderr, "Warning: Failed to preallocate output file: %s\n", strerror(result));
+    }
+#else
+    (void)outputFile;
+    (void)fileSize;
+#endif
+}
+
+void _truncate_output(FILE *outputFile, uint64_t fileSize) {
+    fflush(outputFile);
+#ifdef WIN32
+    if (_chsize_s(_fileno(outputFile), (__int64)fileSize) != 0) {
+#else
+    if (ftruncate(fileno(outputFile), (off_t)fileSize) != 0) {
+#endif
+        fprintf(stderr, "Warning: Failed to trim output file to its actual size\n");
+    }
+}
+
+int _sync_file(FILE *file) {
+    if (fflush(file) != 0) {
+        return -1;
+    }
+#ifdef WIN32
+    return FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(file))) ? 0 : -1;
+#elif defined(__APPLE__)
+    return fsync(fileno(file));
+#else
+    return fdatasync(fileno(file));
+#endif
+}
+
+int _sync_directory(const char *directoryPath) {
+#ifdef WIN32
+    (void)directoryPath;
+    return 0;
+#else
+    const int fd = open(directoryPath, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    const int result = fsync(fd);
+    close(fd);
+    return result;
+#endif
+}
+
+void _output_name(char *name_p, size_t nameSize, const ChannelSelection *channels, uint16_t output) {
+    if (channels->names_p) {
+        snprintf(name_p, nameSize, "%s", channels->names_p[output]);
+    } else {
+        snprintf(name_p, nameSize, "ch_%d", channels->channels_p[channels->firstSlots_p[output]] + 1);
+    }
 }
 
-void _init_output_files(FILE *inputFile, FILE ***outputFiles, const WavHeader *inputHeader, uint32_t **dataWritten,
-                        const char *outputPath) {
+void _output_header(const WavHeader *inputHeader, uint16_t channelCount, WavHeader *outHeader) {
+    *outHeader = *inputHeader;
+    outHeader->num_channels = channelCount;
+    outHeader->block_align = channelCount * (outHeader->bits_per_sample / 8);
+    outHeader->byte_rate = outHeader->sample_rate * outHeader->block_align;
+}
+
+void _init_output_files(FILE ***outputFiles, const WavHeader *inputHeader, const ChannelSelection *channels,
+                        uint64_t **dataWritten, const char *outputPath, uint64_t frameCount,
+                        uint32_t dataOffset, WavContainer largeContainer) {
     // Allocate arrays for files and bytes written
-    *outputFiles = malloc(inputHeader->num_channels * sizeof(FILE *));
-    *dataWritten = calloc(inputHeader->num_channels, sizeof(uint32_t));
+    *outputFiles = malloc(channels->count * sizeof(FILE *));
+    *dataWritten = calloc(channels->count, sizeof(uint64_t));
     if (!*outputFiles || !*dataWritten) {
         fprintf(stderr, "Failed to allocate memory for output files or tracking data.\n");
-        fclose(inputFile);
-        _cleanup(outputFiles, inputHeader->num_channels, dataWritten);
+        _cleanup(outputFiles, 0, dataWritten);
         exit(1);
     }
 
-    WavHeader outHeader = *inputHeader;
-    outHeader.num_channels = 1;
-    outHeader.byte_rate = outHeader.sample_rate * outHeader.bits_per_sample / 8;
-    outHeader.block_align = outHeader.bits_per_sample / 8;
-    outHeader.data_bytes = 0; // Placeholder
-    outHeader.wav_size = 36 + outHeader.data_bytes;
+    // create output files, write final headers and reserve space for the audio data
+    for (int i = 0; i < channels->count; i++) {
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels, i);
+
+        WavHeader outHeader;
+        _output_header(inputHeader, channels->groupSizes_p[i], &outHeader);
+        const uint64_t dataBytes = frameCount * outHeader.block_align;
+        if (dataOffset - 8 + dataBytes > UINT32_MAX) {
+            printf("Output %s exceeds the RIFF size limit, writing %s header\n", outputName,
+                   largeContainer == WAV_CONTAINER_BW64 ? "BW64" : "RF64");
+        }
 
-    // create output files and write headers
-    for (int i = 0; i < inputHeader->num_channels; i++) {
         char outputFileName[260];
-        snprintf(outputFileName, sizeof(outputFileName), "%sch_%d.wav", outputPath, i + 1);
+        snprintf(outputFileName, sizeof(outputFileName), "%s%s.wav", outputPath, outputName);
         (*outputFiles)[i] = fopen(outputFileName, "wb+");
         if (!(*outputFiles)[i]) {
             fprintf(stderr, "Failed to open output file %s\n", outputFileName);
-            fclose(inputFile);
             _cleanup(outputFiles, i, dataWritten);
             exit(1);
         }
 
-        if (write_header((*outputFiles)[i], &outHeader) == -1) {
+        if (write_output_header((*outputFiles)[i], &outHeader, dataBytes, dataOffset, largeContainer) == -1) {
             fprintf(stderr, "Failed to write header to output file.\n");
-            fclose(inputFile);
+            _cleanup(outputFiles, i + 1, dataWritten);
+            exit(1);
+        }
+
+        _preallocate_output((*outputFiles)[i], dataOffset + dataBytes);
+    }
+}
+
+void _reopen_output_files(FILE ***outputFiles, const WavHeader *inputHeader, const ChannelSelection *channels,
+                          uint64_t **dataWritten, const char *outputPath, uint64_t resumeFrames, uint64_t frameCount,
+                          uint32_t dataOffset, WavContainer largeContainer) {
+    *outputFiles = malloc(channels->count * sizeof(FILE *));
+    *dataWritten = calloc(channels->count, sizeof(uint64_t));
+    if (!*outputFiles || !*dataWritten) {
+        fprintf(stderr, "Failed to allocate memory for output files or tracking data.\n");
+        _cleanup(outputFiles, 0, dataWritten);
+        exit(1);
+    }
+
+    for (int i = 0; i < channels->count; i++) {
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels, i);
+
+        char outputFileName[260];
+        snprintf(outputFileName, sizeof(outputFileName), "%s%s.wav", outputPath, outputName);
+        (*outputFiles)[i] = fopen(outputFileName, "rb+");
+        if (!(*outputFiles)[i]) {
+            fprintf(stderr, "Failed to reopen output file %s\n", outputFileName);
             _cleanup(outputFiles, i, dataWritten);
             exit(1);
         }
+
+        // the header describes the extended session, audio past the resume point is dropped
+        WavHeader outHeader;
+        _output_header(inputHeader, channels->groupSizes_p[i], &outHeader);
+        const uint64_t dataBytes = frameCount * outHeader.block_align;
+        (*dataWritten)[i] = resumeFrames * outHeader.block_align;
+        if (write_output_header((*outputFiles)[i], &outHeader, dataBytes, dataOffset, largeContainer) == -1) {
+            fprintf(stderr, "Failed to write header to output file.\n");
+            _cleanup(outputFiles, i + 1, dataWritten);
+            exit(1);
+        }
+        _truncate_output((*outputFiles)[i], dataOffset + (*dataWritten)[i]);
+        _preallocate_output((*outputFiles)[i], dataOffset + dataBytes);
+#ifdef WIN32
+        _fseeki64((*outputFiles)[i], (__int64)(dataOffset + (*dataWritten)[i]), SEEK_SET);
+#else
+        fseeko((*outputFiles)[i], (off_t)(dataOffset + (*dataWritten)[i]), SEEK_SET);
+#endif
     }
 }
 
-void _rewrite_headers(const WavHeader *inputHeader, uint32_t **dataWritten, FILE ***outputFiles) {
-    for (int i = 0; i < inputHeader->num_channels; i++) {
+void _rewrite_headers(const WavHeader *inputHeader, const ChannelSelection *channels, uint64_t **dataWritten,
+                      FILE ***outputFiles, uint64_t plannedFrames, uint32_t dataOffset,
+                      WavContainer largeContainer) {
+    for (int i = 0; i < channels->count; i++) {
+        WavHeader finalHeader;
+        _output_header(inputHeader, channels->groupSizes_p[i], &finalHeader);
+        const uint64_t plannedBytes = plannedFrames * finalHeader.block_align;
+        if ((*dataWritten)[i] == plannedBytes) {
+            continue;
+        }
+
+        char outputName[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        _output_name(outputName, sizeof(outputName), channels, i);
+        fprintf(stderr, "Warning: Output %s received %" PRIu64 " instead of %" PRIu64 " bytes, fixing its header\n",
+                outputName, (*dataWritten)[i], plannedBytes);
+
         fseek((*outputFiles)[i], 0, SEEK_SET);
-        WavHeader finalHeader = *inputHeader;
-        finalHeader.num_channels = 1;
-        finalHeader.byte_rate = finalHeader.sample_rate * finalHeader.bits_per_sample / 8;
-        finalHeader.block_align = finalHeader.bits_per_sample / 8;
-        finalHeader.data_bytes = (*dataWritten)[i];
-        finalHeader.wav_size = 36 + finalHeader.data_bytes;
-
-        if (write_header((*outputFiles)[i], &finalHeader) == -1) {
-            fprintf(stderr, "Failed to rewrite header with correct sizes for output file %d.\n", i + 1);
+        if (write_output_header((*outputFiles)[i], &finalHeader, (*dataWritten)[i], dataOffset,
+                                largeContainer) == -1) {
+            fprintf(stderr, "Failed to rewrite header with correct sizes for output file %s.\n", outputName);
         }
+        _truncate_output((*outputFiles)[i], dataOffset + (*dataWritten)[i]);
     }
 }
+
+void _update_headers(const WavHeader *inputHeader, const ChannelSelection *channels, const uint64_t *dataWritten,
+                     FILE **outputFiles, uint32_t dataOffset, WavContainer largeContainer) {
+    for (int i = 0; i < channels->count; i++) {
+        WavHeader currentHeader;
+        _output_header(inputHeader, channels->groupSizes_p[i], &currentHeader);
+
+        fseek(outputFiles[i], 0, SEEK_SET);
+        if (write_output_header(outputFiles[i], &currentHeader, dataWritten[i], dataOffset, largeContainer) == -1) {
+            fprintf(stderr, "Warning: Failed to update header of output %d\n", i + 1);
+        }
+        fflush(outputFiles[i]);
+
+        // buffered writes continue behind the data written so far
+#ifdef WIN32
+        _fseeki64(outputFiles[i], (__int64)(dataOffset + dataWritten[i]), SEEK_SET);
+#else
+        fseeko(outputFiles[i], (off_t)(dataOffset + dataWritten[i]), SEEK_SET);
+#endif
+    }
+}
+
+uint64_t _peak_memory_bytes(void) {
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (uint64_t)usage.ru_maxrss * 1024; // reported in kilobytes on Linux
+#endif
+}
+
+double _monotonic_seconds(void) {
+#ifdef WIN32
+    return GetTickCount64() / 1000.0;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
@@ -0,0 +1,241 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "verify.h"
+#include "checksum.h"
+#include "input-source.h"
+#include "session-index.h"
+#include "wavsplit.h"
+#include "utils.h"
+
+#ifdef WIN32
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+#define MAX_PATH_LENGTH 250
+
+// Interleaved audio is read in blocks of whole frames of up to this size
+#define READ_BLOCK_SIZE_BYTES (1024 * 1024)
+
+typedef struct {
+    bool output;                // Entry describes an output rather than an input chunk
+    char name[MAX_PATH_LENGTH]; // Chunk file or output name
+    uint64_t bytes;             // Audio bytes recorded for the entry
+    uint32_t crc;               // CRC32C recorded for the entry
+    bool seen;                  // Entry was compared
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *entries_p; // Entries in file order
+    size_t count;             // Number of entries
+} Manifest;
+
+
+/**
+ * Load the entries of a manifest
+ *
+ * Comment lines starting with # and the column header are skipped.
+ */
+static int _load_manifest(const char *manifestPath_p, Manifest *manifest_p) {
+    memset(manifest_p, 0, sizeof(*manifest_p));
+    FILE *manifestFile_p = fopen(manifestPath_p, "r");
+    if (!manifestFile_p) {
+        fprintf(stderr, "ERROR: Failed to open manifest %s\n", manifestPath_p);
+        return -1;
+    }
+
+    size_t capacity = 0;
+    unsigned int lineNumber = 0;
+    char line[2 * MAX_PATH_LENGTH];
+    while (fgets(line, sizeof(line), manifestFile_p)) {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r' || strncmp(line, "kind,", 5) == 0) {
+            continue;
+        }
+
+        ManifestEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        char kind[8];
+        if (sscanf(line, "%7[^,],%249[^,],%" SCNu64 ",%" SCNx32, kind, entry.name, &entry.bytes, &entry.crc) != 4 ||
+            (strcmp(kind, "input") != 0 && strcmp(kind, "output") != 0)) {
+            fprintf(stderr, "ERROR: Invalid line %u in manifest %s\n", lineNumber, manifestPath_p);
+            fclose(manifestFile_p);
+            free(manifest_p->entries_p);
+            return -1;
+        }
+        entry.output = kind[0] == 'o';
+
+        if (manifest_p->count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            ManifestEntry *entries_p = realloc(manifest_p->entries_p, capacity * sizeof(ManifestEntry));
+            if (!entries_p) {
+                fprintf(stderr, "ERROR: Memory allocation failed\n");
+                exit(1);
+            }
+            manifest_p->entries_p = entries_p;
+        }
+        manifest_p->entries_p[manifest_p->count++] = entry;
+    }
+    fclose(manifestFile_p);
+
+    if (manifest_p->count == 0) {
+        fprintf(stderr, "ERROR: Manifest %s holds no checksums\n", manifestPath_p);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Compare a checksum with its manifest entry
+ *
+ * @return 1 if the entry is missing or differs, 0 if it matches
+ */
+static unsigned int _compare_entry(Manifest *manifest_p, bool output, const char *name_p, const Checksum *checksum_p) {
+    const char *kind_p = output ? "output" : "input";
+    for (size_t i = 0; i < manifest_p->count; i++) {
+        ManifestEntry *entry_p = &manifest_p->entries_p[i];
+        if (entry_p->output != output || strcmp(entry_p->name, name_p) != 0) {
+            continue;
+        }
+        entry_p->seen = true;
+        if (entry_p->bytes == checksum_p->bytes && entry_p->crc == checksum_p->crc) {
+            return 0;
+        }
+        printf("MISMATCH %s %s: %" PRIu64 " bytes with CRC32C %08" PRIx32 ", manifest has %" PRIu64
+               " bytes with %08" PRIx32 "\n", kind_p, name_p, checksum_p->bytes, checksum_p->crc,
+               entry_p->bytes, entry_p->crc);
+        return 1;
+    }
+    printf("MISMATCH %s %s: not in the manifest\n", kind_p, name_p);
+    return 1;
+}
+
+
+static int _hash_block(void *user_p, const WavsplitBlock *block_p) {
+    Checksum **outputs_pp = user_p;
+    checksum_update(&(*outputs_pp)[block_p->output], block_p->data_p, block_p->bytes);
+    return 0;
+}
+
+
+unsigned int verify_session(const SplitOptions *options_p, const char *channelSpec_p, const char *channelMap_p,
+                            const char *manifestPath_p, const char *sessionPath_p) {
+    Manifest manifest;
+    if (_load_manifest(manifestPath_p, &manifest) != 0) {
+        exit(1);
+    }
+    SessionIndex index;
+    if (session_index_build(&index, sessionPath_p) != 0) {
+        exit(1);
+    }
+    const WavHeader *format_p = &index.chunks_p[0].header;
+
+    // the outputs are split in memory exactly as a run would write them
+    Checksum *outputs_p = NULL;
+    WavsplitConfig config;
+    memset(&config, 0, sizeof(config));
+    config.numChannels = format_p->num_channels;
+    config.sampleRate = format_p->sample_rate;
+    config.bitsPerSample = format_p->bits_per_sample;
+    config.floatSamples = format_p->audio_format == WAV_FORMAT_IEEE_FLOAT;
+    config.channels_p = channelSpec_p;
+    config.channelMap_p = channelMap_p;
+    config.sampleFormat = sample_format_to_wavsplit(options_p->sampleFormat);
+    config.sink_p = _hash_block;
+    config.user_p = &outputs_p;
+
+    WavsplitContext *context_p = NULL;
+    if (wavsplit_create(&config, &context_p) != WAVSPLIT_OK) {
+        fprintf(stderr, "ERROR: %s\n", context_p ? wavsplit_error_message(context_p) : "Memory allocation failed");
+        exit(1);
+    }
+    const uint16_t outputCount = wavsplit_output_count(context_p);
+    outputs_p = calloc(outputCount, sizeof(Checksum));
+    Checksum *inputs_p = calloc(index.chunkCount, sizeof(Checksum));
+    const size_t framesPerRead = READ_BLOCK_SIZE_BYTES / format_p->block_align > 0 ?
+                                 READ_BLOCK_SIZE_BYTES / format_p->block_align : 1;
+    uint8_t *readBuffer_p = malloc(framesPerRead * format_p->block_align);
+    if (!outputs_p || !inputs_p || !readBuffer_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+
+    printf("Verifying %" PRIu64 " chunks and %u outputs of %s against %s (CRC32C %s)\n", index.chunkCount,
+           outputCount, sessionPath_p, manifestPath_p, checksum_kernel_name());
+    fflush(stdout);
+    const double start = _monotonic_seconds();
+    uint64_t bytesRead = 0;
+    for (uint64_t chunkIndex = 1; chunkIndex <= index.chunkCount; chunkIndex++) {
+        char inputFilePath[MAX_PATH_LENGTH];
+        snprintf(inputFilePath, sizeof(inputFilePath), "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR,
+                 chunkIndex);
+        FILE *inputFile_p = fopen(inputFilePath, "rb");
+        WavHeader inputHeader;
+        if (!inputFile_p || read_header(inputFile_p, &inputHeader) != 0) {
+            fprintf(stderr, "ERROR: Failed to read %s\n", inputFilePath);
+            exit(1);
+        }
+        InputSource source;
+        if (input_source_open(&source, inputFile_p, &inputHeader, options_p->inputBackend, NULL) != 0) {
+            fprintf(stderr, "ERROR: Failed to open audio data of input file\n");
+            exit(1);
+        }
+        input_source_set_checksum(&source, &inputs_p[chunkIndex - 1]);
+
+        const uint8_t *frames_p = NULL;
+        size_t framesRead;
+        while ((framesRead = input_source_next(&source, readBuffer_p, framesPerRead, &frames_p)) > 0) {
+            if (wavsplit_push(context_p, frames_p, framesRead) != WAVSPLIT_OK) {
+                fprintf(stderr, "ERROR: %s\n", wavsplit_error_message(context_p));
+                exit(1);
+            }
+            bytesRead += framesRead * format_p->block_align;
+        }
+        input_source_close(&source);
+        fclose(inputFile_p);
+    }
+    if (wavsplit_finish(context_p) != WAVSPLIT_OK) {
+        fprintf(stderr, "ERROR: %s\n", wavsplit_error_message(context_p));
+        exit(1);
+    }
+    const double seconds = _monotonic_seconds() - start;
+
+    unsigned int mismatches = 0;
+    for (uint64_t i = 0; i < index.chunkCount; i++) {
+        char name[MAX_PATH_LENGTH];
+        snprintf(name, sizeof(name), "%08" PRIX64 ".WAV", i + 1);
+        mismatches += _compare_entry(&manifest, false, name, &inputs_p[i]);
+    }
+    for (uint16_t i = 0; i < outputCount; i++) {
+        mismatches += _compare_entry(&manifest, true, wavsplit_output_name(context_p, i), &outputs_p[i]);
+    }
+    for (size_t i = 0; i < manifest.count; i++) {
+        if (!manifest.entries_p[i].seen) {
+            printf("MISMATCH %s %s: missing\n", manifest.entries_p[i].output ? "output" : "input",
+                   manifest.entries_p[i].name);
+            mismatches++;
+        }
+    }
+
+    printf("Read %.1f MB in %.1f s (%.1f MB/s)\n", bytesRead / (1024.0 * 1024.0), seconds,
+           seconds > 0 ? bytesRead / (1024.0 * 1024.0) / seconds : 0.0);
+    if (mismatches == 0) {
+        printf("All %zu checksums match\n", manifest.count);
+    } else {
+        printf("%u checksums do not match\n", mismatches);
+    }
+
+    wavsplit_destroy(context_p);
+    free(readBuffer_p);
+    free(inputs_p);
+    free(outputs_p);
+    free(manifest.entries_p);
+    session_index_free(&index);
+    return mismatches;
+}
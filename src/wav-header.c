@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "wav-header.h"
 
@@ -12,20 +13,43 @@
 #define PATH_SEPARATOR '/'
 #endif
 
-int read_header(FILE *inputFile_p, WavHeader *header_p) {
+/**
+ * Skip bytes of the input, reading over them where the input cannot seek (pipes)
+ *
+ * @return 0 on success, -1 if the input ended before
+ */
+static int _skip_bytes(FILE *inputFile_p, uint64_t byteCount) {
+    if (fseek(inputFile_p, (long)byteCount, SEEK_CUR) == 0) {
+        return 0;
+    }
+    for (uint64_t i = 0; i < byteCount; i++) {
+        if (fgetc(inputFile_p) == EOF) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parse the header of a WAV file up to the start of its audio data
+ *
+ * @param reason_pp Pointer to store the reason of a failure
+ * @return 0 on success, -1 if the header is incomplete or malformed
+ */
+static int _parse_header(FILE *inputFile_p, WavHeader *header_p, const char **reason_pp) {
     char currentChunkName[4];
     uint32_t currentChunkSize;
 
     // read RIFF header
     if (fread(header_p->riff_header, sizeof(header_p->riff_header), 1, inputFile_p) != 1 ||
         fread(&header_p->wav_size, sizeof(header_p->wav_size), 1, inputFile_p) != 1) {
-        fprintf(stderr, "ERROR: Failed to read initial RIFF header\n");
+        *reason_pp = "Failed to read initial RIFF header";
         return -1;
     }
 
     // read WAVE header
     if (fread(header_p->wave_header, sizeof(header_p->wave_header), 1, inputFile_p) != 1) {
-        fprintf(stderr, "ERROR: Failed to read WAVE header\n");
+        *reason_pp = "Failed to read WAVE header";
         return -1;
     }
 
@@ -33,13 +57,13 @@ int read_header(FILE *inputFile_p, WavHeader *header_p) {
     while (1) {
         // read current chunk id
         if (fread(currentChunkName, sizeof(currentChunkName), 1, inputFile_p) != 1) {
-            fprintf(stderr, "ERROR: Failed to read chunk ID\n");
+            *reason_pp = "Failed to read chunk ID";
             return -1;
         }
 
         // read the size of the current chunk
         if (fread(&currentChunkSize, sizeof(currentChunkSize), 1, inputFile_p) != 1) {
-            fprintf(stderr, "ERROR: Failed to read chunk size\n");
+            *reason_pp = "Failed to read chunk size";
             return -1;
         }
 
@@ -50,9 +74,9 @@ int read_header(FILE *inputFile_p, WavHeader *header_p) {
             break;
         }
 
-        // skip chunk
-        if (fseek(inputFile_p, currentChunkSize, SEEK_CUR) != 0) {
-            fprintf(stderr, "ERROR: Failed to skip chunk\n");
+        // skip chunk (chunks are word aligned, odd sizes are followed by a pad byte)
+        if (_skip_bytes(inputFile_p, (uint64_t)currentChunkSize + (currentChunkSize & 1)) != 0) {
+            *reason_pp = "Failed to skip chunk";
             return -1;
         }
     }
@@ -64,21 +88,30 @@ int read_header(FILE *inputFile_p, WavHeader *header_p) {
         fread(&header_p->byte_rate, sizeof(header_p->byte_rate), 1, inputFile_p) != 1 ||
         fread(&header_p->block_align, sizeof(header_p->block_align), 1, inputFile_p) != 1 ||
         fread(&header_p->bits_per_sample, sizeof(header_p->bits_per_sample), 1, inputFile_p) != 1) {
-        fprintf(stderr, "ERROR: Failed to read fmt-chunk\n");
+        *reason_pp = "Failed to read fmt-chunk";
         return -1;
     }
 
+    // skip extension fields (WAVE_FORMAT_EXTENSIBLE and friends)
+    if (header_p->fmt_chunk_size > 16) {
+        const uint32_t extraBytes = header_p->fmt_chunk_size - 16 + (header_p->fmt_chunk_size & 1);
+        if (_skip_bytes(inputFile_p, extraBytes) != 0) {
+            *reason_pp = "Failed to skip fmt-chunk extension";
+            return -1;
+        }
+    }
+
     // find the data chunk by skipping over other ones
     while (1) {
         // read current chunk id
         if (fread(currentChunkName, sizeof(currentChunkName), 1, inputFile_p) != 1) {
-            fprintf(stderr, "ERROR: Failed to read chunk ID\n");
+            *reason_pp = "Failed to read chunk ID";
             return -1;
         }
 
         // read current chunk size
         if (fread(&currentChunkSize, sizeof(currentChunkSize), 1, inputFile_p) != 1) {
-            fprintf(stderr, "ERROR: Failed to read chunk size\n");
+            *reason_pp = "Failed to read chunk size";
             return -1;
         }
 
@@ -89,9 +122,9 @@ int read_header(FILE *inputFile_p, WavHeader *header_p) {
             break;
         }
 
-        // skip chunk
-        if (fseek(inputFile_p, currentChunkSize, SEEK_CUR) != 0) {
-            fprintf(stderr, "ERROR: Failed to skip chunk\n");
+        // skip chunk (chunks are word aligned, odd sizes are followed by a pad byte)
+        if (_skip_bytes(inputFile_p, (uint64_t)currentChunkSize + (currentChunkSize & 1)) != 0) {
+            *reason_pp = "Failed to skip chunk";
             return -1;
         }
     }
@@ -99,6 +132,20 @@ int read_header(FILE *inputFile_p, WavHeader *header_p) {
     return 0;
 }
 
+int read_header(FILE *inputFile_p, WavHeader *header_p) {
+    const char *reason_p = NULL;
+    if (_parse_header(inputFile_p, header_p, &reason_p) != 0) {
+        fprintf(stderr, "ERROR: %s\n", reason_p);
+        return -1;
+    }
+    return 0;
+}
+
+int read_header_quiet(FILE *inputFile_p, WavHeader *header_p) {
+    const char *reason_p = NULL;
+    return _parse_header(inputFile_p, header_p, &reason_p);
+}
+
 int write_header(FILE *outputFile_p, const WavHeader *header_p) {
     // write RIFF header
     if (fwrite(header_p->riff_header, sizeof(header_p->riff_header), 1, outputFile_p) != 1 ||
@@ -136,6 +183,106 @@ int write_header(FILE *outputFile_p, const WavHeader *header_p) {
     return 0;
 }
 
+static int _write_chunk_header(FILE *outputFile_p, const char *id_p, uint32_t size) {
+    if (fwrite(id_p, 4, 1, outputFile_p) != 1 ||
+        fwrite(&size, sizeof(size), 1, outputFile_p) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int write_output_header(FILE *outputFile_p, const WavHeader *format_p, uint64_t dataBytes, uint32_t dataOffset,
+                        WavContainer largeContainer) {
+    const bool isFloat = format_p->audio_format == WAV_FORMAT_IEEE_FLOAT;
+    const uint32_t headerSize = wav_output_header_size(format_p->audio_format);
+    if (dataOffset != headerSize && dataOffset < headerSize + 8) {
+        fprintf(stderr, "ERROR: Invalid data offset %u\n", dataOffset);
+        return -1;
+    }
+
+    // RIFF sizes are 32 bit, larger files move the real sizes into the ds64 chunk
+    const bool isStream = dataBytes == WAV_STREAM_DATA_BYTES;
+    const uint64_t riffSize = isStream ? UINT32_MAX : dataOffset - 8 + dataBytes;
+    const bool isLarge = !isStream && riffSize > UINT32_MAX;
+    const char *riffId_p = "RIFF";
+    if (isLarge) {
+        riffId_p = largeContainer == WAV_CONTAINER_BW64 ? "BW64" : "RF64";
+    }
+
+    // write RIFF header
+    if (_write_chunk_header(outputFile_p, riffId_p, isLarge ? UINT32_MAX : (uint32_t)riffSize) != 0 ||
+        fwrite("WAVE", 4, 1, outputFile_p) != 1) {
+        fprintf(stderr, "ERROR: Failed to write RIFF chunk to output file\n");
+        return -1;
+    }
+
+    // write ds64 chunk, or a JUNK chunk of the same size reserving its space
+    uint64_t ds64Sizes[3] = {0, 0, 0};
+    if (isLarge) {
+        ds64Sizes[0] = riffSize;
+        ds64Sizes[1] = dataBytes;
+        ds64Sizes[2] = format_p->block_align ? dataBytes / format_p->block_align : 0;
+    }
+    const uint32_t tableLength = 0;
+    if (_write_chunk_header(outputFile_p, isLarge ? "ds64" : "JUNK", WAV_DS64_CHUNK_SIZE) != 0 ||
+        fwrite(ds64Sizes, sizeof(ds64Sizes), 1, outputFile_p) != 1 ||
+        fwrite(&tableLength, sizeof(tableLength), 1, outputFile_p) != 1) {
+        fprintf(stderr, "ERROR: Failed to write ds64 chunk to output file\n");
+        return -1;
+    }
+
+    // write fmt chunk (plain PCM format without extension, float with an empty one)
+    if (_write_chunk_header(outputFile_p, "fmt ", isFloat ? 18 : 16) != 0 ||
+        fwrite(&format_p->audio_format, sizeof(format_p->audio_format), 1, outputFile_p) != 1 ||
+        fwrite(&format_p->num_channels, sizeof(format_p->num_channels), 1, outputFile_p) != 1 ||
+        fwrite(&format_p->sample_rate, sizeof(format_p->sample_rate), 1, outputFile_p) != 1 ||
+        fwrite(&format_p->byte_rate, sizeof(format_p->byte_rate), 1, outputFile_p) != 1 ||
+        fwrite(&format_p->block_align, sizeof(format_p->block_align), 1, outputFile_p) != 1 ||
+        fwrite(&format_p->bits_per_sample, sizeof(format_p->bits_per_sample), 1, outputFile_p) != 1) {
+        fprintf(stderr, "ERROR: Failed to write 'fmt ' chunk to output file\n");
+        return -1;
+    }
+
+    // non-PCM formats need the frame count in a fact chunk, ds64 holds it for large files
+    if (isFloat) {
+        const uint16_t extensionSize = 0;
+        const uint64_t frames = format_p->block_align ? dataBytes / format_p->block_align : 0;
+        const uint32_t factFrames = isStream || isLarge || frames > UINT32_MAX ? UINT32_MAX : (uint32_t)frames;
+        if (fwrite(&extensionSize, sizeof(extensionSize), 1, outputFile_p) != 1 ||
+            _write_chunk_header(outputFile_p, "fact", sizeof(factFrames)) != 0 ||
+            fwrite(&factFrames, sizeof(factFrames), 1, outputFile_p) != 1) {
+            fprintf(stderr, "ERROR: Failed to write 'fact' chunk to output file\n");
+            return -1;
+        }
+    }
+
+    // pad up to the data offset
+    if (dataOffset > headerSize) {
+        const uint32_t junkSize = dataOffset - headerSize - 8;
+        if (_write_chunk_header(outputFile_p, "JUNK", junkSize) != 0) {
+            fprintf(stderr, "ERROR: Failed to write JUNK chunk to output file\n");
+            return -1;
+        }
+        for (uint32_t i = 0; i < junkSize; i++) {
+            if (fputc(0, outputFile_p) == EOF) {
+                fprintf(stderr, "ERROR: Failed to write JUNK chunk to output file\n");
+                return -1;
+            }
+        }
+    }
+
+    // write data chunk header
+    if (_write_chunk_header(outputFile_p, "data", isStream || isLarge ? UINT32_MAX : (uint32_t)dataBytes) != 0) {
+        fprintf(stderr, "ERROR: Failed to write data chunk header to output file\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+uint32_t wav_output_header_size(uint16_t audioFormat) {
+    return audioFormat == WAV_FORMAT_IEEE_FLOAT ? WAV_HEADER_SIZE_RESERVED_FLOAT : WAV_HEADER_SIZE_RESERVED;
+}
 
 int create_output_files(const WavHeader *inputHeader_p, const char *basePath_p, FILE ***outputFiles_ppp) {
     *outputFiles_ppp = malloc(inputHeader_p->num_channels * sizeof(FILE *));
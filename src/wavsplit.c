@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "wavsplit.h"
+#include "channel-selection.h"
+#include "deinterleave.h"
+#include "wav-header.h"
+#include "sample-convert.h"
+
+struct WavsplitContext {
+    WavsplitConfig config;          // Configuration of the stream (strings are not kept)
+    WavHeader format;               // Format of the pushed frames
+    WavHeader outputFormat;         // Format of the outputs
+    SampleFormat sampleFormat;      // Requested sample format of the outputs
+    ChannelSelection channels;      // Input channels of every output
+    char **names_pp;                // Name of every output
+    Deinterleaver deinterleaver;    // Kernel splitting the pushed frames into the outputs
+    SampleConverter converter;      // Conversion of the outputs (used when converts is set)
+    bool converts;                  // Outputs differ from the format of the stream
+    uint8_t *staging_p;             // Staging area samples are converted from (NULL when copied)
+    size_t stagingFrames;           // Frames the staging area holds
+    uint8_t **stagingTargets_pp;    // Slice of every output in the staging area
+    uint8_t *blocks_p;              // Blocks of all outputs in one allocation
+    uint8_t **blockStarts_pp;       // Start of the block of every output
+    uint8_t **targets_pp;           // Where the next deinterleaved frames of every output go
+    size_t blockFrames;             // Frames per delivered block
+    size_t filledFrames;            // Frames in the blocks that were not delivered yet
+    uint64_t pushedFrames;          // Frames pushed so far
+    uint64_t deliveredFrames;       // Frames handed to the sink so far
+    bool finished;                  // wavsplit_finish was called
+    WavsplitStatus failure;         // First failure, further pushes are refused
+    char message[WAVSPLIT_MESSAGE_LENGTH]; // Description of the failure
+};
+
+
+static WavsplitStatus _fail(WavsplitContext *context_p, WavsplitStatus status, const char *format_p, ...) {
+    va_list arguments;
+    va_start(arguments, format_p);
+    vsnprintf(context_p->message, sizeof(context_p->message), format_p, arguments);
+    va_end(arguments);
+    return status;
+}
+
+
+/**
+ * Check the stream format of a configuration and describe it as a WAV header
+ */
+static WavsplitStatus _configure_format(WavsplitContext *context_p) {
+    const WavsplitConfig *config_p = &context_p->config;
+    const uint16_t bits = config_p->bitsPerSample;
+    if (config_p->numChannels == 0 || !config_p->sink_p) {
+        return _fail(context_p, WAVSPLIT_ERROR_ARGUMENT, "A stream needs at least one channel and a sink");
+    }
+    if ((bits != 16 && bits != 24 && bits != 32) || (config_p->floatSamples && bits != 32)) {
+        return _fail(context_p, WAVSPLIT_ERROR_FORMAT, "Unsupported stream format of %u bit %s samples", bits,
+                     config_p->floatSamples ? "float" : "integer");
+    }
+
+    WavHeader *format_p = &context_p->format;
+    memset(format_p, 0, sizeof(*format_p));
+    format_p->audio_format = config_p->floatSamples ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM;
+    format_p->num_channels = config_p->numChannels;
+    format_p->sample_rate = config_p->sampleRate;
+    format_p->bits_per_sample = bits;
+    format_p->block_align = (uint16_t)(config_p->numChannels * (bits / 8));
+    format_p->byte_rate = config_p->sampleRate * format_p->block_align;
+
+    if (sample_format_from_wavsplit(config_p->sampleFormat, &context_p->sampleFormat) != 0) {
+        return _fail(context_p, WAVSPLIT_ERROR_ARGUMENT, "Unknown output sample format %d",
+                     (int)config_p->sampleFormat);
+    }
+    if (sample_format_output_header(context_p->sampleFormat, format_p, &context_p->outputFormat) != 0) {
+        return _fail(context_p, WAVSPLIT_ERROR_FORMAT, "Samples of the stream cannot be converted to %s",
+                     sample_format_name(context_p->sampleFormat));
+    }
+    context_p->converts = sample_format_converts(format_p, &context_p->outputFormat);
+    return WAVSPLIT_OK;
+}
+
+
+/**
+ * Resolve the outputs of a configuration and name them
+ */
+static WavsplitStatus _configure_outputs(WavsplitContext *context_p, const char *channels_p,
+                                         const char *channelMap_p) {
+    ChannelSelection *selection_p = &context_p->channels;
+    if (channels_p && channelMap_p) {
+        return _fail(context_p, WAVSPLIT_ERROR_ARGUMENT, "A channel list cannot be combined with a channel map");
+    }
+    if (channels_p && channel_selection_parse(channels_p, selection_p) != 0) {
+        return _fail(context_p, WAVSPLIT_ERROR_CHANNELS, "Invalid channel list '%s'", channels_p);
+    }
+    if (channelMap_p &&
+        channel_selection_load_map(channelMap_p, selection_p, context_p->message, sizeof(context_p->message)) != 0) {
+        return WAVSPLIT_ERROR_CHANNELS;
+    }
+    if (channel_selection_resolve(selection_p, context_p->config.numChannels, context_p->message,
+                                  sizeof(context_p->message)) != 0) {
+        return WAVSPLIT_ERROR_CHANNELS;
+    }
+
+    context_p->names_pp = calloc(selection_p->count, sizeof(char *));
+    if (!context_p->names_pp) {
+        return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate output names");
+    }
+    for (uint16_t i = 0; i < selection_p->count; i++) {
+        char name_p[CHANNEL_MAP_MAX_NAME_LENGTH + 1];
+        if (selection_p->names_p) {
+            snprintf(name_p, sizeof(name_p), "%s", selection_p->names_p[i]);
+        } else {
+            snprintf(name_p, sizeof(name_p), "ch_%d", selection_p->channels_p[selection_p->firstSlots_p[i]] + 1);
+        }
+        const size_t nameBytes = strlen(name_p) + 1;
+        context_p->names_pp[i] = malloc(nameBytes);
+        if (!context_p->names_pp[i]) {
+            return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate output names");
+        }
+        memcpy(context_p->names_pp[i], name_p, nameBytes);
+    }
+    return WAVSPLIT_OK;
+}
+
+
+/**
+ * Allocate the blocks of all outputs and the conversion staging area
+ */
+static WavsplitStatus _allocate_blocks(WavsplitContext *context_p) {
+    const ChannelSelection *selection_p = &context_p->channels;
+    const uint16_t outputCount = selection_p->count;
+    const size_t outputBytes = context_p->outputFormat.bits_per_sample / 8;
+
+    size_t frameBytes = 0;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        frameBytes += (size_t)selection_p->groupSizes_p[i] * outputBytes;
+    }
+    context_p->blocks_p = malloc(context_p->blockFrames * frameBytes);
+    context_p->blockStarts_pp = malloc(outputCount * sizeof(uint8_t *));
+    context_p->targets_pp = malloc(outputCount * sizeof(uint8_t *));
+    context_p->stagingTargets_pp = malloc(outputCount * sizeof(uint8_t *));
+    if (!context_p->blocks_p || !context_p->blockStarts_pp || !context_p->targets_pp ||
+        !context_p->stagingTargets_pp) {
+        return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate %zu frames per block",
+                     context_p->blockFrames);
+    }
+    uint8_t *block_p = context_p->blocks_p;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        context_p->blockStarts_pp[i] = block_p;
+        block_p += context_p->blockFrames * selection_p->groupSizes_p[i] * outputBytes;
+    }
+
+    if (!context_p->converts) {
+        return WAVSPLIT_OK;
+    }
+
+    // the stream starts at the first sample, so the dither does too
+    uint64_t *bytesWritten_p = calloc(outputCount, sizeof(uint64_t));
+    if (!bytesWritten_p) {
+        return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate sample converter");
+    }
+    const int converterStatus = sample_converter_init(&context_p->converter, &context_p->format,
+                                                      &context_p->outputFormat, outputCount, bytesWritten_p);
+    free(bytesWritten_p);
+    if (converterStatus != 0) {
+        context_p->converts = false;
+        return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate sample converter");
+    }
+    context_p->staging_p = sample_converter_staging(&context_p->converter, selection_p->groupSizes_p, outputCount,
+                                                    context_p->stagingTargets_pp, &context_p->stagingFrames);
+    if (!context_p->staging_p) {
+        return _fail(context_p, WAVSPLIT_ERROR_MEMORY, "Failed to allocate conversion staging buffer");
+    }
+    return WAVSPLIT_OK;
+}
+
+
+WavsplitStatus wavsplit_create(const WavsplitConfig *config_p, WavsplitContext **context_pp) {
+    if (!context_pp) {
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+    *context_pp = NULL;
+    if (!config_p) {
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+
+    WavsplitContext *context_p = calloc(1, sizeof(WavsplitContext));
+    if (!context_p) {
+        return WAVSPLIT_ERROR_MEMORY;
+    }
+    context_p->config = *config_p;
+    context_p->config.channels_p = NULL;
+    context_p->config.channelMap_p = NULL;
+    context_p->blockFrames = config_p->blockFrames ? config_p->blockFrames : WAVSPLIT_DEFAULT_BLOCK_FRAMES;
+
+    WavsplitStatus status = _configure_format(context_p);
+    if (status == WAVSPLIT_OK) {
+        status = _configure_outputs(context_p, config_p->channels_p, config_p->channelMap_p);
+    }
+    if (status == WAVSPLIT_OK) {
+        status = _allocate_blocks(context_p);
+    }
+    *context_pp = context_p;
+    if (status != WAVSPLIT_OK) {
+        // the failed context is kept so its message can be read
+        context_p->failure = status;
+        return status;
+    }
+
+    deinterleaver_init_regroup(&context_p->deinterleaver, context_p->format.num_channels,
+                               context_p->format.bits_per_sample / 8, context_p->channels.channels_p,
+                               context_p->channels.groupSizes_p, context_p->channels.count, true);
+    return WAVSPLIT_OK;
+}
+
+
+/**
+ * Hand the filled part of every block to the sink
+ */
+static WavsplitStatus _deliver_blocks(WavsplitContext *context_p) {
+    const ChannelSelection *selection_p = &context_p->channels;
+    const uint16_t outputBytes = context_p->outputFormat.bits_per_sample / 8;
+
+    WavsplitBlock block;
+    block.bitsPerSample = context_p->outputFormat.bits_per_sample;
+    block.floatSamples = context_p->outputFormat.audio_format == WAV_FORMAT_IEEE_FLOAT;
+    block.firstFrame = context_p->deliveredFrames;
+    block.frames = context_p->filledFrames;
+    for (uint16_t i = 0; i < selection_p->count; i++) {
+        block.output = i;
+        block.name_p = context_p->names_pp[i];
+        block.channels = selection_p->groupSizes_p[i];
+        block.data_p = context_p->blockStarts_pp[i];
+        block.bytes = context_p->filledFrames * block.channels * outputBytes;
+
+        const int sinkStatus = context_p->config.sink_p(context_p->config.user_p, &block);
+        if (sinkStatus != 0) {
+            context_p->failure = _fail(context_p, WAVSPLIT_ERROR_SINK,
+                                       "Sink failed with %d on output %s at frame %llu", sinkStatus,
+                                       block.name_p, (unsigned long long)block.firstFrame);
+            return context_p->failure;
+        }
+    }
+
+    context_p->deliveredFrames += context_p->filledFrames;
+    context_p->filledFrames = 0;
+    return WAVSPLIT_OK;
+}
+
+
+static WavsplitStatus _check_open(WavsplitContext *context_p) {
+    if (context_p->failure != WAVSPLIT_OK) {
+        return WAVSPLIT_ERROR_STATE;
+    }
+    if (context_p->finished) {
+        return _fail(context_p, WAVSPLIT_ERROR_STATE, "The stream was already finished");
+    }
+    return WAVSPLIT_OK;
+}
+
+
+WavsplitStatus wavsplit_push(WavsplitContext *context_p, const void *frames_p, size_t frameCount) {
+    if (!context_p || (!frames_p && frameCount > 0)) {
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+    const WavsplitStatus openStatus = _check_open(context_p);
+    if (openStatus != WAVSPLIT_OK) {
+        return openStatus;
+    }
+
+    const ChannelSelection *selection_p = &context_p->channels;
+    const uint16_t outputCount = selection_p->count;
+    const size_t outputBytes = context_p->outputFormat.bits_per_sample / 8;
+    const uint8_t *source_p = frames_p;
+
+    while (frameCount > 0) {
+        // all outputs advance by the same number of frames, converted ones at most a staging area at a time
+        size_t frames = context_p->blockFrames - context_p->filledFrames;
+        if (frames > frameCount) {
+            frames = frameCount;
+        }
+        if (context_p->converts && frames > context_p->stagingFrames) {
+            frames = context_p->stagingFrames;
+        }
+
+        for (uint16_t i = 0; i < outputCount; i++) {
+            context_p->targets_pp[i] = context_p->blockStarts_pp[i] +
+                                       context_p->filledFrames * selection_p->groupSizes_p[i] * outputBytes;
+        }
+        if (context_p->converts) {
+            deinterleaver_run(&context_p->deinterleaver, source_p, frames, context_p->stagingTargets_pp);
+            for (uint16_t i = 0; i < outputCount; i++) {
+                sample_converter_run(&context_p->converter, i, context_p->stagingTargets_pp[i],
+                                     context_p->targets_pp[i], frames * selection_p->groupSizes_p[i]);
+            }
+        } else {
+            deinterleaver_run(&context_p->deinterleaver, source_p, frames, context_p->targets_pp);
+        }
+
+        source_p += frames * context_p->format.block_align;
+        frameCount -= frames;
+        context_p->pushedFrames += frames;
+        context_p->filledFrames += frames;
+        if (context_p->filledFrames == context_p->blockFrames) {
+            const WavsplitStatus status = _deliver_blocks(context_p);
+            if (status != WAVSPLIT_OK) {
+                return status;
+            }
+        }
+    }
+    return WAVSPLIT_OK;
+}
+
+
+WavsplitStatus wavsplit_finish(WavsplitContext *context_p) {
+    if (!context_p) {
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+    const WavsplitStatus openStatus = _check_open(context_p);
+    if (openStatus != WAVSPLIT_OK) {
+        return openStatus;
+    }
+
+    context_p->finished = true;
+    if (context_p->filledFrames > 0) {
+        return _deliver_blocks(context_p);
+    }
+    return WAVSPLIT_OK;
+}
+
+
+uint16_t wavsplit_output_count(const WavsplitContext *context_p) {
+    return context_p->channels.count;
+}
+
+
+const char *wavsplit_output_name(const WavsplitContext *context_p, uint16_t output) {
+    if (!context_p->names_pp || output >= context_p->channels.count) {
+        return NULL;
+    }
+    return context_p->names_pp[output];
+}
+
+
+uint64_t wavsplit_frames(const WavsplitContext *context_p) {
+    return context_p->pushedFrames;
+}
+
+
+const char *wavsplit_error_message(const WavsplitContext *context_p) {
+    return context_p->message;
+}
+
+
+const char *wavsplit_status_string(WavsplitStatus status) {
+    switch (status) {
+        case WAVSPLIT_OK:             return "ok";
+        case WAVSPLIT_ERROR_ARGUMENT: return "invalid argument";
+        case WAVSPLIT_ERROR_FORMAT:   return "unsupported sample format";
+        case WAVSPLIT_ERROR_CHANNELS: return "invalid channel selection";
+        case WAVSPLIT_ERROR_MEMORY:   return "out of memory";
+        case WAVSPLIT_ERROR_SINK:     return "sink failed";
+        case WAVSPLIT_ERROR_STATE:    return "stream finished or failed";
+    }
+    return "unknown status";
+}
+
+
+void wavsplit_destroy(WavsplitContext *context_p) {
+    if (!context_p) {
+        return;
+    }
+    if (context_p->names_pp) {
+        for (uint16_t i = 0; i < context_p->channels.count; i++) {
+            free(context_p->names_pp[i]);
+        }
+    }
+    if (context_p->converts) {
+        sample_converter_free(&context_p->converter);
+    }
+    free(context_p->names_pp);
+    free(context_p->staging_p);
+    free(context_p->stagingTargets_pp);
+    free(context_p->blocks_p);
+    free(context_p->blockStarts_pp);
+    free(context_p->targets_pp);
+    channel_selection_free(&context_p->channels);
+    free(context_p);
+}
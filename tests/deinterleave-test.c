@@ -0,0 +1,399 @@
+/**
+ * @file deinterleave-test.c
+ * @brief Kernel test of the deinterleave engine
+ *
+ * Runs every kernel of the deinterleave engine the CPU can execute (scalar, SSE2, SSSE3 and
+ * AVX2 transposes, gather, regroup and the interleave kernels) against a naive per-sample
+ * reference loop, for 16, 24 and 32 bit samples, 1 to 64 channels and frame counts that are
+ * not multiples of any tile size. The interleaved input ends right in front of a protected
+ * page, so a kernel reading past the last frame crashes the test, and every output buffer
+ * carries a guard area that must stay untouched.
+ *
+ * The engine is compiled into the test, which reaches the SIMD kernels directly even where
+ * the runtime selection prefers a wider one.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../src/deinterleave.c"
+
+// Bytes behind every output that a kernel must not write
+#define GUARD_BYTES 64
+
+// Value of the guard bytes and of unwritten output
+#define GUARD_VALUE 0xA5
+
+typedef enum {
+    CPU_ANY = 0,
+    CPU_SSE2,
+    CPU_SSSE3,
+    CPU_AVX2
+} CpuFeature;
+
+typedef struct {
+    uint8_t *base_p;  // Start of the allocation
+    size_t length;    // Length of the allocation
+    uint8_t *data_p;  // Data area ending at the protected page
+} GuardedBuffer;
+
+static const uint16_t channelCounts[] = {1, 7, 8, 16, 32, 64};
+static const size_t frameCounts[] = {0, 1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 33, 63, 65, 255, 1000, 4099};
+static unsigned int runs;
+static unsigned int failures;
+
+
+static bool _cpu_has(CpuFeature feature) {
+#ifdef DEINTERLEAVE_X86_SIMD
+    __builtin_cpu_init();
+    switch (feature) {
+        case CPU_SSE2:  return __builtin_cpu_supports("sse2");
+        case CPU_SSSE3: return __builtin_cpu_supports("ssse3");
+        case CPU_AVX2:  return __builtin_cpu_supports("avx2");
+        default:        return true;
+    }
+#else
+    return feature == CPU_ANY;
+#endif
+}
+
+
+/**
+ * Allocate a buffer whose last byte lies right in front of an inaccessible page
+ */
+static void _guarded_alloc(GuardedBuffer *buffer_p, size_t bytes) {
+#ifndef WIN32
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t dataPages = (bytes + pageSize - 1) / pageSize;
+    buffer_p->length = (dataPages + 1) * pageSize;
+    buffer_p->base_p = mmap(NULL, buffer_p->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_p->base_p == MAP_FAILED ||
+        mprotect(buffer_p->base_p + dataPages * pageSize, pageSize, PROT_NONE) != 0) {
+        fprintf(stderr, "ERROR: Failed to map guarded buffer\n");
+        exit(1);
+    }
+    buffer_p->data_p = buffer_p->base_p + dataPages * pageSize - bytes;
+#else
+    buffer_p->length = bytes > 0 ? bytes : 1;
+    buffer_p->base_p = malloc(buffer_p->length);
+    if (!buffer_p->base_p) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    buffer_p->data_p = buffer_p->base_p + buffer_p->length - bytes;
+#endif
+}
+
+
+static void _guarded_free(GuardedBuffer *buffer_p) {
+#ifndef WIN32
+    munmap(buffer_p->base_p, buffer_p->length);
+#else
+    free(buffer_p->base_p);
+#endif
+}
+
+
+static void _fill_pattern(uint8_t *data_p, size_t bytes, uint32_t seed) {
+    uint32_t state = seed * 2654435761u + 1;
+    for (size_t i = 0; i < bytes; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data_p[i] = (uint8_t)state;
+    }
+}
+
+
+/**
+ * Allocate one output per entry, each followed by its guard area
+ */
+static uint8_t **_alloc_outputs(uint16_t outputCount, const size_t *bytes_p) {
+    uint8_t **outputs_pp = calloc(outputCount, sizeof(uint8_t *));
+    if (!outputs_pp) {
+        fprintf(stderr, "ERROR: Memory allocation failed\n");
+        exit(1);
+    }
+    for (uint16_t i = 0; i < outputCount; i++) {
+        outputs_pp[i] = malloc(bytes_p[i] + GUARD_BYTES);
+        if (!outputs_pp[i]) {
+            fprintf(stderr, "ERROR: Memory allocation failed\n");
+            exit(1);
+        }
+        memset(outputs_pp[i], GUARD_VALUE, bytes_p[i] + GUARD_BYTES);
+    }
+    return outputs_pp;
+}
+
+
+static void _free_outputs(uint8_t **outputs_pp, uint16_t outputCount) {
+    for (uint16_t i = 0; i < outputCount; i++) {
+        free(outputs_pp[i]);
+    }
+    free(outputs_pp);
+}
+
+
+/**
+ * Compare the outputs of a kernel with the reference and check their guard areas
+ */
+static void _compare_outputs(const char *kernelName_p, uint16_t frameChannels, uint16_t bytesPerSample,
+                             size_t frameCount, uint8_t *const *actual_pp, uint8_t *const *expected_pp,
+                             const size_t *bytes_p, uint16_t outputCount) {
+    runs++;
+    for (uint16_t i = 0; i < outputCount; i++) {
+        bool guardIntact = true;
+        for (size_t b = 0; b < GUARD_BYTES; b++) {
+            guardIntact = guardIntact && actual_pp[i][bytes_p[i] + b] == GUARD_VALUE;
+        }
+        if (memcmp(actual_pp[i], expected_pp[i], bytes_p[i]) != 0 || !guardIntact) {
+            fprintf(stderr, "FAIL %s: %u bit, %u channels, %zu frames, output %u %s\n", kernelName_p,
+                    bytesPerSample * 8, frameChannels, frameCount, i,
+                    guardIntact ? "differs from the reference" : "wrote past its end");
+            failures++;
+            return;
+        }
+    }
+}
+
+
+/**
+ * Run a deinterleave kernel on channels firstChannel.. of frames with frameChannels channels
+ */
+static void _check_kernel(const char *kernelName_p, DeinterleaveKernel kernel_p, uint16_t frameChannels,
+                          uint16_t firstChannel, uint16_t channelCount, uint16_t bytesPerSample,
+                          size_t frameCount) {
+    const size_t frameStride = (size_t)frameChannels * bytesPerSample;
+    GuardedBuffer source;
+    _guarded_alloc(&source, frameCount * frameStride);
+    _fill_pattern(source.data_p, frameCount * frameStride, frameChannels * 131 + bytesPerSample);
+
+    size_t *bytes_p = malloc(channelCount * sizeof(size_t));
+    for (uint16_t c = 0; c < channelCount; c++) {
+        bytes_p[c] = frameCount * bytesPerSample;
+    }
+    uint8_t **expected_pp = _alloc_outputs(channelCount, bytes_p);
+    uint8_t **actual_pp = _alloc_outputs(channelCount, bytes_p);
+    for (size_t f = 0; f < frameCount; f++) {
+        for (uint16_t c = 0; c < channelCount; c++) {
+            memcpy(expected_pp[c] + f * bytesPerSample,
+                   source.data_p + f * frameStride + (size_t)(firstChannel + c) * bytesPerSample, bytesPerSample);
+        }
+    }
+
+    kernel_p(source.data_p + (size_t)firstChannel * bytesPerSample, frameCount, frameStride, channelCount,
+             bytesPerSample, actual_pp);
+    _compare_outputs(kernelName_p, frameChannels, bytesPerSample, frameCount, actual_pp, expected_pp, bytes_p,
+                     channelCount);
+
+    _free_outputs(expected_pp, channelCount);
+    _free_outputs(actual_pp, channelCount);
+    free(bytes_p);
+    _guarded_free(&source);
+}
+
+
+/**
+ * Run a deinterleaver set up for a channel list with groups against the reference
+ */
+static void _check_selection(const Deinterleaver *deinterleaver_p, uint16_t frameChannels,
+                             const uint16_t *channels_p, const uint16_t *groupSizes_p, uint16_t outputCount,
+                             uint16_t bytesPerSample, size_t frameCount) {
+    const size_t frameStride = (size_t)frameChannels * bytesPerSample;
+    GuardedBuffer source;
+    _guarded_alloc(&source, frameCount * frameStride);
+    _fill_pattern(source.data_p, frameCount * frameStride, frameChannels * 257 + bytesPerSample);
+
+    size_t *bytes_p = malloc(outputCount * sizeof(size_t));
+    for (uint16_t o = 0; o < outputCount; o++) {
+        bytes_p[o] = frameCount * groupSizes_p[o] * bytesPerSample;
+    }
+    uint8_t **expected_pp = _alloc_outputs(outputCount, bytes_p);
+    uint8_t **actual_pp = _alloc_outputs(outputCount, bytes_p);
+    for (size_t f = 0; f < frameCount; f++) {
+        const uint16_t *slot_p = channels_p;
+        for (uint16_t o = 0; o < outputCount; o++) {
+            for (uint16_t c = 0; c < groupSizes_p[o]; c++) {
+                memcpy(expected_pp[o] + (f * groupSizes_p[o] + c) * bytesPerSample,
+                       source.data_p + f * frameStride + (size_t)slot_p[c] * bytesPerSample, bytesPerSample);
+            }
+            slot_p += groupSizes_p[o];
+        }
+    }
+
+    deinterleaver_run(deinterleaver_p, source.data_p, frameCount, actual_pp);
+    _compare_outputs(deinterleaver_p->kernelName_p, frameChannels, bytesPerSample, frameCount, actual_pp,
+                     expected_pp, bytes_p, outputCount);
+
+    _free_outputs(expected_pp, outputCount);
+    _free_outputs(actual_pp, outputCount);
+    free(bytes_p);
+    _guarded_free(&source);
+}
+
+
+/**
+ * Run an interleave kernel, the last channel ends right in front of the protected page
+ */
+static void _check_interleave(const char *kernelName_p, InterleaveKernel kernel_p, uint16_t numChannels,
+                              uint16_t bytesPerSample, size_t frameCount) {
+    const size_t channelBytes = frameCount * bytesPerSample;
+    GuardedBuffer source;
+    _guarded_alloc(&source, channelBytes * numChannels);
+    _fill_pattern(source.data_p, channelBytes * numChannels, numChannels * 31 + bytesPerSample);
+    const uint8_t **sources_pp = malloc(numChannels * sizeof(uint8_t *));
+    for (uint16_t c = 0; c < numChannels; c++) {
+        sources_pp[c] = source.data_p + c * channelBytes;
+    }
+
+    const size_t bytes = channelBytes * numChannels;
+    uint8_t **expected_pp = _alloc_outputs(1, &bytes);
+    uint8_t **actual_pp = _alloc_outputs(1, &bytes);
+    for (size_t f = 0; f < frameCount; f++) {
+        for (uint16_t c = 0; c < numChannels; c++) {
+            memcpy(expected_pp[0] + (f * numChannels + c) * bytesPerSample, sources_pp[c] + f * bytesPerSample,
+                   bytesPerSample);
+        }
+    }
+
+    kernel_p(sources_pp, frameCount, (size_t)numChannels * bytesPerSample, numChannels, bytesPerSample,
+             actual_pp[0]);
+    _compare_outputs(kernelName_p, numChannels, bytesPerSample, frameCount, actual_pp, expected_pp, &bytes, 1);
+
+    _free_outputs(expected_pp, 1);
+    _free_outputs(actual_pp, 1);
+    free(sources_pp);
+    _guarded_free(&source);
+}
+
+
+int main(void) {
+    typedef struct {
+        const char *name_p;
+        DeinterleaveKernel kernel_p;
+        uint16_t bytesPerSample;
+        uint16_t channelMultiple;
+        CpuFeature feature;
+    } KernelCase;
+    typedef struct {
+        const char *name_p;
+        InterleaveKernel kernel_p;
+        uint16_t bytesPerSample;
+        uint16_t channelMultiple;
+        CpuFeature feature;
+    } InterleaveCase;
+
+    // kernels the runtime selection picks from, usable wherever the channel count fits
+    const KernelCase kernelCases[] = {
+        {"scalar-generic", _deinterleave_generic, 0, 1, CPU_ANY},
+#ifdef DEINTERLEAVE_X86_SIMD
+        {"sse2-s16", _deinterleave_sse2_s16, 2, 8, CPU_SSE2},
+        {"sse2-s32", _deinterleave_sse2_s32, 4, 4, CPU_SSE2},
+        {"ssse3-s24", _deinterleave_ssse3_s24, 3, 4, CPU_SSSE3},
+        {"avx2-s24", _deinterleave_avx2_s24, 3, 8, CPU_AVX2},
+        {"avx2-s32", _deinterleave_avx2_s32, 4, 8, CPU_AVX2},
+#endif
+    };
+    const InterleaveCase interleaveCases[] = {
+        {"interleave-scalar-generic", _interleave_generic, 0, 1, CPU_ANY},
+#ifdef DEINTERLEAVE_X86_SIMD
+        {"interleave-sse2-s16", _interleave_sse2_s16, 2, 8, CPU_SSE2},
+        {"interleave-sse2-s32", _interleave_sse2_s32, 4, 4, CPU_SSE2},
+        {"interleave-avx2-s24", _interleave_avx2_s24, 3, 8, CPU_AVX2},
+        {"interleave-avx2-s32", _interleave_avx2_s32, 4, 8, CPU_AVX2},
+#endif
+    };
+
+    for (uint16_t bytesPerSample = 2; bytesPerSample <= 4; bytesPerSample++) {
+        for (size_t n = 0; n < sizeof(channelCounts) / sizeof(channelCounts[0]); n++) {
+            const uint16_t channels = channelCounts[n];
+            for (size_t i = 0; i < sizeof(frameCounts) / sizeof(frameCounts[0]); i++) {
+                const size_t frameCount = frameCounts[i];
+
+                // every kernel on whole frames and on a channel range inside wider frames
+                for (size_t k = 0; k < sizeof(kernelCases) / sizeof(kernelCases[0]); k++) {
+                    const KernelCase *case_p = &kernelCases[k];
+                    if ((case_p->bytesPerSample != 0 && case_p->bytesPerSample != bytesPerSample) ||
+                        channels % case_p->channelMultiple != 0 || !_cpu_has(case_p->feature)) {
+                        continue;
+                    }
+                    _check_kernel(case_p->name_p, case_p->kernel_p, channels, 0, channels, bytesPerSample,
+                                  frameCount);
+                    _check_kernel(case_p->name_p, case_p->kernel_p, channels + 3, 2, channels, bytesPerSample,
+                                  frameCount);
+                }
+
+                // runtime selection, scalar specializations included
+                for (int simd = 0; simd <= 1; simd++) {
+                    Deinterleaver deinterleaver;
+                    deinterleaver_init(&deinterleaver, channels, bytesPerSample, simd);
+                    _check_kernel(deinterleaver.kernelName_p, deinterleaver.kernel_p, channels, 0, channels,
+                                  bytesPerSample, frameCount);
+                    deinterleaver_init_range(&deinterleaver, channels + 1, bytesPerSample, 1, channels, simd);
+                    _check_kernel(deinterleaver.kernelName_p, deinterleaver.kernel_p, channels + 1, 1, channels,
+                                  bytesPerSample, frameCount);
+                }
+
+                // every other channel from the last one down, then the same channels in groups of 1 to 3
+                uint16_t selection[64];
+                uint16_t groupSizes[64];
+                uint16_t selected = 0;
+                for (int c = channels - 1; c >= 0; c -= 2) {
+                    selection[selected++] = (uint16_t)c;
+                }
+                Deinterleaver gather;
+                deinterleaver_init_gather(&gather, channels, bytesPerSample, selection, selected, true);
+                for (uint16_t o = 0; o < selected; o++) {
+                    groupSizes[o] = 1;
+                }
+                _check_selection(&gather, channels, selection, groupSizes, selected, bytesPerSample, frameCount);
+
+                for (uint16_t c = 0; c < channels; c++) {
+                    selection[c] = (uint16_t)((c * 5 + 3) % channels);
+                }
+                uint16_t groupCount = 0;
+                for (uint16_t c = 0; c < channels; c += groupSizes[groupCount++]) {
+                    groupSizes[groupCount] = (uint16_t)(groupCount % 3 + 1);
+                    if (c + groupSizes[groupCount] > channels) {
+                        groupSizes[groupCount] = (uint16_t)(channels - c);
+                    }
+                }
+                Deinterleaver regroup;
+                deinterleaver_init_regroup(&regroup, channels, bytesPerSample, selection, groupSizes, groupCount,
+                                           true);
+                _check_selection(&regroup, channels, selection, groupSizes, groupCount, bytesPerSample,
+                                 frameCount);
+
+                // the inverse direction
+                for (size_t k = 0; k < sizeof(interleaveCases) / sizeof(interleaveCases[0]); k++) {
+                    const InterleaveCase *case_p = &interleaveCases[k];
+                    if ((case_p->bytesPerSample != 0 && case_p->bytesPerSample != bytesPerSample) ||
+                        channels % case_p->channelMultiple != 0 || !_cpu_has(case_p->feature)) {
+                        continue;
+                    }
+                    _check_interleave(case_p->name_p, case_p->kernel_p, channels, bytesPerSample, frameCount);
+                }
+                for (int simd = 0; simd <= 1; simd++) {
+                    Interleaver interleaver;
+                    interleaver_init(&interleaver, channels, bytesPerSample, simd);
+                    _check_interleave(interleaver.kernelName_p, interleaver.kernel_p, channels, bytesPerSample,
+                                      frameCount);
+                }
+            }
+        }
+    }
+
+    printf("deinterleave-test: %u kernel runs, %u failures\n", runs, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,407 @@
+/**
+ * @file wavsplit-bench.c
+ * @brief Throughput benchmark of the splitter
+ *
+ * Generates synthetic sessions with wavsplit-gen and splits each of them with every
+ * combination of buffer size, job count and I/O backends given on the command line.
+ * Every combination runs several times in a child process, the median wall time is
+ * reported together with the throughput and the peak resident memory of the child.
+ * Results are printed as CSV on stdout, progress goes to stderr, so the output can be
+ * redirected into a file and compared between releases.
+ *
+ * The page cache is not dropped between runs, so unless the sessions exceed the memory
+ * of the machine the numbers describe the processing pipeline rather than the disks.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_PATH_LENGTH 250
+
+// Values of one matrix dimension
+#define MAX_MATRIX_VALUES 16
+
+// Paths of the sibling targets, set by CMake
+#ifndef WAVSPLIT_SPLITTER_PATH
+#define WAVSPLIT_SPLITTER_PATH "wav-splitter"
+#endif
+#ifndef WAVSPLIT_GENERATOR_PATH
+#define WAVSPLIT_GENERATOR_PATH "wavsplit-gen"
+#endif
+
+typedef struct {
+    const char *values_pp[MAX_MATRIX_VALUES]; // Values as passed to the tools
+    unsigned int count;                       // Number of values
+} MatrixDimension;
+
+typedef struct {
+    const char *splitterPath_p;   // wav-splitter executable
+    const char *generatorPath_p;  // wavsplit-gen executable
+    const char *workPath_p;       // Directory holding the generated sessions
+    const char *seconds_p;        // Length of the generated sessions
+    const char *sampleRate_p;     // Sample rate of the generated sessions
+    unsigned int repeats;         // Runs per combination
+    MatrixDimension channels;     // -c of wavsplit-gen
+    MatrixDimension bits;         // -b of wavsplit-gen
+    MatrixDimension bufferSizes;  // -m of wav-splitter
+    MatrixDimension jobs;         // -j of wav-splitter
+    MatrixDimension inputs;       // -i of wav-splitter
+    MatrixDimension outputs;      // -w of wav-splitter
+} BenchOptions;
+
+typedef struct {
+    double seconds;     // Wall time
+    uint64_t peakBytes; // Peak resident memory of the child
+    bool failed;        // Child did not exit with status 0
+} RunResult;
+
+
+static void print_usage(void) {
+    printf("Usage: wavsplit-bench [-s splitter] [-g generator] [-o work_dir] [-d seconds] [-R sample_rate] [-r repeats]\n");
+    printf("                      [-c channels] [-b bits] [-m buffer_size_mb] [-j jobs] [-i input_backend] [-w output_backend]\n");
+    printf("  -s splitter       : Optional path of wav-splitter (default: %s)\n", WAVSPLIT_SPLITTER_PATH);
+    printf("  -g generator      : Optional path of wavsplit-gen (default: %s)\n", WAVSPLIT_GENERATOR_PATH);
+    printf("  -o work_dir       : Optional directory for the generated sessions (default: wavsplit-bench.work)\n");
+    printf("  -d seconds        : Optional length of the generated sessions in seconds (default: 60)\n");
+    printf("  -R sample_rate    : Optional sample rate of the generated sessions in Hz (default: 48000)\n");
+    printf("  -r repeats        : Optional runs per combination, the median is reported (default: 3)\n");
+    printf("  -c channels       : Optional comma separated channel counts (default: 32)\n");
+    printf("  -b bits           : Optional comma separated bit depths (default: 24)\n");
+    printf("  -m buffer_size_mb : Optional comma separated buffer sizes (default: 8,32,128)\n");
+    printf("  -j jobs           : Optional comma separated job counts (default: 1,4)\n");
+    printf("  -i input_backend  : Optional comma separated input backends (default: stdio,mmap)\n");
+    printf("  -w output_backend : Optional comma separated output backends (default: stdio,uring,direct)\n");
+}
+
+
+/**
+ * Split a comma separated list into the values of a matrix dimension
+ *
+ * The list is modified in place, the values point into it.
+ *
+ * @param option_p Name of the option (for error messages)
+ * @param list_p Comma separated list
+ * @param dimension_p Dimension to fill
+ */
+static void parse_matrix_option(const char *option_p, char *list_p, MatrixDimension *dimension_p) {
+    dimension_p->count = 0;
+    for (char *value_p = strtok(list_p, ","); value_p; value_p = strtok(NULL, ",")) {
+        if (dimension_p->count == MAX_MATRIX_VALUES) {
+            fprintf(stderr, "ERROR: Too many values for option %s\n", option_p);
+            exit(1);
+        }
+        dimension_p->values_pp[dimension_p->count++] = value_p;
+    }
+    if (dimension_p->count == 0) {
+        fprintf(stderr, "ERROR: Missing values for option %s\n", option_p);
+        exit(1);
+    }
+}
+
+
+/**
+ * Parse command line arguments
+ *
+ * @param argc Argument count
+ * @param argv Argument values
+ * @param options_p Pointer to store the benchmark options
+ */
+static void parse_arguments(int argc, char *argv[], BenchOptions *options_p) {
+    static char defaultChannels[] = "32";
+    static char defaultBits[] = "24";
+    static char defaultBufferSizes[] = "8,32,128";
+    static char defaultJobs[] = "1,4";
+    static char defaultInputs[] = "stdio,mmap";
+    static char defaultOutputs[] = "stdio,uring,direct";
+
+    options_p->splitterPath_p = WAVSPLIT_SPLITTER_PATH;
+    options_p->generatorPath_p = WAVSPLIT_GENERATOR_PATH;
+    options_p->workPath_p = "wavsplit-bench.work";
+    options_p->seconds_p = "60";
+    options_p->sampleRate_p = "48000";
+    options_p->repeats = 3;
+    parse_matrix_option("-c", defaultChannels, &options_p->channels);
+    parse_matrix_option("-b", defaultBits, &options_p->bits);
+    parse_matrix_option("-m", defaultBufferSizes, &options_p->bufferSizes);
+    parse_matrix_option("-j", defaultJobs, &options_p->jobs);
+    parse_matrix_option("-i", defaultInputs, &options_p->inputs);
+    parse_matrix_option("-w", defaultOutputs, &options_p->outputs);
+
+    // parse options, each of them takes a value
+    int argIndex = 1;
+    while (argIndex < argc && argv[argIndex][0] == '-') {
+        if (argIndex + 1 >= argc) {
+            fprintf(stderr, "ERROR: Missing value for option %s\n", argv[argIndex]);
+            print_usage();
+            exit(1);
+        }
+
+        char *value_p = argv[argIndex + 1];
+        if (strcmp(argv[argIndex], "-s") == 0) {
+            options_p->splitterPath_p = value_p;
+        } else if (strcmp(argv[argIndex], "-g") == 0) {
+            options_p->generatorPath_p = value_p;
+        } else if (strcmp(argv[argIndex], "-o") == 0) {
+            options_p->workPath_p = value_p;
+        } else if (strcmp(argv[argIndex], "-d") == 0) {
+            options_p->seconds_p = value_p;
+        } else if (strcmp(argv[argIndex], "-R") == 0) {
+            options_p->sampleRate_p = value_p;
+        } else if (strcmp(argv[argIndex], "-r") == 0) {
+            char *endptr;
+            const long repeats = strtol(value_p, &endptr, 10);
+            if (*endptr != '\0' || repeats <= 0) {
+                fprintf(stderr, "ERROR: Invalid value '%s' for option -r\n", value_p);
+                exit(1);
+            }
+            options_p->repeats = (unsigned int)repeats;
+        } else if (strcmp(argv[argIndex], "-c") == 0) {
+            parse_matrix_option("-c", value_p, &options_p->channels);
+        } else if (strcmp(argv[argIndex], "-b") == 0) {
+            parse_matrix_option("-b", value_p, &options_p->bits);
+        } else if (strcmp(argv[argIndex], "-m") == 0) {
+            parse_matrix_option("-m", value_p, &options_p->bufferSizes);
+        } else if (strcmp(argv[argIndex], "-j") == 0) {
+            parse_matrix_option("-j", value_p, &options_p->jobs);
+        } else if (strcmp(argv[argIndex], "-i") == 0) {
+            parse_matrix_option("-i", value_p, &options_p->inputs);
+        } else if (strcmp(argv[argIndex], "-w") == 0) {
+            parse_matrix_option("-w", value_p, &options_p->outputs);
+        } else {
+            fprintf(stderr, "ERROR: Unknown option %s\n", argv[argIndex]);
+            print_usage();
+            exit(1);
+        }
+        argIndex += 2;
+    }
+
+    if (argIndex != argc) {
+        print_usage();
+        exit(1);
+    }
+}
+
+
+static double _now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+/**
+ * Run a tool in a child process with its stdout discarded
+ *
+ * @param argv_pp NULL terminated arguments, the first one is the executable
+ * @param result_p Pointer to store wall time, peak memory and exit state
+ */
+static void _run_tool(char *const argv_pp[], RunResult *result_p) {
+    const double start = _now_seconds();
+    const pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "ERROR: Failed to start %s\n", argv_pp[0]);
+        exit(1);
+    }
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(1);
+        }
+        execv(argv_pp[0], argv_pp);
+        fprintf(stderr, "ERROR: Failed to run %s\n", argv_pp[0]);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "ERROR: Failed to wait for %s\n", argv_pp[0]);
+            exit(1);
+        }
+    }
+    result_p->seconds = _now_seconds() - start;
+    result_p->peakBytes = (uint64_t)usage.ru_maxrss * 1024;
+    result_p->failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+
+/**
+ * Remove the output directory a split left behind
+ *
+ * @param outputPath_p Output directory, it only holds files
+ */
+static void _remove_outputs(const char *outputPath_p) {
+    DIR *dir_p = opendir(outputPath_p);
+    if (!dir_p) {
+        return;
+    }
+    struct dirent *entry_p;
+    while ((entry_p = readdir(dir_p)) != NULL) {
+        if (strcmp(entry_p->d_name, ".") == 0 || strcmp(entry_p->d_name, "..") == 0) {
+            continue;
+        }
+        char filePath[MAX_PATH_LENGTH];
+        if (snprintf(filePath, sizeof(filePath), "%s/%s", outputPath_p, entry_p->d_name) >= (int)sizeof(filePath)) {
+            continue;
+        }
+        unlink(filePath);
+    }
+    closedir(dir_p);
+    if (rmdir(outputPath_p) != 0) {
+        fprintf(stderr, "ERROR: Failed to remove %s\n", outputPath_p);
+        exit(1);
+    }
+}
+
+
+/**
+ * Size of all chunks of a session
+ *
+ * @param sessionPath_p Session directory
+ * @return Bytes of all .WAV files in the directory
+ */
+static uint64_t _session_bytes(const char *sessionPath_p) {
+    uint64_t bytes = 0;
+    DIR *dir_p = opendir(sessionPath_p);
+    if (!dir_p) {
+        return 0;
+    }
+    struct dirent *entry_p;
+    while ((entry_p = readdir(dir_p)) != NULL) {
+        const size_t nameLength = strlen(entry_p->d_name);
+        if (nameLength < 4 || strcmp(entry_p->d_name + nameLength - 4, ".WAV") != 0) {
+            continue;
+        }
+        char filePath[MAX_PATH_LENGTH];
+        struct stat fileStat;
+        if (snprintf(filePath, sizeof(filePath), "%s/%s", sessionPath_p, entry_p->d_name) < (int)sizeof(filePath) &&
+            stat(filePath, &fileStat) == 0) {
+            bytes += (uint64_t)fileStat.st_size;
+        }
+    }
+    closedir(dir_p);
+    return bytes;
+}
+
+
+static int _compare_runs(const void *a_p, const void *b_p) {
+    const double a = ((const RunResult *)a_p)->seconds;
+    const double b = ((const RunResult *)b_p)->seconds;
+    return (a > b) - (a < b);
+}
+
+
+int main(const int argc, char *argv[]) {
+    BenchOptions options;
+    parse_arguments(argc, argv, &options);
+
+    if (mkdir(options.workPath_p, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: Failed to create work directory %s\n", options.workPath_p);
+        return 1;
+    }
+    RunResult *runs_p = malloc(options.repeats * sizeof(RunResult));
+    if (!runs_p) {
+        fprintf(stderr, "ERROR: Failed to allocate run results\n");
+        return 1;
+    }
+
+    printf("channels,bits,sample_rate,seconds_of_audio,input_mb,buffer_mb,jobs,input_backend,output_backend,"
+           "runs,seconds,mb_per_s,frames_per_s,peak_rss_mb,status\n");
+    fflush(stdout);
+
+    unsigned int failures = 0;
+    for (unsigned int c = 0; c < options.channels.count; c++) {
+        for (unsigned int b = 0; b < options.bits.count; b++) {
+            const char *channels_p = options.channels.values_pp[c];
+            const char *bits_p = options.bits.values_pp[b];
+
+            // same options give the same session, so existing ones are reused
+            char sessionPath[MAX_PATH_LENGTH];
+            char outputPath[MAX_PATH_LENGTH + 4];
+            if (snprintf(sessionPath, sizeof(sessionPath), "%s/session_%sch_%sbit_%shz_%ss", options.workPath_p,
+                         channels_p, bits_p, options.sampleRate_p, options.seconds_p) >= (int)sizeof(sessionPath)) {
+                fprintf(stderr, "ERROR: Work directory path too long\n");
+                return 1;
+            }
+            snprintf(outputPath, sizeof(outputPath), "%s/out", sessionPath);
+            struct stat sessionStat;
+            if (stat(sessionPath, &sessionStat) != 0) {
+                fprintf(stderr, "Generating %s\n", sessionPath);
+                char *const generatorArgv[] = {(char *)options.generatorPath_p, "-c", (char *)channels_p,
+                                               "-b", (char *)bits_p, "-r", (char *)options.sampleRate_p,
+                                               "-d", (char *)options.seconds_p,
+                                               sessionPath, NULL};
+                RunResult generated;
+                _run_tool(generatorArgv, &generated);
+                if (generated.failed) {
+                    fprintf(stderr, "ERROR: Failed to generate %s\n", sessionPath);
+                    return 1;
+                }
+            }
+            _remove_outputs(outputPath);
+
+            const uint64_t inputBytes = _session_bytes(sessionPath);
+            const double frames = strtod(options.seconds_p, NULL) * strtod(options.sampleRate_p, NULL);
+            const double inputMB = inputBytes / (1024.0 * 1024.0);
+
+            for (unsigned int m = 0; m < options.bufferSizes.count; m++) {
+                for (unsigned int j = 0; j < options.jobs.count; j++) {
+                    for (unsigned int i = 0; i < options.inputs.count; i++) {
+                        for (unsigned int w = 0; w < options.outputs.count; w++) {
+                            char *const splitterArgv[] = {(char *)options.splitterPath_p,
+                                                          "-m", (char *)options.bufferSizes.values_pp[m],
+                                                          "-j", (char *)options.jobs.values_pp[j],
+                                                          "-i", (char *)options.inputs.values_pp[i],
+                                                          "-w", (char *)options.outputs.values_pp[w],
+                                                          sessionPath, NULL};
+                            fprintf(stderr, "Splitting %s with -m %s -j %s -i %s -w %s\n", sessionPath,
+                                    splitterArgv[2], splitterArgv[4], splitterArgv[6], splitterArgv[8]);
+
+                            bool failed = false;
+                            uint64_t peakBytes = 0;
+                            for (unsigned int r = 0; r < options.repeats; r++) {
+                                _run_tool(splitterArgv, &runs_p[r]);
+                                _remove_outputs(outputPath);
+                                failed = failed || runs_p[r].failed;
+                                if (runs_p[r].peakBytes > peakBytes) {
+                                    peakBytes = runs_p[r].peakBytes;
+                                }
+                            }
+                            qsort(runs_p, options.repeats, sizeof(RunResult), _compare_runs);
+                            const double seconds = runs_p[options.repeats / 2].seconds;
+                            if (failed) {
+                                failures++;
+                            }
+
+                            printf("%s,%s,%s,%s,%.2f,%s,%s,%s,%s,%u,%.4f,%.2f,%.0f,%.2f,%s\n",
+                                   channels_p, bits_p, options.sampleRate_p, options.seconds_p, inputMB, splitterArgv[2], splitterArgv[4],
+                                   splitterArgv[6], splitterArgv[8], options.repeats, seconds,
+                                   failed ? 0.0 : inputMB / seconds, failed ? 0.0 : frames / seconds,
+                                   peakBytes / (1024.0 * 1024.0), failed ? "failed" : "ok");
+                            fflush(stdout);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    free(runs_p);
+    return failures > 0 ? 1 : 0;
+}
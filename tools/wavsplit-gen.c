@@ -0,0 +1,349 @@
+/**
+ * @file wavsplit-gen.c
+ * @brief Synthetic session generator
+ *
+ * Writes a deterministic X32-style session: numbered chunks 00000001.WAV, 00000002.WAV, ...
+ * holding interleaved PCM audio that continues seamlessly from one chunk into the next.
+ * The samples come from a seeded xorshift generator, so the same options always produce
+ * byte-identical sessions. Optional odd-sized extra chunks around the fmt chunk exercise
+ * the header parser the way recordings edited by other tools do.
+ *
+ * @author Tobias Hafner
+ * @date 2026-10-17
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include <direct.h>
+#define PATH_SEPARATOR '\\'
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#define MAX_PATH_LENGTH 250
+
+// X32 chunks never exceed the 4 GiB RIFF limit
+#define DEFAULT_CHUNK_SIZE_MB 4095
+#define MAX_CHUNK_SIZE_MB 4095
+
+// Audio is generated and written in blocks of about this size
+#define WRITE_BLOCK_SIZE_BYTES (1024 * 1024)
+
+typedef struct {
+    uint16_t channels;        // Channels per frame
+    uint16_t bitsPerSample;   // 16, 24 or 32
+    uint32_t sampleRate;      // Frames per second
+    double seconds;           // Length of the session
+    uint32_t chunkSizeMB;     // Maximum size of a chunk
+    unsigned int extraChunks; // Odd-sized chunks before and after the fmt chunk
+    uint64_t seed;            // Seed of the sample generator
+} GeneratorOptions;
+
+
+static void print_usage(void) {
+    printf("Usage: wavsplit-gen [-c channels] [-b bits] [-r sample_rate] [-d seconds] [-s chunk_size_mb] [-e extra_chunks] [-S seed]\n");
+    printf("                    <session_path>\n");
+    printf("  -c channels       : Optional number of channels (default: 32)\n");
+    printf("  -b bits           : Optional bits per sample, 16, 24 or 32 (default: 24)\n");
+    printf("  -r sample_rate    : Optional sample rate in Hz (default: 48000)\n");
+    printf("  -d seconds        : Optional length of the session in seconds (default: 60)\n");
+    printf("  -s chunk_size_mb  : Optional maximum chunk size in MB (default: %d)\n", DEFAULT_CHUNK_SIZE_MB);
+    printf("  -e extra_chunks   : Optional number of odd-sized chunks around the fmt chunk, also extends fmt to 18 bytes (default: 0)\n");
+    printf("  -S seed           : Optional seed of the sample generator (default: 1)\n");
+}
+
+
+/**
+ * Parse an unsigned integer option value
+ *
+ * @param option_p Name of the option (for error messages)
+ * @param value_p Value string to parse
+ * @param allowZero Whether 0 is a valid value
+ * @return Parsed value
+ */
+static unsigned long parse_number_option(const char *option_p, const char *value_p, bool allowZero) {
+    char *endptr;
+    const unsigned long long value = strtoull(value_p, &endptr, 10);
+
+    if (*endptr != '\0' || value_p[0] == '-' || (value == 0 && !allowZero) || value > UINT32_MAX) {
+        fprintf(stderr, "ERROR: Invalid value '%s' for option %s\n", value_p, option_p);
+        exit(1);
+    }
+    return (unsigned long)value;
+}
+
+
+/**
+ * Parse command line arguments
+ *
+ * @param argc Argument count
+ * @param argv Argument values
+ * @param sessionPath_p Pointer to store the session path
+ * @param options_p Pointer to store the generator options
+ */
+static void parse_arguments(int argc, char *argv[], const char **sessionPath_p, GeneratorOptions *options_p) {
+    options_p->channels = 32;
+    options_p->bitsPerSample = 24;
+    options_p->sampleRate = 48000;
+    options_p->seconds = 60.0;
+    options_p->chunkSizeMB = DEFAULT_CHUNK_SIZE_MB;
+    options_p->extraChunks = 0;
+    options_p->seed = 1;
+
+    if (argc < 2) {
+        print_usage();
+        exit(1);
+    }
+
+    // parse options, each of them takes a value
+    int argIndex = 1;
+    while (argIndex < argc && argv[argIndex][0] == '-') {
+        if (argIndex + 1 >= argc) {
+            fprintf(stderr, "ERROR: Missing value for option %s\n", argv[argIndex]);
+            print_usage();
+            exit(1);
+        }
+
+        const char *value_p = argv[argIndex + 1];
+        if (strcmp(argv[argIndex], "-c") == 0) {
+            const unsigned long channels = parse_number_option("-c", value_p, false);
+            if (channels > UINT16_MAX) {
+                fprintf(stderr, "ERROR: Too many channels '%s'\n", value_p);
+                exit(1);
+            }
+            options_p->channels = (uint16_t)channels;
+        } else if (strcmp(argv[argIndex], "-b") == 0) {
+            const unsigned long bits = parse_number_option("-b", value_p, false);
+            if (bits != 16 && bits != 24 && bits != 32) {
+                fprintf(stderr, "ERROR: Unsupported bits per sample '%s'\n", value_p);
+                exit(1);
+            }
+            options_p->bitsPerSample = (uint16_t)bits;
+        } else if (strcmp(argv[argIndex], "-r") == 0) {
+            options_p->sampleRate = (uint32_t)parse_number_option("-r", value_p, false);
+        } else if (strcmp(argv[argIndex], "-d") == 0) {
+            char *endptr;
+            options_p->seconds = strtod(value_p, &endptr);
+            if (*endptr != '\0' || !(options_p->seconds > 0.0)) {
+                fprintf(stderr, "ERROR: Invalid value '%s' for option -d\n", value_p);
+                exit(1);
+            }
+        } else if (strcmp(argv[argIndex], "-s") == 0) {
+            options_p->chunkSizeMB = (uint32_t)parse_number_option("-s", value_p, false);
+            if (options_p->chunkSizeMB > MAX_CHUNK_SIZE_MB) {
+                fprintf(stderr, "ERROR: Chunks are limited to %d MB\n", MAX_CHUNK_SIZE_MB);
+                exit(1);
+            }
+        } else if (strcmp(argv[argIndex], "-e") == 0) {
+            options_p->extraChunks = (unsigned int)parse_number_option("-e", value_p, true);
+        } else if (strcmp(argv[argIndex], "-S") == 0) {
+            options_p->seed = parse_number_option("-S", value_p, true);
+        } else {
+            fprintf(stderr, "ERROR: Unknown option %s\n", argv[argIndex]);
+            print_usage();
+            exit(1);
+        }
+        argIndex += 2;
+    }
+
+    if (argIndex + 1 != argc) {
+        fprintf(stderr, "ERROR: Session path not provided\n");
+        exit(1);
+    }
+    *sessionPath_p = argv[argIndex];
+}
+
+
+/**
+ * Next value of a xorshift64* generator
+ *
+ * @param state_p Generator state, never 0
+ * @return Pseudo random value
+ */
+static uint64_t _next_random(uint64_t *state_p) {
+    uint64_t x = *state_p;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state_p = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+static void _write_chunk_header(FILE *file_p, const char *id_p, uint32_t size) {
+    if (fwrite(id_p, 4, 1, file_p) != 1 || fwrite(&size, sizeof(size), 1, file_p) != 1) {
+        fprintf(stderr, "ERROR: Failed to write chunk header\n");
+        exit(1);
+    }
+}
+
+
+/**
+ * Size of the extra chunk with the given index including its header and pad byte
+ */
+static uint32_t _extra_chunk_bytes(unsigned int extraIndex) {
+    const uint32_t payload = 13 + 2 * (extraIndex % 16);
+    return 8 + payload + (payload & 1);
+}
+
+
+/**
+ * Write the extra chunks with the given parity of their index
+ *
+ * Even ones go before the fmt chunk, odd ones between the fmt and the data chunk. Every
+ * payload has an odd size and is followed by a pad byte, as RIFF requires.
+ */
+static void _write_extra_chunks(FILE *file_p, const GeneratorOptions *options_p, unsigned int parity) {
+    for (unsigned int extraIndex = parity; extraIndex < options_p->extraChunks; extraIndex += 2) {
+        const uint32_t payload = 13 + 2 * (extraIndex % 16);
+        char id[5];
+        snprintf(id, sizeof(id), "x%03u", extraIndex % 1000);
+        _write_chunk_header(file_p, id, payload);
+        for (uint32_t i = 0; i < payload + 1; i++) {
+            if (fputc(i < payload ? 'a' + (int)(i % 26) : 0, file_p) == EOF) {
+                fprintf(stderr, "ERROR: Failed to write extra chunk\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+
+/**
+ * Size of a chunk header up to the first audio byte
+ */
+static uint32_t _header_bytes(const GeneratorOptions *options_p) {
+    uint32_t headerBytes = 12 + 8 + (options_p->extraChunks > 0 ? 18 : 16) + 8;
+    for (unsigned int extraIndex = 0; extraIndex < options_p->extraChunks; extraIndex++) {
+        headerBytes += _extra_chunk_bytes(extraIndex);
+    }
+    return headerBytes;
+}
+
+
+/**
+ * Write the header of a chunk with the given number of audio bytes
+ */
+static void _write_wav_header(FILE *file_p, const GeneratorOptions *options_p, uint32_t dataBytes) {
+    const uint16_t blockAlign = options_p->channels * (options_p->bitsPerSample / 8);
+    const uint32_t fmtSize = options_p->extraChunks > 0 ? 18 : 16;
+    const uint32_t headerBytes = _header_bytes(options_p);
+
+    const uint16_t audioFormat = 1;
+    const uint32_t byteRate = options_p->sampleRate * blockAlign;
+    const uint16_t extensionSize = 0;
+    _write_chunk_header(file_p, "RIFF", headerBytes - 8 + dataBytes);
+    if (fwrite("WAVE", 4, 1, file_p) != 1) {
+        fprintf(stderr, "ERROR: Failed to write WAVE header\n");
+        exit(1);
+    }
+    _write_extra_chunks(file_p, options_p, 0);
+    _write_chunk_header(file_p, "fmt ", fmtSize);
+    if (fwrite(&audioFormat, sizeof(audioFormat), 1, file_p) != 1 ||
+        fwrite(&options_p->channels, sizeof(options_p->channels), 1, file_p) != 1 ||
+        fwrite(&options_p->sampleRate, sizeof(options_p->sampleRate), 1, file_p) != 1 ||
+        fwrite(&byteRate, sizeof(byteRate), 1, file_p) != 1 ||
+        fwrite(&blockAlign, sizeof(blockAlign), 1, file_p) != 1 ||
+        fwrite(&options_p->bitsPerSample, sizeof(options_p->bitsPerSample), 1, file_p) != 1 ||
+        (fmtSize > 16 && fwrite(&extensionSize, sizeof(extensionSize), 1, file_p) != 1)) {
+        fprintf(stderr, "ERROR: Failed to write 'fmt ' chunk\n");
+        exit(1);
+    }
+    _write_extra_chunks(file_p, options_p, 1);
+    _write_chunk_header(file_p, "data", dataBytes);
+}
+
+
+int main(const int argc, char *argv[]) {
+    const char *sessionPath_p = NULL;
+    GeneratorOptions options;
+    parse_arguments(argc, argv, &sessionPath_p, &options);
+
+    const size_t bytesPerSample = options.bitsPerSample / 8;
+    const size_t blockAlign = options.channels * bytesPerSample;
+    const uint64_t totalFrames = (uint64_t)(options.seconds * options.sampleRate + 0.5);
+
+    // whole frames only, leaving room for the header
+    const uint32_t headerBytes = _header_bytes(&options);
+    const uint64_t chunkBytes = (uint64_t)options.chunkSizeMB * 1024 * 1024;
+    if (chunkBytes <= headerBytes + blockAlign) {
+        fprintf(stderr, "ERROR: Chunk size too small for a single frame\n");
+        return 1;
+    }
+    const uint64_t framesPerChunk = (chunkBytes - headerBytes) / blockAlign;
+
+    if (mkdir(sessionPath_p, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: Failed to create session directory %s\n", sessionPath_p);
+        return 1;
+    }
+
+    size_t framesPerBlock = WRITE_BLOCK_SIZE_BYTES / blockAlign;
+    if (framesPerBlock == 0) {
+        framesPerBlock = 1;
+    }
+    uint8_t *block_p = malloc(framesPerBlock * blockAlign);
+    if (!block_p) {
+        fprintf(stderr, "ERROR: Failed to allocate write buffer\n");
+        return 1;
+    }
+
+    // the sample stream runs across chunk boundaries, like a real recording
+    uint64_t randomState = (options.seed * 0x9E3779B97F4A7C15ULL) | 1;
+    uint64_t chunkIndex = 0;
+    uint64_t framesLeft = totalFrames;
+    while (framesLeft > 0) {
+        chunkIndex++;
+        const uint64_t chunkFrames = framesLeft < framesPerChunk ? framesLeft : framesPerChunk;
+        framesLeft -= chunkFrames;
+
+        char chunkPath[MAX_PATH_LENGTH];
+        snprintf(chunkPath, sizeof(chunkPath), "%s%c%08" PRIX64 ".WAV", sessionPath_p, PATH_SEPARATOR, chunkIndex);
+        FILE *chunk_p = fopen(chunkPath, "wb");
+        if (!chunk_p) {
+            fprintf(stderr, "ERROR: Failed to create %s\n", chunkPath);
+            return 1;
+        }
+        _write_wav_header(chunk_p, &options, (uint32_t)(chunkFrames * blockAlign));
+
+        for (uint64_t frame = 0; frame < chunkFrames;) {
+            const size_t blockFrames = chunkFrames - frame < framesPerBlock ? (size_t)(chunkFrames - frame)
+                                                                            : framesPerBlock;
+            const size_t blockBytes = blockFrames * blockAlign;
+            // whole 8 byte words of noise, the tail of the block takes part of one more word
+            size_t byteIndex = 0;
+            for (; byteIndex + 8 <= blockBytes; byteIndex += 8) {
+                const uint64_t value = _next_random(&randomState);
+                memcpy(block_p + byteIndex, &value, 8);
+            }
+            if (byteIndex < blockBytes) {
+                const uint64_t value = _next_random(&randomState);
+                memcpy(block_p + byteIndex, &value, blockBytes - byteIndex);
+            }
+            if (fwrite(block_p, 1, blockBytes, chunk_p) != blockBytes) {
+                fprintf(stderr, "ERROR: Failed to write %s\n", chunkPath);
+                return 1;
+            }
+            frame += blockFrames;
+        }
+
+        if (fclose(chunk_p) != 0) {
+            fprintf(stderr, "ERROR: Failed to write %s\n", chunkPath);
+            return 1;
+        }
+        printf("Wrote %s (%" PRIu64 " frames)\n", chunkPath, chunkFrames);
+    }
+
+    printf("Generated %" PRIu64 " frames of %u channels at %u Hz / %u bit in %" PRIu64 " chunks\n",
+           totalFrames, options.channels, options.sampleRate, options.bitsPerSample, chunkIndex);
+    free(block_p);
+    return 0;
+}